@@ -20,6 +20,7 @@
 #include <hybris/common/binding.h>
 
 #include "hooks_shm.h"
+#include "hooks_log.h"
 
 #define _GNU_SOURCE
 #include <stdio.h>
@@ -44,6 +45,7 @@
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include <linux/futex.h>
 #include <sys/syscall.h>
@@ -982,40 +984,270 @@ static int my_set_errno(int oi_errno)
  */
 static int __my_isthreaded = 1;
 
+/*
+ * Bionic-layout FILE shims.
+ *
+ * Android code is compiled against bionic's stdio.h, whose macros
+ * (getc_unlocked, putc_unlocked, __sgetc, __sputc, fileno_unlocked, ...)
+ * access the BSD "struct __sFILE" fields directly. Handing out glibc FILE
+ * pointers would make those macros poke at unrelated glibc fields, so every
+ * FILE given to Android code is a struct bionic_file instead.
+ *
+ * The shim does not have a buffer of its own: its _p/_r/_w window aliases
+ * the glibc buffer of the backing FILE, so bionic's inline fast paths read
+ * and write glibc's buffer directly. When the window is exhausted bionic
+ * calls __srget/__swbuf, which we hook to let glibc refill or flush and
+ * then reload the window. Any other hooked stdio call first writes the
+ * window position back to glibc (see _get_actual_fp()) and invalidates it.
+ */
+
+/* "struct __sFILE" from bionic/libc/include/stdio.h */
+struct bionic_sbuf {
+    unsigned char *_base;
+    int _size;
+};
+
+struct bionic_file {
+    unsigned char *_p;
+    int _r;
+    int _w;
+    short _flags;
+    short _file;
+    struct bionic_sbuf _bf;
+    int _lbfsize;
+    void *_cookie;
+    void *_close;
+    void *_read;
+    void *_seek;
+    void *_write;
+    struct bionic_sbuf _ext;
+    unsigned char *_up;
+    int _ur;
+    unsigned char _ubuf[3];
+    unsigned char _nbuf[1];
+    struct bionic_sbuf _lb;
+    int _blksize;
+    long _offset;
+};
+
+#define BIONIC_SRD  0x0004
+#define BIONIC_SWR  0x0008
+#define BIONIC_SEOF 0x0020
+#define BIONIC_SERR 0x0040
+
+/*
+ * A shim for a FILE opened by Android code. _cookie points back at the
+ * shim itself, which is what tells it apart from a glibc FILE (at that
+ * offset glibc has _IO_buf_base, which never points at the FILE).
+ */
+struct bionic_file_shim {
+    struct bionic_file bf;
+    FILE *fp;
+};
+
 /*
  * redirection for bionic's __sF, which is defined as:
  *   FILE __sF[3];
  *   #define stdin  &__sF[0];
  *   #define stdout &__sF[1];
  *   #define stderr &__sF[2];
- *   So the goal here is to catch the call to file methods where the FILE* pointer
- *   is either stdin, stdout or stderr, and translate that pointer to a valid glibc
- *   pointer.
- *   Currently, only fputs is managed.
+ *   These are plain bionic_file structs without a shim around them, they
+ *   are recognized by address and map to glibc's stdin, stdout and stderr.
  */
-#define BIONIC_SIZEOF_FILE 84
-static char my_sF[3*BIONIC_SIZEOF_FILE] = {0};
-static FILE *_get_actual_fp(FILE *fp)
+static struct bionic_file my_sF[3] = {
+    { ._file = 0 },
+    { ._file = 1 },
+    { ._file = 2 },
+};
+
+static int _is_sF(struct bionic_file *bf)
+{
+    return bf >= &my_sF[0] && bf <= &my_sF[2];
+}
+
+static int _is_bionic_file(FILE *fp)
+{
+    struct bionic_file *bf = (struct bionic_file *) fp;
+
+    if (fp == NULL)
+        return 0;
+
+    return _is_sF(bf) || bf->_cookie == (void *) bf;
+}
+
+static FILE *_bionic_file_fp(struct bionic_file *bf)
 {
-    char *c_fp = (char*)fp;
-    if (c_fp == &my_sF[0])
+    if (bf == &my_sF[0])
         return stdin;
-    else if (c_fp == &my_sF[BIONIC_SIZEOF_FILE])
+    else if (bf == &my_sF[1])
         return stdout;
-    else if (c_fp == &my_sF[BIONIC_SIZEOF_FILE*2])
+    else if (bf == &my_sF[2])
         return stderr;
 
-    return fp;
+    return ((struct bionic_file_shim *) bf)->fp;
+}
+
+/* Hand the position of the bionic window back to glibc and invalidate it */
+static void _bionic_file_sync(struct bionic_file *bf, FILE *fp)
+{
+    if (bf->_flags & BIONIC_SRD)
+        fp->_IO_read_ptr = (char *) bf->_p;
+    else if (bf->_flags & BIONIC_SWR)
+        fp->_IO_write_ptr = (char *) bf->_p;
+
+    bf->_flags &= ~(BIONIC_SRD | BIONIC_SWR);
+    bf->_r = 0;
+    bf->_w = 0;
+}
+
+/* Expose whatever glibc currently has buffered through the bionic window */
+static void _bionic_file_load(struct bionic_file *bf, FILE *fp)
+{
+    bf->_flags &= ~(BIONIC_SEOF | BIONIC_SERR);
+    if (feof_unlocked(fp))
+        bf->_flags |= BIONIC_SEOF;
+    if (ferror_unlocked(fp))
+        bf->_flags |= BIONIC_SERR;
+
+    /* Line buffered and unbuffered streams keep _IO_write_end at
+     * _IO_write_ptr, so every bionic putc ends up in __swbuf and
+     * newlines get flushed as expected */
+    if (__fwriting(fp)) {
+        if (fp->_IO_write_end > fp->_IO_write_ptr) {
+            bf->_p = (unsigned char *) fp->_IO_write_ptr;
+            bf->_w = fp->_IO_write_end - fp->_IO_write_ptr;
+            bf->_flags |= BIONIC_SWR;
+        }
+    } else if (fp->_IO_read_end > fp->_IO_read_ptr) {
+        bf->_p = (unsigned char *) fp->_IO_read_ptr;
+        bf->_r = fp->_IO_read_end - fp->_IO_read_ptr;
+        bf->_flags |= BIONIC_SRD;
+    }
+}
+
+static FILE *_get_actual_fp(FILE *fp)
+{
+    struct bionic_file *bf = (struct bionic_file *) fp;
+    FILE *real;
+
+    if (!_is_bionic_file(fp))
+        return fp;
+
+    /* glibc's buffer pointers belong to whoever holds the stream lock */
+    real = _bionic_file_fp(bf);
+    flockfile(real);
+    _bionic_file_sync(bf, real);
+    funlockfile(real);
+
+    return real;
+}
+
+static FILE *_bionic_file_wrap(FILE *fp)
+{
+    struct bionic_file_shim *shim;
+
+    if (fp == NULL)
+        return NULL;
+
+    shim = calloc(1, sizeof(struct bionic_file_shim));
+    if (!shim) {
+        fclose(fp);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    shim->fp = fp;
+    shim->bf._cookie = shim;
+    shim->bf._file = fileno(fp);
+
+    return (FILE *) shim;
+}
+
+static void _bionic_file_free(FILE *fp)
+{
+    struct bionic_file *bf = (struct bionic_file *) fp;
+
+    if (_is_bionic_file(fp) && !_is_sF(bf)) {
+        bf->_cookie = NULL;
+        free(bf);
+    }
+}
+
+/* Called by bionic's __sgetc() once the read window is exhausted */
+static int my___srget(FILE *fp)
+{
+    struct bionic_file *bf = (struct bionic_file *) fp;
+    FILE *real;
+    int c;
+
+    if (!_is_bionic_file(fp))
+        return getc(fp);
+
+    real = _bionic_file_fp(bf);
+    flockfile(real);
+    _bionic_file_sync(bf, real);
+    c = getc_unlocked(real);
+    _bionic_file_load(bf, real);
+    funlockfile(real);
+
+    return c;
+}
+
+/* Called by bionic's __sputc() once the write window is exhausted */
+static int my___swbuf(int c, FILE *fp)
+{
+    struct bionic_file *bf = (struct bionic_file *) fp;
+    FILE *real;
+    int ret;
+
+    if (!_is_bionic_file(fp))
+        return putc(c, fp);
+
+    real = _bionic_file_fp(bf);
+    flockfile(real);
+    _bionic_file_sync(bf, real);
+    ret = putc_unlocked(c, real);
+    _bionic_file_load(bf, real);
+    funlockfile(real);
+
+    return ret;
+}
+
+static FILE *my_fopen(const char *filename, const char *mode)
+{
+    return _bionic_file_wrap(fopen(filename, mode));
+}
+
+static FILE *my_fdopen(int fd, const char *mode)
+{
+    return _bionic_file_wrap(fdopen(fd, mode));
+}
+
+static FILE *my_popen(const char *command, const char *type)
+{
+    return _bionic_file_wrap(popen(command, type));
+}
+
+static FILE *my_tmpfile(void)
+{
+    return _bionic_file_wrap(tmpfile());
 }
 
 static void my_clearerr(FILE *fp)
 {
+    if (_is_bionic_file(fp))
+        ((struct bionic_file *) fp)->_flags &= ~(BIONIC_SEOF | BIONIC_SERR);
+
     clearerr(_get_actual_fp(fp));
 }
 
 static int my_fclose(FILE *fp)
 {
-    return fclose(_get_actual_fp(fp));
+    int ret = fclose(_get_actual_fp(fp));
+
+    _bionic_file_free(fp);
+
+    return ret;
 }
 
 static int my_feof(FILE *fp)
@@ -1077,7 +1309,25 @@ static size_t my_fread(void *ptr, size_t size, size_t nmemb, FILE *fp)
 
 static FILE* my_freopen(const char *filename, const char *mode, FILE *fp)
 {
-    return freopen(filename, mode, _get_actual_fp(fp));
+    struct bionic_file *bf = (struct bionic_file *) fp;
+    FILE *real;
+
+    if (!_is_bionic_file(fp))
+        return freopen(filename, mode, fp);
+
+    real = freopen(filename, mode, _get_actual_fp(fp));
+    if (real == NULL) {
+        /* the original stream is closed even if freopen fails */
+        _bionic_file_free(fp);
+        return NULL;
+    }
+
+    if (!_is_sF(bf))
+        ((struct bionic_file_shim *) bf)->fp = real;
+    bf->_file = fileno(real);
+    bf->_flags &= ~(BIONIC_SEOF | BIONIC_SERR);
+
+    return fp;
 }
 
 FP_ATTRIB static int my_fscanf(FILE *fp, const char *fmt, ...)
@@ -1182,7 +1432,11 @@ static int my_fileno(FILE *fp)
 
 static int my_pclose(FILE *fp)
 {
-    return pclose(_get_actual_fp(fp));
+    int ret = pclose(_get_actual_fp(fp));
+
+    _bionic_file_free(fp);
+
+    return ret;
 }
 
 static void my_flockfile(FILE *fp)
@@ -1203,12 +1457,24 @@ static void my_funlockfile(FILE *fp)
 
 static int my_getc_unlocked(FILE *fp)
 {
-    return getc_unlocked(_get_actual_fp(fp));
+    struct bionic_file *bf = (struct bionic_file *) fp;
+
+    /* Same as bionic's __sgetc(), the caller holds the lock */
+    if (_is_bionic_file(fp) && --bf->_r >= 0)
+        return *bf->_p++;
+
+    return my___srget(fp);
 }
 
 static int my_putc_unlocked(int c, FILE *fp)
 {
-    return putc_unlocked(c, _get_actual_fp(fp));
+    struct bionic_file *bf = (struct bionic_file *) fp;
+
+    /* Same as bionic's __sputc(), the caller holds the lock */
+    if (_is_bionic_file(fp) && --bf->_w >= 0)
+        return (*bf->_p++ = c);
+
+    return my___swbuf(c, fp);
 }
 
 /* exists only on the BSD platform
@@ -1255,70 +1521,198 @@ struct bionic_dirent {
     char             d_name[256];
 };
 
-static struct bionic_dirent *my_readdir(DIR *dirp)
+/*
+ * The DIR handed out to Android code.
+ *
+ * The kernel's struct linux_dirent64 has the same layout as the header of
+ * bionic's struct dirent, so - exactly like bionic itself does - entries are
+ * read in bulk with getdents64 and returned as pointers into the per-stream
+ * buffer, without any copying or translation. This also keeps the data
+ * returned by readdir() private to its stream.
+ */
+#define BIONIC_DIR_BUFFER_SIZE 8192
+
+struct bionic_dir {
+    int fd;
+    size_t available;
+    size_t next;
+    long current_pos;
+    pthread_mutex_t mutex;
+    char buff[BIONIC_DIR_BUFFER_SIZE] __attribute__((aligned(8)));
+};
+
+static struct bionic_dir *_bionic_dir_create(int fd)
 {
-    /**
-     * readdir(3) manpage says:
-     *  The data returned by readdir() may be overwritten by subsequent calls
-     *  to readdir() for the same directory stream.
-     *
-     * XXX: At the moment, for us, the data will be overwritten even by
-     * subsequent calls to /different/ directory streams. Eventually fix that
-     * (e.g. by storing per-DIR * bionic_dirent structs, and removing them on
-     * closedir, requires hooking of all funcs returning/taking DIR *) and
-     * handling the additional data attachment there)
-     **/
+    struct bionic_dir *d = malloc(sizeof(struct bionic_dir));
+    if (!d)
+        return NULL;
 
-    static struct bionic_dirent result;
+    d->fd = fd;
+    d->available = 0;
+    d->next = 0;
+    d->current_pos = 0L;
+    pthread_mutex_init(&d->mutex, NULL);
 
-    struct dirent *real_result = readdir(dirp);
-    if (!real_result) {
+    return d;
+}
+
+/* Called with d->mutex held */
+static struct bionic_dirent *_bionic_dir_next(struct bionic_dir *d)
+{
+    struct bionic_dirent *entry;
+
+    if (d->next >= d->available) {
+        int saved_errno = errno;
+        long rc = syscall(SYS_getdents64, d->fd, d->buff, sizeof(d->buff));
+        if (rc <= 0) {
+            /* EOF is not an error, so leave errno alone */
+            if (rc == 0)
+                errno = saved_errno;
+            return NULL;
+        }
+        d->available = rc;
+        d->next = 0;
+    }
+
+    entry = (struct bionic_dirent *) &d->buff[d->next];
+    d->next += entry->d_reclen;
+    d->current_pos = entry->d_off;
+
+    return entry;
+}
+
+/* Called with d->mutex held */
+static void _bionic_dir_seek(struct bionic_dir *d, long offset)
+{
+    if (lseek(d->fd, offset, SEEK_SET) != -1) {
+        d->available = 0;
+        d->next = 0;
+        d->current_pos = offset;
+    }
+}
+
+static struct bionic_dir *my_fdopendir(int fd)
+{
+    struct stat sb;
+    struct bionic_dir *d;
+
+    if (fstat(fd, &sb) == -1)
+        return NULL;
+
+    if (!S_ISDIR(sb.st_mode)) {
+        errno = ENOTDIR;
         return NULL;
     }
 
-    result.d_ino = real_result->d_ino;
-    result.d_off = real_result->d_off;
-    result.d_reclen = real_result->d_reclen;
-    result.d_type = real_result->d_type;
-    memcpy(result.d_name, real_result->d_name, sizeof(result.d_name));
+    d = _bionic_dir_create(fd);
+    if (!d)
+        errno = ENOMEM;
 
-    // Make sure the string is zero-terminated, even if cut off (which
-    // shouldn't happen, as both bionic and glibc have d_name defined
-    // as fixed array of 256 chars)
-    result.d_name[sizeof(result.d_name)-1] = '\0';
-    return &result;
+    return d;
 }
 
-static int my_readdir_r(DIR *dir, struct bionic_dirent *entry,
-        struct bionic_dirent **result)
+static struct bionic_dir *my_opendir(const char *path)
 {
-    struct dirent entry_r;
-    struct dirent *result_r;
+    struct bionic_dir *d;
+    int fd = open(path, O_CLOEXEC | O_DIRECTORY | O_RDONLY);
+    if (fd == -1)
+        return NULL;
 
-    int res = readdir_r(dir, &entry_r, &result_r);
+    d = _bionic_dir_create(fd);
+    if (!d) {
+        close(fd);
+        errno = ENOMEM;
+    }
 
-    if (res == 0) {
-        if (result_r != NULL) {
-            *result = entry;
+    return d;
+}
 
-            entry->d_ino = entry_r.d_ino;
-            entry->d_off = entry_r.d_off;
-            entry->d_reclen = entry_r.d_reclen;
-            entry->d_type = entry_r.d_type;
-            memcpy(entry->d_name, entry_r.d_name, sizeof(entry->d_name));
+static int my_closedir(struct bionic_dir *d)
+{
+    int fd;
 
-            // Make sure the string is zero-terminated, even if cut off (which
-            // shouldn't happen, as both bionic and glibc have d_name defined
-            // as fixed array of 256 chars)
-            entry->d_name[sizeof(entry->d_name) - 1] = '\0';
-        } else {
-            *result = NULL;
-        }
+    if (d == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    fd = d->fd;
+    pthread_mutex_destroy(&d->mutex);
+    free(d);
+
+    return close(fd);
+}
+
+static int my_dirfd(struct bionic_dir *d)
+{
+    return d->fd;
+}
+
+static struct bionic_dirent *my_readdir(struct bionic_dir *d)
+{
+    struct bionic_dirent *entry;
+
+    pthread_mutex_lock(&d->mutex);
+    entry = _bionic_dir_next(d);
+    pthread_mutex_unlock(&d->mutex);
+
+    return entry;
+}
+
+static int my_readdir_r(struct bionic_dir *d, struct bionic_dirent *entry,
+        struct bionic_dirent **result)
+{
+    struct bionic_dirent *next;
+    int saved_errno = errno;
+    int res = 0;
+
+    *result = NULL;
+    errno = 0;
+
+    pthread_mutex_lock(&d->mutex);
+
+    next = _bionic_dir_next(d);
+    if (errno != 0) {
+        res = errno;
+    } else if (next != NULL) {
+        memcpy(entry, next, next->d_reclen < sizeof(*entry) ?
+                            next->d_reclen : sizeof(*entry));
+        // Make sure the string is zero-terminated, even if cut off
+        entry->d_name[sizeof(entry->d_name) - 1] = '\0';
+        *result = entry;
     }
 
+    pthread_mutex_unlock(&d->mutex);
+
+    errno = saved_errno;
     return res;
 }
 
+static void my_rewinddir(struct bionic_dir *d)
+{
+    pthread_mutex_lock(&d->mutex);
+    _bionic_dir_seek(d, 0L);
+    pthread_mutex_unlock(&d->mutex);
+}
+
+static void my_seekdir(struct bionic_dir *d, long offset)
+{
+    pthread_mutex_lock(&d->mutex);
+    _bionic_dir_seek(d, offset);
+    pthread_mutex_unlock(&d->mutex);
+}
+
+static long my_telldir(struct bionic_dir *d)
+{
+    long pos;
+
+    pthread_mutex_lock(&d->mutex);
+    pos = d->current_pos;
+    pthread_mutex_unlock(&d->mutex);
+
+    return pos;
+}
+
 static int my_alphasort(struct bionic_dirent **a,
                         struct bionic_dirent **b)
 {
@@ -1337,51 +1731,81 @@ static int my_scandirat(int fd, const char *dir,
                       int (*compar) (const struct bionic_dirent **,
                                      const struct bionic_dirent **))
 {
-    struct dirent **namelist_r;
-    struct bionic_dirent **result;
-    struct bionic_dirent *filter_r;
-
-    int i = 0;
+    struct bionic_dir *d;
+    struct bionic_dirent *entry;
+    struct bionic_dirent **result = NULL;
     size_t nItems = 0;
+    size_t capacity = 0;
+    int saved_errno = errno;
+    int error = ENOMEM;
 
-    int res = scandirat(fd, dir, &namelist_r, NULL, NULL);
-
-    if (res != 0 && namelist_r != NULL) {
+    int dfd = openat(fd, dir, O_CLOEXEC | O_DIRECTORY | O_RDONLY);
+    if (dfd == -1)
+        return -1;
 
-        result = malloc(res * sizeof(struct bionic_dirent));
-        if (!result)
-            return -1;
+    d = _bionic_dir_create(dfd);
+    if (!d) {
+        close(dfd);
+        errno = ENOMEM;
+        return -1;
+    }
 
-        for (i = 0; i < res; i++) {
-            filter_r = malloc(sizeof(struct bionic_dirent));
-            if (!filter_r) {
-                while (i-- > 0)
-                        free(result[i]);
-                    free(result);
-                    return -1;
+    /* Entries are filtered in place in the getdents buffer, so only the
+     * ones we actually return get copied out. errno is cleared before
+     * each read to tell the end of the directory from a failed read. */
+    for (;;) {
+        struct bionic_dirent *copy;
+        size_t size;
+
+        errno = 0;
+        entry = _bionic_dir_next(d);
+        if (entry == NULL) {
+            if (errno != 0) {
+                error = errno;
+                goto fail;
             }
-            filter_r->d_ino = namelist_r[i]->d_ino;
-            filter_r->d_off = namelist_r[i]->d_off;
-            filter_r->d_reclen = namelist_r[i]->d_reclen;
-            filter_r->d_type = namelist_r[i]->d_type;
-
-            strcpy(filter_r->d_name, namelist_r[i]->d_name);
-            filter_r->d_name[sizeof(namelist_r[i]->d_name) - 1] = '\0';
+            break;
+        }
 
-            if (filter != NULL && !(*filter)(filter_r)) {//apply filter
-                free(filter_r);
-                continue;
-            }
+        if (filter != NULL && !(*filter)(entry))
+            continue;
 
-            result[nItems++] = filter_r;
+        if (nItems == capacity) {
+            struct bionic_dirent **grown;
+            capacity = capacity ? capacity * 2 : 32;
+            grown = realloc(result, capacity * sizeof(struct bionic_dirent *));
+            if (!grown)
+                goto fail;
+            result = grown;
         }
-        if (nItems && compar != NULL) // sort
-            qsort(result, nItems, sizeof(struct bionic_dirent *), compar);
 
-        *namelist = result;
+        size = offsetof(struct bionic_dirent, d_name) + strlen(entry->d_name) + 1;
+        size = (size + 7) & ~7;
+        copy = malloc(size);
+        if (!copy)
+            goto fail;
+
+        memcpy(copy, entry, size < entry->d_reclen ? size : entry->d_reclen);
+        copy->d_reclen = size;
+        result[nItems++] = copy;
     }
 
-    return res;
+    my_closedir(d);
+
+    if (nItems && compar != NULL) // sort
+        qsort(result, nItems, sizeof(struct bionic_dirent *), compar);
+
+    *namelist = result;
+    errno = saved_errno;
+    return nItems;
+
+fail:
+    while (nItems-- > 0)
+        free(result[nItems]);
+    free(result);
+    my_closedir(d);
+    errno = error;
+    return -1;
 }
 
 static int my_scandir(const char *dir,
@@ -1531,7 +1955,6 @@ static struct _hook hooks[] = {
     {"memalign", memalign },
     {"valloc", valloc },
     {"pvalloc", pvalloc },
-    {"fread", fread },
     {"getxattr", getxattr},
     /* string.h */
     {"memccpy",memccpy},
@@ -1584,9 +2007,6 @@ static struct _hook hooks[] = {
     {"rindex",rindex},
     {"strcasecmp",strcasecmp},
     {"strncasecmp",strncasecmp},
-    /* dirent.h */
-    {"opendir", opendir},
-    {"closedir", closedir},
     /* pthread.h */
     {"getauxval", getauxval},
     {"gettid", my_gettid},
@@ -1667,9 +2087,12 @@ static struct _hook hooks[] = {
     /* stdio.h */
     {"__isthreaded", &__my_isthreaded},
     {"__sF", &my_sF},
-    {"fopen", fopen},
-    {"fdopen", fdopen},
-    {"popen", popen},
+    {"__srget", my___srget},
+    {"__swbuf", my___swbuf},
+    {"fopen", my_fopen},
+    {"fdopen", my_fdopen},
+    {"popen", my_popen},
+    {"tmpfile", my_tmpfile},
     {"puts", puts},
     {"sprintf", sprintf},
     {"asprintf", asprintf},
@@ -1738,15 +2161,15 @@ static struct _hook hooks[] = {
     {"dladdr", android_dladdr},
     {"dlclose", android_dlclose},
     /* dirent.h */
-    {"opendir", opendir},
-    {"fdopendir", fdopendir},
-    {"closedir", closedir},
+    {"opendir", my_opendir},
+    {"fdopendir", my_fdopendir},
+    {"closedir", my_closedir},
     {"readdir", my_readdir},
     {"readdir_r", my_readdir_r},
-    {"rewinddir", rewinddir},
-    {"seekdir", seekdir},
-    {"telldir", telldir},
-    {"dirfd", dirfd},
+    {"rewinddir", my_rewinddir},
+    {"seekdir", my_seekdir},
+    {"telldir", my_telldir},
+    {"dirfd", my_dirfd},
     {"scandir", my_scandir},
     {"scandirat", my_scandirat},
     {"alphasort", my_alphasort},
@@ -1772,6 +2195,13 @@ static struct _hook hooks[] = {
     {"gmtime", gmtime},
     {"abort", abort},
     {"writev", writev},
+    /* android/log.h */
+    {"__android_log_write", hybris_android_log_write},
+    {"__android_log_buf_write", hybris_android_log_buf_write},
+    {"__android_log_vprint", hybris_android_log_vprint},
+    {"__android_log_print", hybris_android_log_print},
+    {"__android_log_buf_print", hybris_android_log_buf_print},
+    {"__android_log_assert", hybris_android_log_assert},
     /* unistd.h */
     {"access", access},
     /* grp.h */
@@ -0,0 +1,544 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "hooks_log.h"
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/* Debug */
+#include "logging.h"
+#define LOGD(message, ...) HYBRIS_DEBUG_LOG(HOOKS, message, ##__VA_ARGS__)
+
+/* android_LogPriority from system/core/include/android/log.h */
+#define ANDROID_LOG_VERBOSE 2
+#define ANDROID_LOG_DEBUG   3
+#define ANDROID_LOG_INFO    4
+#define ANDROID_LOG_WARN    5
+#define ANDROID_LOG_ERROR   6
+#define ANDROID_LOG_FATAL   7
+#define ANDROID_LOG_SILENT  8
+
+/* log_id_t from system/core/include/log/log.h */
+#define ANDROID_LOG_ID_MAIN   0
+#define ANDROID_LOG_ID_RADIO  1
+#define ANDROID_LOG_ID_EVENTS 2
+#define ANDROID_LOG_ID_SYSTEM 3
+
+/* Number of ring slots, must be a power of two */
+#define HYBRIS_LOG_RING_SIZE  256
+#define HYBRIS_LOG_TAG_MAX    32
+#define HYBRIS_LOG_MSG_MAX    512
+
+/* How long the drain thread sleeps at most before looking at the ring again */
+#define HYBRIS_LOG_DRAIN_TIMEOUT_MS 250
+
+enum hybris_android_log_target {
+    HYBRIS_ANDROID_LOG_TARGET_NONE,
+    HYBRIS_ANDROID_LOG_TARGET_SYSLOG,
+    HYBRIS_ANDROID_LOG_TARGET_FILE,
+};
+
+struct hybris_log_slot {
+    /* Sequence number as in Dmitry Vyukov's bounded queue: equals the ring
+     * position when free, position + 1 once a producer published into it */
+    volatile unsigned int seq;
+    int prio;
+    int buf_id;
+    pid_t tid;
+    struct timespec ts;
+    char tag[HYBRIS_LOG_TAG_MAX];
+    char msg[HYBRIS_LOG_MSG_MAX];
+};
+
+static struct hybris_log_slot *_log_ring = NULL;
+static volatile unsigned int _log_ring_tail = 0;
+static unsigned int _log_ring_head = 0;
+static volatile unsigned int _log_dropped = 0;
+
+/* Set by the drain thread before it goes to sleep on the futex */
+static volatile int _log_drainer_sleeping = 0;
+
+static int _log_min_prio = ANDROID_LOG_WARN;
+static enum hybris_android_log_target _log_target = HYBRIS_ANDROID_LOG_TARGET_SYSLOG;
+static FILE *_log_file = NULL;
+
+static pthread_once_t _log_once = PTHREAD_ONCE_INIT;
+static pthread_t _log_thread;
+static int _log_thread_running = 0;
+static pthread_mutex_t _log_output_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *_log_buf_name(int buf_id)
+{
+    switch (buf_id) {
+    case ANDROID_LOG_ID_RADIO:
+        return "radio";
+    case ANDROID_LOG_ID_EVENTS:
+        return "events";
+    case ANDROID_LOG_ID_SYSTEM:
+        return "system";
+    default:
+        return "main";
+    }
+}
+
+static char _log_prio_char(int prio)
+{
+    static const char chars[] = "??VDIWEF";
+
+    if (prio < 0 || prio >= ANDROID_LOG_SILENT)
+        return '?';
+
+    return chars[prio];
+}
+
+static int _log_prio_to_syslog(int prio)
+{
+    switch (prio) {
+    case ANDROID_LOG_VERBOSE:
+    case ANDROID_LOG_DEBUG:
+        return LOG_DEBUG;
+    case ANDROID_LOG_INFO:
+        return LOG_INFO;
+    case ANDROID_LOG_WARN:
+        return LOG_WARNING;
+    case ANDROID_LOG_ERROR:
+        return LOG_ERR;
+    default:
+        return LOG_CRIT;
+    }
+}
+
+/* Called with _log_output_mutex held */
+static void _log_emit(const struct hybris_log_slot *slot)
+{
+    switch (_log_target) {
+    case HYBRIS_ANDROID_LOG_TARGET_SYSLOG:
+        if (slot->buf_id == ANDROID_LOG_ID_MAIN)
+            syslog(_log_prio_to_syslog(slot->prio), "%s: %s", slot->tag, slot->msg);
+        else
+            syslog(_log_prio_to_syslog(slot->prio), "[%s] %s: %s",
+                   _log_buf_name(slot->buf_id), slot->tag, slot->msg);
+        break;
+    case HYBRIS_ANDROID_LOG_TARGET_FILE:
+        fprintf(_log_file, "%ld.%06ld %5d %5d %c/%s(%s): %s\n",
+                (long) slot->ts.tv_sec, slot->ts.tv_nsec / 1000,
+                getpid(), slot->tid, _log_prio_char(slot->prio),
+                slot->tag, _log_buf_name(slot->buf_id), slot->msg);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Write out everything that has been published so far and return how many
+ * lines that were. Called with _log_output_mutex held, which keeps it to
+ * one consumer at a time (the drain thread, a producer writing a fatal
+ * message or logging without a drain thread, or exit).
+ */
+static int _log_drain_locked(void)
+{
+    unsigned int dropped;
+    int drained = 0;
+
+    for (;;) {
+        struct hybris_log_slot *slot = &_log_ring[_log_ring_head & (HYBRIS_LOG_RING_SIZE - 1)];
+
+        if (slot->seq != _log_ring_head + 1)
+            break;
+
+        __sync_synchronize();
+        _log_emit(slot);
+        drained++;
+
+        /* Hand the slot back to the producers for the next lap */
+        __sync_synchronize();
+        slot->seq = _log_ring_head + HYBRIS_LOG_RING_SIZE;
+        _log_ring_head++;
+    }
+
+    dropped = __sync_fetch_and_and(&_log_dropped, 0);
+    if (dropped > 0) {
+        struct hybris_log_slot note;
+
+        memset(&note, 0, sizeof(note));
+        note.prio = ANDROID_LOG_WARN;
+        note.tid = syscall(__NR_gettid);
+        clock_gettime(CLOCK_REALTIME, &note.ts);
+        strcpy(note.tag, "libhybris");
+        snprintf(note.msg, sizeof(note.msg),
+                 "log ring full, dropped %u messages", dropped);
+        _log_emit(&note);
+        drained++;
+    }
+
+    return drained;
+}
+
+static void _log_drain(void)
+{
+    pthread_mutex_lock(&_log_output_mutex);
+
+    if (_log_drain_locked() > 0 && _log_target == HYBRIS_ANDROID_LOG_TARGET_FILE)
+        fflush(_log_file);
+
+    pthread_mutex_unlock(&_log_output_mutex);
+}
+
+/*
+ * Fatal messages bypass the ring: they must not be dropped when it is full,
+ * and the process is usually about to abort. Whatever was published before
+ * goes out first so the order is kept.
+ */
+static void _log_write_sync(const struct hybris_log_slot *slot)
+{
+    pthread_mutex_lock(&_log_output_mutex);
+
+    _log_drain_locked();
+    _log_emit(slot);
+    if (_log_target == HYBRIS_ANDROID_LOG_TARGET_FILE)
+        fflush(_log_file);
+
+    pthread_mutex_unlock(&_log_output_mutex);
+}
+
+static void _log_wake_drainer(void)
+{
+    /* Only pay for the futex syscall if the drain thread is actually asleep */
+    if (__sync_bool_compare_and_swap(&_log_drainer_sleeping, 1, 0))
+        syscall(SYS_futex, &_log_drainer_sleeping, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static void *_log_drain_thread(void *arg)
+{
+    struct timespec timeout;
+
+    timeout.tv_sec = HYBRIS_LOG_DRAIN_TIMEOUT_MS / 1000;
+    timeout.tv_nsec = (HYBRIS_LOG_DRAIN_TIMEOUT_MS % 1000) * 1000000;
+
+    for (;;) {
+        _log_drain();
+
+        __sync_lock_test_and_set(&_log_drainer_sleeping, 1);
+
+        /* A producer may have published after the drain above but before it
+         * could see us sleeping, so look once more before blocking */
+        if (_log_ring[_log_ring_head & (HYBRIS_LOG_RING_SIZE - 1)].seq == _log_ring_head + 1) {
+            _log_drainer_sleeping = 0;
+            continue;
+        }
+
+        syscall(SYS_futex, &_log_drainer_sleeping, FUTEX_WAIT_PRIVATE, 1, &timeout, NULL, 0);
+        _log_drainer_sleeping = 0;
+    }
+
+    return NULL;
+}
+
+static void _log_atexit(void)
+{
+    _log_drain();
+}
+
+static void _log_start_thread(void)
+{
+    if (pthread_create(&_log_thread, NULL, _log_drain_thread, NULL) == 0) {
+        _log_thread_running = 1;
+        pthread_setname_np(_log_thread, "hybris-log");
+    } else {
+        _log_thread_running = 0;
+        LOGD("Could not start log drain thread, logging synchronously");
+    }
+}
+
+/* Keep the output stream consistent across fork() */
+static void _log_atfork_prepare(void)
+{
+    pthread_mutex_lock(&_log_output_mutex);
+}
+
+static void _log_atfork_parent(void)
+{
+    pthread_mutex_unlock(&_log_output_mutex);
+}
+
+/*
+ * Only the forking thread survives in the child: the drain thread is gone,
+ * and slots claimed by other threads would never be published. Messages
+ * still queued belong to the parent, which writes them out itself, so the
+ * child starts over with an empty ring and a drain thread of its own.
+ */
+static void _log_atfork_child(void)
+{
+    unsigned int i;
+
+    pthread_mutex_init(&_log_output_mutex, NULL);
+
+    for (i = 0; i < HYBRIS_LOG_RING_SIZE; i++)
+        _log_ring[i].seq = i;
+    _log_ring_head = 0;
+    _log_ring_tail = 0;
+    _log_dropped = 0;
+    _log_drainer_sleeping = 0;
+
+    _log_start_thread();
+}
+
+static void _log_initialize(void)
+{
+    const char *env = getenv("HYBRIS_ANDROID_LOG_LEVEL");
+    unsigned int i;
+
+    if (env == NULL) {
+        /* Nothing to do - use default level */
+    } else if (strcmp(env, "verbose") == 0) {
+        _log_min_prio = ANDROID_LOG_VERBOSE;
+    } else if (strcmp(env, "debug") == 0) {
+        _log_min_prio = ANDROID_LOG_DEBUG;
+    } else if (strcmp(env, "info") == 0) {
+        _log_min_prio = ANDROID_LOG_INFO;
+    } else if (strcmp(env, "warn") == 0) {
+        _log_min_prio = ANDROID_LOG_WARN;
+    } else if (strcmp(env, "error") == 0) {
+        _log_min_prio = ANDROID_LOG_ERROR;
+    } else if (strcmp(env, "fatal") == 0) {
+        _log_min_prio = ANDROID_LOG_FATAL;
+    } else if (strcmp(env, "silent") == 0) {
+        _log_min_prio = ANDROID_LOG_SILENT;
+    }
+
+    env = getenv("HYBRIS_ANDROID_LOG_TARGET");
+    if (env == NULL || strcmp(env, "syslog") == 0 || strcmp(env, "journal") == 0) {
+        /* journald picks up everything sent to syslog */
+        _log_target = HYBRIS_ANDROID_LOG_TARGET_SYSLOG;
+    } else if (strcmp(env, "none") == 0) {
+        _log_target = HYBRIS_ANDROID_LOG_TARGET_NONE;
+    } else if (strcmp(env, "stderr") == 0) {
+        _log_target = HYBRIS_ANDROID_LOG_TARGET_FILE;
+        _log_file = stderr;
+    } else {
+        _log_target = HYBRIS_ANDROID_LOG_TARGET_FILE;
+        _log_file = fopen(env, "a");
+        if (_log_file == NULL)
+            _log_file = stderr;
+    }
+
+    if (_log_target == HYBRIS_ANDROID_LOG_TARGET_NONE)
+        _log_min_prio = ANDROID_LOG_SILENT;
+
+    if (_log_min_prio >= ANDROID_LOG_SILENT)
+        return;
+
+    _log_ring = malloc(HYBRIS_LOG_RING_SIZE * sizeof(struct hybris_log_slot));
+    if (_log_ring == NULL) {
+        _log_min_prio = ANDROID_LOG_SILENT;
+        return;
+    }
+
+    for (i = 0; i < HYBRIS_LOG_RING_SIZE; i++)
+        _log_ring[i].seq = i;
+
+    _log_start_thread();
+
+    pthread_atfork(_log_atfork_prepare, _log_atfork_parent, _log_atfork_child);
+    atexit(_log_atexit);
+}
+
+/*
+ * Claim a free ring slot. Returns NULL if the ring is full, in which case
+ * the message is counted as dropped rather than blocking the caller.
+ */
+static struct hybris_log_slot *_log_claim(unsigned int *pos)
+{
+    unsigned int tail = _log_ring_tail;
+
+    for (;;) {
+        struct hybris_log_slot *slot = &_log_ring[tail & (HYBRIS_LOG_RING_SIZE - 1)];
+        int diff = (int) (slot->seq - tail);
+
+        if (diff == 0) {
+            if (__sync_bool_compare_and_swap(&_log_ring_tail, tail, tail + 1)) {
+                *pos = tail;
+                return slot;
+            }
+        } else if (diff < 0) {
+            __sync_fetch_and_add(&_log_dropped, 1);
+            return NULL;
+        }
+
+        tail = _log_ring_tail;
+    }
+}
+
+static void _log_publish(struct hybris_log_slot *slot, unsigned int pos)
+{
+    __sync_synchronize();
+    slot->seq = pos + 1;
+
+    if (!_log_thread_running)
+        _log_drain();
+    else
+        _log_wake_drainer();
+}
+
+static int _log_enabled(int prio)
+{
+    pthread_once(&_log_once, _log_initialize);
+
+    return prio >= _log_min_prio;
+}
+
+static void _log_fill(struct hybris_log_slot *slot, int buf_id, int prio, const char *tag)
+{
+    slot->prio = prio;
+    slot->buf_id = buf_id;
+    slot->tid = syscall(__NR_gettid);
+    clock_gettime(CLOCK_REALTIME, &slot->ts);
+    strncpy(slot->tag, tag ? tag : "", sizeof(slot->tag) - 1);
+    slot->tag[sizeof(slot->tag) - 1] = '\0';
+}
+
+static struct hybris_log_slot *_log_begin(int buf_id, int prio, const char *tag,
+                                          unsigned int *pos)
+{
+    struct hybris_log_slot *slot = _log_claim(pos);
+
+    if (slot != NULL)
+        _log_fill(slot, buf_id, prio, tag);
+
+    return slot;
+}
+
+static int _log_vwrite(int buf_id, int prio, const char *tag, const char *fmt, va_list ap)
+{
+    struct hybris_log_slot *slot;
+    unsigned int pos;
+
+    if (!_log_enabled(prio))
+        return 0;
+
+    if (prio >= ANDROID_LOG_FATAL) {
+        struct hybris_log_slot fatal;
+
+        _log_fill(&fatal, buf_id, prio, tag);
+        vsnprintf(fatal.msg, sizeof(fatal.msg), fmt, ap);
+        _log_write_sync(&fatal);
+        return 1;
+    }
+
+    slot = _log_begin(buf_id, prio, tag, &pos);
+    if (slot == NULL)
+        return -1;
+
+    vsnprintf(slot->msg, sizeof(slot->msg), fmt, ap);
+    _log_publish(slot, pos);
+
+    return 1;
+}
+
+int hybris_android_log_buf_write(int bufID, int prio, const char *tag, const char *text)
+{
+    struct hybris_log_slot *slot;
+    unsigned int pos;
+
+    if (!_log_enabled(prio))
+        return 0;
+
+    if (prio >= ANDROID_LOG_FATAL) {
+        struct hybris_log_slot fatal;
+
+        _log_fill(&fatal, bufID, prio, tag);
+        strncpy(fatal.msg, text ? text : "", sizeof(fatal.msg) - 1);
+        fatal.msg[sizeof(fatal.msg) - 1] = '\0';
+        _log_write_sync(&fatal);
+        return 1;
+    }
+
+    slot = _log_begin(bufID, prio, tag, &pos);
+    if (slot == NULL)
+        return -1;
+
+    strncpy(slot->msg, text ? text : "", sizeof(slot->msg) - 1);
+    slot->msg[sizeof(slot->msg) - 1] = '\0';
+    _log_publish(slot, pos);
+
+    return 1;
+}
+
+int hybris_android_log_write(int prio, const char *tag, const char *text)
+{
+    return hybris_android_log_buf_write(ANDROID_LOG_ID_MAIN, prio, tag, text);
+}
+
+int hybris_android_log_vprint(int prio, const char *tag, const char *fmt, va_list ap)
+{
+    return _log_vwrite(ANDROID_LOG_ID_MAIN, prio, tag, fmt, ap);
+}
+
+int hybris_android_log_print(int prio, const char *tag, const char *fmt, ...)
+{
+    int ret;
+    va_list ap;
+
+    va_start(ap, fmt);
+    ret = _log_vwrite(ANDROID_LOG_ID_MAIN, prio, tag, fmt, ap);
+    va_end(ap);
+
+    return ret;
+}
+
+int hybris_android_log_buf_print(int bufID, int prio, const char *tag, const char *fmt, ...)
+{
+    int ret;
+    va_list ap;
+
+    va_start(ap, fmt);
+    ret = _log_vwrite(bufID, prio, tag, fmt, ap);
+    va_end(ap);
+
+    return ret;
+}
+
+void hybris_android_log_assert(const char *cond, const char *tag, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (fmt) {
+        va_start(ap, fmt);
+        _log_vwrite(ANDROID_LOG_ID_MAIN, ANDROID_LOG_FATAL, tag, fmt, ap);
+        va_end(ap);
+    } else if (cond) {
+        hybris_android_log_print(ANDROID_LOG_FATAL, tag, "Assertion failed: %s", cond);
+    } else {
+        hybris_android_log_write(ANDROID_LOG_FATAL, tag, "Unspecified assertion failed");
+    }
+
+    abort();
+}
+
+// vim:ts=4:sw=4:noexpandtab
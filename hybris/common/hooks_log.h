@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef HOOKS_LOG_H_
+#define HOOKS_LOG_H_
+
+#include <stdarg.h>
+
+/*
+ * Replacements for the liblog write entry points used by Android code.
+ *
+ * Messages below the priority selected with HYBRIS_ANDROID_LOG_LEVEL are
+ * dropped before being formatted; the rest are formatted into an in-memory
+ * ring and written out by a background thread to the sink selected with
+ * HYBRIS_ANDROID_LOG_TARGET ("syslog", "stderr", "none" or a file path).
+ */
+int hybris_android_log_write(int prio, const char *tag, const char *text);
+int hybris_android_log_buf_write(int bufID, int prio, const char *tag, const char *text);
+int hybris_android_log_vprint(int prio, const char *tag, const char *fmt, va_list ap);
+int hybris_android_log_print(int prio, const char *tag, const char *fmt, ...);
+int hybris_android_log_buf_print(int bufID, int prio, const char *tag, const char *fmt, ...);
+void hybris_android_log_assert(const char *cond, const char *tag, const char *fmt, ...);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
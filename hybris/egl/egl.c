@@ -25,10 +25,13 @@
 #include <GLES2/gl2ext.h>
 #include <dlfcn.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <malloc.h>
+#include <pthread.h>
 #include "ws.h"
 #include "helper.h"
+#include "procaddress.h"
 #include <assert.h>
 
 
@@ -42,6 +45,13 @@ static void *_libegl = NULL;
 static void *_libgles = NULL;
 static void *_hybris_libgles1 = NULL;
 static void *_hybris_libgles2 = NULL;
+static void *_hybris_libgles3 = NULL;
+static pthread_once_t _hybris_libgles1_once = PTHREAD_ONCE_INIT;
+static pthread_once_t _hybris_libgles2_once = PTHREAD_ONCE_INIT;
+static pthread_once_t _hybris_libgles3_once = PTHREAD_ONCE_INIT;
+/* client version of the context current on this thread, 0 if there is none */
+static __thread int _egl_current_client_version = 0;
+/* for threads without a context, the version of the last one created */
 static int _egl_context_client_version = 1;
 
 static EGLint  (*_eglGetError)(void) = NULL;
@@ -148,38 +158,189 @@ EGLint eglGetError(void)
 	return (*_eglGetError)();
 }
 
-#define _EGL_MAX_DISPLAYS 100
+/*
+ * Platform displays by vendor EGLDisplay, in a chained hash that grows
+ * with the number of displays. Lookups from several threads share the
+ * lock, only opening and terminating displays take it exclusively. Each
+ * thread also remembers the last display it found, which stays valid
+ * until any display is terminated.
+ *
+ * Like the EGLDisplay itself, a mapping outlives eglTerminate. The
+ * platform display goes away with it and is made again, from the native
+ * display it was made from, the next time the EGLDisplay is used.
+ */
+struct _EGLDisplayMapping {
+	EGLDisplay dpy;
+	EGLNativeDisplayType native;
+	/* NULL from eglTerminate until the display is used again */
+	struct _EGLDisplay *display;
+	/* whether the driver implements EGL_EXT_buffer_age, -1 until known */
+	int hasBufferAge;
+	struct _EGLDisplayMapping *next;
+};
 
-struct _EGLDisplay *_displayMappings[_EGL_MAX_DISPLAYS];
+static struct _EGLDisplayMapping **_displayBuckets = NULL;
+static unsigned int _displayBucketCount = 0;
+static unsigned int _displayCount = 0;
+static pthread_rwlock_t _displayLock = PTHREAD_RWLOCK_INITIALIZER;
+static unsigned int _displayGeneration = 0;
 
-void _addMapping(struct _EGLDisplay *display_id)
+/* initial-exec spares the lookup a call to __tls_get_addr */
+static __thread __attribute__((tls_model("initial-exec"))) struct {
+	EGLDisplay dpy;
+	struct _EGLDisplay *display;
+	unsigned int generation;
+} _lastDisplay;
+
+static unsigned int _displayBucket(EGLDisplay display, unsigned int bucketCount)
 {
-	int i;
-	for (i = 0; i < _EGL_MAX_DISPLAYS; i++)
-	{
-		if (_displayMappings[i] == NULL)
-		{
-			_displayMappings[i] = display_id;
-			return;
+	uintptr_t key = (uintptr_t) display;
+
+	key ^= key >> 16;
+	key *= 0x45d9f3b;
+	key ^= key >> 16;
+	return key & (bucketCount - 1);
+}
+
+static struct _EGLDisplayMapping **_findMapping(EGLDisplay display)
+{
+	struct _EGLDisplayMapping **mapping;
+
+	if (_displayBuckets == NULL)
+		return NULL;
+
+	mapping = &_displayBuckets[_displayBucket(display, _displayBucketCount)];
+	while (*mapping != NULL && (*mapping)->dpy != display)
+		mapping = &(*mapping)->next;
+	return *mapping ? mapping : NULL;
+}
+
+static void _growMappings()
+{
+	unsigned int bucketCount = _displayBucketCount ? 2 * _displayBucketCount : 8;
+	struct _EGLDisplayMapping **buckets = calloc(bucketCount, sizeof(*buckets));
+	unsigned int i;
+
+	assert(buckets != NULL);
+	for (i = 0; i < _displayBucketCount; i++) {
+		struct _EGLDisplayMapping *mapping = _displayBuckets[i];
+		while (mapping != NULL) {
+			struct _EGLDisplayMapping *next = mapping->next;
+			unsigned int bucket = _displayBucket(mapping->dpy, bucketCount);
+			mapping->next = buckets[bucket];
+			buckets[bucket] = mapping;
+			mapping = next;
 		}
 	}
+	free(_displayBuckets);
+	_displayBuckets = buckets;
+	_displayBucketCount = bucketCount;
 }
 
-struct _EGLDisplay *hybris_egl_display_get_mapping(EGLDisplay display)
+/*
+ * Makes the platform display of dpy from native_display, unless another
+ * thread got there first. Returns the platform display now mapped.
+ */
+static struct _EGLDisplay *_openMapping(EGLDisplay dpy, EGLNativeDisplayType native_display)
+{
+	struct _EGLDisplayMapping **existing;
+	struct _EGLDisplay *display;
+	struct _EGLDisplay *result;
+
+	display = ws_GetDisplay(native_display);
+	if (!display)
+		return NULL;
+	display->dpy = dpy;
+	result = display;
+
+	pthread_rwlock_wrlock(&_displayLock);
+	existing = _findMapping(dpy);
+	if (existing != NULL && (*existing)->display != NULL) {
+		result = (*existing)->display;
+	} else if (existing != NULL) {
+		(*existing)->native = native_display;
+		(*existing)->display = display;
+	} else {
+		struct _EGLDisplayMapping *mapping = malloc(sizeof(*mapping));
+		unsigned int bucket;
+
+		assert(mapping != NULL);
+		if (_displayCount >= _displayBucketCount)
+			_growMappings();
+		bucket = _displayBucket(dpy, _displayBucketCount);
+		mapping->dpy = dpy;
+		mapping->native = native_display;
+		mapping->display = display;
+		mapping->hasBufferAge = -1;
+		mapping->next = _displayBuckets[bucket];
+		_displayBuckets[bucket] = mapping;
+		_displayCount++;
+	}
+	pthread_rwlock_unlock(&_displayLock);
+
+	if (result != display)
+		ws_Terminate(display);
+	return result;
+}
+
+/* Takes the platform display of dpy out of its mapping, which stays */
+static struct _EGLDisplay *_closeMapping(EGLDisplay dpy)
 {
-	int i;
-	for (i = 0; i < _EGL_MAX_DISPLAYS; i++)
-	{
-		if (_displayMappings[i])
-		{
-			if (_displayMappings[i]->dpy == display)
-			{
-				return _displayMappings[i];
-			}
+	struct _EGLDisplayMapping **mapping;
+	struct _EGLDisplay *result = NULL;
 
-		}
+	pthread_rwlock_wrlock(&_displayLock);
+	mapping = _findMapping(dpy);
+	if (mapping != NULL && (*mapping)->display != NULL) {
+		result = (*mapping)->display;
+		(*mapping)->display = NULL;
+		__atomic_add_fetch(&_displayGeneration, 1, __ATOMIC_RELEASE);
 	}
-	return EGL_NO_DISPLAY;
+	pthread_rwlock_unlock(&_displayLock);
+
+	return result;
+}
+
+/*
+ * Returns the platform display of dpy. A terminated one is made again
+ * if reopen is set, otherwise NULL is returned for it.
+ */
+static struct _EGLDisplay *_getMapping(EGLDisplay display, int reopen)
+{
+	unsigned int generation = __atomic_load_n(&_displayGeneration, __ATOMIC_ACQUIRE);
+	struct _EGLDisplayMapping **mapping;
+	EGLNativeDisplayType native = EGL_DEFAULT_DISPLAY;
+	struct _EGLDisplay *result = NULL;
+	int found;
+
+	if (_lastDisplay.display != NULL && _lastDisplay.dpy == display &&
+			_lastDisplay.generation == generation)
+		return _lastDisplay.display;
+
+	pthread_rwlock_rdlock(&_displayLock);
+	mapping = _findMapping(display);
+	found = mapping != NULL;
+	if (found) {
+		result = (*mapping)->display;
+		native = (*mapping)->native;
+	}
+	pthread_rwlock_unlock(&_displayLock);
+
+	if (found && result == NULL && reopen)
+		result = _openMapping(display, native);
+
+	/* a display opened here is cached on the next lookup */
+	if (result != NULL && generation == __atomic_load_n(&_displayGeneration, __ATOMIC_ACQUIRE)) {
+		_lastDisplay.dpy = display;
+		_lastDisplay.display = result;
+		_lastDisplay.generation = generation;
+	}
+	return result;
+}
+
+struct _EGLDisplay *hybris_egl_display_get_mapping(EGLDisplay display)
+{
+	return _getMapping(display, 1);
 }
 
 EGLDisplay eglGetDisplay(EGLNativeDisplayType display_id)
@@ -193,14 +354,13 @@ EGLDisplay eglGetDisplay(EGLNativeDisplayType display_id)
 		return EGL_NO_DISPLAY;
 	}
 
-	struct _EGLDisplay *dpy = hybris_egl_display_get_mapping(real_display);
+	/* a terminated display is made again from the native display given now */
+	struct _EGLDisplay *dpy = _getMapping(real_display, 0);
 	if (!dpy) {
-		dpy = ws_GetDisplay(display_id);
+		dpy = _openMapping(real_display, display_id);
 		if (!dpy) {
 			return EGL_NO_DISPLAY;
 		}
-		dpy->dpy = real_display;
-		_addMapping(dpy);
 	}
 
 	return real_display;
@@ -216,8 +376,11 @@ EGLBoolean eglTerminate(EGLDisplay dpy)
 {
 	EGL_DLSYM(&_eglTerminate, "eglTerminate");
 
-	struct _EGLDisplay *display = hybris_egl_display_get_mapping(dpy);
-	ws_Terminate(display);
+	/* the platform frees its display, the next use of dpy makes a new one */
+	struct _EGLDisplay *display = _closeMapping(dpy);
+	if (display) {
+		ws_Terminate(display);
+	}
 	return (*_eglTerminate)(dpy);
 }
 
@@ -304,10 +467,50 @@ EGLBoolean eglDestroySurface(EGLDisplay dpy, EGLSurface surface)
 	return result;
 }
 
+/* Looked up once per display, the displays may be driven by different drivers */
+static int driver_has_buffer_age(EGLDisplay dpy)
+{
+	struct _EGLDisplayMapping **mapping;
+	const char *extensions;
+	int has_buffer_age = -1;
+
+	pthread_rwlock_rdlock(&_displayLock);
+	mapping = _findMapping(dpy);
+	if (mapping != NULL)
+		has_buffer_age = __atomic_load_n(&(*mapping)->hasBufferAge, __ATOMIC_RELAXED);
+	pthread_rwlock_unlock(&_displayLock);
+
+	if (has_buffer_age >= 0)
+		return has_buffer_age;
+
+	EGL_DLSYM(&_eglQueryString, "eglQueryString");
+	extensions = (*_eglQueryString)(dpy, EGL_EXTENSIONS);
+	/* not initialized yet, ask again next time */
+	if (!extensions)
+		return 0;
+	has_buffer_age = strstr(extensions, "EGL_EXT_buffer_age") != NULL;
+
+	pthread_rwlock_rdlock(&_displayLock);
+	mapping = _findMapping(dpy);
+	if (mapping != NULL)
+		__atomic_store_n(&(*mapping)->hasBufferAge, has_buffer_age, __ATOMIC_RELAXED);
+	pthread_rwlock_unlock(&_displayLock);
+
+	return has_buffer_age;
+}
+
 EGLBoolean eglQuerySurface(EGLDisplay dpy, EGLSurface surface,
 		EGLint attribute, EGLint *value)
 {
 	EGL_DLSYM(&_eglQuerySurface, "eglQuerySurface");
+
+	/* drivers without EGL_EXT_buffer_age get the age from our window */
+	if (attribute == EGL_BUFFER_AGE_EXT && egl_helper_has_mapping(surface) &&
+			!driver_has_buffer_age(dpy)) {
+		*value = ws_getBufferAge(dpy, egl_helper_get_mapping(surface));
+		return EGL_TRUE;
+	}
+
 	return (*_eglQuerySurface)(dpy, surface, attribute, value);
 }
 
@@ -393,28 +596,42 @@ EGLContext eglCreateContext(EGLDisplay dpy, EGLConfig config,
 {
 	EGL_DLSYM(&_eglCreateContext, "eglCreateContext");
 
+	int version = 1;
 	EGLint *p = attrib_list;
 	while (p != NULL && *p != EGL_NONE) {
 		if (*p == EGL_CONTEXT_CLIENT_VERSION) {
-			_egl_context_client_version = p[1];
+			version = p[1];
 		}
 		p += 2;
 	}
 
-	return (*_eglCreateContext)(dpy, config, share_context, attrib_list);
+	EGLContext ctx = (*_eglCreateContext)(dpy, config, share_context, attrib_list);
+	if (ctx != EGL_NO_CONTEXT) {
+		egl_helper_push_context_version(ctx, version);
+		_egl_context_client_version = version;
+	}
+	return ctx;
 }
 
 EGLBoolean eglDestroyContext(EGLDisplay dpy, EGLContext ctx)
 {
 	EGL_DLSYM(&_eglDestroyContext, "eglDestroyContext");
-	return (*_eglDestroyContext)(dpy, ctx);
+	EGLBoolean ret = (*_eglDestroyContext)(dpy, ctx);
+	if (ret == EGL_TRUE) {
+		egl_helper_pop_context_version(ctx);
+	}
+	return ret;
 }
 
 EGLBoolean eglMakeCurrent(EGLDisplay dpy, EGLSurface draw,
 		EGLSurface read, EGLContext ctx)
 {
 	EGL_DLSYM(&_eglMakeCurrent, "eglMakeCurrent");
-	return (*_eglMakeCurrent)(dpy, draw, read, ctx);
+	EGLBoolean ret = (*_eglMakeCurrent)(dpy, draw, read, ctx);
+	if (ret == EGL_TRUE) {
+		_egl_current_client_version = ctx == EGL_NO_CONTEXT ? 0 : egl_helper_get_context_version(ctx);
+	}
+	return ret;
 }
 
 EGLContext eglGetCurrentContext(void)
@@ -490,6 +707,35 @@ EGLBoolean eglCopyBuffers(EGLDisplay dpy, EGLSurface surface,
 }
 
 
+static EGLBoolean _egl_image_destroy(struct egl_image *image)
+{
+	EGL_DLSYM(&_eglDestroyImageKHR, "eglDestroyImageKHR");
+	EGLBoolean ret = (*_eglDestroyImageKHR)(image->dpy, image->egl_image);
+	if (ret == EGL_TRUE) {
+		free(image->attrib_list);
+		free(image);
+	} else {
+		image->refcount = 1;
+	}
+	return ret;
+}
+
+/* the attributes up to and including EGL_NONE, NULL for an empty list */
+static EGLint *_egl_copy_attrib_list(const EGLint *attrib_list)
+{
+	int n = 0;
+	EGLint *copy;
+
+	if (attrib_list == NULL || attrib_list[0] == EGL_NONE)
+		return NULL;
+
+	while (attrib_list[n] != EGL_NONE)
+		n += 2;
+	copy = malloc((n + 1) * sizeof(EGLint));
+	memcpy(copy, attrib_list, (n + 1) * sizeof(EGLint));
+	return copy;
+}
+
 static EGLImageKHR _my_eglCreateImageKHR(EGLDisplay dpy, EGLContext ctx, EGLenum target, EGLClientBuffer buffer, const EGLint *attrib_list)
 {
 	EGL_DLSYM(&_eglCreateImageKHR, "eglCreateImageKHR");
@@ -497,6 +743,13 @@ static EGLImageKHR _my_eglCreateImageKHR(EGLDisplay dpy, EGLContext ctx, EGLenum
 	EGLenum newtarget = target;
 	EGLClientBuffer newbuffer = buffer;
 	const EGLint *newattrib_list = attrib_list;
+	struct egl_image *image;
+
+	/* compositors import the same few client buffers every frame */
+	image = ws_lookupImageKHR(dpy, ctx, target, buffer, attrib_list);
+	if (image) {
+		return (EGLImageKHR)image;
+	}
 
 	ws_passthroughImageKHR(&newctx, &newtarget, &newbuffer, &newattrib_list);
 
@@ -506,11 +759,17 @@ static EGLImageKHR _my_eglCreateImageKHR(EGLDisplay dpy, EGLContext ctx, EGLenum
 		return EGL_NO_IMAGE_KHR;
 	}
 
-	struct egl_image *image;
 	image = malloc(sizeof *image);
 	image->egl_image = eik;
 	image->egl_buffer = buffer;
 	image->target = target;
+	image->ctx = ctx;
+	image->attrib_list = _egl_copy_attrib_list(attrib_list);
+	image->refcount = 1;
+	image->dpy = dpy;
+	image->destroy = _egl_image_destroy;
+
+	ws_cacheImageKHR(dpy, target, buffer, image);
 
 	return (EGLImageKHR)image;
 }
@@ -522,46 +781,71 @@ static void _my_glEGLImageTargetTexture2DOES(GLenum target, GLeglImageOES image)
 	(*_glEGLImageTargetTexture2DOES)(target, img ? img->egl_image : NULL);
 }
 
+/* the entry points wrapped here, everything else comes from the driver */
+static const struct egl_proc _wrapped_procs[] = {
+	{ "eglCreateImageKHR", (__eglMustCastToProperFunctionPointerType) _my_eglCreateImageKHR },
+	{ "eglDestroyImageKHR", (__eglMustCastToProperFunctionPointerType) eglDestroyImageKHR },
+	{ "eglSwapBuffersWithDamageEXT", (__eglMustCastToProperFunctionPointerType) _my_eglSwapBuffersWithDamageEXT },
+	{ "glEGLImageTargetTexture2DOES", (__eglMustCastToProperFunctionPointerType) _my_glEGLImageTargetTexture2DOES },
+};
+
+static void _init_hybris_libgles1()
+{
+	_hybris_libgles1 = (void *) dlopen(getenv("HYBRIS_LIBGLESV1") ?: "libGLESv1_CM.so.1", RTLD_LAZY);
+}
+
+static void _init_hybris_libgles2()
+{
+	_hybris_libgles2 = (void *) dlopen(getenv("HYBRIS_LIBGLESV2") ?: "libGLESv2.so.2", RTLD_LAZY);
+}
+
+static void _init_hybris_libgles3()
+{
+	_hybris_libgles3 = (void *) dlopen(getenv("HYBRIS_LIBGLESV3") ?: "libGLESv3.so.3", RTLD_LAZY);
+}
+
+static struct egl_proc_table _wrapped_proc_table;
+static pthread_once_t _wrapped_proc_once = PTHREAD_ONCE_INIT;
+
+static void _init_wrapped_procs()
+{
+	egl_proc_table_init(&_wrapped_proc_table, _wrapped_procs,
+			sizeof(_wrapped_procs) / sizeof(_wrapped_procs[0]));
+}
+
 __eglMustCastToProperFunctionPointerType eglGetProcAddress(const char *procname)
 {
 	EGL_DLSYM(&_eglGetProcAddress, "eglGetProcAddress");
-	if (strcmp(procname, "eglCreateImageKHR") == 0)
-	{
-		return _my_eglCreateImageKHR;
-	}
-	else if (strcmp(procname, "eglDestroyImageKHR") == 0)
-	{
-		return eglDestroyImageKHR;
-	}
-	else if (strcmp(procname, "eglSwapBuffersWithDamageEXT") == 0)
-	{
-		return _my_eglSwapBuffersWithDamageEXT;
-	}
-	else if (strcmp(procname, "glEGLImageTargetTexture2DOES") == 0)
-	{
-		return _my_glEGLImageTargetTexture2DOES;
-	}
+	pthread_once(&_wrapped_proc_once, _init_wrapped_procs);
+
+	__eglMustCastToProperFunctionPointerType ret = egl_proc_table_lookup(&_wrapped_proc_table, procname);
+	if (ret != NULL)
+		return ret;
 
-	__eglMustCastToProperFunctionPointerType ret = NULL;
+	/* which library resolves gl* names depends on the client version */
+	int version = _egl_current_client_version ?: _egl_context_client_version;
+	if (egl_proc_cache_lookup(procname, version, &ret))
+		return ret;
 
-	switch (_egl_context_client_version) {
+	switch (version) {
 		case 1:  // OpenGL ES 1.x API
-			if (_hybris_libgles1 == NULL) {
-				_hybris_libgles1 = (void *) dlopen(getenv("HYBRIS_LIBGLESV1") ?: "libGLESv1_CM.so.1", RTLD_LAZY);
-			}
+			pthread_once(&_hybris_libgles1_once, _init_hybris_libgles1);
 			ret = _hybris_libgles1 ? dlsym(_hybris_libgles1, procname) : NULL;
 			break;
 		case 2:  // OpenGL ES 2.0 API
-			if (_hybris_libgles2 == NULL) {
-				_hybris_libgles2 = (void *) dlopen(getenv("HYBRIS_LIBGLESV2") ?: "libGLESv2.so.2", RTLD_LAZY);
-			}
+			pthread_once(&_hybris_libgles2_once, _init_hybris_libgles2);
 			ret = _hybris_libgles2 ? dlsym(_hybris_libgles2, procname) : NULL;
 			break;
-		case 3:  // OpenGL ES 3.x API
-			// TODO: Load from libGLESv3.so once we have OpenGL ES 3.0/3.1 support
+		case 3:  // OpenGL ES 3.x API, the 2.0 entry points stay in libGLESv2
+			pthread_once(&_hybris_libgles3_once, _init_hybris_libgles3);
+			ret = _hybris_libgles3 ? dlsym(_hybris_libgles3, procname) : NULL;
+			if (ret == NULL) {
+				pthread_once(&_hybris_libgles2_once, _init_hybris_libgles2);
+				ret = _hybris_libgles2 ? dlsym(_hybris_libgles2, procname) : NULL;
+			}
 			break;
 		default:
-			HYBRIS_WARN("Unknown EGL context client version: %d", _egl_context_client_version);
+			HYBRIS_WARN("Unknown EGL context client version: %d", version);
 			break;
 	}
 
@@ -573,6 +857,10 @@ __eglMustCastToProperFunctionPointerType eglGetProcAddress(const char *procname)
 		ret = (*_eglGetProcAddress)(procname);
 	}
 
+	/* a missing name may still show up once a library is loaded */
+	if (ret != NULL)
+		egl_proc_cache_insert(procname, version, ret);
+
 	return ret;
 }
 
@@ -580,12 +868,11 @@ EGLBoolean eglDestroyImageKHR(EGLDisplay dpy, EGLImageKHR image)
 {
 	EGL_DLSYM(&_eglDestroyImageKHR, "eglDestroyImageKHR");
 	struct egl_image *img = image;
-	EGLBoolean ret = (*_eglDestroyImageKHR)(dpy, img ? img->egl_image : NULL);
-	if (ret == EGL_TRUE) {
-		free(img);
-		return EGL_TRUE;
+	if (img == NULL) {
+		return (*_eglDestroyImageKHR)(dpy, NULL);
 	}
-	return ret;
+	/* the image lives on while a platform cache holds it */
+	return egl_image_unref(img);
 }
 
 // vim:ts=4:sw=4:noexpandtab
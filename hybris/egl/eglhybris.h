@@ -30,6 +30,7 @@ extern "C" {
 int hybris_register_buffer_handle(buffer_handle_t handle);
 int hybris_unregister_buffer_handle(buffer_handle_t handle);
 void hybris_dump_buffer_to_file(struct ANativeWindowBuffer *buf);
+void hybris_capture_frame(struct ANativeWindowBuffer *buf, int fence_fd);
 
 void *hybris_android_egl_dlsym(const char *symbol);
 int hybris_egl_has_mapping(EGLSurface surface);
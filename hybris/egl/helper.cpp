@@ -21,12 +21,17 @@
 #include "helper.h"
 
 #include <assert.h>
+#include <pthread.h>
 #include <map>
 
 
 /* Keep track of active EGL window surfaces */
 static std::map<EGLSurface,EGLNativeWindowType> _surface_window_map;
 
+/* Client API version of each context, contexts live on many threads */
+static std::map<EGLContext,int> _context_version_map;
+static pthread_mutex_t _context_version_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 
 void egl_helper_push_mapping(EGLSurface surface, EGLNativeWindowType window)
 {
@@ -63,3 +68,31 @@ EGLNativeWindowType egl_helper_pop_mapping(EGLSurface surface)
     _surface_window_map.erase(it);
     return result;
 }
+
+void egl_helper_push_context_version(EGLContext context, int version)
+{
+    pthread_mutex_lock(&_context_version_mutex);
+    _context_version_map[context] = version;
+    pthread_mutex_unlock(&_context_version_mutex);
+}
+
+int egl_helper_get_context_version(EGLContext context)
+{
+    std::map<EGLContext,int>::iterator it;
+    int version = 0;
+
+    pthread_mutex_lock(&_context_version_mutex);
+    it = _context_version_map.find(context);
+    if (it != _context_version_map.end())
+        version = it->second;
+    pthread_mutex_unlock(&_context_version_mutex);
+
+    return version;
+}
+
+void egl_helper_pop_context_version(EGLContext context)
+{
+    pthread_mutex_lock(&_context_version_mutex);
+    _context_version_map.erase(context);
+    pthread_mutex_unlock(&_context_version_mutex);
+}
@@ -42,6 +42,15 @@ EGLNativeWindowType egl_helper_get_mapping(EGLSurface surface);
 /* Return and remove the mapping for a surface */
 EGLNativeWindowType egl_helper_pop_mapping(EGLSurface surface);
 
+/* Remember the client API version a context was created for */
+void egl_helper_push_context_version(EGLContext context, int version);
+
+/* Return the client API version of a context, 0 if it is unknown */
+int egl_helper_get_context_version(EGLContext context);
+
+/* Forget the client API version of a context */
+void egl_helper_pop_context_version(EGLContext context);
+
 
 #ifdef __cplusplus
 };
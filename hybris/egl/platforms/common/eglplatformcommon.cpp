@@ -16,11 +16,19 @@
 
 #ifdef WANT_WAYLAND
 #include <wayland-client.h>
+#include <pthread.h>
 #include "server_wlegl.h"
 #include "server_wlegl_buffer.h"
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
+extern "C" {
+#include <sync/sync.h>
+}
+#endif
 #endif
 
 #include "windowbuffer.h"
+#include "framecapture.h"
+#include "hybris_framestats.h"
 
 static struct ws_egl_interface *my_egl_interface;
 static gralloc_module_t *my_gralloc = 0;
@@ -31,6 +39,7 @@ extern "C" void eglplatformcommon_init(struct ws_egl_interface *egl_iface, grall
 	my_egl_interface = egl_iface;
 	my_gralloc = gralloc;
 	my_alloc = allocdevice;
+	hybris_capture_init(gralloc);
 }
 
 extern "C" void *hybris_android_egl_dlsym(const char *symbol)
@@ -64,30 +73,10 @@ extern "C" int hybris_unregister_buffer_handle(buffer_handle_t handle)
 	return my_gralloc->unregisterBuffer(my_gralloc, handle);
 }
 
+/* kept for compatibility, frames go through the capture service now */
 extern "C" void hybris_dump_buffer_to_file(ANativeWindowBuffer *buf)
 {
-	static int cnt = 0;
-	void *vaddr;
-	int ret = my_gralloc->lock(my_gralloc, buf->handle, buf->usage, 0, 0, buf->width, buf->height, &vaddr);
-	TRACE("buf:%p gralloc lock returns %i", buf, ret);
-	TRACE("buf:%p lock to vaddr %p", buf, vaddr);
-	char b[1024];
-	int bytes_pp = 0;
-
-	if (buf->format == HAL_PIXEL_FORMAT_RGBA_8888)
-		bytes_pp = 4;
-	else if (buf->format == HAL_PIXEL_FORMAT_RGB_565)
-		bytes_pp = 2;
-
-	snprintf(b, 1020, "vaddr.%p.%p.%i.%is%ix%ix%i", buf, vaddr, cnt, buf->width, buf->stride, buf->height, bytes_pp);
-	cnt++;
-	int fd = ::open(b, O_WRONLY|O_CREAT, S_IRWXU);
-	if(fd < 0)
-		return;
-
-	::write(fd, vaddr, buf->stride * buf->height * bytes_pp);
-	::close(fd);
-	my_gralloc->unlock(my_gralloc, buf->handle);
+	hybris_capture_frame(buf, -1);
 }
 
 #ifdef WANT_WAYLAND
@@ -153,6 +142,20 @@ extern "C" EGLBoolean eglplatformcommon_eglHybrisAcquireNativeBufferWL(EGLDispla
     return EGL_TRUE;
 }
 
+// Added as part of EGL_HYBRIS_WL_acquire_fence. Hands the native fence of
+// the contents attached last to a compositor that reads the buffer without
+// creating an EGLImage through us on each attach, e.g. one that keeps its
+// own EGLImages or hands buffers to hwcomposer. Returns -1 if there is
+// none; otherwise the caller owns the fd and must not read the buffer
+// before it signals.
+extern "C" int eglplatformcommon_eglHybrisAcquireFenceWL(EGLDisplay dpy, struct wl_resource *wlBuffer)
+{
+    server_wlegl_buffer *buf = server_wlegl_buffer_get(wlBuffer);
+    if (!buf)
+        return -1;
+    return server_wlegl_buffer_take_acquire_fence(buf);
+}
+
 #endif
 
 // Added as part of EGL_HYBRIS_native_buffer2
@@ -264,26 +267,136 @@ extern "C" EGLBoolean eglplatformcommon_eglHybrisReleaseNativeBuffer(EGLClientBu
 
 
 
+/* only window surfaces have a native window to collect statistics in */
+extern "C" EGLBoolean eglplatformcommon_eglHybrisGetFrameStats(EGLDisplay dpy, EGLSurface surface, struct HybrisFrameStats *stats, EGLBoolean reset)
+{
+	if (stats == NULL || !hybris_egl_has_mapping(surface))
+		return EGL_FALSE;
+
+	BaseNativeWindow *window = static_cast<BaseNativeWindow *>((struct ANativeWindow *) hybris_egl_get_mapping(surface));
+	window->getFrameStats(stats, reset == EGL_TRUE);
+	return EGL_TRUE;
+}
+
+
+
+#ifdef WANT_WAYLAND
+/* EGL_ANDROID_native_fence_sync and EGL_KHR_wait_sync, missing from our headers */
+#define HYBRIS_EGL_SYNC_NATIVE_FENCE_ANDROID 0x3144
+#define HYBRIS_EGL_SYNC_NATIVE_FENCE_FD_ANDROID 0x3145
+typedef EGLint (EGLAPIENTRYP HYBRIS_PFNEGLWAITSYNCKHRPROC)(EGLDisplay dpy, EGLSyncKHR sync, EGLint flags);
+
+static pthread_once_t native_fence_once = PTHREAD_ONCE_INIT;
+static EGLDisplay (*vendor_eglGetCurrentDisplay)(void);
+static EGLContext (*vendor_eglGetCurrentContext)(void);
+static const char *(*vendor_eglQueryString)(EGLDisplay dpy, EGLint name);
+static PFNEGLCREATESYNCKHRPROC vendor_eglCreateSyncKHR;
+static PFNEGLDESTROYSYNCKHRPROC vendor_eglDestroySyncKHR;
+static HYBRIS_PFNEGLWAITSYNCKHRPROC vendor_eglWaitSyncKHR;
+
+static void native_fence_init()
+{
+	__eglMustCastToProperFunctionPointerType (*get_proc_address)(const char *) =
+		(__eglMustCastToProperFunctionPointerType (*)(const char *)) hybris_android_egl_dlsym("eglGetProcAddress");
+
+	vendor_eglGetCurrentDisplay = (EGLDisplay (*)(void)) hybris_android_egl_dlsym("eglGetCurrentDisplay");
+	vendor_eglGetCurrentContext = (EGLContext (*)(void)) hybris_android_egl_dlsym("eglGetCurrentContext");
+	vendor_eglQueryString = (const char *(*)(EGLDisplay, EGLint)) hybris_android_egl_dlsym("eglQueryString");
+	if (!get_proc_address)
+		return;
+	vendor_eglCreateSyncKHR = (PFNEGLCREATESYNCKHRPROC) get_proc_address("eglCreateSyncKHR");
+	vendor_eglDestroySyncKHR = (PFNEGLDESTROYSYNCKHRPROC) get_proc_address("eglDestroySyncKHR");
+	vendor_eglWaitSyncKHR = (HYBRIS_PFNEGLWAITSYNCKHRPROC) get_proc_address("eglWaitSyncKHR");
+}
+
+/*
+ * Queues a wait for fence on the GPU of the current context, so reading
+ * the buffer waits without blocking the compositor thread. Takes
+ * ownership of fence on success, returns 0 if the driver can't do it.
+ */
+static int gpu_wait_fence(int fence)
+{
+	// the compositor imports buffers from one thread, the display rarely changes
+	static EGLDisplay checked_dpy = EGL_NO_DISPLAY;
+	static int has_native_fence = 0;
+
+	pthread_once(&native_fence_once, native_fence_init);
+	if (!vendor_eglCreateSyncKHR || !vendor_eglDestroySyncKHR || !vendor_eglWaitSyncKHR ||
+			!vendor_eglGetCurrentDisplay || !vendor_eglGetCurrentContext || !vendor_eglQueryString)
+		return 0;
+
+	EGLDisplay dpy = (*vendor_eglGetCurrentDisplay)();
+	if (dpy == EGL_NO_DISPLAY || (*vendor_eglGetCurrentContext)() == EGL_NO_CONTEXT)
+		return 0;
+
+	if (dpy != checked_dpy) {
+		const char *extensions = (*vendor_eglQueryString)(dpy, EGL_EXTENSIONS);
+		has_native_fence = extensions && strstr(extensions, "EGL_ANDROID_native_fence_sync") &&
+			strstr(extensions, "EGL_KHR_wait_sync");
+		checked_dpy = dpy;
+	}
+	if (!has_native_fence)
+		return 0;
+
+	const EGLint attribs[] = { HYBRIS_EGL_SYNC_NATIVE_FENCE_FD_ANDROID, fence, EGL_NONE };
+	EGLSyncKHR sync = (*vendor_eglCreateSyncKHR)(dpy, HYBRIS_EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+	if (sync == EGL_NO_SYNC_KHR)
+		return 0;
+
+	// the sync owns the fence now
+	(*vendor_eglWaitSyncKHR)(dpy, sync, 0);
+	(*vendor_eglDestroySyncKHR)(dpy, sync);
+	return 1;
+}
+
+/*
+ * The acquire fence belongs to the contents of the last attach, so it is
+ * consumed on every use of the buffer, not only when an image is made.
+ */
+static void wait_acquire_fence(server_wlegl_buffer *buf)
+{
+	int fence = server_wlegl_buffer_take_acquire_fence(buf);
+
+	if (fence < 0 || gpu_wait_fence(fence))
+		return;
+
+	HYBRIS_TRACE_BEGIN("eglplatformcommon", "acquire-fence-wait", "-%i", fence);
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
+	sync_wait(fence, -1);
+#endif
+	close(fence);
+	HYBRIS_TRACE_END("eglplatformcommon", "acquire-fence-wait", "-%i", fence);
+}
+
+/* HYBRIS_WAYLAND_KHR_DUMP_BUFFERS captures the buffers a compositor imports */
+static void capture_imported_buffer(server_wlegl_buffer *buf)
+{
+	static int debugenvchecked = 0;
+
+	if (debugenvchecked == 0)
+	{
+		if (getenv("HYBRIS_WAYLAND_KHR_DUMP_BUFFERS") != NULL)
+			debugenvchecked = 2;
+		else
+			debugenvchecked = 1;
+	}
+	if (debugenvchecked == 2)
+		hybris_capture_frame((ANativeWindowBuffer *) buf->buf, -1);
+}
+#endif
+
 extern "C" void
 eglplatformcommon_passthroughImageKHR(EGLContext *ctx, EGLenum *target, EGLClientBuffer *buffer, const EGLint **attrib_list)
 {
 #ifdef WANT_WAYLAND
-	static int debugenvchecked = 0;
 	if (*target == EGL_WAYLAND_BUFFER_WL)
 	{
 		server_wlegl_buffer *buf = server_wlegl_buffer_from((struct wl_resource *)*buffer);
 		HYBRIS_TRACE_BEGIN("eglplatformcommon", "Wayland_eglImageKHR", "-resource@%i", wl_resource_get_id((struct wl_resource *)*buffer));
 		HYBRIS_TRACE_END("eglplatformcommon", "Wayland_eglImageKHR", "-resource@%i", wl_resource_get_id((struct wl_resource *)*buffer));
-		if (debugenvchecked == 0)
-		{
-			if (getenv("HYBRIS_WAYLAND_KHR_DUMP_BUFFERS") != NULL)
-				debugenvchecked = 2;
-			else
-				debugenvchecked = 1;
-		} else if (debugenvchecked == 2)
-		{
-			hybris_dump_buffer_to_file((ANativeWindowBuffer *) buf->buf);
-		}
+		// the client may have committed before its rendering finished
+		wait_acquire_fence(buf);
+		capture_imported_buffer(buf);
 		*buffer = (EGLClientBuffer) (ANativeWindowBuffer *) buf->buf;
 		*target = EGL_NATIVE_BUFFER_ANDROID;
 		*ctx = EGL_NO_CONTEXT;
@@ -292,6 +405,38 @@ eglplatformcommon_passthroughImageKHR(EGLContext *ctx, EGLenum *target, EGLClien
 #endif
 }
 
+/*
+ * Wayland buffers keep the image created for them, a compositor imports
+ * the same few buffers of each client over and over.
+ */
+extern "C" struct egl_image *
+eglplatformcommon_lookupImageKHR(EGLDisplay dpy, EGLContext ctx, EGLenum target, EGLClientBuffer buffer, const EGLint *attrib_list)
+{
+#ifdef WANT_WAYLAND
+	if (target == EGL_WAYLAND_BUFFER_WL)
+	{
+		server_wlegl_buffer *buf = server_wlegl_buffer_from((struct wl_resource *)buffer);
+		struct egl_image *image = server_wlegl_buffer_get_image(buf, dpy, ctx, attrib_list);
+		// a cached image skips passthroughImageKHR, which waits otherwise
+		if (image) {
+			wait_acquire_fence(buf);
+			capture_imported_buffer(buf);
+		}
+		return image;
+	}
+#endif
+	return NULL;
+}
+
+extern "C" void
+eglplatformcommon_cacheImageKHR(EGLDisplay dpy, EGLenum target, EGLClientBuffer buffer, struct egl_image *image)
+{
+#ifdef WANT_WAYLAND
+	if (target == EGL_WAYLAND_BUFFER_WL)
+		server_wlegl_buffer_set_image(server_wlegl_buffer_from((struct wl_resource *)buffer), image);
+#endif
+}
+
 extern "C" __eglMustCastToProperFunctionPointerType eglplatformcommon_eglGetProcAddress(const char *procname)
 {
 #ifdef WANT_WAYLAND
@@ -314,6 +459,11 @@ extern "C" __eglMustCastToProperFunctionPointerType eglplatformcommon_eglGetProc
         return (__eglMustCastToProperFunctionPointerType) eglplatformcommon_eglHybrisAcquireNativeBufferWL;
     }
     else
+    if (strcmp(procname, "eglHybrisAcquireFenceWL") == 0)
+    {
+        return (__eglMustCastToProperFunctionPointerType) eglplatformcommon_eglHybrisAcquireFenceWL;
+    }
+    else
 #endif
 	if (strcmp(procname, "eglHybrisCreateNativeBuffer") == 0)
 	{
@@ -354,19 +504,24 @@ extern "C" __eglMustCastToProperFunctionPointerType eglplatformcommon_eglGetProc
 	{
 		return (__eglMustCastToProperFunctionPointerType)eglplatformcommon_eglHybrisNativeBufferHandle;
 	}
+	else
+	if (strcmp(procname, "eglHybrisGetFrameStats") == 0)
+	{
+		return (__eglMustCastToProperFunctionPointerType)eglplatformcommon_eglHybrisGetFrameStats;
+	}
 	return NULL;
 }
 
 extern "C" const char *eglplatformcommon_eglQueryString(EGLDisplay dpy, EGLint name, const char *(*real_eglQueryString)(EGLDisplay dpy, EGLint name))
 {
-#ifdef WANT_WAYLAND
 	if (name == EGL_EXTENSIONS)
 	{
 		const char *ret = (*real_eglQueryString)(dpy, name);
-		static char eglextensionsbuf[512];
-		snprintf(eglextensionsbuf, 510, "%sEGL_HYBRIS_native_buffer2 EGL_HYBRIS_WL_acquire_native_buffer %s", ret ? ret : "",
+		static char eglextensionsbuf[2048];
+		snprintf(eglextensionsbuf, sizeof(eglextensionsbuf) - 2, "%s%s%s", ret ? ret : "",
+			"EGL_HYBRIS_frame_stats ",
 #ifdef WANT_WAYLAND
-			"EGL_WL_bind_wayland_display "
+			"EGL_HYBRIS_native_buffer2 EGL_HYBRIS_WL_acquire_native_buffer EGL_HYBRIS_WL_acquire_fence EGL_WL_bind_wayland_display "
 #else
 			""
 #endif
@@ -374,6 +529,11 @@ extern "C" const char *eglplatformcommon_eglQueryString(EGLDisplay dpy, EGLint n
 		ret = eglextensionsbuf;
 		return ret;
 	}
-#endif
 	return (*real_eglQueryString)(dpy, name);
 }
+
+extern "C" EGLint eglplatformcommon_getBufferAge(EGLDisplay dpy, EGLNativeWindowType win)
+{
+	BaseNativeWindow *window = static_cast<BaseNativeWindow *>((struct ANativeWindow *) win);
+	return window->dequeuedBufferAge();
+}
@@ -4,8 +4,13 @@
 #include <hardware/gralloc.h>
 #include <EGL/egl.h>
 
+struct egl_image;
+
 void eglplatformcommon_init(struct ws_egl_interface *egl_iface, gralloc_module_t *gralloc, alloc_device_t *allocdevice);
 __eglMustCastToProperFunctionPointerType eglplatformcommon_eglGetProcAddress(const char *procname);
 void eglplatformcommon_passthroughImageKHR(EGLContext *ctx, EGLenum *target, EGLClientBuffer *buffer, const EGLint **attrib_list);
 const char *eglplatformcommon_eglQueryString(EGLDisplay dpy, EGLint name, const char *(*real_eglQueryString)(EGLDisplay dpy, EGLint name));
+EGLint eglplatformcommon_getBufferAge(EGLDisplay dpy, EGLNativeWindowType win);
+struct egl_image *eglplatformcommon_lookupImageKHR(EGLDisplay dpy, EGLContext ctx, EGLenum target, EGLClientBuffer buffer, const EGLint *attrib_list);
+void eglplatformcommon_cacheImageKHR(EGLDisplay dpy, EGLenum target, EGLClientBuffer buffer, struct egl_image *image);
 #endif
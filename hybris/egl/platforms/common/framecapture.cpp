@@ -0,0 +1,404 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <android-config.h>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
+extern "C" {
+#include <sync/sync.h>
+}
+#endif
+
+#include "framecapture.h"
+#include "logging.h"
+
+enum capture_slot_state {
+	CAPTURE_SLOT_FREE,
+	/* claimed by a producer, which copies the frame in without the lock */
+	CAPTURE_SLOT_FILLING,
+	/* copied, for the writer to write out */
+	CAPTURE_SLOT_READY,
+};
+
+struct capture_slot {
+	capture_slot_state state;
+	hybris_capture_frame_header header;
+	void *data;
+	size_t capacity;
+};
+
+static const gralloc_module_t *capture_gralloc;
+
+static pthread_once_t capture_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t capture_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t capture_thread;
+static bool capture_running;
+/* no more frames are claimed, the writer finishes the file once idle */
+static bool capture_finishing;
+
+static int capture_fd = -1;
+static unsigned int capture_interval = 1;
+static unsigned int capture_max_frames;
+
+/* slots are claimed at tail and written out from head */
+static capture_slot *capture_ring;
+static unsigned int capture_ring_size;
+static unsigned int capture_head;
+static unsigned int capture_tail;
+
+static unsigned int capture_sequence;
+static hybris_capture_stats capture_stats;
+
+static uint64_t
+capture_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int
+capture_bytes_per_pixel(int format)
+{
+	switch (format) {
+	case HAL_PIXEL_FORMAT_RGBA_8888:
+	case HAL_PIXEL_FORMAT_RGBX_8888:
+	case HAL_PIXEL_FORMAT_BGRA_8888:
+		return 4;
+	case HAL_PIXEL_FORMAT_RGB_888:
+		return 3;
+	case HAL_PIXEL_FORMAT_RGB_565:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+static bool
+capture_write(const void *data, size_t size)
+{
+	const char *p = static_cast<const char *>(data);
+
+	while (size > 0) {
+		ssize_t ret = ::write(capture_fd, p, size);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p += ret;
+		size -= ret;
+	}
+
+	return true;
+}
+
+static void
+capture_finish_file(const std::vector<hybris_capture_index_entry> &index, uint64_t offset)
+{
+	hybris_capture_trailer trailer;
+
+	memset(&trailer, 0, sizeof(trailer));
+	trailer.index_offset = offset;
+	trailer.frames = index.size();
+	trailer.dropped = capture_stats.dropped;
+	memcpy(trailer.magic, HYBRIS_CAPTURE_INDEX_MAGIC, sizeof(trailer.magic));
+
+	if (!index.empty())
+		capture_write(&index[0], index.size() * sizeof(index[0]));
+	capture_write(&trailer, sizeof(trailer));
+
+	::close(capture_fd);
+	capture_fd = -1;
+}
+
+/*
+ * Runs on the producer, before the window can hand the buffer out again,
+ * into a slot it has claimed. The slots are allocated up front, so this
+ * only costs a copy of the frame.
+ */
+static void
+capture_copy(capture_slot *slot, struct ANativeWindowBuffer *buf, int fence_fd)
+{
+	hybris_capture_frame_header *header = &slot->header;
+	size_t row = (size_t) header->width * header->bytes_per_pixel;
+	void *vaddr = NULL;
+
+	HYBRIS_TRACE_BEGIN("eglplatformcommon", "capture_frame", "-%u", header->sequence);
+
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
+	if (fence_fd >= 0)
+		sync_wait(fence_fd, -1);
+#endif
+
+	header->size = 0;
+	if (slot->capacity >= row * header->height &&
+	    capture_gralloc->lock(capture_gralloc, buf->handle, buf->usage, 0, 0,
+				  buf->width, buf->height, &vaddr) == 0) {
+		const char *src = static_cast<const char *>(vaddr);
+		char *dst = static_cast<char *>(slot->data);
+
+		for (int y = 0; y < buf->height; y++)
+			memcpy(dst + y * row, src + (size_t) y * buf->stride * header->bytes_per_pixel, row);
+		header->size = row * buf->height;
+
+		capture_gralloc->unlock(capture_gralloc, buf->handle);
+	} else {
+		TRACE("buf:%p could not be captured", buf);
+	}
+
+	HYBRIS_TRACE_END("eglplatformcommon", "capture_frame", "-%u", header->sequence);
+}
+
+static void *
+capture_writer(void *data)
+{
+	std::vector<hybris_capture_index_entry> index;
+	hybris_capture_file_header header;
+	uint64_t offset;
+	bool failed = false;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, HYBRIS_CAPTURE_MAGIC, sizeof(header.magic));
+	header.version = HYBRIS_CAPTURE_VERSION;
+	header.frame_header_size = sizeof(hybris_capture_frame_header);
+	failed = !capture_write(&header, sizeof(header));
+	offset = sizeof(header);
+
+	pthread_mutex_lock(&capture_mutex);
+	for (;;) {
+		capture_slot *slot = &capture_ring[capture_head % capture_ring_size];
+
+		if (slot->state != CAPTURE_SLOT_READY) {
+			if (capture_finishing && capture_head == capture_tail)
+				break;
+			pthread_cond_wait(&capture_cond, &capture_mutex);
+			continue;
+		}
+		pthread_mutex_unlock(&capture_mutex);
+
+		/* a frame that could not be copied is still written, without pixels */
+		HYBRIS_TRACE_BEGIN("eglplatformcommon", "capture_write", "-%u", slot->header.sequence);
+		if (!failed) {
+			failed = !capture_write(&slot->header, sizeof(slot->header)) ||
+				 !capture_write(slot->data, slot->header.size);
+			if (failed) {
+				TRACE("writing captured frames failed: %s", strerror(errno));
+			} else {
+				hybris_capture_index_entry entry = { offset, slot->header.timestamp_ns };
+				index.push_back(entry);
+				offset += sizeof(slot->header) + slot->header.size;
+			}
+		}
+		HYBRIS_TRACE_END("eglplatformcommon", "capture_write", "-%u", slot->header.sequence);
+
+		pthread_mutex_lock(&capture_mutex);
+		if (!failed)
+			capture_stats.written++;
+		slot->state = CAPTURE_SLOT_FREE;
+		capture_head++;
+	}
+
+	capture_finish_file(index, offset);
+	pthread_mutex_unlock(&capture_mutex);
+
+	return NULL;
+}
+
+static void
+capture_atexit()
+{
+	hybris_capture_stop();
+}
+
+static void
+capture_initialize()
+{
+	char path[256];
+	const char *env;
+
+	if ((env = getenv("HYBRIS_CAPTURE_INTERVAL")) != NULL && atoi(env) > 0)
+		capture_interval = atoi(env);
+	if ((env = getenv("HYBRIS_CAPTURE_FRAMES")) != NULL && atoi(env) > 0)
+		capture_max_frames = atoi(env);
+	capture_ring_size = 4;
+	if ((env = getenv("HYBRIS_CAPTURE_RING")) != NULL && atoi(env) > 0)
+		capture_ring_size = atoi(env);
+
+	if ((env = getenv("HYBRIS_CAPTURE_FILE")) == NULL) {
+		snprintf(path, sizeof(path), "hybris-capture.%d.hcap", getpid());
+		env = path;
+	}
+
+	capture_fd = ::open(env, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (capture_fd < 0) {
+		TRACE("cannot open %s for frame capture: %s", env, strerror(errno));
+		return;
+	}
+
+	capture_ring = new capture_slot[capture_ring_size]();
+
+	if (pthread_create(&capture_thread, NULL, capture_writer, NULL) != 0) {
+		TRACE("cannot start the frame capture thread");
+		::close(capture_fd);
+		capture_fd = -1;
+		return;
+	}
+	pthread_setname_np(capture_thread, "hybris-capture");
+	capture_running = true;
+
+	atexit(capture_atexit);
+}
+
+/*
+ * The slots are allocated together for the first frame, so that
+ * capturing does not allocate while frames keep their size. Called with
+ * the mutex held, for a slot just claimed.
+ */
+static bool
+capture_reserve(capture_slot *slot, size_t size)
+{
+	if (slot->capacity >= size)
+		return true;
+
+	if (slot->data == NULL) {
+		for (unsigned int i = 0; i < capture_ring_size; i++) {
+			capture_slot *other = &capture_ring[i];
+
+			if (other->data == NULL && other->state == CAPTURE_SLOT_FREE) {
+				other->data = malloc(size);
+				other->capacity = other->data ? size : 0;
+			}
+		}
+	}
+
+	if (slot->capacity < size) {
+		void *data = realloc(slot->data, size);
+		if (data == NULL)
+			return false;
+		slot->data = data;
+		slot->capacity = size;
+	}
+
+	return true;
+}
+
+extern "C" void
+hybris_capture_init(const gralloc_module_t *gralloc)
+{
+	capture_gralloc = gralloc;
+}
+
+extern "C" void
+hybris_capture_frame(struct ANativeWindowBuffer *buf, int fence_fd)
+{
+	uint64_t timestamp = capture_now();
+	unsigned int sequence;
+	int bpp;
+
+	pthread_once(&capture_once, capture_initialize);
+	if (!capture_running || !capture_gralloc)
+		return;
+
+	/* the frames not sampled only cost this */
+	sequence = __sync_fetch_and_add(&capture_sequence, 1);
+	if (sequence % capture_interval != 0)
+		return;
+
+	bpp = capture_bytes_per_pixel(buf->format);
+	if (bpp == 0) {
+		TRACE("cannot capture buffers of format %i", buf->format);
+		return;
+	}
+
+	pthread_mutex_lock(&capture_mutex);
+	if (capture_finishing) {
+		pthread_mutex_unlock(&capture_mutex);
+		return;
+	}
+
+	capture_slot *slot = &capture_ring[capture_tail % capture_ring_size];
+	if (slot->state != CAPTURE_SLOT_FREE) {
+		capture_stats.dropped++;
+		HYBRIS_TRACE_COUNTER("eglplatformcommon", "capture_dropped", "%u", capture_stats.dropped);
+		pthread_mutex_unlock(&capture_mutex);
+		return;
+	}
+
+	/* a failed reservation leaves the slot too small, the frame has no pixels then */
+	capture_reserve(slot, (size_t) buf->width * bpp * buf->height);
+
+	hybris_capture_frame_header *header = &slot->header;
+	header->timestamp_ns = timestamp;
+	header->buffer = (uintptr_t) buf;
+	header->sequence = sequence;
+	header->width = buf->width;
+	header->height = buf->height;
+	header->format = buf->format;
+	header->bytes_per_pixel = bpp;
+	header->size = 0;
+
+	/* the writer keeps to the order slots were claimed in */
+	slot->state = CAPTURE_SLOT_FILLING;
+	capture_tail++;
+	capture_stats.captured++;
+	if (capture_max_frames && capture_stats.captured == capture_max_frames)
+		capture_finishing = true;
+	pthread_mutex_unlock(&capture_mutex);
+
+	capture_copy(slot, buf, fence_fd);
+
+	pthread_mutex_lock(&capture_mutex);
+	slot->state = CAPTURE_SLOT_READY;
+	pthread_cond_signal(&capture_cond);
+	pthread_mutex_unlock(&capture_mutex);
+}
+
+extern "C" void
+hybris_capture_stop(void)
+{
+	bool running;
+
+	pthread_mutex_lock(&capture_mutex);
+	capture_finishing = true;
+	running = capture_running;
+	capture_running = false;
+	pthread_cond_signal(&capture_cond);
+	pthread_mutex_unlock(&capture_mutex);
+
+	if (running)
+		pthread_join(capture_thread, NULL);
+}
+
+extern "C" void
+hybris_capture_get_stats(struct hybris_capture_stats *stats)
+{
+	pthread_mutex_lock(&capture_mutex);
+	*stats = capture_stats;
+	pthread_mutex_unlock(&capture_mutex);
+}
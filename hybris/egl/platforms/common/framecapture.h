@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <stdint.h>
+#include <hardware/gralloc.h>
+/* Needed for ICS window.h */
+#include <string.h>
+#include <system/window.h>
+
+/*
+ * Frames handed to hybris_capture_frame() are copied into a ring of
+ * buffers allocated with the first frame, and a background thread writes
+ * them to a single file, so that capturing costs the caller a copy of the
+ * frame but no I/O. When the writer falls behind and the ring is full,
+ * frames are dropped rather than waited for.
+ *
+ * The capture is configured from the environment when the first frame
+ * comes in:
+ *
+ *   HYBRIS_CAPTURE_FILE      file to write, hybris-capture.<pid>.hcap by default
+ *   HYBRIS_CAPTURE_INTERVAL  capture every n-th frame, 1 by default
+ *   HYBRIS_CAPTURE_FRAMES    stop after n frames, 0 (no limit) by default
+ *   HYBRIS_CAPTURE_RING      number of frames buffered, 4 by default
+ *
+ * The file starts with a hybris_capture_file_header. Each frame follows as
+ * a hybris_capture_frame_header and its pixels, rows packed without
+ * padding. Once the capture stops, an index of all frames and a
+ * hybris_capture_trailer are appended. All fields are in host byte order.
+ */
+
+#define HYBRIS_CAPTURE_MAGIC "HYBRCAP1"
+#define HYBRIS_CAPTURE_INDEX_MAGIC "HYBRIDX1"
+#define HYBRIS_CAPTURE_VERSION 1
+
+struct hybris_capture_file_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t frame_header_size;
+};
+
+struct hybris_capture_frame_header {
+	/* CLOCK_MONOTONIC time the frame was handed over */
+	uint64_t timestamp_ns;
+	/* the ANativeWindowBuffer, to tell buffers apart */
+	uint64_t buffer;
+	/* counts every frame handed over, including the ones not captured */
+	uint32_t sequence;
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;
+	uint32_t bytes_per_pixel;
+	/* bytes of pixel data following the header */
+	uint32_t size;
+};
+
+struct hybris_capture_index_entry {
+	/* file offset of the frame header */
+	uint64_t offset;
+	uint64_t timestamp_ns;
+};
+
+struct hybris_capture_trailer {
+	/* file offset of the first index entry */
+	uint64_t index_offset;
+	uint32_t frames;
+	/* frames dropped because the ring was full */
+	uint32_t dropped;
+	char magic[8];
+};
+
+struct hybris_capture_stats {
+	unsigned int captured;
+	unsigned int dropped;
+	unsigned int written;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* sets the gralloc module frames are read through */
+void hybris_capture_init(const gralloc_module_t *gralloc);
+
+/*
+ * Copies buf into the ring once the rendering fence_fd signals, unless it
+ * is -1. The buffer can be drawn into again as soon as this returns. The
+ * fence stays owned by the caller.
+ */
+void hybris_capture_frame(struct ANativeWindowBuffer *buf, int fence_fd);
+
+/* writes out the buffered frames and the index, later frames are ignored */
+void hybris_capture_stop(void);
+
+void hybris_capture_get_stats(struct hybris_capture_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FRAMECAPTURE_H */
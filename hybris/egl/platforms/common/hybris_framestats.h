@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EGL_HYBRIS_frame_stats
+#define EGL_HYBRIS_frame_stats 1
+
+#include <stdint.h>
+
+#define HYBRIS_FRAME_STATS_BUCKETS 12
+
+/*
+ * Bucket 0 counts durations under 1 ms, bucket i > 0 those from 2^(i-1)
+ * up to 2^i ms, and the last bucket everything longer than that.
+ */
+struct HybrisFrameStatsHistogram {
+    uint32_t buckets[HYBRIS_FRAME_STATS_BUCKETS];
+    uint32_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+};
+
+/*
+ * Statistics of a window surface since it was created or the statistics
+ * were last reset, collected from the buffers going through its window.
+ */
+struct HybrisFrameStats {
+    /* time the statistics cover */
+    uint64_t elapsed_ns;
+    /* how long dequeueBuffer blocked for a free buffer */
+    struct HybrisFrameStatsHistogram dequeue_wait;
+    /* time between two queued frames */
+    struct HybrisFrameStatsHistogram frame_interval;
+    /* time from queueing a frame until it was handed to the display */
+    struct HybrisFrameStatsHistogram swap_latency;
+    uint32_t queued;
+    uint32_t presented;
+    /* buffers given back unrendered with cancelBuffer */
+    uint32_t cancelled;
+    /* frames replaced by a newer one before they were presented */
+    uint32_t dropped;
+    /* vsyncs a frame that was being rendered in time came late for */
+    uint32_t missed_vsyncs;
+    /* buffers dequeued or queued, but not yet presented */
+    uint32_t buffers_in_flight;
+    uint32_t max_buffers_in_flight;
+};
+
+typedef EGLBoolean (EGLAPIENTRYP PFNEGLHYBRISGETFRAMESTATSPROC)(EGLDisplay dpy, EGLSurface surface,
+                                                                struct HybrisFrameStats *stats, EGLBoolean reset);
+
+#endif
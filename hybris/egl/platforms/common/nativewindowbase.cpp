@@ -4,6 +4,7 @@
 #include <hardware/gralloc.h>
 #include "support.h"
 #include <stdarg.h>
+#include <time.h>
 
 #if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
 extern "C" {
@@ -39,6 +40,12 @@ BaseNativeWindowBuffer::BaseNativeWindowBuffer()
 	ANativeWindowBuffer::handle = 0;
 
 	refcount = 0;
+	queuedFrame = 0;
+	memset(&queuedCrop, 0, sizeof(queuedCrop));
+	queuedTransform = 0;
+	queuedPresent = 0;
+	dequeuedTime = 0;
+	queuedTime = 0;
 }
 
 
@@ -81,6 +88,33 @@ ANativeWindowBuffer* BaseNativeWindowBuffer::getNativeBuffer() const
 	return static_cast<ANativeWindowBuffer*>(const_cast<BaseNativeWindowBuffer*>(this));
 }
 
+static int64_t monotonicNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void addSample(struct HybrisFrameStatsHistogram *histogram, int64_t ns)
+{
+	uint64_t ms;
+	int bucket = 0;
+
+	if (ns < 0)
+		ns = 0;
+	ms = ns / 1000000;
+	if (ms > 0)
+		bucket = 64 - __builtin_clzll(ms);
+	if (bucket >= HYBRIS_FRAME_STATS_BUCKETS)
+		bucket = HYBRIS_FRAME_STATS_BUCKETS - 1;
+
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	histogram->total_ns += ns;
+	if ((uint64_t) ns > histogram->max_ns)
+		histogram->max_ns = ns;
+}
+
 BaseNativeWindow::BaseNativeWindow()
 {
 	TRACE("this=%p or A %p", this, (ANativeWindow*)this);
@@ -117,11 +151,26 @@ BaseNativeWindow::BaseNativeWindow()
 	ANativeWindow::perform = &_perform;
 
 	refcount = 0;
+	frameCounter = 0;
+	lastDequeuedAge = 0;
+	bufferDequeued = false;
+	memset(&pendingCrop, 0, sizeof(pendingCrop));
+	pendingCropPostTransform = false;
+	pendingTransform = 0;
+	pendingTimestamp = NATIVE_WINDOW_TIMESTAMP_AUTO;
+
+	pthread_mutex_init(&statsMutex, NULL);
+	memset(&stats, 0, sizeof(stats));
+	statsStart = monotonicNow();
+	lastQueueTime = 0;
+	lastPresentTime = 0;
+	requestedSwapInterval = 1;
 }
 
 BaseNativeWindow::~BaseNativeWindow()
 {
 	TRACE("");
+	pthread_mutex_destroy(&statsMutex);
 	ANativeWindow::common.decRef = NULL;
 	ANativeWindow::common.incRef = NULL;
 	refcount = 0;
@@ -151,16 +200,200 @@ void BaseNativeWindow::_incRef(struct android_native_base_t* base)
 	__sync_fetch_and_add(&bnw->refcount,1);
 }
 
+/*
+ * A buffer's age is the number of frames since its contents were queued,
+ * so 1 means it holds the previous frame. Buffers that were never queued
+ * have undefined contents and an age of 0.
+ */
+void BaseNativeWindow::bufferWasDequeued(BaseNativeWindowBuffer *buffer, int64_t waitStart)
+{
+	if (!buffer)
+		return;
+
+	if (buffer->queuedFrame == 0 || buffer->queuedFrame > frameCounter)
+		lastDequeuedAge = 0;
+	else
+		lastDequeuedAge = (int) (frameCounter - buffer->queuedFrame + 1);
+
+	bufferDequeued = true;
+
+	buffer->dequeuedTime = monotonicNow();
+	pthread_mutex_lock(&statsMutex);
+	addSample(&stats.dequeue_wait, buffer->dequeuedTime - waitStart);
+	if (++stats.buffers_in_flight > stats.max_buffers_in_flight)
+		stats.max_buffers_in_flight = stats.buffers_in_flight;
+	pthread_mutex_unlock(&statsMutex);
+}
+
+/*
+ * Maps a crop given after the transform, i.e. in display orientation, back
+ * onto the buffer. The transform flips first and then rotates by 90
+ * degrees clockwise, so this undoes the rotation before the flips.
+ */
+static android_native_rect_t untransformCrop(const android_native_rect_t &crop, uint32_t transform,
+					     int width, int height)
+{
+	android_native_rect_t r = crop;
+
+	if (transform & NATIVE_WINDOW_TRANSFORM_ROT_90) {
+		r.left = crop.top;
+		r.right = crop.bottom;
+		r.top = height - crop.right;
+		r.bottom = height - crop.left;
+	}
+	if (transform & NATIVE_WINDOW_TRANSFORM_FLIP_H) {
+		int32_t left = r.left;
+		r.left = width - r.right;
+		r.right = width - left;
+	}
+	if (transform & NATIVE_WINDOW_TRANSFORM_FLIP_V) {
+		int32_t top = r.top;
+		r.top = height - r.bottom;
+		r.bottom = height - top;
+	}
+
+	return r;
+}
+
+void BaseNativeWindow::bufferWasQueued(BaseNativeWindowBuffer *buffer)
+{
+	buffer->queuedFrame = ++frameCounter;
+	bufferDequeued = false;
+
+	buffer->queuedTransform = pendingTransform;
+	if (pendingCropPostTransform)
+		buffer->queuedCrop = untransformCrop(pendingCrop, pendingTransform,
+						     buffer->width, buffer->height);
+	else
+		buffer->queuedCrop = pendingCrop;
+	buffer->queuedPresent = pendingTimestamp == NATIVE_WINDOW_TIMESTAMP_AUTO ? 0 : pendingTimestamp;
+
+	buffer->queuedTime = monotonicNow();
+	pthread_mutex_lock(&statsMutex);
+	stats.queued++;
+	if (lastQueueTime)
+		addSample(&stats.frame_interval, buffer->queuedTime - lastQueueTime);
+	lastQueueTime = buffer->queuedTime;
+	pthread_mutex_unlock(&statsMutex);
+}
+
+void BaseNativeWindow::bufferWasCancelled(BaseNativeWindowBuffer *buffer)
+{
+	bufferDequeued = false;
+
+	pthread_mutex_lock(&statsMutex);
+	stats.cancelled++;
+	if (stats.buffers_in_flight > 0)
+		stats.buffers_in_flight--;
+	pthread_mutex_unlock(&statsMutex);
+}
+
+/*
+ * A frame that was presented later than the swap interval allows counts
+ * the vsyncs it missed, unless rendering it only started after the vsync
+ * it could have made, i.e. the client was idle rather than slow.
+ */
+void BaseNativeWindow::bufferWasPresented(BaseNativeWindowBuffer *buffer, int64_t vsyncPeriod)
+{
+	int64_t now = monotonicNow();
+
+	pthread_mutex_lock(&statsMutex);
+	stats.presented++;
+	addSample(&stats.swap_latency, now - buffer->queuedTime);
+	if (stats.buffers_in_flight > 0)
+		stats.buffers_in_flight--;
+
+	if (vsyncPeriod > 0 && lastPresentTime)
+	{
+		int64_t expected = requestedSwapInterval > 1 ? requestedSwapInterval : 1;
+		int64_t vsyncs = (now - lastPresentTime + vsyncPeriod / 2) / vsyncPeriod;
+
+		if (vsyncs > expected && buffer->dequeuedTime < lastPresentTime + expected * vsyncPeriod)
+			stats.missed_vsyncs += vsyncs - expected;
+	}
+	lastPresentTime = now;
+	pthread_mutex_unlock(&statsMutex);
+}
+
+void BaseNativeWindow::bufferWasDropped(BaseNativeWindowBuffer *buffer)
+{
+	pthread_mutex_lock(&statsMutex);
+	stats.dropped++;
+	if (stats.buffers_in_flight > 0)
+		stats.buffers_in_flight--;
+	pthread_mutex_unlock(&statsMutex);
+}
+
+void BaseNativeWindow::getFrameStats(struct HybrisFrameStats *out, bool reset)
+{
+	int64_t now = monotonicNow();
+
+	pthread_mutex_lock(&statsMutex);
+	*out = stats;
+	out->elapsed_ns = now - statsStart;
+	if (reset)
+	{
+		// buffers still in flight are accounted for when they land
+		uint32_t inFlight = stats.buffers_in_flight;
+		memset(&stats, 0, sizeof(stats));
+		stats.buffers_in_flight = inFlight;
+		stats.max_buffers_in_flight = inFlight;
+		statsStart = now;
+	}
+	pthread_mutex_unlock(&statsMutex);
+}
+
+int BaseNativeWindow::setCrop(const android_native_rect_t *rect, bool postTransform)
+{
+	// no crop, or an empty one, shows the whole buffer
+	if (rect && (rect->right < rect->left || rect->bottom < rect->top))
+		return BAD_VALUE;
+
+	if (rect)
+		pendingCrop = *rect;
+	else
+		memset(&pendingCrop, 0, sizeof(pendingCrop));
+	pendingCropPostTransform = postTransform;
+	return NO_ERROR;
+}
+
+int BaseNativeWindow::setBuffersTransform(int transform)
+{
+	// NATIVE_WINDOW_TRANSFORM_INVERSE_DISPLAY is only a hint for SurfaceFlinger
+	pendingTransform = transform & (NATIVE_WINDOW_TRANSFORM_FLIP_H |
+					NATIVE_WINDOW_TRANSFORM_FLIP_V |
+					NATIVE_WINDOW_TRANSFORM_ROT_90);
+	return NO_ERROR;
+}
+
+int BaseNativeWindow::setBuffersTimestamp(int64_t timestamp)
+{
+	pendingTimestamp = timestamp;
+	return NO_ERROR;
+}
+
+int BaseNativeWindow::dequeuedBufferAge() const
+{
+	return bufferDequeued ? lastDequeuedAge : 0;
+}
+
 int BaseNativeWindow::_setSwapInterval(struct ANativeWindow* window, int interval)
 {
-	return static_cast<BaseNativeWindow*>(window)->setSwapInterval(interval);
+	BaseNativeWindow *nativeWindow = static_cast<BaseNativeWindow*>(window);
+
+	pthread_mutex_lock(&nativeWindow->statsMutex);
+	nativeWindow->requestedSwapInterval = interval;
+	pthread_mutex_unlock(&nativeWindow->statsMutex);
+	return nativeWindow->setSwapInterval(interval);
 }
 
 int BaseNativeWindow::_dequeueBuffer_DEPRECATED(ANativeWindow* window, ANativeWindowBuffer** buffer)
 {
 	BaseNativeWindowBuffer* temp = static_cast<BaseNativeWindowBuffer*>(*buffer);
 	int fenceFd = -1;
-	int ret = static_cast<BaseNativeWindow*>(window)->dequeueBuffer(&temp, &fenceFd);
+	BaseNativeWindow *nativeWindow = static_cast<BaseNativeWindow*>(window);
+	int64_t start = monotonicNow();
+	int ret = nativeWindow->dequeueBuffer(&temp, &fenceFd);
 
 	*buffer = static_cast<ANativeWindowBuffer*>(temp);
 
@@ -172,13 +405,21 @@ int BaseNativeWindow::_dequeueBuffer_DEPRECATED(ANativeWindow* window, ANativeWi
 	}
 #endif
 
+	// the fence wait blocks the caller as well
+	if (ret == NO_ERROR)
+		nativeWindow->bufferWasDequeued(temp, start);
+
 	return ret;
 }
 
 int BaseNativeWindow::_dequeueBuffer(struct ANativeWindow *window, ANativeWindowBuffer **buffer, int *fenceFd)
 {
+	BaseNativeWindow *nativeWindow = static_cast<BaseNativeWindow*>(window);
 	BaseNativeWindowBuffer *nativeBuffer = static_cast<BaseNativeWindowBuffer*>(*buffer);
-	int ret = static_cast<BaseNativeWindow*>(window)->dequeueBuffer(&nativeBuffer, fenceFd);
+	int64_t start = monotonicNow();
+	int ret = nativeWindow->dequeueBuffer(&nativeBuffer, fenceFd);
+	if (ret == NO_ERROR)
+		nativeWindow->bufferWasDequeued(nativeBuffer, start);
 	*buffer = static_cast<ANativeWindowBuffer*>(nativeBuffer);
 	return ret;
 }
@@ -188,6 +429,7 @@ int BaseNativeWindow::_queueBuffer_DEPRECATED(struct ANativeWindow* window, ANat
 	BaseNativeWindow *nativeWindow = static_cast<BaseNativeWindow*>(window);
 	BaseNativeWindowBuffer *nativeBuffer = static_cast<BaseNativeWindowBuffer*>(buffer);
 
+	nativeWindow->bufferWasQueued(nativeBuffer);
 	return nativeWindow->queueBuffer(nativeBuffer, -1);
 }
 
@@ -196,6 +438,7 @@ int BaseNativeWindow::_queueBuffer(struct ANativeWindow *window, ANativeWindowBu
 	BaseNativeWindow *nativeWindow = static_cast<BaseNativeWindow*>(window);
 	BaseNativeWindowBuffer *nativeBuffer = static_cast<BaseNativeWindowBuffer*>(buffer);
 
+	nativeWindow->bufferWasQueued(nativeBuffer);
 	return nativeWindow->queueBuffer(nativeBuffer, fenceFd);
 }
 
@@ -204,6 +447,7 @@ int BaseNativeWindow::_cancelBuffer_DEPRECATED(struct ANativeWindow* window, ANa
 	BaseNativeWindow *nativeWindow = static_cast<BaseNativeWindow*>(window);
 	BaseNativeWindowBuffer *nativeBuffer = static_cast<BaseNativeWindowBuffer*>(buffer);
 
+	nativeWindow->bufferWasCancelled(nativeBuffer);
 	return nativeWindow->cancelBuffer(nativeBuffer, -1);
 }
 
@@ -212,6 +456,7 @@ int BaseNativeWindow::_cancelBuffer(struct ANativeWindow *window, ANativeWindowB
 	BaseNativeWindow *nativeWindow = static_cast<BaseNativeWindow*>(window);
 	BaseNativeWindowBuffer *nativeBuffer = static_cast<BaseNativeWindowBuffer*>(buffer);
 
+	nativeWindow->bufferWasCancelled(nativeBuffer);
 	return nativeWindow->cancelBuffer(nativeBuffer, fenceFd);
 }
 
@@ -260,6 +505,7 @@ const char *BaseNativeWindow::_native_query_operation(int what)
 #if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=1 || ANDROID_VERSION_MAJOR>=5
 		case NATIVE_WINDOW_CONSUMER_RUNNING_BEHIND: return "NATIVE_WINDOW_CONSUMER_RUNNING_BEHIND";
 #endif
+		case NATIVE_WINDOW_BUFFER_AGE: return "NATIVE_WINDOW_BUFFER_AGE";
 		default: return "NATIVE_UNKNOWN_QUERY";
 	}
 }
@@ -296,6 +542,10 @@ int BaseNativeWindow::_query(const struct ANativeWindow* window, int what, int*
 		case NATIVE_WINDOW_MIN_UNDEQUEUED_BUFFERS:
 			*value = 1;
 			return NO_ERROR;
+		case NATIVE_WINDOW_BUFFER_AGE:
+			// 0 unless a buffer is dequeued, its contents are unknown otherwise
+			*value = self->dequeuedBufferAge();
+			return NO_ERROR;
 	}
 	TRACE("EGL error: unkown window attribute! %i", what);
 	*value = 0;
@@ -324,8 +574,11 @@ int BaseNativeWindow::_perform(struct ANativeWindow* window, int operation, ...
 		TRACE("disconnect");
 		break;
 	case NATIVE_WINDOW_SET_CROP                  : //  3,   /* private */
-		TRACE("set crop");
-		break;
+	{
+		android_native_rect_t const *rect = va_arg(args, android_native_rect_t const *);
+		va_end(args);
+		return self->setCrop(rect, false);
+	}
 	case NATIVE_WINDOW_SET_BUFFER_COUNT          : //  4,
 	{
 		int cnt = va_arg(args, int);
@@ -338,11 +591,17 @@ int BaseNativeWindow::_perform(struct ANativeWindow* window, int operation, ...
 		TRACE("set buffers geometry");
 		break;
 	case NATIVE_WINDOW_SET_BUFFERS_TRANSFORM     : //  6,
-		TRACE("set buffers transform");
-		break;
+	{
+		int transform = va_arg(args, int);
+		va_end(args);
+		return self->setBuffersTransform(transform);
+	}
 	case NATIVE_WINDOW_SET_BUFFERS_TIMESTAMP     : //  7,
-		TRACE("set buffers timestamp");
-		break;
+	{
+		int64_t timestamp = va_arg(args, int64_t);
+		va_end(args);
+		return self->setBuffersTimestamp(timestamp);
+	}
 	case NATIVE_WINDOW_SET_BUFFERS_DIMENSIONS    : //  8,
 	{
 		int width  = va_arg(args, int);
@@ -376,8 +635,11 @@ int BaseNativeWindow::_perform(struct ANativeWindow* window, int operation, ...
 		TRACE("set buffers user dimensions");
 		break;
 	case NATIVE_WINDOW_SET_POST_TRANSFORM_CROP   : // 16,
-		TRACE("set post transform crop");
-		break;
+	{
+		android_native_rect_t const *rect = va_arg(args, android_native_rect_t const *);
+		va_end(args);
+		return self->setCrop(rect, true);
+	}
 #endif
 	}
 	va_end(args);
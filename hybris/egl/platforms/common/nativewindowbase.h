@@ -7,7 +7,10 @@
 #include <EGL/egl.h>
 #include "support.h"
 #include <stdarg.h>
+#include <stdint.h>
 #include <assert.h>
+#include <pthread.h>
+#include "hybris_framestats.h"
 
 #ifdef DEBUG
 #include <stdio.h>
@@ -16,6 +19,11 @@
 #define NO_ERROR                0L
 #define BAD_VALUE               -1
 
+#if ANDROID_VERSION_MAJOR<6
+/* only part of system/window.h since Android 6.0 */
+#define NATIVE_WINDOW_BUFFER_AGE 13
+#endif
+
 /**
  * @brief A Class to do common ANativeBuffer initialization and thunk c-style
  *        callbacks into C++ method calls.
@@ -31,8 +39,26 @@ public:
 	 * buffer. This method takes care about proper casting. */
 	ANativeWindowBuffer* getNativeBuffer() const;
 
+	/* What the client set through perform() when the buffer was last
+	 * queued: the area of the buffer to show, empty for all of it, the
+	 * NATIVE_WINDOW_TRANSFORM_* to show it with, and the CLOCK_MONOTONIC
+	 * time in ns it should be presented at, 0 for as soon as possible. */
+	const android_native_rect_t &getCrop() const { return queuedCrop; }
+	uint32_t getTransform() const { return queuedTransform; }
+	int64_t getDesiredPresent() const { return queuedPresent; }
+
 private:
+	friend class BaseNativeWindow;
+
 	unsigned int refcount;
+	// frame number of the last queueBuffer() of this buffer, 0 if never queued
+	uint64_t queuedFrame;
+	android_native_rect_t queuedCrop;
+	uint32_t queuedTransform;
+	int64_t queuedPresent;
+	// CLOCK_MONOTONIC ns of the last dequeueBuffer() and queueBuffer()
+	int64_t dequeuedTime;
+	int64_t queuedTime;
 	static void _decRef(struct android_native_base_t* base);
 	static void _incRef(struct android_native_base_t* base);
 };
@@ -50,6 +76,12 @@ public:
 		return ret;
 	}
 
+	// EGL_EXT_buffer_age of the buffer dequeued for rendering, 0 when unknown
+	int dequeuedBufferAge() const;
+
+	// EGL_HYBRIS_frame_stats of the window, cleared afterwards on reset
+	void getFrameStats(struct HybrisFrameStats *stats, bool reset);
+
 protected:
 	BaseNativeWindow();
 	virtual ~BaseNativeWindow();
@@ -59,6 +91,26 @@ protected:
 	static void _decRef(struct android_native_base_t* base);
 	static void _incRef(struct android_native_base_t* base);
 
+	// buffer age bookkeeping, see dequeuedBufferAge()
+	uint64_t frameCounter;
+	int lastDequeuedAge;
+	bool bufferDequeued;
+	void bufferWasDequeued(BaseNativeWindowBuffer *buffer, int64_t waitStart);
+	void bufferWasQueued(BaseNativeWindowBuffer *buffer);
+	void bufferWasCancelled(BaseNativeWindowBuffer *buffer);
+
+	// to be called by the implementation, from any thread, once a queued
+	// buffer went to the display, with the display's vsync period in ns
+	// or 0 when unknown, or when it was replaced by a newer one unseen
+	void bufferWasPresented(BaseNativeWindowBuffer *buffer, int64_t vsyncPeriod);
+	void bufferWasDropped(BaseNativeWindowBuffer *buffer);
+
+	// set through perform(), handed to each buffer as it is queued
+	android_native_rect_t pendingCrop;
+	bool pendingCropPostTransform;
+	uint32_t pendingTransform;
+	int64_t pendingTimestamp;
+
 	// these have to be implemented in the concrete implementation, eg. FBDEV or offscreen window
 	virtual int setSwapInterval(int interval) = 0;
 
@@ -80,7 +132,20 @@ protected:
 	virtual int setBuffersDimensions(int width, int height) = 0;
 	virtual int setUsage(int usage) = 0;
 	virtual int setBufferCount(int cnt) = 0;
+	// optional, to reject what the backend cannot do; the defaults store
+	// the values for the buffers queued next
+	virtual int setCrop(const android_native_rect_t *rect, bool postTransform);
+	virtual int setBuffersTransform(int transform);
+	virtual int setBuffersTimestamp(int64_t timestamp);
 private:
+	// frame statistics, updated from the rendering and presenting threads
+	pthread_mutex_t statsMutex;
+	struct HybrisFrameStats stats;
+	int64_t statsStart;
+	int64_t lastQueueTime;
+	int64_t lastPresentTime;
+	int requestedSwapInterval;
+
 	static int _setSwapInterval(struct ANativeWindow* window, int interval);
 	static int _dequeueBuffer_DEPRECATED(ANativeWindow* window, ANativeWindowBuffer** buffer);
 	static const char *_native_window_operation(int what);
@@ -22,6 +22,8 @@
 
 #include <android-config.h>
 #include <cstring>
+#include <cstdlib>
+#include <unistd.h>
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
@@ -127,7 +129,15 @@ server_wlegl_get_server_buffer_handle(wl_client *client, wl_resource *res, uint3
 
 	usage |= GRALLOC_USAGE_HW_COMPOSER;
 
-	int ret = wlegl->alloc->alloc(wlegl->alloc, width, height, format, usage, &_handle, &_stride);
+	int ret = wlegl->pool ?
+		server_wlegl_pool_alloc(wlegl->pool, client, width, height, format, usage, &_handle, &_stride) :
+		wlegl->alloc->alloc(wlegl->alloc, width, height, format, usage, &_handle, &_stride);
+	if (ret) {
+		wl_resource_destroy(resource);
+		wl_client_post_no_memory(client);
+		return;
+	}
+
 	server_wlegl_buffer *buffer = server_wlegl_buffer_create_server(client, width, height, _stride, format, usage, _handle, wlegl);
 
 	struct wl_array ints;
@@ -147,10 +157,27 @@ server_wlegl_get_server_buffer_handle(wl_client *client, wl_resource *res, uint3
 	wl_resource_destroy(resource);
 }
 
+static void
+server_wlegl_set_acquire_fence(wl_client *client, wl_resource *res, wl_resource *buffer_res, int32_t fence)
+{
+	server_wlegl_buffer *buffer = server_wlegl_buffer_get(buffer_res);
+
+	if (!buffer) {
+		close(fence);
+		wl_resource_post_error(res, ANDROID_WLEGL_ERROR_BAD_VALUE,
+				       "wl_buffer@%u is not an android_wlegl buffer",
+				       wl_resource_get_id(buffer_res));
+		return;
+	}
+
+	server_wlegl_buffer_set_acquire_fence(buffer, fence);
+}
+
 static const struct android_wlegl_interface server_wlegl_impl = {
 	server_wlegl_create_handle,
 	server_wlegl_create_buffer,
 	server_wlegl_get_server_buffer_handle,
+	server_wlegl_set_acquire_fence,
 };
 
 static void
@@ -168,15 +195,27 @@ server_wlegl *
 server_wlegl_create(struct wl_display *display, gralloc_module_t *gralloc, alloc_device_t *alloc)
 {
 	struct server_wlegl *wlegl;
+	size_t pool_size = SERVER_WLEGL_POOL_DEFAULT_SIZE;
+	int pool_age = SERVER_WLEGL_POOL_DEFAULT_MAX_AGE;
+	const char *env;
 	int ret;
 
 	wlegl = new server_wlegl;
 
+	/* negative values are ignored */
+	if ((env = getenv("HYBRIS_WLEGL_POOL_SIZE")) != NULL && atoi(env) >= 0)
+		pool_size = (size_t) atoi(env) * 1024;
+	if ((env = getenv("HYBRIS_WLEGL_POOL_MAX_AGE")) != NULL && atoi(env) >= 0)
+		pool_age = atoi(env);
+
 	wlegl->display = display;
-	wlegl->global = wl_global_create(display, &android_wlegl_interface, 2,
+	wlegl->global = wl_global_create(display, &android_wlegl_interface, 3,
 					      wlegl, server_wlegl_bind);
 	wlegl->gralloc = (const gralloc_module_t *)gralloc;
-	wlegl->alloc = alloc;
+	wlegl->device_alloc = alloc;
+	wlegl->pool = server_wlegl_pool_create(alloc, pool_size, pool_age,
+					       wl_display_get_event_loop(display));
+	wlegl->alloc = server_wlegl_pool_device(wlegl->pool);
 
 	return wlegl;
 }
@@ -186,6 +225,11 @@ server_wlegl_destroy(server_wlegl *wlegl)
 {
 	/* FIXME: server_wlegl_buffer objects may exist */
 
+	/* buffers still allocated are freed through the pool's device, which outlives it */
+	server_wlegl_pool_destroy(wlegl->pool);
+	wlegl->pool = NULL;
+	wlegl->alloc = wlegl->device_alloc;
+
 	/* no way to release wlegl->gralloc */
 
 	/* FIXME: remove global_ */
@@ -23,7 +23,9 @@
 #include <android-config.h>
 #include <cstring>
 #include <cassert>
+#include <unistd.h>
 
+#include <ws.h>
 #include "server_wlegl_buffer.h"
 #include "server_wlegl_private.h"
 
@@ -43,11 +45,62 @@ server_wlegl_buffer_from(struct wl_resource *buffer)
 	return static_cast<server_wlegl_buffer *>(wl_resource_get_user_data(buffer));
 }
 
+server_wlegl_buffer *
+server_wlegl_buffer_get(struct wl_resource *buffer)
+{
+	if (!wl_resource_instance_of(buffer, &wl_buffer_interface, &server_wlegl_buffer_impl))
+		return NULL;
+
+	return server_wlegl_buffer_from(buffer);
+}
+
+void
+server_wlegl_buffer_set_acquire_fence(server_wlegl_buffer *buffer, int fence)
+{
+	if (buffer->acquire_fence >= 0)
+		close(buffer->acquire_fence);
+
+	buffer->acquire_fence = fence;
+}
+
+int
+server_wlegl_buffer_take_acquire_fence(server_wlegl_buffer *buffer)
+{
+	int fence = buffer->acquire_fence;
+
+	buffer->acquire_fence = -1;
+	return fence;
+}
+
+struct egl_image *
+server_wlegl_buffer_get_image(server_wlegl_buffer *buffer, EGLDisplay dpy,
+			      EGLContext ctx, const EGLint *attrib_list)
+{
+	if (!buffer->image || !egl_image_matches(buffer->image, dpy, ctx, attrib_list))
+		return NULL;
+
+	egl_image_ref(buffer->image);
+	return buffer->image;
+}
+
+void
+server_wlegl_buffer_set_image(server_wlegl_buffer *buffer, struct egl_image *image)
+{
+	egl_image_ref(image);
+	if (buffer->image)
+		egl_image_unref(buffer->image);
+	buffer->image = image;
+}
+
 static void
 server_wlegl_buffer_dtor(struct wl_resource *resource)
 {
 	server_wlegl_buffer *buffer = server_wlegl_buffer_from(resource);
+	if (buffer->image)
+		egl_image_unref(buffer->image);
 	buffer->buf->common.decRef(&buffer->buf->common);
+	if (buffer->acquire_fence >= 0)
+		close(buffer->acquire_fence);
 	delete buffer;
 }
 
@@ -66,6 +119,8 @@ server_wlegl_buffer_create(wl_client *client,
 	int ret;
 
 	buffer->wlegl = wlegl;
+	buffer->acquire_fence = -1;
+	buffer->image = NULL;
 	buffer->resource = wl_resource_create(client, &wl_buffer_interface, 1, id);
 	wl_resource_set_implementation(buffer->resource, &server_wlegl_buffer_impl, buffer, server_wlegl_buffer_dtor);
 
@@ -95,6 +150,8 @@ server_wlegl_buffer_create_server(wl_client *client,
 	int ret;
 
 	buffer->wlegl = wlegl;
+	buffer->acquire_fence = -1;
+	buffer->image = NULL;
 	buffer->resource = wl_resource_create(client, &wl_buffer_interface, 1, 0);
 	wl_resource_set_implementation(buffer->resource, &server_wlegl_buffer_impl, buffer, server_wlegl_buffer_dtor);
 
@@ -28,15 +28,23 @@
 #include <system/window.h>
 #include <hardware/gralloc.h>
 #include <wayland-server.h>
+#include <EGL/egl.h>
 #include "windowbuffer.h"
 
 struct server_wlegl;
+struct egl_image;
 
 struct server_wlegl_buffer {
 	struct wl_resource *resource;
 	server_wlegl *wlegl;
 
 	RemoteWindowBuffer *buf;
+
+	/* native fence of the client's last rendering, or -1 */
+	int acquire_fence;
+
+	/* image shared by the compositor's imports of this buffer */
+	struct egl_image *image;
 };
 
 server_wlegl_buffer *
@@ -52,4 +60,27 @@ server_wlegl_buffer_create_server(wl_client *client, int32_t width, int32_t heig
 server_wlegl_buffer *
 server_wlegl_buffer_from(struct wl_resource *);
 
+/* NULL if the wl_buffer was not created through android_wlegl */
+server_wlegl_buffer *
+server_wlegl_buffer_get(struct wl_resource *);
+
+void
+server_wlegl_buffer_set_acquire_fence(server_wlegl_buffer *buffer, int fence);
+
+/*
+ * The fence of the contents attached last, or -1 if it was taken already.
+ * The caller owns it and must wait for it before reading the buffer.
+ */
+int
+server_wlegl_buffer_take_acquire_fence(server_wlegl_buffer *buffer);
+
+/* the cached image if it was created with the same arguments, with a reference added */
+struct egl_image *
+server_wlegl_buffer_get_image(server_wlegl_buffer *buffer, EGLDisplay dpy,
+			      EGLContext ctx, const EGLint *attrib_list);
+
+/* keeps a reference to image until the wl_buffer is destroyed */
+void
+server_wlegl_buffer_set_image(server_wlegl_buffer *buffer, struct egl_image *image);
+
 #endif /* SERVER_WLEGL_BUFFER_H */
@@ -0,0 +1,389 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <android-config.h>
+#include <cstring>
+#include <stdint.h>
+#include <time.h>
+#include <list>
+#include <map>
+
+#include "server_wlegl_pool.h"
+#include "logging.h"
+
+struct pool_key {
+	/* buffers are only handed out again to the client that freed them */
+	struct wl_client *owner;
+	int width;
+	int height;
+	int format;
+	int usage;
+
+	bool operator<(const pool_key &other) const
+	{
+		if (owner != other.owner)
+			return owner < other.owner;
+		if (width != other.width)
+			return width < other.width;
+		if (height != other.height)
+			return height < other.height;
+		if (format != other.format)
+			return format < other.format;
+		return usage < other.usage;
+	}
+};
+
+struct pool_buffer {
+	pool_key key;
+	int stride;
+	size_t bytes;
+	/* when it was returned to the pool, in milliseconds */
+	uint64_t freed;
+	buffer_handle_t handle;
+};
+
+typedef std::list<pool_buffer> pool_list;
+
+struct pool_owner {
+	/* first, so that the listener can be cast back to the owner */
+	struct wl_listener destroy;
+	server_wlegl_pool *pool;
+	struct wl_client *client;
+};
+
+struct server_wlegl_pool {
+	/* first, so that the device can be cast back to the pool */
+	alloc_device_t device;
+
+	alloc_device_t *alloc;
+	size_t max_bytes;
+	int max_age;
+	struct wl_event_source *timer;
+
+	/* pooled buffers, least recently freed first, and by bucket */
+	pool_list buffers;
+	std::multimap<pool_key, pool_list::iterator> buckets;
+	/* buffers handed out, to know what is freed */
+	std::map<buffer_handle_t, pool_buffer> allocated;
+	/* clients buffers were allocated for, until they are destroyed */
+	std::map<struct wl_client *, pool_owner *> owners;
+	/* server_wlegl_pool_destroy() was called, buffers are not pooled anymore */
+	bool destroyed;
+
+	server_wlegl_pool_stats stats;
+};
+
+static uint64_t
+now_ms()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static size_t
+buffer_bytes(int stride, int height, int format)
+{
+	int bpp;
+
+	switch (format) {
+	case HAL_PIXEL_FORMAT_RGB_565:
+		bpp = 2;
+		break;
+	case HAL_PIXEL_FORMAT_RGB_888:
+		bpp = 3;
+		break;
+	default:
+		/* YUV formats are smaller, but better be safe */
+		bpp = 4;
+		break;
+	}
+
+	return (size_t) stride * height * bpp;
+}
+
+static server_wlegl_pool *
+pool_from_device(alloc_device_t *dev)
+{
+	return reinterpret_cast<server_wlegl_pool *>(dev);
+}
+
+static void
+pool_release(server_wlegl_pool *pool, pool_list::iterator it)
+{
+	std::multimap<pool_key, pool_list::iterator>::iterator b = pool->buckets.lower_bound(it->key);
+
+	while (b->second != it)
+		b++;
+	pool->buckets.erase(b);
+
+	pool->stats.buffers--;
+	pool->stats.bytes -= it->bytes;
+	pool->alloc->free(pool->alloc, it->handle);
+	pool->buffers.erase(it);
+
+	HYBRIS_TRACE_COUNTER("server-wlegl", "pool_bytes", "%zu", pool->stats.bytes);
+}
+
+static void
+pool_schedule_expiry(server_wlegl_pool *pool)
+{
+	if (!pool->timer || pool->buffers.empty())
+		return;
+
+	uint64_t now = now_ms();
+	uint64_t expires = pool->buffers.front().freed + pool->max_age;
+
+	/* a timeout of 0 would disarm the timer */
+	wl_event_source_timer_update(pool->timer, expires > now ? expires - now : 1);
+}
+
+void
+server_wlegl_pool_expire(server_wlegl_pool *pool)
+{
+	uint64_t now = now_ms();
+
+	while (!pool->buffers.empty() && pool->buffers.front().freed + pool->max_age <= now) {
+		pool_release(pool, pool->buffers.begin());
+		pool->stats.expirations++;
+	}
+}
+
+static int
+pool_timer(void *data)
+{
+	server_wlegl_pool *pool = static_cast<server_wlegl_pool *>(data);
+
+	server_wlegl_pool_expire(pool);
+	pool_schedule_expiry(pool);
+
+	return 0;
+}
+
+static void
+pool_owner_destroyed(struct wl_listener *listener, void *data)
+{
+	pool_owner *owner = reinterpret_cast<pool_owner *>(listener);
+	server_wlegl_pool *pool = owner->pool;
+
+	/* nobody may get the contents of the client's buffers anymore */
+	for (pool_list::iterator it = pool->buffers.begin(); it != pool->buffers.end(); ) {
+		pool_list::iterator next = it;
+
+		next++;
+		if (it->key.owner == owner->client)
+			pool_release(pool, it);
+		it = next;
+	}
+
+	/* and those it still has are freed straight away */
+	for (std::map<buffer_handle_t, pool_buffer>::iterator a = pool->allocated.begin();
+	     a != pool->allocated.end(); ) {
+		std::map<buffer_handle_t, pool_buffer>::iterator next = a;
+
+		next++;
+		if (a->second.key.owner == owner->client)
+			pool->allocated.erase(a);
+		a = next;
+	}
+
+	pool->owners.erase(owner->client);
+	wl_list_remove(&owner->destroy.link);
+	delete owner;
+}
+
+static void
+pool_track_owner(server_wlegl_pool *pool, struct wl_client *client)
+{
+	if (!client || pool->owners.count(client))
+		return;
+
+	pool_owner *owner = new pool_owner;
+	owner->destroy.notify = pool_owner_destroyed;
+	owner->pool = pool;
+	owner->client = client;
+	wl_client_add_destroy_listener(client, &owner->destroy);
+	pool->owners[client] = owner;
+}
+
+int
+server_wlegl_pool_alloc(server_wlegl_pool *pool, struct wl_client *owner,
+			int w, int h, int format, int usage,
+			buffer_handle_t *handle, int *stride)
+{
+	pool_key key = { owner, w, h, format, usage };
+	pool_buffer buffer;
+
+	if (!pool->timer)
+		server_wlegl_pool_expire(pool);
+
+	std::multimap<pool_key, pool_list::iterator>::iterator b = pool->buckets.find(key);
+	if (b != pool->buckets.end()) {
+		pool_list::iterator it = b->second;
+
+		buffer = *it;
+		pool->buckets.erase(b);
+		pool->buffers.erase(it);
+		pool->stats.buffers--;
+		pool->stats.bytes -= buffer.bytes;
+		pool->stats.hits++;
+		HYBRIS_TRACE_COUNTER("server-wlegl", "pool_hits", "%u", pool->stats.hits);
+	} else {
+		int ret = pool->alloc->alloc(pool->alloc, w, h, format, usage, &buffer.handle, &buffer.stride);
+		if (ret)
+			return ret;
+
+		buffer.key = key;
+		buffer.bytes = buffer_bytes(buffer.stride, h, format);
+		pool->stats.misses++;
+		HYBRIS_TRACE_COUNTER("server-wlegl", "pool_misses", "%u", pool->stats.misses);
+	}
+
+	if (!pool->destroyed)
+		pool_track_owner(pool, owner);
+	pool->allocated[buffer.handle] = buffer;
+	*handle = buffer.handle;
+	*stride = buffer.stride;
+
+	return 0;
+}
+
+static int
+pool_alloc(alloc_device_t *dev, int w, int h, int format, int usage,
+	   buffer_handle_t *handle, int *stride)
+{
+	return server_wlegl_pool_alloc(pool_from_device(dev), NULL, w, h, format, usage,
+				       handle, stride);
+}
+
+static int
+pool_free(alloc_device_t *dev, buffer_handle_t handle)
+{
+	server_wlegl_pool *pool = pool_from_device(dev);
+	std::map<buffer_handle_t, pool_buffer>::iterator a = pool->allocated.find(handle);
+
+	if (a == pool->allocated.end())
+		return pool->alloc->free(pool->alloc, handle);
+
+	pool_buffer buffer = a->second;
+	pool->allocated.erase(a);
+
+	if (pool->destroyed) {
+		int ret = pool->alloc->free(pool->alloc, handle);
+		if (pool->allocated.empty())
+			delete pool;
+		return ret;
+	}
+
+	if (buffer.bytes > pool->max_bytes)
+		return pool->alloc->free(pool->alloc, handle);
+
+	buffer.freed = now_ms();
+	pool_list::iterator it = pool->buffers.insert(pool->buffers.end(), buffer);
+	pool->buckets.insert(std::make_pair(buffer.key, it));
+	pool->stats.buffers++;
+	pool->stats.bytes += buffer.bytes;
+
+	while (pool->stats.bytes > pool->max_bytes) {
+		pool_release(pool, pool->buffers.begin());
+		pool->stats.evictions++;
+	}
+
+	if (pool->buffers.size() == 1)
+		pool_schedule_expiry(pool);
+
+	HYBRIS_TRACE_COUNTER("server-wlegl", "pool_bytes", "%zu", pool->stats.bytes);
+
+	return 0;
+}
+
+static void
+pool_dump(struct alloc_device_t *dev, char *buff, int buff_len)
+{
+	server_wlegl_pool *pool = pool_from_device(dev);
+
+	if (pool->alloc->dump)
+		pool->alloc->dump(pool->alloc, buff, buff_len);
+}
+
+static int
+pool_close(struct hw_device_t *device)
+{
+	/* the pool is destroyed with server_wlegl_pool_destroy() */
+	return 0;
+}
+
+server_wlegl_pool *
+server_wlegl_pool_create(alloc_device_t *alloc, size_t max_bytes, int max_age_ms,
+			 struct wl_event_loop *loop)
+{
+	server_wlegl_pool *pool = new server_wlegl_pool;
+
+	memset(&pool->device, 0, sizeof(pool->device));
+	pool->device.common.tag = alloc->common.tag;
+	pool->device.common.version = alloc->common.version;
+	pool->device.common.module = alloc->common.module;
+	pool->device.common.close = pool_close;
+	pool->device.alloc = pool_alloc;
+	pool->device.free = pool_free;
+	pool->device.dump = pool_dump;
+
+	pool->alloc = alloc;
+	pool->max_bytes = max_bytes;
+	pool->max_age = max_age_ms;
+	pool->timer = loop ? wl_event_loop_add_timer(loop, pool_timer, pool) : NULL;
+	pool->destroyed = false;
+	memset(&pool->stats, 0, sizeof(pool->stats));
+
+	return pool;
+}
+
+void
+server_wlegl_pool_destroy(server_wlegl_pool *pool)
+{
+	while (!pool->buffers.empty())
+		pool_release(pool, pool->buffers.begin());
+
+	if (pool->timer)
+		wl_event_source_remove(pool->timer);
+	pool->timer = NULL;
+
+	for (std::map<struct wl_client *, pool_owner *>::iterator o = pool->owners.begin();
+	     o != pool->owners.end(); o++) {
+		wl_list_remove(&o->second->destroy.link);
+		delete o->second;
+	}
+	pool->owners.clear();
+
+	/* the device stays usable until the last buffer it handed out is freed */
+	pool->destroyed = true;
+	if (pool->allocated.empty())
+		delete pool;
+}
+
+alloc_device_t *
+server_wlegl_pool_device(server_wlegl_pool *pool)
+{
+	return &pool->device;
+}
+
+void
+server_wlegl_pool_get_stats(server_wlegl_pool *pool, server_wlegl_pool_stats *stats)
+{
+	*stats = pool->stats;
+}
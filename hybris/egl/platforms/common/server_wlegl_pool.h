@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef SERVER_WLEGL_POOL_H
+#define SERVER_WLEGL_POOL_H
+
+#include <stddef.h>
+#include <hardware/gralloc.h>
+#include <wayland-server.h>
+
+/* Defaults, overridden by HYBRIS_WLEGL_POOL_SIZE (in KiB, 0 disables the
+ * pool) and HYBRIS_WLEGL_POOL_MAX_AGE (in milliseconds) */
+#define SERVER_WLEGL_POOL_DEFAULT_SIZE (32 * 1024 * 1024)
+#define SERVER_WLEGL_POOL_DEFAULT_MAX_AGE 5000
+
+struct server_wlegl_pool_stats {
+	/* allocations served from the pool and from the real device */
+	unsigned int hits;
+	unsigned int misses;
+	/* pooled buffers freed to stay within the size limit and by age */
+	unsigned int evictions;
+	unsigned int expirations;
+	/* buffers currently pooled and their estimated size */
+	unsigned int buffers;
+	size_t bytes;
+};
+
+struct server_wlegl_pool;
+
+/*
+ * Creates a pool of recently freed buffers in front of alloc. Buffers
+ * freed through the pool's device are kept for max_age_ms, up to
+ * max_bytes in total, and handed out again for allocations of the same
+ * size, format and usage by the same client. With a loop, expired
+ * buffers are freed from a timer, otherwise whenever the pool is used.
+ */
+server_wlegl_pool *
+server_wlegl_pool_create(alloc_device_t *alloc, size_t max_bytes, int max_age_ms,
+			 struct wl_event_loop *loop);
+
+/*
+ * Frees the pooled buffers. The device stays valid, without pooling,
+ * until the buffers still allocated have been freed through it.
+ */
+void
+server_wlegl_pool_destroy(server_wlegl_pool *pool);
+
+/*
+ * Allocates a buffer for owner, reusing one only the same client freed.
+ * Its pooled buffers are freed when the client is destroyed.
+ */
+int
+server_wlegl_pool_alloc(server_wlegl_pool *pool, struct wl_client *owner,
+			int w, int h, int format, int usage,
+			buffer_handle_t *handle, int *stride);
+
+/* an allocation device that goes through the pool, as a client of its own */
+alloc_device_t *
+server_wlegl_pool_device(server_wlegl_pool *pool);
+
+void
+server_wlegl_pool_get_stats(server_wlegl_pool *pool, server_wlegl_pool_stats *stats);
+
+/* frees the buffers that have been pooled for longer than the max age */
+void
+server_wlegl_pool_expire(server_wlegl_pool *pool);
+
+#endif /* SERVER_WLEGL_POOL_H */
@@ -27,6 +27,7 @@
 #include <wayland-server.h>
 
 #include "server_wlegl.h"
+#include "server_wlegl_pool.h"
 
 struct server_wlegl {
 	struct wl_display *display;
@@ -35,6 +36,11 @@ struct server_wlegl {
 
 	const gralloc_module_t *gralloc;
         alloc_device_t *alloc;
+
+	/* recycles server side buffers, alloc allocates through it */
+	server_wlegl_pool *pool;
+	/* the gralloc device behind the pool */
+	alloc_device_t *device_alloc;
 };
 
 #endif /* SERVER_WLEGL_PRIVATE_H */
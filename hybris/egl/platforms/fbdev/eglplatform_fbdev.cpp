@@ -108,6 +108,9 @@ struct ws_module ws_module_info = {
 	NULL,
 	NULL,
 	fbdevws_setSwapInterval,
+	eglplatformcommon_getBufferAge,
+	eglplatformcommon_lookupImageKHR,
+	eglplatformcommon_cacheImageKHR,
 };
 
 // vim:ts=4:sw=4:noexpandtab
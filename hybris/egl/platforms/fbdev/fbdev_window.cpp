@@ -22,12 +22,21 @@
 #include <assert.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 
 #define FRAMEBUFFER_PARTITIONS 2
 
 static pthread_cond_t _cond = PTHREAD_COND_INITIALIZER;
 static pthread_mutex_t _mutex = PTHREAD_MUTEX_INITIALIZER;
 
+static long long monotonic_usec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
 
 FbDevNativeWindowBuffer::FbDevNativeWindowBuffer(alloc_device_t* alloc_device,
                             unsigned int width,
@@ -42,6 +51,7 @@ FbDevNativeWindowBuffer::FbDevNativeWindowBuffer(alloc_device_t* alloc_device,
     busy = 0;
     status = 0;
     m_alloc = alloc_device;
+    m_queuedAt = 0;
 
     if (m_alloc) {
         status = m_alloc->alloc(m_alloc,
@@ -72,7 +82,23 @@ FbDevNativeWindow::FbDevNativeWindow( alloc_device_t* alloc,
     m_bufFormat = m_fbDev->format;
     m_usage = GRALLOC_USAGE_HW_FB;
     m_bufferCount = 0;
+    m_freeBufs = 0;
+    m_frontBuf = NULL;
     m_allocateBuffers = true;
+    m_presenting = false;
+    m_stopPresenter = false;
+    pthread_cond_init(&m_presentCond, NULL);
+
+    /*
+     * Maximum number of frames waiting to be flipped. 0 means as many as
+     * there are non-front buffers, so the client only blocks in
+     * dequeueBuffer() once every one of them is in flight. Negative
+     * values are ignored.
+     */
+    m_queueDepth = 0;
+    const char *env = getenv("HYBRIS_FBDEV_QUEUE_DEPTH");
+    if (env != NULL && atoi(env) >= 0)
+        m_queueDepth = atoi(env);
 
 #if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
     if (m_fbDev->numFramebuffers>0)
@@ -83,6 +109,11 @@ FbDevNativeWindow::FbDevNativeWindow( alloc_device_t* alloc,
     setBufferCount(FRAMEBUFFER_PARTITIONS);
 #endif
 
+    if (pthread_create(&m_presenter, NULL, presenterThread, this) != 0)
+    {
+        fprintf(stderr, "ERROR: %s: failed to start presenter thread\n", __PRETTY_FUNCTION__);
+        assert(0);
+    }
 }
 
 
@@ -90,11 +121,101 @@ FbDevNativeWindow::FbDevNativeWindow( alloc_device_t* alloc,
 
 FbDevNativeWindow::~FbDevNativeWindow()
 {
+    pthread_mutex_lock(&_mutex);
+    m_stopPresenter = true;
+    pthread_cond_signal(&m_presentCond);
+    pthread_mutex_unlock(&_mutex);
+
+    // the presenter posts whatever is still queued before it exits
+    pthread_join(m_presenter, NULL);
+    pthread_cond_destroy(&m_presentCond);
+
     destroyBuffers();
 }
 
 
 
+void* FbDevNativeWindow::presenterThread(void *data)
+{
+    static_cast<FbDevNativeWindow*>(data)->presentLoop();
+    return NULL;
+}
+
+
+
+/*
+ * Posts queued buffers to the framebuffer in order. post() usually blocks
+ * until the next vsync, so doing it here lets the client render the next
+ * frame while the previous one is being flipped.
+ */
+void FbDevNativeWindow::presentLoop()
+{
+    pthread_mutex_lock(&_mutex);
+
+    while (1)
+    {
+        while (m_postQueue.empty() && !m_stopPresenter)
+            pthread_cond_wait(&m_presentCond, &_mutex);
+
+        if (m_postQueue.empty())
+            break;
+
+        FbDevNativeWindowBuffer* fbnb = m_postQueue.front();
+        m_postQueue.pop_front();
+        m_presenting = true;
+
+        // room in the queue again
+        pthread_cond_broadcast(&_cond);
+        pthread_mutex_unlock(&_mutex);
+
+        HYBRIS_TRACE_BEGIN("fbdev-platform", "presenter-post", "-%p", fbnb);
+
+        int rv = m_fbDev->post(m_fbDev, fbnb->handle);
+        if (rv!=0)
+        {
+            fprintf(stderr,"ERROR: fb->post(%s)\n",strerror(-rv));
+        }
+        HYBRIS_TRACE_END("fbdev-platform", "presenter-post", "-%p", fbnb);
+
+#if defined(DEBUG)
+        long long latency = monotonic_usec() - fbnb->m_queuedAt;
+#endif
+
+        pthread_mutex_lock(&_mutex);
+
+        bufferWasPresented(fbnb, m_fbDev->fps > 0 ? (int64_t) (1e9 / m_fbDev->fps) : 0);
+        fbnb->busy=0;
+        m_frontBuf = fbnb;
+        m_presenting = false;
+
+        m_freeBufs++;
+
+#if defined(DEBUG)
+        HYBRIS_TRACE_COUNTER("fbdev-platform", "flip-latency-us", "%lli", latency);
+        TRACE("%p posted after %lli us, %i still queued", fbnb, latency, (int) m_postQueue.size());
+#endif
+        HYBRIS_TRACE_COUNTER("fbdev-platform", "queue-depth", "%i", (int) m_postQueue.size());
+
+        pthread_cond_broadcast(&_cond);
+    }
+
+    pthread_mutex_unlock(&_mutex);
+}
+
+
+
+/*
+ * Waits until every queued buffer has been posted. Must be called with
+ * _mutex held.
+ */
+void FbDevNativeWindow::waitForPresenterIdle()
+{
+    while (!m_postQueue.empty() || m_presenting)
+        pthread_cond_wait(&_cond, &_mutex);
+}
+
+
+
 void FbDevNativeWindow::destroyBuffers()
 {
     TRACE("");
@@ -152,7 +273,11 @@ int FbDevNativeWindow::dequeueBuffer(BaseNativeWindowBuffer** buffer, int *fence
     pthread_mutex_lock(&_mutex);
 
     if (m_allocateBuffers)
+    {
+        // buffers still owned by the presenter must not be freed under it
+        waitForPresenterIdle();
         reallocateBuffers();
+    }
 
     HYBRIS_TRACE_BEGIN("fbdev-platform", "dequeueBuffer-wait", "");
 #if defined(DEBUG)
@@ -228,7 +353,9 @@ int FbDevNativeWindow::dequeueBuffer(BaseNativeWindowBuffer** buffer, int *fence
 
 /*
  * Hook called by EGL when modifications to the render buffer are done.
- * This unlocks and post the buffer.
+ * This unlocks the buffer and hands it to the presenter thread, which
+ * posts it to the framebuffer. It only blocks if the configured queue
+ * depth has been reached.
  *
  * The window holds a reference to the buffer between dequeueBuffer and
  * either queueBuffer or cancelBuffer, so clients only need their own
@@ -256,33 +383,26 @@ int FbDevNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd)
 
     assert(fbnb->busy==1);
 
-    fbnb->busy = 2;
-
-    pthread_mutex_unlock(&_mutex);
-
-    HYBRIS_TRACE_BEGIN("fbdev-platform", "queueBuffer-post", "-%p", fbnb);
-
-    int rv = m_fbDev->post(m_fbDev, fbnb->handle);
-    if (rv!=0)
+    if (m_queueDepth > 0)
     {
-        fprintf(stderr,"ERROR: fb->post(%s)\n",strerror(-rv));
+        HYBRIS_TRACE_BEGIN("fbdev-platform", "queueBuffer-wait", "-%p", fbnb);
+        while (m_postQueue.size() >= m_queueDepth)
+            pthread_cond_wait(&_cond, &_mutex);
+        HYBRIS_TRACE_END("fbdev-platform", "queueBuffer-wait", "-%p", fbnb);
     }
-    HYBRIS_TRACE_END("fbdev-platform", "queueBuffer-post", "-%p", fbnb);
-
-    pthread_mutex_lock(&_mutex);
-
-    fbnb->busy=0;
-    m_frontBuf = fbnb;
 
-    m_freeBufs++;
+    fbnb->busy = 2;
+    fbnb->m_queuedAt = monotonic_usec();
+    m_postQueue.push_back(fbnb);
 
+    HYBRIS_TRACE_COUNTER("fbdev-platform", "queue-depth", "%i", (int) m_postQueue.size());
     TRACE("%lu %p %p",pthread_self(), m_frontBuf, fbnb);
 
-    pthread_cond_signal(&_cond);
+    pthread_cond_signal(&m_presentCond);
     pthread_mutex_unlock(&_mutex);
 
     HYBRIS_TRACE_END("fbdev-platform", "queueBuffer", "-%p", fbnb);
-    return rv;
+    return NO_ERROR;
 }
 
 
@@ -322,7 +442,7 @@ int FbDevNativeWindow::cancelBuffer(BaseNativeWindowBuffer* buffer, int fenceFd)
 
     m_freeBufs++;
 
-    pthread_cond_signal(&_cond);
+    pthread_cond_broadcast(&_cond);
     pthread_mutex_unlock(&_mutex);
 
     return 0;
@@ -20,6 +20,7 @@
 #include "nativewindowbase.h"
 #include <linux/fb.h>
 #include <hardware/gralloc.h>
+#include <pthread.h>
 
 #include <list>
 
@@ -39,6 +40,8 @@ protected:
     int busy;
     int status;
     alloc_device_t* m_alloc;
+    // when the buffer was handed to the presenter thread, in microseconds
+    long long m_queuedAt;
 };
 
 
@@ -74,6 +77,10 @@ protected:
 private:
     void destroyBuffers();
     void reallocateBuffers();
+    void waitForPresenterIdle();
+
+    static void* presenterThread(void *data);
+    void presentLoop();
 
 private:
     framebuffer_device_t* m_fbDev;
@@ -86,6 +93,15 @@ private:
 
     std::list<FbDevNativeWindowBuffer*> m_bufList;
     FbDevNativeWindowBuffer* m_frontBuf;
+
+    // buffers queued by the client and not yet posted, oldest first
+    std::list<FbDevNativeWindowBuffer*> m_postQueue;
+    unsigned int m_queueDepth;
+    bool m_presenting;
+    bool m_stopPresenter;
+    pthread_t m_presenter;
+    // signalled when m_postQueue gains a buffer or the presenter should stop
+    pthread_cond_t m_presentCond;
 };
 
 #endif
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * EGL_PLATFORM=headless renders into memory instead of a display, with a
+ * simulated consumer taking the frames. Meant for benchmarking and
+ * testing the window buffer paths on machines without Android graphics
+ * HALs. Configured through the environment:
+ *
+ *   HYBRIS_HEADLESS_SIZE       window size, "<width>x<height>", 1280x720
+ *   HYBRIS_HEADLESS_VSYNC_US   vsync period of the consumer, 16667; 0
+ *                              presents frames as soon as they are ready
+ *   HYBRIS_HEADLESS_LATENCY_US time the consumer spends on a frame, 0
+ */
+
+#include <android-config.h>
+#include <ws.h>
+#include "headless_gralloc.h"
+#include "headless_window.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+extern "C" {
+#include <eglplatformcommon.h>
+};
+
+#include "logging.h"
+
+static gralloc_module_t *gralloc = 0;
+static alloc_device_t *alloc = 0;
+
+static unsigned int window_width = 1280;
+static unsigned int window_height = 720;
+static int64_t vsync_period = 16666667;
+static int64_t consumer_latency = 0;
+
+extern "C" void headlessws_init_module(struct ws_egl_interface *egl_iface)
+{
+    const char *env;
+    int err;
+
+    err = headless_gralloc_open(&gralloc, &alloc);
+    if (err) {
+        fprintf(stderr, "ERROR: failed to open headless gralloc: (%s)\n", strerror(-err));
+        assert(0);
+    }
+
+    if ((env = getenv("HYBRIS_HEADLESS_SIZE")) != NULL) {
+        unsigned int w, h;
+        if (sscanf(env, "%ux%u", &w, &h) == 2 && w > 0 && h > 0) {
+            window_width = w;
+            window_height = h;
+        }
+    }
+    if ((env = getenv("HYBRIS_HEADLESS_VSYNC_US")) != NULL && atoi(env) >= 0)
+        vsync_period = atoi(env) * 1000LL;
+    if ((env = getenv("HYBRIS_HEADLESS_LATENCY_US")) != NULL && atoi(env) >= 0)
+        consumer_latency = atoi(env) * 1000LL;
+
+    TRACE("%ux%u, vsync %lld ns, latency %lld ns", window_width, window_height,
+          (long long) vsync_period, (long long) consumer_latency);
+    eglplatformcommon_init(egl_iface, gralloc, alloc);
+}
+
+extern "C" _EGLDisplay *headlessws_GetDisplay(EGLNativeDisplayType display)
+{
+    assert(gralloc != NULL);
+
+    _EGLDisplay *dpy = 0;
+    if (display == EGL_DEFAULT_DISPLAY) {
+        dpy = new _EGLDisplay;
+    }
+    return dpy;
+}
+
+extern "C" void headlessws_Terminate(_EGLDisplay *dpy)
+{
+    delete dpy;
+}
+
+/* there is nothing a native window could refer to, every one gets its own */
+extern "C" EGLNativeWindowType headlessws_CreateWindow(EGLNativeWindowType win, _EGLDisplay *display)
+{
+    assert(gralloc != NULL);
+
+    HeadlessNativeWindow *window = new HeadlessNativeWindow(alloc, window_width, window_height,
+                                                            HAL_PIXEL_FORMAT_RGBA_8888);
+    window->setConsumer(vsync_period, consumer_latency);
+    window->common.incRef(&window->common);
+    return (EGLNativeWindowType) static_cast<struct ANativeWindow *>(window);
+}
+
+extern "C" void headlessws_DestroyWindow(EGLNativeWindowType win)
+{
+    HeadlessNativeWindow *window = static_cast<HeadlessNativeWindow *>((struct ANativeWindow *) win);
+
+    window->common.decRef(&window->common);
+}
+
+extern "C" void headlessws_setSwapInterval(EGLDisplay dpy, EGLNativeWindowType win, EGLint interval)
+{
+    HeadlessNativeWindow *window = static_cast<HeadlessNativeWindow *>((struct ANativeWindow *) win);
+    window->setSwapInterval(interval);
+}
+
+struct ws_module ws_module_info = {
+    headlessws_init_module,
+    headlessws_GetDisplay,
+    headlessws_Terminate,
+    headlessws_CreateWindow,
+    headlessws_DestroyWindow,
+    eglplatformcommon_eglGetProcAddress,
+    eglplatformcommon_passthroughImageKHR,
+    eglplatformcommon_eglQueryString,
+    NULL,
+    NULL,
+    headlessws_setSwapInterval,
+    eglplatformcommon_getBufferAge,
+    eglplatformcommon_lookupImageKHR,
+    eglplatformcommon_cacheImageKHR,
+};
+
+// vim: noai:ts=4:sw=4:ss=4:expandtab
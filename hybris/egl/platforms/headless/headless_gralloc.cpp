@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-config.h>
+#include "headless_gralloc.h"
+#include "logging.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define HEADLESS_HANDLE_MAGIC 0x68796272
+
+/* the ints of a headless buffer handle, it carries no fds */
+enum {
+    HANDLE_MAGIC,
+    HANDLE_SIZE,
+    HANDLE_ADDR_LO,
+    HANDLE_ADDR_HI,
+    HANDLE_NUM_INTS
+};
+
+static gralloc_module_t headless_module;
+static alloc_device_t headless_alloc;
+static pthread_once_t headless_once = PTHREAD_ONCE_INIT;
+
+static int bytes_per_pixel(int format)
+{
+    switch (format) {
+    case HAL_PIXEL_FORMAT_RGBA_8888:
+    case HAL_PIXEL_FORMAT_RGBX_8888:
+    case HAL_PIXEL_FORMAT_BGRA_8888:
+        return 4;
+    case HAL_PIXEL_FORMAT_RGB_888:
+        return 3;
+    case HAL_PIXEL_FORMAT_RGB_565:
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+static void *handle_address(buffer_handle_t handle)
+{
+    if (!handle || handle->numFds != 0 || handle->numInts != HANDLE_NUM_INTS ||
+            handle->data[HANDLE_MAGIC] != HEADLESS_HANDLE_MAGIC)
+        return NULL;
+
+    uint64_t addr = (uint32_t) handle->data[HANDLE_ADDR_LO] |
+                    (uint64_t) (uint32_t) handle->data[HANDLE_ADDR_HI] << 32;
+    return (void *) (uintptr_t) addr;
+}
+
+static int headless_register_buffer(gralloc_module_t const *module, buffer_handle_t handle)
+{
+    return handle_address(handle) ? 0 : -EINVAL;
+}
+
+static int headless_unregister_buffer(gralloc_module_t const *module, buffer_handle_t handle)
+{
+    return handle_address(handle) ? 0 : -EINVAL;
+}
+
+static int headless_lock(gralloc_module_t const *module, buffer_handle_t handle, int usage,
+                         int l, int t, int w, int h, void **vaddr)
+{
+    void *addr = handle_address(handle);
+    if (!addr)
+        return -EINVAL;
+
+    *vaddr = addr;
+    return 0;
+}
+
+static int headless_unlock(gralloc_module_t const *module, buffer_handle_t handle)
+{
+    return handle_address(handle) ? 0 : -EINVAL;
+}
+
+static int headless_alloc_buffer(alloc_device_t *dev, int w, int h, int format, int usage,
+                                 buffer_handle_t *handle, int *stride)
+{
+    int bpp = bytes_per_pixel(format);
+    if (bpp == 0 || w <= 0 || h <= 0)
+        return -EINVAL;
+
+    // like most GPUs, rows start 64 byte aligned
+    int alignedStride = (w * bpp + 63) / 64 * 64 / bpp;
+    size_t size = (size_t) alignedStride * h * bpp;
+
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+        return -ENOMEM;
+
+    native_handle_t *nh = native_handle_create(0, HANDLE_NUM_INTS);
+    if (!nh) {
+        munmap(addr, size);
+        return -ENOMEM;
+    }
+    nh->data[HANDLE_MAGIC] = HEADLESS_HANDLE_MAGIC;
+    nh->data[HANDLE_SIZE] = size;
+    nh->data[HANDLE_ADDR_LO] = (uint32_t) (uintptr_t) addr;
+    nh->data[HANDLE_ADDR_HI] = (uint32_t) ((uint64_t) (uintptr_t) addr >> 32);
+
+    TRACE("%dx%d format=x%x usage=x%x stride=%d addr=%p", w, h, format, usage, alignedStride, addr);
+    *handle = nh;
+    *stride = alignedStride;
+    return 0;
+}
+
+static int headless_free_buffer(alloc_device_t *dev, buffer_handle_t handle)
+{
+    void *addr = handle_address(handle);
+    if (!addr)
+        return -EINVAL;
+
+    munmap(addr, handle->data[HANDLE_SIZE]);
+    native_handle_delete(const_cast<native_handle_t *>(handle));
+    return 0;
+}
+
+static int headless_close(hw_device_t *device)
+{
+    return 0;
+}
+
+static int headless_open(const hw_module_t *module, const char *id, hw_device_t **device)
+{
+    if (strcmp(id, GRALLOC_HARDWARE_GPU0) != 0)
+        return -EINVAL;
+
+    *device = &headless_alloc.common;
+    return 0;
+}
+
+static hw_module_methods_t headless_methods = { headless_open };
+
+static void headless_init()
+{
+    memset(&headless_module, 0, sizeof(headless_module));
+    headless_module.common.tag = HARDWARE_MODULE_TAG;
+    headless_module.common.id = GRALLOC_HARDWARE_MODULE_ID;
+    headless_module.common.name = "libhybris headless gralloc";
+    headless_module.common.author = "libhybris";
+    headless_module.common.methods = &headless_methods;
+    headless_module.registerBuffer = headless_register_buffer;
+    headless_module.unregisterBuffer = headless_unregister_buffer;
+    headless_module.lock = headless_lock;
+    headless_module.unlock = headless_unlock;
+
+    memset(&headless_alloc, 0, sizeof(headless_alloc));
+    headless_alloc.common.tag = HARDWARE_DEVICE_TAG;
+    headless_alloc.common.module = &headless_module.common;
+    headless_alloc.common.close = headless_close;
+    headless_alloc.alloc = headless_alloc_buffer;
+    headless_alloc.free = headless_free_buffer;
+}
+
+int headless_gralloc_open(gralloc_module_t **module, alloc_device_t **alloc)
+{
+    pthread_once(&headless_once, headless_init);
+
+    *module = &headless_module;
+    return gralloc_open(&headless_module.common, alloc);
+}
+
+// vim: noai:ts=4:sw=4:ss=4:expandtab
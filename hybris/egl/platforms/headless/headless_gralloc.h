@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HEADLESS_GRALLOC_H
+#define HEADLESS_GRALLOC_H
+
+#include <hardware/gralloc.h>
+
+/*
+ * A stand-in for the gralloc HAL that hands out plain memory of the
+ * calling process, so that the window code runs without any Android
+ * graphics drivers. The buffers can be locked for software rendering,
+ * but neither a GPU nor another process can use them.
+ */
+int headless_gralloc_open(gralloc_module_t **module, alloc_device_t **alloc);
+
+#endif
+// vim: noai:ts=4:sw=4:ss=4:expandtab
@@ -0,0 +1,520 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-config.h>
+#include "headless_window.h"
+#include "logging.h"
+
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
+extern "C" {
+#include <sync/sync.h>
+};
+#endif
+
+
+static int64_t monotonicNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void sleepUntil(int64_t deadline)
+{
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000LL;
+    ts.tv_nsec = deadline % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+
+
+HeadlessNativeWindowBuffer::HeadlessNativeWindowBuffer(alloc_device_t* alloc_device,
+                            unsigned int width,
+                            unsigned int height,
+                            unsigned int format,
+                            unsigned int usage)
+{
+    ANativeWindowBuffer::width  = width;
+    ANativeWindowBuffer::height = height;
+    ANativeWindowBuffer::format = format;
+    ANativeWindowBuffer::usage  = usage;
+    fenceFd = -1;
+    state = FREE;
+    status = 0;
+    m_alloc = alloc_device;
+
+    if (m_alloc) {
+        status = m_alloc->alloc(m_alloc,
+                            width, height, format, usage,
+                            &handle, &stride);
+    }
+
+    TRACE("width=%d height=%d stride=%d format=x%x usage=x%x status=%s this=%p",
+        width, height, stride, format, usage, strerror(-status), this);
+}
+
+
+
+HeadlessNativeWindowBuffer::~HeadlessNativeWindowBuffer()
+{
+    TRACE("%p", this);
+    if (m_alloc && handle)
+        m_alloc->free(m_alloc, handle);
+}
+
+
+////////////////////////////////////////////////////////////////////////////////
+HeadlessNativeWindow::HeadlessNativeWindow(alloc_device_t* alloc, unsigned int width,
+                                           unsigned int height, unsigned int format)
+{
+    pthread_mutex_init(&m_mutex, 0);
+    pthread_cond_init(&m_cond, 0);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&m_consumeCond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    const_cast<int&>(ANativeWindow::minSwapInterval) = 0;
+    const_cast<int&>(ANativeWindow::maxSwapInterval) = 4;
+    m_swapInterval = 1;
+    m_vsyncPeriod = 16666667;
+    m_latency = 0;
+    m_vsyncBase = monotonicNow();
+    m_lastLatch = 0;
+    m_alloc = alloc;
+    m_width = width;
+    m_height = height;
+    m_bufFormat = format;
+    m_usage = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE;
+    m_bufferCount = 3;
+    m_frontBuf = NULL;
+    m_stopConsumer = false;
+    m_consuming = false;
+
+    m_consumerRunning = pthread_create(&m_consumer, NULL, consumerThread, this) == 0;
+    if (!m_consumerRunning)
+        fprintf(stderr, "ERROR: %s: failed to start consumer thread\n", __PRETTY_FUNCTION__);
+}
+
+HeadlessNativeWindow::~HeadlessNativeWindow()
+{
+    pthread_mutex_lock(&m_mutex);
+    m_stopConsumer = true;
+    pthread_cond_signal(&m_consumeCond);
+    pthread_mutex_unlock(&m_mutex);
+
+    if (m_consumerRunning)
+        pthread_join(m_consumer, NULL);
+    destroyBuffers();
+
+    pthread_cond_destroy(&m_consumeCond);
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_mutex);
+}
+
+
+
+void HeadlessNativeWindow::setConsumer(int64_t vsyncPeriod, int64_t latency)
+{
+    pthread_mutex_lock(&m_mutex);
+    m_vsyncPeriod = vsyncPeriod > 0 ? vsyncPeriod : 0;
+    m_latency = latency > 0 ? latency : 0;
+    m_vsyncBase = monotonicNow();
+    pthread_cond_signal(&m_consumeCond);
+    pthread_mutex_unlock(&m_mutex);
+}
+
+
+
+void* HeadlessNativeWindow::consumerThread(void *data)
+{
+    static_cast<HeadlessNativeWindow*>(data)->consumeLoop();
+    return NULL;
+}
+
+
+
+/*
+ * Waits for the first simulated vsync at least m_swapInterval periods
+ * after the last buffer was latched; the display still refreshes only
+ * once per vsync with an interval of 0. Must be called with m_mutex held,
+ * which is dropped while waiting.
+ */
+void HeadlessNativeWindow::waitForVsync()
+{
+    if (m_vsyncPeriod == 0)
+        return;
+
+    int64_t period = m_vsyncPeriod;
+    int64_t interval = m_swapInterval > 1 ? m_swapInterval : 1;
+    int64_t now = monotonicNow();
+    int64_t vsync = m_vsyncBase + ((now - m_vsyncBase) / period + 1) * period;
+    // give or take a bit of scheduling jitter
+    while (m_lastLatch && vsync < m_lastLatch + interval * period - period / 2)
+        vsync += period;
+
+    HYBRIS_TRACE_BEGIN("headless-platform", "vsync-wait", "");
+    pthread_mutex_unlock(&m_mutex);
+    sleepUntil(vsync);
+    pthread_mutex_lock(&m_mutex);
+    HYBRIS_TRACE_END("headless-platform", "vsync-wait", "");
+}
+
+
+
+/*
+ * Takes queued buffers in order, like a compositor would: latch the
+ * oldest one on vsync, wait for the client's rendering, compose for
+ * m_latency and present. Until it is latched a buffer can still be
+ * replaced by a newer one, and the client can keep dequeueing and
+ * rendering meanwhile.
+ */
+void HeadlessNativeWindow::consumeLoop()
+{
+    pthread_mutex_lock(&m_mutex);
+
+    while (1)
+    {
+        while (m_queue.empty() && !m_stopConsumer)
+            pthread_cond_wait(&m_consumeCond, &m_mutex);
+
+        if (m_stopConsumer)
+            break;
+
+        waitForVsync();
+        if (m_queue.empty())
+            continue;
+        m_lastLatch = monotonicNow();
+
+        HeadlessNativeWindowBuffer *b = m_queue.front();
+        m_queue.pop_front();
+        m_consuming = true;
+        int fenceFd = b->fenceFd;
+        b->fenceFd = -1;
+        int64_t latency = m_latency;
+        pthread_mutex_unlock(&m_mutex);
+
+        HYBRIS_TRACE_BEGIN("headless-platform", "consume", "-%p", b);
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
+        if (fenceFd >= 0)
+        {
+            sync_wait(fenceFd, -1);
+            close(fenceFd);
+        }
+#endif
+        if (latency > 0)
+            sleepUntil(monotonicNow() + latency);
+        HYBRIS_TRACE_END("headless-platform", "consume", "-%p", b);
+
+        pthread_mutex_lock(&m_mutex);
+        m_consuming = false;
+        bufferWasPresented(b, m_vsyncPeriod);
+
+        if (m_frontBuf && m_frontBuf != b)
+        {
+            m_frontBuf->state = HeadlessNativeWindowBuffer::FREE;
+            m_freeList.push_back(m_frontBuf);
+        }
+        b->state = HeadlessNativeWindowBuffer::ON_SCREEN;
+        m_frontBuf = b;
+
+        if (m_bufList.size() == 1)
+        {
+            b->state = HeadlessNativeWindowBuffer::FREE;
+            m_freeList.push_back(b);
+        }
+
+        HYBRIS_TRACE_COUNTER("headless-platform", "queued", "%i", (int) m_queue.size());
+        pthread_cond_broadcast(&m_cond);
+    }
+
+    pthread_mutex_unlock(&m_mutex);
+}
+
+
+
+/*
+ * Waits until the consumer is not touching any buffer. Must be called
+ * with m_mutex held.
+ */
+void HeadlessNativeWindow::waitForConsumerIdle()
+{
+    while (m_consumerRunning && (!m_queue.empty() || m_consuming))
+        pthread_cond_wait(&m_cond, &m_mutex);
+}
+
+
+
+void HeadlessNativeWindow::destroyBuffers()
+{
+    TRACE("");
+
+    std::vector<HeadlessNativeWindowBuffer*>::iterator it = m_bufList.begin();
+    for (; it!=m_bufList.end(); ++it)
+    {
+        HeadlessNativeWindowBuffer* b = *it;
+        if (b->fenceFd != -1)
+        {
+            close(b->fenceFd);
+            b->fenceFd = -1;
+        }
+        b->common.decRef(&b->common);
+    }
+    m_bufList.clear();
+    m_freeList.clear();
+    m_queue.clear();
+    m_frontBuf = NULL;
+}
+
+void HeadlessNativeWindow::allocateBuffers()
+{
+    // called from dequeueBuffer with m_mutex held
+    TRACE("cnt=%d", m_bufferCount);
+
+    for (unsigned int i = 0; i < m_bufferCount; i++)
+    {
+        HeadlessNativeWindowBuffer *b
+         = new HeadlessNativeWindowBuffer(m_alloc, m_width, m_height, m_bufFormat, m_usage);
+
+        b->common.incRef(&b->common);
+
+        if (b->status) {
+            b->common.decRef(&b->common);
+            fprintf(stderr, "WARNING: %s: allocated only %d buffers out of %d\n", __PRETTY_FUNCTION__,
+                    (int) m_bufList.size(), m_bufferCount);
+            break;
+        }
+
+        m_bufList.push_back(b);
+        m_freeList.push_back(b);
+    }
+}
+
+
+
+/*
+ * 0 means a queued buffer replaces any buffer still waiting for the
+ * consumer, so queueBuffer() never waits for the display. N > 0 presents
+ * at most one buffer every N simulated vsyncs.
+ */
+int HeadlessNativeWindow::setSwapInterval(int interval)
+{
+    TRACE("interval=%i", interval);
+    if (interval < 0)
+        interval = 0;
+
+    pthread_mutex_lock(&m_mutex);
+    m_swapInterval = interval;
+    pthread_mutex_unlock(&m_mutex);
+    return 0;
+}
+
+
+int HeadlessNativeWindow::dequeueBuffer(BaseNativeWindowBuffer** buffer, int *fenceFd)
+{
+    HYBRIS_TRACE_BEGIN("headless-platform", "dequeueBuffer", "");
+
+    pthread_mutex_lock(&m_mutex);
+
+    if (m_bufList.empty())
+        allocateBuffers();
+    if (m_bufList.empty())
+    {
+        pthread_mutex_unlock(&m_mutex);
+        HYBRIS_TRACE_END("headless-platform", "dequeueBuffer", "");
+        return -ENOMEM;
+    }
+
+    HYBRIS_TRACE_BEGIN("headless-platform", "dequeueBuffer-wait", "");
+    while (m_freeList.empty())
+        pthread_cond_wait(&m_cond, &m_mutex);
+    HYBRIS_TRACE_END("headless-platform", "dequeueBuffer-wait", "");
+
+    HeadlessNativeWindowBuffer *b = m_freeList.front();
+    m_freeList.pop_front();
+    b->state = HeadlessNativeWindowBuffer::DEQUEUED;
+    *buffer = b;
+
+    // a fence given back with cancelBuffer() goes to the next user
+    *fenceFd = b->fenceFd;
+    b->fenceFd = -1;
+
+    pthread_mutex_unlock(&m_mutex);
+    HYBRIS_TRACE_END("headless-platform", "dequeueBuffer", "");
+    return 0;
+}
+
+int HeadlessNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd)
+{
+    HeadlessNativeWindowBuffer* b = (HeadlessNativeWindowBuffer*) buffer;
+    HYBRIS_TRACE_BEGIN("headless-platform", "queueBuffer", "-%p", b);
+
+    pthread_mutex_lock(&m_mutex);
+    assert(b->state == HeadlessNativeWindowBuffer::DEQUEUED);
+    b->fenceFd = fenceFd;
+
+    if (m_swapInterval == 0)
+    {
+        // mailbox, the fence of a replaced frame stays with it
+        while (!m_queue.empty())
+        {
+            HeadlessNativeWindowBuffer *old = m_queue.front();
+            m_queue.pop_front();
+            bufferWasDropped(old);
+            old->state = HeadlessNativeWindowBuffer::FREE;
+            m_freeList.push_back(old);
+        }
+        pthread_cond_broadcast(&m_cond);
+    }
+
+    b->state = HeadlessNativeWindowBuffer::QUEUED;
+    m_queue.push_back(b);
+    HYBRIS_TRACE_COUNTER("headless-platform", "queued", "%i", (int) m_queue.size());
+    pthread_cond_signal(&m_consumeCond);
+    pthread_mutex_unlock(&m_mutex);
+
+    HYBRIS_TRACE_END("headless-platform", "queueBuffer", "-%p", b);
+    return 0;
+}
+
+int HeadlessNativeWindow::cancelBuffer(BaseNativeWindowBuffer* buffer, int fenceFd)
+{
+    HeadlessNativeWindowBuffer* b = (HeadlessNativeWindowBuffer*) buffer;
+
+    pthread_mutex_lock(&m_mutex);
+    b->fenceFd = fenceFd;
+    b->state = HeadlessNativeWindowBuffer::FREE;
+    m_freeList.push_front(b);
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+    return 0;
+}
+
+int HeadlessNativeWindow::lockBuffer(BaseNativeWindowBuffer* buffer)
+{
+    return NO_ERROR;
+}
+
+unsigned int HeadlessNativeWindow::type() const
+{
+    return NATIVE_WINDOW_FRAMEBUFFER;
+}
+
+unsigned int HeadlessNativeWindow::width() const
+{
+    return m_width;
+}
+
+unsigned int HeadlessNativeWindow::height() const
+{
+    return m_height;
+}
+
+unsigned int HeadlessNativeWindow::format() const
+{
+    return m_bufFormat;
+}
+
+unsigned int HeadlessNativeWindow::defaultWidth() const
+{
+    return m_width;
+}
+
+unsigned int HeadlessNativeWindow::defaultHeight() const
+{
+    return m_height;
+}
+
+unsigned int HeadlessNativeWindow::queueLength() const
+{
+    pthread_mutex_lock(&m_mutex);
+    unsigned int rv = m_queue.size();
+    pthread_mutex_unlock(&m_mutex);
+    return rv;
+}
+
+unsigned int HeadlessNativeWindow::transformHint() const
+{
+    return 0;
+}
+
+int HeadlessNativeWindow::setUsage(int usage)
+{
+    pthread_mutex_lock(&m_mutex);
+    bool need_realloc = m_usage != (unsigned int) usage;
+    TRACE("usage=x%x realloc=%d", usage, need_realloc);
+    m_usage = usage;
+    if (need_realloc) {
+        waitForConsumerIdle();
+        destroyBuffers();
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return NO_ERROR;
+}
+
+int HeadlessNativeWindow::setBuffersFormat(int format)
+{
+    if (format == 0)
+        return NO_ERROR;
+
+    pthread_mutex_lock(&m_mutex);
+    bool need_realloc = m_bufFormat != (unsigned int) format;
+    TRACE("format=x%x realloc=%d", format, need_realloc);
+    m_bufFormat = format;
+    if (need_realloc) {
+        waitForConsumerIdle();
+        destroyBuffers();
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return NO_ERROR;
+}
+
+/*
+ * Like the other platforms, buffers always have the size of the window.
+ */
+int HeadlessNativeWindow::setBuffersDimensions(int width, int height)
+{
+    TRACE("WARN: stub. size=%ix%i", width, height);
+    return NO_ERROR;
+}
+
+int HeadlessNativeWindow::setBufferCount(int count)
+{
+    TRACE("cnt=%d", count);
+    if (count < 1)
+        return -EINVAL;
+
+    pthread_mutex_lock(&m_mutex);
+    if ((unsigned int) count != m_bufferCount) {
+        waitForConsumerIdle();
+        destroyBuffers();
+    }
+    m_bufferCount = count;
+    pthread_mutex_unlock(&m_mutex);
+    return NO_ERROR;
+}
+// vim: noai:ts=4:sw=4:ss=4:expandtab
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HEADLESS_WINDOW_H
+#define HEADLESS_WINDOW_H
+
+#include "nativewindowbase.h"
+#include <hardware/gralloc.h>
+#include <pthread.h>
+
+#include <list>
+#include <vector>
+
+
+class HeadlessNativeWindowBuffer : public BaseNativeWindowBuffer {
+friend class HeadlessNativeWindow;
+
+protected:
+    HeadlessNativeWindowBuffer(alloc_device_t* alloc,
+                               unsigned int width,
+                               unsigned int height,
+                               unsigned int format,
+                               unsigned int usage);
+    virtual ~HeadlessNativeWindowBuffer();
+
+public:
+    enum State {
+        FREE,       // owned by the window, can be dequeued
+        DEQUEUED,   // being rendered into by the client
+        QUEUED,     // waiting for the consumer
+        ON_SCREEN   // last buffer the consumer presented
+    };
+
+protected:
+    State state;
+    int fenceFd;
+    int status;
+    alloc_device_t* m_alloc;
+};
+
+
+/*
+ * A window without a display. A consumer thread stands in for the
+ * compositor: it latches queued buffers on a simulated vsync, waits for
+ * their acquire fence, spends the configured latency on each and then
+ * presents them. The previous buffer is released once the next one is
+ * presented.
+ */
+class HeadlessNativeWindow : public BaseNativeWindow {
+public:
+    HeadlessNativeWindow(alloc_device_t* alloc, unsigned int width, unsigned int height,
+                         unsigned int format);
+    ~HeadlessNativeWindow();
+
+    /*
+     * Times in ns. A vsync period of 0 presents as soon as the latency
+     * has passed, which leaves only the overhead of the window itself.
+     */
+    void setConsumer(int64_t vsyncPeriod, int64_t latency);
+
+    // overloads from BaseNativeWindow
+    virtual int setSwapInterval(int interval);
+protected:
+
+    virtual int dequeueBuffer(BaseNativeWindowBuffer** buffer, int* fenceFd);
+    virtual int queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd);
+    virtual int cancelBuffer(BaseNativeWindowBuffer* buffer, int fenceFd);
+    virtual int lockBuffer(BaseNativeWindowBuffer* buffer);
+
+    virtual unsigned int type() const;
+    virtual unsigned int width() const;
+    virtual unsigned int height() const;
+    virtual unsigned int format() const;
+    virtual unsigned int defaultWidth() const;
+    virtual unsigned int defaultHeight() const;
+    virtual unsigned int queueLength() const;
+    virtual unsigned int transformHint() const;
+    // perform calls
+    virtual int setUsage(int usage);
+    virtual int setBuffersFormat(int format);
+    virtual int setBuffersDimensions(int width, int height);
+    virtual int setBufferCount(int cnt);
+
+private:
+    void destroyBuffers();
+    void allocateBuffers();
+    void waitForConsumerIdle();
+    void waitForVsync();
+
+    static void* consumerThread(void *data);
+    void consumeLoop();
+
+private:
+    alloc_device_t* m_alloc;
+    unsigned int m_usage;
+    unsigned int m_bufFormat;
+    std::vector<HeadlessNativeWindowBuffer*> m_bufList;
+    unsigned int m_bufferCount;
+
+    // FREE buffers, least recently released first
+    std::list<HeadlessNativeWindowBuffer*> m_freeList;
+    // QUEUED buffers, oldest first
+    std::list<HeadlessNativeWindowBuffer*> m_queue;
+    HeadlessNativeWindowBuffer* m_frontBuf;
+
+    int m_width;
+    int m_height;
+
+    mutable pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+    pthread_cond_t m_consumeCond;
+    pthread_t m_consumer;
+    bool m_consumerRunning;
+    bool m_stopConsumer;
+    bool m_consuming;
+
+    int m_swapInterval;
+    int64_t m_vsyncPeriod;
+    int64_t m_latency;
+    // the simulated vsyncs are at m_vsyncBase + n * m_vsyncPeriod
+    int64_t m_vsyncBase;
+    int64_t m_lastLatch;
+};
+
+#endif
+// vim: noai:ts=4:sw=4:ss=4:expandtab
@@ -16,7 +16,6 @@ extern "C" {
 
 static gralloc_module_t *gralloc = 0;
 static alloc_device_t *alloc = 0;
-static HWComposerNativeWindow *_nativewindow = NULL;
 
 extern "C" void hwcomposerws_init_module(struct ws_egl_interface *egl_iface)
 {
@@ -54,23 +53,21 @@ extern "C" void hwcomposerws_Terminate(_EGLDisplay *dpy)
 extern "C" EGLNativeWindowType hwcomposerws_CreateWindow(EGLNativeWindowType win, _EGLDisplay *display)
 {
 	assert (gralloc != NULL);
-	assert (_nativewindow == NULL);
 
+	/* Any number of windows may exist, e.g. one per display plus overlays */
 	HWComposerNativeWindow *window = static_cast<HWComposerNativeWindow *>((ANativeWindow *) win);
 	window->setup(gralloc, alloc);
-	_nativewindow = window;
-	_nativewindow->common.incRef(&_nativewindow->common);
-	return (EGLNativeWindowType) static_cast<struct ANativeWindow *>(_nativewindow);
+	window->common.incRef(&window->common);
+	return (EGLNativeWindowType) static_cast<struct ANativeWindow *>(window);
 }
 
 extern "C" void hwcomposerws_DestroyWindow(EGLNativeWindowType win)
 {
-	assert (_nativewindow != NULL);
-	assert (static_cast<HWComposerNativeWindow *>((struct ANativeWindow *)win) == _nativewindow);
+	HWComposerNativeWindow *window = static_cast<HWComposerNativeWindow *>((struct ANativeWindow *)win);
+	assert (window != NULL);
 
-	_nativewindow->common.decRef(&_nativewindow->common);
 	/* We are done with it, refcounting will delete the window when appropriate */
-	_nativewindow = NULL;
+	window->common.decRef(&window->common);
 }
 
 extern "C" __eglMustCastToProperFunctionPointerType hwcomposerws_eglGetProcAddress(const char *procname) 
@@ -83,6 +80,12 @@ extern "C" void hwcomposerws_passthroughImageKHR(EGLContext *ctx, EGLenum *targe
 	eglplatformcommon_passthroughImageKHR(ctx, target, buffer, attrib_list);
 }
 
+extern "C" void hwcomposerws_setSwapInterval(EGLDisplay dpy, EGLNativeWindowType win, EGLint interval)
+{
+	HWComposerNativeWindow *window = static_cast<HWComposerNativeWindow *>((struct ANativeWindow *)win);
+	window->setSwapInterval(interval);
+}
+
 struct ws_module ws_module_info = {
 	hwcomposerws_init_module,
 	hwcomposerws_GetDisplay,
@@ -91,7 +94,13 @@ struct ws_module ws_module_info = {
 	hwcomposerws_DestroyWindow,
 	hwcomposerws_eglGetProcAddress,
 	hwcomposerws_passthroughImageKHR,
-	eglplatformcommon_eglQueryString
+	eglplatformcommon_eglQueryString,
+	NULL,
+	NULL,
+	hwcomposerws_setSwapInterval,
+	eglplatformcommon_getBufferAge,
+	eglplatformcommon_lookupImageKHR,
+	eglplatformcommon_cacheImageKHR,
 };
 
 // vim:ts=4:sw=4:noexpandtab
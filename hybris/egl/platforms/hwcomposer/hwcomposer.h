@@ -17,6 +17,8 @@
 #ifndef HYBRIS_HWCOMPOSER_H
 #define HYBRIS_HWCOMPOSER_H
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -27,6 +29,33 @@ struct ANativeWindowBuffer;
 typedef void (*HWCPresentCallback)(void *user_data, struct ANativeWindow *window,
                                    struct ANativeWindowBuffer *buffer);
 
+typedef struct HWCRect {
+    int left;
+    int top;
+    int right;
+    int bottom;
+} HWCRect;
+
+/** Describes how the buffers of a window should be composited.
+ *
+ * The fields map directly onto a hwc_layer_1_t, so a present callback can
+ * copy them into the layer it hands to the hwcomposer. This allows video or
+ * cursor surfaces to go to an overlay plane instead of being composited
+ * with the GPU.
+ */
+typedef struct HWCLayerInfo {
+    int display;            /**< HWC display the window is shown on */
+    int zOrder;             /**< Position in the layer list, higher is on top */
+    HWCRect sourceCrop;     /**< Area of the buffer to show */
+    HWCRect displayFrame;   /**< Where on the display to show it */
+    unsigned int transform; /**< HWC_TRANSFORM_* flags */
+    unsigned char planeAlpha;
+} HWCLayerInfo;
+
+typedef void (*HWCLayerPresentCallback)(void *user_data, struct ANativeWindow *window,
+                                        struct ANativeWindowBuffer *buffer,
+                                        const HWCLayerInfo *layer);
+
 /** Create a new HWC ANativeWindow.
  *
  * The Window can be casted to EGLNativeWindowType and used to create
@@ -47,6 +76,45 @@ typedef void (*HWCPresentCallback)(void *user_data, struct ANativeWindow *window
 struct ANativeWindow *HWCNativeWindowCreate(unsigned int width, unsigned int height, unsigned int format,
                                             HWCPresentCallback present, void *cbData);
 
+/** Create a new HWC ANativeWindow for a layer other than the framebuffer target.
+ *
+ * Works like HWCNativeWindowCreate(), but the present callback also gets
+ * the layer information that was current when the buffer was queued. Any
+ * number of such windows can exist, for example one per display plus
+ * windows meant for overlay planes. Their buffers are not allocated from
+ * the framebuffer.
+ *
+ * \param width The width of the window in pixels.
+ * \param height The height of the window in pixels.
+ * \param format The HAL format of the window.
+ * \param layer The initial layer information, or NULL to show the whole
+ *              buffer at the top left of display 0.
+ * \param present The present callback the window will use.
+ * \param cbData The callback data the window will pass along to the present callback.
+ *
+ * \sa HWCNativeWindowSetLayerInfo
+ * \sa HWCNativeWindowDestroy
+ */
+struct ANativeWindow *HWCNativeWindowCreateLayer(unsigned int width, unsigned int height, unsigned int format,
+                                                 const HWCLayerInfo *layer,
+                                                 HWCLayerPresentCallback present, void *cbData);
+
+/** Change the layer information of a HWC ANativeWindow.
+ *
+ * Applies to buffers queued after this call; buffers already queued are
+ * presented with the information they were queued with.
+ *
+ * \sa HWCNativeWindowCreateLayer
+ * \sa HWCNativeWindowGetLayerInfo
+ */
+void HWCNativeWindowSetLayerInfo(struct ANativeWindow *window, const HWCLayerInfo *layer);
+
+/** Get the current layer information of a HWC ANativeWindow.
+ *
+ * \sa HWCNativeWindowSetLayerInfo
+ */
+void HWCNativeWindowGetLayerInfo(struct ANativeWindow *window, HWCLayerInfo *layer);
+
 /** Destroy a HWC ANativeWindow.
  *
  * Destroys a native window created with HWCNativeWindowCreate().
@@ -78,6 +146,51 @@ int HWCNativeBufferGetFence(struct ANativeWindowBuffer *buf);
  */
 void HWCNativeBufferSetFence(struct ANativeWindowBuffer *buf, int fd);
 
+/** Get the layer information a buffer was queued with.
+ *
+ * Includes the crop and transform the client set on the window, e.g.
+ * through native_window_set_crop() and native_window_set_buffers_transform(),
+ * which replace the ones of the window's layer information. Lets the
+ * present callback of windows created with HWCNativeWindowCreate() have
+ * the display hardware crop and rotate as well.
+ *
+ * The buffer must be a buffer passed from the HWC layer trough the present
+ * callback of the window.
+ *
+ * \sa HWCNativeWindowSetLayerInfo
+ */
+const HWCLayerInfo *HWCNativeBufferGetLayerInfo(struct ANativeWindow *window,
+                                                struct ANativeWindowBuffer *buf);
+
+/** Get the time a buffer should be presented at.
+ *
+ * Returns the time the client set with native_window_set_buffers_timestamp()
+ * before queueing the buffer, in nanoseconds, CLOCK_MONOTONIC, or 0 for as
+ * soon as possible. Buffers are handed to the present callback about a
+ * vsync period before that time, and buffers superseded by a later one
+ * that is due as well are not presented at all.
+ *
+ * \sa HWCNativeWindowSetVsyncTimestamp
+ */
+int64_t HWCNativeBufferGetPresentTime(struct ANativeWindowBuffer *buf);
+
+/** Report a display vsync to a HWC ANativeWindow.
+ *
+ * Windows use these timestamps to honour swap intervals greater than 1,
+ * presenting a new buffer only every Nth vsync. Callers would typically
+ * forward the timestamps delivered to the hwcomposer vsync callback.
+ * Without a vsync source, intervals greater than 1 behave like 1.
+ *
+ * A swap interval of 0 never needs vsync timestamps: a newly queued buffer
+ * replaces any buffer still waiting to be presented.
+ *
+ * \param window A window created with HWCNativeWindowCreate().
+ * \param timestamp The vsync time in nanoseconds, CLOCK_MONOTONIC.
+ *
+ * \sa HWCNativeWindowCreate
+ */
+void HWCNativeWindowSetVsyncTimestamp(struct ANativeWindow *window, int64_t timestamp);
+
 #ifdef __cplusplus
 }
 #endif
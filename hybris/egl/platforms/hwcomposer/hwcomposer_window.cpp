@@ -16,13 +16,13 @@
 
 #include <android-config.h>
 #include "hwcomposer_window.h"
-#include "hwcomposer.h"
 #include "logging.h"
 
 #include <errno.h>
 #include <assert.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <time.h>
 #include <unistd.h>
 
 extern "C" {
@@ -40,6 +40,12 @@ extern "C" struct ANativeWindow *HWCNativeWindowCreate(unsigned int width, unsig
             , cb(p)
             , cb_data(d)
         {
+            startPresenter();
+        }
+
+        ~Window()
+        {
+            stopPresenter();
         }
 
         void present(HWComposerNativeWindowBuffer *b)
@@ -58,11 +64,63 @@ extern "C" struct ANativeWindow *HWCNativeWindowCreate(unsigned int width, unsig
     return w;
 }
 
+extern "C" struct ANativeWindow *HWCNativeWindowCreateLayer(unsigned int width, unsigned int height, unsigned int format, const HWCLayerInfo *layer, HWCLayerPresentCallback present, void *cb_data)
+{
+    class LayerWindow : public HWComposerNativeWindow
+    {
+    public:
+        LayerWindow(unsigned int w, unsigned int h, unsigned int f, HWCLayerPresentCallback p, void *d)
+            : HWComposerNativeWindow(w, h, f, GRALLOC_USAGE_HW_COMPOSER|GRALLOC_USAGE_HW_TEXTURE)
+            , cb(p)
+            , cb_data(d)
+        {
+            startPresenter();
+        }
+
+        ~LayerWindow()
+        {
+            stopPresenter();
+        }
+
+        void present(HWComposerNativeWindowBuffer *b)
+        {
+            cb(cb_data, static_cast<ANativeWindow *>(this), static_cast<ANativeWindowBuffer *>(b),
+               getBufferLayerInfo(b));
+        }
+
+        HWCLayerPresentCallback cb;
+        void *cb_data;
+    };
+
+    if (!present)
+        return 0;
+
+    LayerWindow *w = new LayerWindow(width, height, format, present, cb_data);
+    if (layer)
+        w->setLayerInfo(layer);
+    return w;
+}
+
+extern "C" void HWCNativeWindowSetLayerInfo(struct ANativeWindow *window, const HWCLayerInfo *layer)
+{
+    static_cast<HWComposerNativeWindow *>(window)->setLayerInfo(layer);
+}
+
+extern "C" void HWCNativeWindowGetLayerInfo(struct ANativeWindow *window, HWCLayerInfo *layer)
+{
+    static_cast<HWComposerNativeWindow *>(window)->getLayerInfo(layer);
+}
+
 extern "C" void HWCNativeWindowDestroy(struct ANativeWindow *window)
 {
     delete window;
 }
 
+extern "C" void HWCNativeWindowSetVsyncTimestamp(struct ANativeWindow *window, int64_t timestamp)
+{
+    static_cast<HWComposerNativeWindow *>(window)->notifyVsync(timestamp);
+}
+
 struct _BufferFenceAccessor : public HWComposerNativeWindowBuffer {
     int get() { return fenceFd; }
     void set(int fd) { fenceFd = fd; };
@@ -78,9 +136,15 @@ extern "C" void HWCNativeBufferSetFence(struct ANativeWindowBuffer *buf, int fd)
     static_cast<_BufferFenceAccessor *>(buf)->set(fd);
 }
 
-static pthread_cond_t _cond = PTHREAD_COND_INITIALIZER;
-static pthread_mutex_t _mutex = PTHREAD_MUTEX_INITIALIZER;
+extern "C" const HWCLayerInfo *HWCNativeBufferGetLayerInfo(struct ANativeWindow *window, struct ANativeWindowBuffer *buf)
+{
+    return static_cast<HWComposerNativeWindow *>(window)->getBufferLayerInfo(static_cast<HWComposerNativeWindowBuffer *>(buf));
+}
 
+extern "C" int64_t HWCNativeBufferGetPresentTime(struct ANativeWindowBuffer *buf)
+{
+    return static_cast<HWComposerNativeWindowBuffer *>(buf)->getDesiredPresent();
+}
 
 HWComposerNativeWindowBuffer::HWComposerNativeWindowBuffer(alloc_device_t* alloc_device,
                             unsigned int width,
@@ -93,7 +157,8 @@ HWComposerNativeWindowBuffer::HWComposerNativeWindowBuffer(alloc_device_t* alloc
     ANativeWindowBuffer::format = format;
     ANativeWindowBuffer::usage  = usage;
     fenceFd = -1;
-    busy = 0;
+    memset(&layer, 0, sizeof(layer));
+    state = FREE;
     status = 0;
     m_alloc = alloc_device;
 
@@ -119,16 +184,42 @@ HWComposerNativeWindowBuffer::~HWComposerNativeWindowBuffer()
 
 
 ////////////////////////////////////////////////////////////////////////////////
-HWComposerNativeWindow::HWComposerNativeWindow(unsigned int width, unsigned int height, unsigned int format)
+HWComposerNativeWindow::HWComposerNativeWindow(unsigned int width, unsigned int height, unsigned int format,
+                                               unsigned int usage)
 {
     pthread_mutex_init(&m_mutex, 0);
+    pthread_cond_init(&m_cond, 0);
+
+    // vsync timestamps are CLOCK_MONOTONIC, so the pacing wait must be too
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&m_presentCond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    const_cast<int&>(ANativeWindow::minSwapInterval) = 0;
+    const_cast<int&>(ANativeWindow::maxSwapInterval) = 4;
+    m_swapInterval = 1;
+    m_lastVsync = 0;
+    m_vsyncPeriod = 0;
+    m_vsyncCount = 0;
+    m_presentVsync = 0;
     m_alloc = NULL;
     m_width = width;
     m_height = height;
     m_bufFormat = format;
-    m_usage = GRALLOC_USAGE_HW_COMPOSER|GRALLOC_USAGE_HW_FB;
+    m_baseUsage = usage;
+    m_usage = usage;
+
+    memset(&m_layer, 0, sizeof(m_layer));
+    m_layer.sourceCrop.right = m_layer.displayFrame.right = width;
+    m_layer.sourceCrop.bottom = m_layer.displayFrame.bottom = height;
+    m_layer.planeAlpha = 0xff;
     m_bufferCount = 2;
-    m_nextBuffer = 0;
+    m_frontBuf = NULL;
+    m_stopPresenter = false;
+    m_presenting = false;
+    m_presenterRunning = false;
 }
 
 void HWComposerNativeWindow::setup(gralloc_module_t* gralloc, alloc_device_t* alloc)
@@ -138,7 +229,308 @@ void HWComposerNativeWindow::setup(gralloc_module_t* gralloc, alloc_device_t* al
 
 HWComposerNativeWindow::~HWComposerNativeWindow()
 {
+    // A subclass that started the presenter has stopped it by now. If it
+    // did not, stop it before anything is torn down; present() can no
+    // longer be called, so whatever is still queued is dropped.
+    if (m_presenterRunning)
+    {
+        pthread_mutex_lock(&m_mutex);
+        m_queue.clear();
+        m_stopPresenter = true;
+        pthread_cond_signal(&m_presentCond);
+        pthread_mutex_unlock(&m_mutex);
+
+        pthread_join(m_presenter, NULL);
+        m_presenterRunning = false;
+    }
+
     destroyBuffers();
+
+    pthread_cond_destroy(&m_presentCond);
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_mutex);
+}
+
+
+
+void HWComposerNativeWindow::startPresenter()
+{
+    if (m_presenterRunning)
+        return;
+
+    m_stopPresenter = false;
+    m_presenterRunning = pthread_create(&m_presenter, NULL, presenterThread, this) == 0;
+    if (!m_presenterRunning)
+        fprintf(stderr, "ERROR: %s: failed to start presenter thread, presenting from queueBuffer\n", __PRETTY_FUNCTION__);
+}
+
+
+
+void HWComposerNativeWindow::stopPresenter()
+{
+    if (!m_presenterRunning)
+        return;
+
+    pthread_mutex_lock(&m_mutex);
+    m_stopPresenter = true;
+    pthread_cond_signal(&m_presentCond);
+    pthread_mutex_unlock(&m_mutex);
+
+    pthread_join(m_presenter, NULL);
+    m_presenterRunning = false;
+}
+
+
+
+void* HWComposerNativeWindow::presenterThread(void *data)
+{
+    static_cast<HWComposerNativeWindow*>(data)->presentLoop();
+    return NULL;
+}
+
+
+
+/*
+ * Hands the oldest queued buffer to present(), without holding m_mutex so
+ * the client can keep dequeueing and rendering meanwhile. Once it has been
+ * presented, the previous on-screen buffer goes back to the free list
+ * together with the release fence present() stored on it. Must be called
+ * with m_mutex held and a buffer queued.
+ */
+void HWComposerNativeWindow::presentNext()
+{
+    if (m_swapInterval > 1)
+        waitForSwapInterval();
+    if (m_swapInterval > 0)
+        waitForPresentTime();
+    dropLateFrames();
+
+    HWComposerNativeWindowBuffer *b = m_queue.front();
+    m_queue.pop_front();
+    m_presenting = true;
+    m_presentVsync = m_vsyncCount;
+    pthread_mutex_unlock(&m_mutex);
+
+    HYBRIS_TRACE_BEGIN("hwcomposer-platform", "present", "-%p", b);
+    this->present(b);
+    HYBRIS_TRACE_END("hwcomposer-platform", "present", "-%p", b);
+
+    pthread_mutex_lock(&m_mutex);
+    m_presenting = false;
+    bufferWasPresented(b, m_vsyncPeriod);
+
+    if (m_frontBuf && m_frontBuf != b)
+    {
+        m_frontBuf->state = HWComposerNativeWindowBuffer::FREE;
+        m_freeList.push_back(m_frontBuf);
+    }
+    b->state = HWComposerNativeWindowBuffer::ON_SCREEN;
+    m_frontBuf = b;
+
+    // With a single buffer there is nothing else to render into; the
+    // release fence keeps the client from overwriting it too early.
+    if (m_bufList.size() == 1)
+    {
+        b->state = HWComposerNativeWindowBuffer::FREE;
+        m_freeList.push_back(b);
+    }
+
+    TRACE("presented %p, %d queued, %d free", b, (int) m_queue.size(), (int) m_freeList.size());
+    HYBRIS_TRACE_COUNTER("hwcomposer-platform", "queued", "%i", (int) m_queue.size());
+    HYBRIS_TRACE_COUNTER("hwcomposer-platform", "free", "%i", (int) m_freeList.size());
+
+    pthread_cond_broadcast(&m_cond);
+}
+
+
+
+void HWComposerNativeWindow::presentLoop()
+{
+    pthread_mutex_lock(&m_mutex);
+
+    while (1)
+    {
+        while (m_queue.empty() && !m_stopPresenter)
+            pthread_cond_wait(&m_presentCond, &m_mutex);
+
+        // frames queued before stopping are still presented
+        if (m_queue.empty())
+            break;
+
+        presentNext();
+    }
+
+    pthread_mutex_unlock(&m_mutex);
+}
+
+
+
+/*
+ * Waits until m_swapInterval vsyncs have passed since the last present.
+ * Gives up after a vsync period past the expected time, so presenting
+ * carries on if the vsync source goes away, e.g. when the display is
+ * blanked. Must be called with m_mutex held.
+ */
+void HWComposerNativeWindow::waitForSwapInterval()
+{
+    // nothing to pace against
+    if (m_vsyncCount == 0)
+        return;
+
+    HYBRIS_TRACE_BEGIN("hwcomposer-platform", "swapInterval-wait", "=%d", m_swapInterval);
+    while (!m_stopPresenter && m_swapInterval > 1
+            && m_vsyncCount < m_presentVsync + m_swapInterval)
+    {
+        int64_t period = m_vsyncPeriod > 0 ? m_vsyncPeriod : 16666667;
+        int64_t missing = m_presentVsync + m_swapInterval - m_vsyncCount;
+        int64_t deadline = m_lastVsync + (missing + 1) * period;
+
+        struct timespec ts;
+        ts.tv_sec = deadline / 1000000000LL;
+        ts.tv_nsec = deadline % 1000000000LL;
+        if (pthread_cond_timedwait(&m_presentCond, &m_mutex, &ts) == ETIMEDOUT)
+            break;
+    }
+    HYBRIS_TRACE_END("hwcomposer-platform", "swapInterval-wait", "");
+}
+
+
+
+static int64_t monotonicNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+
+/*
+ * Holds the next buffer back until a vsync period before its desired
+ * presentation time, so that it is on screen in time but not earlier.
+ * A time more than a second ahead is taken as bogus and the buffer
+ * presented right away, like BufferQueue does. Must be called with
+ * m_mutex held.
+ */
+void HWComposerNativeWindow::waitForPresentTime()
+{
+    int64_t period = m_vsyncPeriod > 0 ? m_vsyncPeriod : 16666667;
+
+    HYBRIS_TRACE_BEGIN("hwcomposer-platform", "presentTime-wait", "");
+    // the front buffer may be replaced while waiting
+    while (!m_stopPresenter && !m_queue.empty())
+    {
+        int64_t due = m_queue.front()->getDesiredPresent();
+        int64_t now = monotonicNow();
+        if (due == 0 || due - period <= now || due > now + 1000000000LL)
+            break;
+
+        int64_t deadline = due - period;
+        struct timespec ts;
+        ts.tv_sec = deadline / 1000000000LL;
+        ts.tv_nsec = deadline % 1000000000LL;
+        pthread_cond_timedwait(&m_presentCond, &m_mutex, &ts);
+    }
+    HYBRIS_TRACE_END("hwcomposer-platform", "presentTime-wait", "");
+}
+
+
+
+/*
+ * Drops queued frames the next frame supersedes because it is due by the
+ * next vsync as well, like a BufferQueue consumer does. Frames without a
+ * presentation time are never dropped. Must be called with m_mutex held.
+ */
+void HWComposerNativeWindow::dropLateFrames()
+{
+    int64_t period = m_vsyncPeriod > 0 ? m_vsyncPeriod : 16666667;
+    int64_t expectedPresent = monotonicNow() + period;
+
+    while (m_queue.size() > 1)
+    {
+        HWComposerNativeWindowBuffer *next = *++m_queue.begin();
+        int64_t due = next->getDesiredPresent();
+        if (due == 0 || due > expectedPresent)
+            break;
+
+        // the acquire fence stays with the buffer, as for the mailbox
+        HWComposerNativeWindowBuffer *late = m_queue.front();
+        m_queue.pop_front();
+        TRACE("dropping late %p", late);
+        bufferWasDropped(late);
+        late->state = HWComposerNativeWindowBuffer::FREE;
+        m_freeList.push_back(late);
+        pthread_cond_broadcast(&m_cond);
+        HYBRIS_TRACE_COUNTER("hwcomposer-platform", "queued", "%i", (int) m_queue.size());
+    }
+}
+
+
+
+void HWComposerNativeWindow::notifyVsync(int64_t timestamp)
+{
+    pthread_mutex_lock(&m_mutex);
+
+    int64_t elapsed = 1;
+    if (m_lastVsync != 0 && timestamp > m_lastVsync)
+    {
+        int64_t delta = timestamp - m_lastVsync;
+        // vsync may have been switched off for a while; count the missed ones
+        if (m_vsyncPeriod > 0)
+            elapsed = (delta + m_vsyncPeriod / 2) / m_vsyncPeriod;
+        if (elapsed <= 1)
+        {
+            elapsed = 1;
+            m_vsyncPeriod = delta;
+        }
+    }
+    m_lastVsync = timestamp;
+    m_vsyncCount += elapsed;
+
+    if (m_swapInterval > 1)
+        pthread_cond_signal(&m_presentCond);
+    pthread_mutex_unlock(&m_mutex);
+}
+
+
+
+void HWComposerNativeWindow::setLayerInfo(const HWCLayerInfo *layer)
+{
+    pthread_mutex_lock(&m_mutex);
+    m_layer = *layer;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+
+
+void HWComposerNativeWindow::getLayerInfo(HWCLayerInfo *layer)
+{
+    pthread_mutex_lock(&m_mutex);
+    *layer = m_layer;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+
+
+/*
+ * Layer information the buffer was queued with. Only meaningful from
+ * present().
+ */
+const HWCLayerInfo *HWComposerNativeWindow::getBufferLayerInfo(HWComposerNativeWindowBuffer *buffer)
+{
+    return &buffer->layer;
+}
+
+
+
+/*
+ * Waits until the presenter is not touching any buffer. Must be called
+ * with m_mutex held.
+ */
+void HWComposerNativeWindow::waitForPresenterIdle()
+{
+    while (!m_queue.empty() || m_presenting)
+        pthread_cond_wait(&m_cond, &m_mutex);
 }
 
 
@@ -151,10 +543,17 @@ void HWComposerNativeWindow::destroyBuffers()
     for (; it!=m_bufList.end(); ++it)
     {
         HWComposerNativeWindowBuffer* fbnb = *it;
+        if (fbnb->fenceFd != -1)
+        {
+            close(fbnb->fenceFd);
+            fbnb->fenceFd = -1;
+        }
         fbnb->common.decRef(&fbnb->common);
     }
     m_bufList.clear();
-    m_nextBuffer = 0;
+    m_freeList.clear();
+    m_queue.clear();
+    m_frontBuf = NULL;
 }
 
 
@@ -163,11 +562,23 @@ void HWComposerNativeWindow::destroyBuffers()
 /*
  * Set the swap interval for this surface.
  *
+ * 0 means a queued buffer replaces any buffer still waiting for the
+ * presenter, so queueBuffer() never waits for the display. N > 1 presents
+ * at most one buffer every N vsyncs, as reported through
+ * HWCNativeWindowSetVsyncTimestamp().
+ *
  * Returns 0 on success or -errno on error.
  */
 int HWComposerNativeWindow::setSwapInterval(int interval)
 {
-    TRACE("interval=%i WARN STUB", interval);
+    TRACE("interval=%i", interval);
+    if (interval < 0)
+        interval = 0;
+
+    pthread_mutex_lock(&m_mutex);
+    m_swapInterval = interval;
+    pthread_cond_signal(&m_presentCond);
+    pthread_mutex_unlock(&m_mutex);
     return 0;
 }
 
@@ -201,27 +612,31 @@ int HWComposerNativeWindow::dequeueBuffer(BaseNativeWindowBuffer** buffer, int *
     if (m_bufList.empty())
         allocateBuffers();
     assert(!m_bufList.empty());
-    assert(m_nextBuffer < m_bufList.size());
-
 
-    // Grabe the next available buffer in the list and assign m_nextBuffer to
-    // the next one.
-    HWComposerNativeWindowBuffer *b = m_bufList.at(m_nextBuffer);
-    TRACE("idx=%d, buffer=%p, fence=%d", m_nextBuffer, b, b->fenceFd);
+    // Only wait for the presenter here; waiting for the display to release
+    // the buffer is left to whoever consumes the fence.
+    HYBRIS_TRACE_BEGIN("hwcomposer-platform", "dequeueBuffer-wait", "");
+    while (m_freeList.empty())
+        pthread_cond_wait(&m_cond, &m_mutex);
+    HYBRIS_TRACE_END("hwcomposer-platform", "dequeueBuffer-wait", "");
+
+    HWComposerNativeWindowBuffer *b = m_freeList.front();
+    m_freeList.pop_front();
+    b->state = HWComposerNativeWindowBuffer::DEQUEUED;
+    TRACE("buffer=%p, fence=%d", b, b->fenceFd);
     *buffer = b;
-    m_nextBuffer++;
-    if (m_nextBuffer >= m_bufList.size())
-        m_nextBuffer = 0;
 
-    // assign the buffer's fence to fenceFd and close/reset our fd.
+    // Hand the release fence over to the caller, who now owns it.
     int fence = b->fenceFd;
-    if (fenceFd)
-        *fenceFd = dup(fence);
-    if (fence != -1) {
-        close(b->fenceFd);
-        b->fenceFd = -1;
+    b->fenceFd = -1;
+    if (fenceFd) {
+        *fenceFd = fence;
+    } else if (fence != -1) {
+        sync_wait(fence, -1);
+        close(fence);
     }
 
+    HYBRIS_TRACE_COUNTER("hwcomposer-platform", "free", "%i", (int) m_freeList.size());
     pthread_mutex_unlock(&m_mutex);
     HYBRIS_TRACE_END("hwcomposer-platform", "dequeueBuffer", "");
     return 0;
@@ -229,7 +644,8 @@ int HWComposerNativeWindow::dequeueBuffer(BaseNativeWindowBuffer** buffer, int *
 
 /*
  * Hook called by EGL when modifications to the render buffer are done.
- * This unlocks and post the buffer.
+ * This unlocks the buffer and queues it for the presenter thread, or
+ * presents it right away if the subclass did not start one.
  *
  * The window holds a reference to the buffer between dequeueBuffer and
  * either queueBuffer or cancelBuffer, so clients only need their own
@@ -253,9 +669,47 @@ int HWComposerNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenc
     TRACE("%lu %p %d", pthread_self(), buffer, fenceFd);
 
     pthread_mutex_lock(&m_mutex);
+    assert(b->state == HWComposerNativeWindowBuffer::DEQUEUED);
     assert(b->fenceFd == -1); // We reset it in dequeue, so it better be -1 still..
     b->fenceFd = fenceFd;
-    this->present(b);
+
+    if (m_swapInterval == 0 && !m_queue.empty())
+    {
+        // Mailbox: drop the frames nobody has seen yet. Their acquire
+        // fence stays with them so they are not reused before the GPU is
+        // done with them.
+        while (!m_queue.empty())
+        {
+            HWComposerNativeWindowBuffer *old = m_queue.front();
+            m_queue.pop_front();
+            TRACE("replacing %p", old);
+            bufferWasDropped(old);
+            old->state = HWComposerNativeWindowBuffer::FREE;
+            m_freeList.push_back(old);
+        }
+        pthread_cond_broadcast(&m_cond);
+    }
+
+    b->state = HWComposerNativeWindowBuffer::QUEUED;
+    b->layer = m_layer;
+    // crop and transform set by the client through perform() win over
+    // the layer's, HWC_TRANSFORM_* and NATIVE_WINDOW_TRANSFORM_* agree
+    const android_native_rect_t &crop = b->getCrop();
+    if (crop.right > crop.left && crop.bottom > crop.top)
+    {
+        b->layer.sourceCrop.left = crop.left;
+        b->layer.sourceCrop.top = crop.top;
+        b->layer.sourceCrop.right = crop.right;
+        b->layer.sourceCrop.bottom = crop.bottom;
+    }
+    if (b->getTransform())
+        b->layer.transform = b->getTransform();
+    m_queue.push_back(b);
+    HYBRIS_TRACE_COUNTER("hwcomposer-platform", "queued", "%i", (int) m_queue.size());
+    if (m_presenterRunning)
+        pthread_cond_signal(&m_presentCond);
+    else
+        presentNext();
     pthread_mutex_unlock(&m_mutex);
 
     TRACE("%lu %p %d", pthread_self(), b, b->fenceFd);
@@ -309,7 +763,10 @@ int HWComposerNativeWindow::cancelBuffer(BaseNativeWindowBuffer* buffer, int fen
     // Assign the fence so we can pass it on in dequeue when the buffer is
     // again acquired.
     fbnb->fenceFd = fenceFd;
+    fbnb->state = HWComposerNativeWindowBuffer::FREE;
+    m_freeList.push_front(fbnb);
 
+    pthread_cond_broadcast(&m_cond);
     pthread_mutex_unlock(&m_mutex);
     return 0;
 }
@@ -427,12 +884,16 @@ unsigned int HWComposerNativeWindow::transformHint() const
  */
 int HWComposerNativeWindow::setUsage(int usage)
 {
-    usage |= GRALLOC_USAGE_HW_COMPOSER|GRALLOC_USAGE_HW_FB;
+    usage |= m_baseUsage;
+    pthread_mutex_lock(&m_mutex);
     int need_realloc = (m_usage != (unsigned int) usage);
     TRACE("usage=x%x realloc=%d", usage, need_realloc);
     m_usage = usage;
-    if (need_realloc)
+    if (need_realloc) {
+        waitForPresenterIdle();
         destroyBuffers();
+    }
+    pthread_mutex_unlock(&m_mutex);
     return NO_ERROR;
 }
 
@@ -445,11 +906,15 @@ int HWComposerNativeWindow::setUsage(int usage)
  */
 int HWComposerNativeWindow::setBuffersFormat(int format)
 {
+    pthread_mutex_lock(&m_mutex);
     int need_realloc = ((unsigned int) format != m_bufFormat);
     TRACE("format=x%x realloc=%d", format, need_realloc);
     m_bufFormat = format;
-    if (need_realloc)
+    if (need_realloc) {
+        waitForPresenterIdle();
         destroyBuffers();
+    }
+    pthread_mutex_unlock(&m_mutex);
 
     return NO_ERROR;
 }
@@ -457,14 +922,23 @@ int HWComposerNativeWindow::setBuffersFormat(int format)
 
 /*
  * native_window_set_buffer_count(..., count)
- * Sets the number of buffers associated with this native window.
+ * Sets the number of buffers associated with this native window. With
+ * more than two buffers the client can render ahead while one buffer is
+ * on screen and another one is waiting to be presented.
  */
 int HWComposerNativeWindow::setBufferCount(int count)
 {
     TRACE("cnt=%d", count);
-    if ((unsigned int) count != m_bufferCount)
+    if (count < 1)
+        return -EINVAL;
+
+    pthread_mutex_lock(&m_mutex);
+    if ((unsigned int) count != m_bufferCount) {
+        waitForPresenterIdle();
         destroyBuffers();
+    }
     m_bufferCount = count;
+    pthread_mutex_unlock(&m_mutex);
     return NO_ERROR;
 }
 
@@ -492,10 +966,8 @@ void HWComposerNativeWindow::allocateBuffers()
         }
 
         m_bufList.push_back(b);
+        m_freeList.push_back(b);
     }
-
-    // Restart the count, to avoid out-of-bounds access if it shrinked.
-    m_nextBuffer = 0;
 }
 
 /*
@@ -18,9 +18,12 @@
 #define FBDEV_WINDOW_H
 
 #include "nativewindowbase.h"
+#include "hwcomposer.h"
 #include <linux/fb.h>
 #include <hardware/gralloc.h>
+#include <pthread.h>
 
+#include <list>
 #include <vector>
 
 
@@ -35,9 +38,19 @@ protected:
                             unsigned int usage) ;
    virtual ~HWComposerNativeWindowBuffer() ;
 
+public:
+    enum State {
+        FREE,       // owned by the window, can be dequeued
+        DEQUEUED,   // being rendered into by the client
+        QUEUED,     // waiting for the presenter thread
+        ON_SCREEN   // last buffer handed to present()
+    };
+
 protected:
-    int busy;
+    State state;
     int fenceFd;
+    // layer information at the time the buffer was queued
+    HWCLayerInfo layer;
     int status;
     alloc_device_t* m_alloc;
 };
@@ -45,16 +58,24 @@ protected:
 
 class HWComposerNativeWindow : public BaseNativeWindow {
 public:
-    HWComposerNativeWindow(unsigned int width, unsigned int height, unsigned int format);
+    HWComposerNativeWindow(unsigned int width, unsigned int height, unsigned int format,
+                           unsigned int usage = GRALLOC_USAGE_HW_COMPOSER|GRALLOC_USAGE_HW_FB);
     ~HWComposerNativeWindow();
     void setup(gralloc_module_t* gralloc, alloc_device_t* alloc);
 
 
     int getFenceBufferFd(HWComposerNativeWindowBuffer *buffer);
     void setFenceBufferFd(HWComposerNativeWindowBuffer *buffer, int fd);
-protected:
+
+    void notifyVsync(int64_t timestamp);
+
+    void setLayerInfo(const HWCLayerInfo *layer);
+    void getLayerInfo(HWCLayerInfo *layer);
+    const HWCLayerInfo *getBufferLayerInfo(HWComposerNativeWindowBuffer *buffer);
+
     // overloads from BaseNativeWindow
     virtual int setSwapInterval(int interval);
+protected:
 
     virtual int dequeueBuffer(BaseNativeWindowBuffer** buffer, int* fenceFd);
     virtual int queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd);
@@ -76,23 +97,64 @@ protected:
     virtual int setBufferCount(int cnt);
     virtual void present(HWComposerNativeWindowBuffer *buffer) = 0;
 
+    /*
+     * By default present() is called from queueBuffer(). A subclass can
+     * opt in to having it called from a separate thread instead, so the
+     * client renders the next frame while the previous one is presented.
+     * A subclass that calls startPresenter() must call stopPresenter()
+     * from its destructor, so that present() is never running while the
+     * subclass is being torn down.
+     */
+    void startPresenter();
+    void stopPresenter();
+
 private:
     void destroyBuffers();
     void allocateBuffers();
+    void waitForPresenterIdle();
+    void waitForSwapInterval();
+    void waitForPresentTime();
+    void dropLateFrames();
+
+    void presentNext();
+
+    static void* presenterThread(void *data);
+    void presentLoop();
 
 private:
     framebuffer_device_t* m_fbDev;
     alloc_device_t* m_alloc;
     unsigned int m_usage;
+    // usage flags every buffer of this window is allocated with
+    unsigned int m_baseUsage;
     unsigned int m_bufFormat;
     std::vector<HWComposerNativeWindowBuffer*> m_bufList;
     unsigned int m_bufferCount;
-    unsigned int m_nextBuffer;
+
+    // FREE buffers, least recently released first
+    std::list<HWComposerNativeWindowBuffer*> m_freeList;
+    // QUEUED buffers, oldest first
+    std::list<HWComposerNativeWindowBuffer*> m_queue;
+    HWComposerNativeWindowBuffer* m_frontBuf;
 
     int m_width;
     int m_height;
+    HWCLayerInfo m_layer;
 
     pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+    pthread_cond_t m_presentCond;
+    pthread_t m_presenter;
+    bool m_presenterRunning;
+    bool m_stopPresenter;
+    bool m_presenting;
+
+    int m_swapInterval;
+    int64_t m_lastVsync;
+    int64_t m_vsyncPeriod;
+    // vsyncs seen so far, and the count when the last buffer was presented
+    uint64_t m_vsyncCount;
+    uint64_t m_presentVsync;
 };
 
 #endif
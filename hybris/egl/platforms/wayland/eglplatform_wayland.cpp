@@ -113,7 +113,7 @@ static void registry_handle_global(void *data, wl_registry *registry, uint32_t n
 	WaylandDisplay *dpy = (WaylandDisplay *)data;
 
 	if (strcmp(interface, "android_wlegl") == 0) {
-		dpy->wlegl = static_cast<struct android_wlegl *>(wl_registry_bind(registry, name, &android_wlegl_interface, std::min(2u, version)));
+		dpy->wlegl = static_cast<struct android_wlegl *>(wl_registry_bind(registry, name, &android_wlegl_interface, std::min(3u, version)));
 	}
 }
 
@@ -252,8 +252,8 @@ extern "C" const char *waylandws_eglQueryString(EGLDisplay dpy, EGLint name, con
 	const char *ret = eglplatformcommon_eglQueryString(dpy, name, real_eglQueryString);
 	if (ret && name == EGL_EXTENSIONS)
 	{
-		static char eglextensionsbuf[512];
-		snprintf(eglextensionsbuf, 510, "%s %s", ret,
+		static char eglextensionsbuf[2048];
+		snprintf(eglextensionsbuf, sizeof(eglextensionsbuf) - 2, "%s %s", ret,
 			"EGL_EXT_swap_buffers_with_damage EGL_WL_create_wayland_buffer_from_image"
 		);
 		ret = eglextensionsbuf;
@@ -271,7 +271,8 @@ extern "C" void waylandws_finishSwap(EGLDisplay dpy, EGLNativeWindowType win)
 {
 	_init_egl_funcs(dpy);
 	WaylandNativeWindow *window = static_cast<WaylandNativeWindow *>((struct ANativeWindow *)win);
-	if (_eglCreateSyncKHR) {
+	/* without a fence for the compositor, the frame must be done before committing */
+	if (_eglCreateSyncKHR && !window->frameHasAcquireFence()) {
 		EGLSyncKHR sync = (*_eglCreateSyncKHR)(dpy, EGL_SYNC_FENCE_KHR, NULL);
 		(*_eglClientWaitSyncKHR)(dpy, sync, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
 		(*_eglDestroySyncKHR)(dpy, sync);
@@ -297,6 +298,9 @@ struct ws_module ws_module_info = {
 	waylandws_prepareSwap,
 	waylandws_finishSwap,
 	waylandws_setSwapInterval,
+	eglplatformcommon_getBufferAge,
+	eglplatformcommon_lookupImageKHR,
+	eglplatformcommon_cacheImageKHR,
 };
 
 
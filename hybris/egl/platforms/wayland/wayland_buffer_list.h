@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef WAYLAND_BUFFER_LIST_H
+#define WAYLAND_BUFFER_LIST_H
+
+#include <assert.h>
+#include <stddef.h>
+
+/* Where a buffer of a window currently is */
+enum wayland_buffer_state {
+    WAYLAND_BUFFER_ALLOCATING,  // requested from the compositor
+    WAYLAND_BUFFER_FREE,        // on the free list
+    WAYLAND_BUFFER_STALE,       // free, but from a previous buffer set
+    WAYLAND_BUFFER_DEQUEUED,    // being rendered into
+    WAYLAND_BUFFER_QUEUED,      // rendered, waiting to be attached
+    WAYLAND_BUFFER_FRONTED,     // attached, until the compositor releases it
+    WAYLAND_BUFFER_POSTED,      // foreign buffer attached by postBuffer()
+    WAYLAND_BUFFER_FAILED       // the compositor couldn't allocate it
+};
+
+/*
+ * Doubly linked list threaded through the listPrev and listNext members
+ * of T. A buffer is on at most one list at a time, so moving buffers
+ * between lists never allocates and removal doesn't need a search.
+ */
+template <class T>
+class WaylandBufferList
+{
+public:
+    WaylandBufferList() : m_head(NULL), m_tail(NULL), m_size(0) {}
+
+    bool empty() const { return m_head == NULL; }
+    int size() const { return m_size; }
+    T *front() const { return m_head; }
+    T *next(const T *item) const { return item->listNext; }
+
+    void push_back(T *item)
+    {
+        item->listPrev = m_tail;
+        item->listNext = NULL;
+        if (m_tail)
+            m_tail->listNext = item;
+        else
+            m_head = item;
+        m_tail = item;
+        m_size++;
+    }
+
+    T *pop_front()
+    {
+        T *item = m_head;
+
+        if (item)
+            remove(item);
+        return item;
+    }
+
+    void remove(T *item)
+    {
+        assert(m_size > 0);
+        if (item->listPrev)
+            item->listPrev->listNext = item->listNext;
+        else
+            m_head = item->listNext;
+        if (item->listNext)
+            item->listNext->listPrev = item->listPrev;
+        else
+            m_tail = item->listPrev;
+        item->listPrev = item->listNext = NULL;
+        m_size--;
+    }
+
+private:
+    T *m_head;
+    T *m_tail;
+    int m_size;
+};
+
+#endif
+// vim: noai:ts=4:sw=4:ss=4:expandtab
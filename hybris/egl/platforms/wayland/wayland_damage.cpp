@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "wayland_damage.h"
+
+#include <stdlib.h>
+
+/* past this many rectangles, merging pairs costs more than it saves */
+#define WAYLAND_MAX_MERGE_RECTS 128
+
+static inline long area(const struct wayland_damage_rect *r)
+{
+    return (long) r->width * r->height;
+}
+
+static void rect_union(const struct wayland_damage_rect *a,
+                       const struct wayland_damage_rect *b,
+                       struct wayland_damage_rect *out)
+{
+    int x1 = a->x < b->x ? a->x : b->x;
+    int y1 = a->y < b->y ? a->y : b->y;
+    int x2 = a->x + a->width > b->x + b->width ? a->x + a->width : b->x + b->width;
+    int y2 = a->y + a->height > b->y + b->height ? a->y + a->height : b->y + b->height;
+
+    out->x = x1;
+    out->y = y1;
+    out->width = x2 - x1;
+    out->height = y2 - y1;
+}
+
+static int coalesce(struct wayland_damage_rect *rects, int count, int max_rects)
+{
+    struct wayland_damage_rect merged;
+
+    if (max_rects < 1)
+        max_rects = 1;
+
+    if (count > WAYLAND_MAX_MERGE_RECTS) {
+        for (int i = 1; i < count; i++)
+            rect_union(&rects[0], &rects[i], &rects[0]);
+        count = 1;
+    }
+
+    while (count > max_rects) {
+        int best_i = 0, best_j = 1;
+        long best_cost = -1;
+
+        /* merge the pair whose bounding box adds the fewest extra pixels */
+        for (int i = 0; i < count; i++) {
+            for (int j = i + 1; j < count; j++) {
+                rect_union(&rects[i], &rects[j], &merged);
+                long cost = area(&merged) - area(&rects[i]) - area(&rects[j]);
+                if (best_cost < 0 || cost < best_cost) {
+                    best_cost = cost;
+                    best_i = i;
+                    best_j = j;
+                }
+            }
+        }
+
+        rect_union(&rects[best_i], &rects[best_j], &rects[best_i]);
+        rects[best_j] = rects[--count];
+    }
+
+    return count;
+}
+
+int wayland_damage_convert(const EGLint *rects, EGLint n_rects,
+                           int width, int height, int max_rects,
+                           struct wayland_damage_rect *out)
+{
+    int count = 0;
+
+    for (EGLint i = 0; i < n_rects; i++) {
+        const EGLint *r = &rects[i * 4];
+        int x1 = r[0];
+        int x2 = r[0] + r[2];
+        /* flip from the GL lower left origin */
+        int y1 = height - (r[1] + r[3]);
+        int y2 = height - r[1];
+
+        if (x1 < 0)
+            x1 = 0;
+        if (y1 < 0)
+            y1 = 0;
+        if (x2 > width)
+            x2 = width;
+        if (y2 > height)
+            y2 = height;
+
+        if (x2 <= x1 || y2 <= y1)
+            continue;
+
+        out[count].x = x1;
+        out[count].y = y1;
+        out[count].width = x2 - x1;
+        out[count].height = y2 - y1;
+        count++;
+    }
+
+    return coalesce(out, count, max_rects);
+}
+
+void wayland_surface_damage(struct wl_surface *surface, int width, int height,
+                            const EGLint *rects, EGLint n_rects, int max_rects)
+{
+    void (*damage)(struct wl_surface *, int32_t, int32_t, int32_t, int32_t) = wl_surface_damage;
+
+#ifdef WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION
+    /* buffer coordinates are what EGL hands us, so prefer them when the
+     * compositor understands them */
+    if (wl_proxy_get_version((struct wl_proxy *) surface) >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION)
+        damage = wl_surface_damage_buffer;
+#endif
+
+    if (!rects || n_rects <= 0) {
+        damage(surface, 0, 0, width, height);
+        return;
+    }
+
+    struct wayland_damage_rect *converted =
+        (struct wayland_damage_rect *) malloc(n_rects * sizeof(*converted));
+    if (!converted) {
+        damage(surface, 0, 0, width, height);
+        return;
+    }
+
+    int count = wayland_damage_convert(rects, n_rects, width, height, max_rects, converted);
+    for (int i = 0; i < count; i++)
+        damage(surface, converted[i].x, converted[i].y, converted[i].width, converted[i].height);
+
+    free(converted);
+}
+
+// vim: noai:ts=4:sw=4:ss=4:expandtab
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef WAYLAND_DAMAGE_H
+#define WAYLAND_DAMAGE_H
+
+#include <EGL/egl.h>
+extern "C" {
+#include <wayland-client.h>
+}
+
+/* Default limit of rectangles sent to the compositor for a single commit,
+ * can be overridden with HYBRIS_WAYLAND_MAX_DAMAGE_RECTS */
+#define WAYLAND_DEFAULT_MAX_DAMAGE_RECTS 16
+
+struct wayland_damage_rect {
+    int x, y, width, height;
+};
+
+/*
+ * Converts EGL damage rectangles (x, y, width, height with the origin in
+ * the lower left corner) into buffer coordinates with the origin in the
+ * upper left corner, clipped to the buffer. Empty rectangles are dropped,
+ * and if more than max_rects remain the cheapest pairs are merged until
+ * they fit. Returns the number of rectangles written to out, which must
+ * have room for n_rects entries.
+ */
+int wayland_damage_convert(const EGLint *rects, EGLint n_rects,
+                           int width, int height, int max_rects,
+                           struct wayland_damage_rect *out);
+
+/*
+ * Posts the damage for the next commit of surface, which has a buffer of
+ * width x height attached. Without rectangles the whole buffer is damaged.
+ */
+void wayland_surface_damage(struct wl_surface *surface, int width, int height,
+                            const EGLint *rects, EGLint n_rects, int max_rects);
+
+#endif
+// vim: noai:ts=4:sw=4:ss=4:expandtab
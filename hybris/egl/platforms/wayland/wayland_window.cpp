@@ -28,9 +28,13 @@
 #include <android-config.h>
 #include "wayland_window.h"
 #include "wayland-egl-priv.h"
+#include "wayland_damage.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include "logging.h"
 #include <eglhybris.h>
@@ -41,6 +45,10 @@ extern "C" {
 }
 #endif
 
+#ifndef ANDROID_WLEGL_SET_ACQUIRE_FENCE_SINCE_VERSION
+#define ANDROID_WLEGL_SET_ACQUIRE_FENCE_SINCE_VERSION 3
+#endif
+
 static void
 buffer_create_sync_callback(void *data, struct wl_callback *callback, uint32_t serial)
 {
@@ -127,20 +135,27 @@ static const struct wl_callback_listener sync_listener = {
     WaylandNativeWindow::sync_callback
 };
 
-int
-WaylandNativeWindow::wayland_roundtrip(WaylandNativeWindow *display)
+/*
+ * Waits until the compositor has processed all requests sent so far.
+ * Must be called with the window locked.
+ */
+int WaylandNativeWindow::roundtrip()
 {
     struct wl_callback *callback;
-    int done = 0, ret = 0;
-    wl_display_dispatch_queue_pending(display->m_display, display->wl_queue);
+    int done = 0;
 
-    callback = wl_display_sync(display->m_display);
+    callback = wl_display_sync(m_display);
     wl_callback_add_listener(callback, &sync_listener, &done);
-    wl_proxy_set_queue((struct wl_proxy *) callback, display->wl_queue);
-    while (ret >= 0 && !done)
-        ret = wl_display_dispatch_queue(display->m_display, display->wl_queue);
+    wl_proxy_set_queue((struct wl_proxy *) callback, wl_queue);
+    wl_display_flush(m_display);
 
-    return ret;
+    while (!done)
+    {
+        if (waitForEvents() < 0)
+            return -1;
+    }
+
+    return 0;
 }
 
 static void check_fatal_error(struct wl_display *display)
@@ -171,6 +186,102 @@ static const struct wl_callback_listener frame_listener = {
     wayland_frame_callback
 };
 
+void *WaylandNativeWindow::dispatcherThread(void *data)
+{
+    static_cast<WaylandNativeWindow *>(data)->dispatchLoop();
+    return NULL;
+}
+
+/*
+ * Services the window's event queue, so that buffer releases and frame
+ * callbacks are handled while the rendering thread is busy. Listeners run
+ * with the window locked, and waiters on cond are woken after every batch
+ * of events.
+ */
+void WaylandNativeWindow::dispatchLoop()
+{
+    struct pollfd fds[2];
+    int ret = 0;
+
+    fds[0].fd = wl_display_get_fd(m_display);
+    fds[0].events = POLLIN;
+    fds[1].fd = m_wakeupFd;
+    fds[1].events = POLLIN;
+
+    while (1)
+    {
+        lock();
+        while (ret >= 0 && wl_display_prepare_read_queue(m_display, wl_queue) != 0)
+            ret = wl_display_dispatch_queue_pending(m_display, wl_queue);
+        pthread_cond_broadcast(&cond);
+        unlock();
+
+        if (ret < 0)
+            break;
+
+        wl_display_flush(m_display);
+
+        HYBRIS_TRACE_BEGIN("wayland-platform", "dispatcher_poll", "");
+        ret = poll(fds, 2, -1);
+        HYBRIS_TRACE_END("wayland-platform", "dispatcher_poll", "");
+
+        if (ret < 0 && errno == EINTR) {
+            wl_display_cancel_read(m_display);
+            ret = 0;
+            continue;
+        }
+
+        if (ret < 0 || (fds[1].revents & POLLIN)) {
+            wl_display_cancel_read(m_display);
+            if (ret >= 0)
+                return;
+            break;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLERR | POLLHUP))
+            ret = wl_display_read_events(m_display);
+        else
+            wl_display_cancel_read(m_display);
+    }
+
+    TRACE("event dispatching failed");
+
+    lock();
+    m_dispatchFailed = true;
+    pthread_cond_broadcast(&cond);
+    unlock();
+
+    check_fatal_error(m_display);
+}
+
+void WaylandNativeWindow::stopDispatcher()
+{
+    if (!m_dispatcherRunning)
+        return;
+
+    uint64_t one = 1;
+    if (write(m_wakeupFd, &one, sizeof(one)) != sizeof(one))
+        fprintf(stderr, "failed to wake the wayland dispatcher thread: %s\n", strerror(errno));
+
+    pthread_join(m_dispatcher, NULL);
+    m_dispatcherRunning = false;
+}
+
+/*
+ * Waits for the dispatcher thread to handle the next batch of events.
+ * Must be called with the window locked. Returns -1 if events can no
+ * longer be dispatched.
+ */
+int WaylandNativeWindow::waitForEvents()
+{
+    if (m_dispatchFailed)
+        return -1;
+
+    pthread_cond_wait(&cond, &mutex);
+
+    return m_dispatchFailed ? -1 : 0;
+}
+
 WaylandNativeWindow::WaylandNativeWindow(struct wl_egl_window *window, struct wl_display *display, android_wlegl *wlegl, alloc_device_t* alloc_device, gralloc_module_t *gralloc)
     : m_android_wlegl(wlegl)
 {
@@ -188,6 +299,9 @@ WaylandNativeWindow::WaylandNativeWindow(struct wl_egl_window *window, struct wl
     this->m_window->free_callback = free_callback;
     this->frame_callback = NULL;
     this->wl_queue = wl_display_create_queue(display);
+    this->m_lastFrameTime = 0;
+    this->m_frameInterval = 0;
+    this->m_bufferTransform = WL_OUTPUT_TRANSFORM_NORMAL;
     this->m_format = 1;
 
 	const_cast<int&>(ANativeWindow::minSwapInterval) = 0;
@@ -195,27 +309,59 @@ WaylandNativeWindow::WaylandNativeWindow(struct wl_egl_window *window, struct wl
     // This is the default as per the EGL documentation
     this->m_swap_interval = 1;
 
+    // older servers can't take the fence, queueBuffer waits for it then
+    m_explicitFences = wl_proxy_get_version((struct wl_proxy *) m_android_wlegl) >=
+        ANDROID_WLEGL_SET_ACQUIRE_FENCE_SINCE_VERSION;
+    if (getenv("HYBRIS_WAYLAND_EXPLICIT_FENCES") != NULL &&
+        atoi(getenv("HYBRIS_WAYLAND_EXPLICIT_FENCES")) == 0)
+        m_explicitFences = false;
+
     this->m_alloc = alloc_device;
     m_gralloc = gralloc;
 
     m_usage=GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE;
     pthread_mutex_init(&mutex, NULL);
     pthread_cond_init(&cond, NULL);
-    m_queueReads = 0;
-    m_freeBufs = 0;
+    m_frontedBufs = 0;
+    m_bufferCount = 0;
+    m_pendingAllocs = 0;
+    m_failedAllocs = 0;
+    m_allocWidth = window->width;
+    m_allocHeight = window->height;
+    m_allocFormat = m_format;
+    m_allocUsage = m_usage;
     m_damage_rects = NULL;
     m_damage_n_rects = 0;
+    m_maxDamageRects = WAYLAND_DEFAULT_MAX_DAMAGE_RECTS;
+    if (getenv("HYBRIS_WAYLAND_MAX_DAMAGE_RECTS") != NULL)
+        m_maxDamageRects = atoi(getenv("HYBRIS_WAYLAND_MAX_DAMAGE_RECTS"));
     m_lastBuffer = 0;
+
+    m_dispatchFailed = false;
+    m_wakeupFd = eventfd(0, EFD_CLOEXEC);
+    m_dispatcherRunning = m_wakeupFd >= 0 &&
+        pthread_create(&m_dispatcher, NULL, dispatcherThread, this) == 0;
+    if (!m_dispatcherRunning) {
+        fprintf(stderr, "failed to start the wayland dispatcher thread\n");
+        m_dispatchFailed = true;
+    }
+
     setBufferCount(3);
     HYBRIS_TRACE_END("wayland-platform", "create_window", "");
 }
 
 WaylandNativeWindow::~WaylandNativeWindow()
 {
-    std::list<WaylandNativeWindowBuffer *>::iterator it = m_bufList.begin();
+    lock();
     destroyBuffers();
     if (frame_callback)
         wl_callback_destroy(frame_callback);
+    frame_callback = NULL;
+    unlock();
+
+    stopDispatcher();
+    if (m_wakeupFd >= 0)
+        close(m_wakeupFd);
     wl_event_queue_destroy(wl_queue);
    if (m_window) {
 	    m_window->nativewindow = NULL;
@@ -224,11 +370,24 @@ WaylandNativeWindow::~WaylandNativeWindow()
     }
 }
 
+static int64_t monotonic_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 void WaylandNativeWindow::frame() {
     HYBRIS_TRACE_BEGIN("wayland-platform", "frame_event", "");
 
     this->frame_callback = NULL;
 
+    // only intervals between back to back frames tell the repaint rate
+    int64_t now = monotonic_now();
+    if (m_lastFrameTime && now - m_lastFrameTime < 100000000LL)
+        m_frameInterval = now - m_lastFrameTime;
+    m_lastFrameTime = now;
+
     HYBRIS_TRACE_END("wayland-platform", "frame_event", "");
 }
 
@@ -255,68 +414,74 @@ int WaylandNativeWindow::setSwapInterval(int interval) {
     static void
 wl_buffer_release(void *data, struct wl_buffer *buffer)
 {
-    WaylandNativeWindow *win = static_cast<WaylandNativeWindow *>(data);
-    win->releaseBuffer(buffer);
+    WaylandNativeWindowBuffer *wnb = static_cast<WaylandNativeWindowBuffer *>(data);
+    wnb->window->releaseBuffer(wnb);
 }
 
 static struct wl_buffer_listener wl_buffer_listener = {
     wl_buffer_release
 };
 
-void WaylandNativeWindow::releaseBuffer(struct wl_buffer *buffer)
+void WaylandNativeWindow::releaseBuffer(WaylandNativeWindowBuffer *wnb)
 {
-    std::list<WaylandNativeWindowBuffer *>::iterator it = posted.begin();
-
-    for (; it != posted.end(); it++)
-    {
-        if ((*it)->wlbuffer == buffer)
-            break;
-    }
-
-    if (it != posted.end())
-    {
-        WaylandNativeWindowBuffer* pwnb = *it;
-        posted.erase(it);
-        TRACE("released posted buffer: %p", buffer);
-        pwnb->busy = 0;
-        unlock();
-        return;
-    }
-
-    it = fronted.begin();
+    HYBRIS_TRACE_BEGIN("wayland-platform", "releaseBuffer", "-%p", wnb);
 
-    for (; it != fronted.end(); it++)
-    {
-        if ((*it)->wlbuffer == buffer)
-            break;
+    switch (wnb->state) {
+    case WAYLAND_BUFFER_POSTED:
+        // not part of the buffer set, there is no list to return it to
+        TRACE("released posted buffer: %p", wnb);
+        wnb->state = WAYLAND_BUFFER_FREE;
+        break;
+    case WAYLAND_BUFFER_FRONTED:
+        --m_frontedBufs;
+        HYBRIS_TRACE_COUNTER("wayland-platform", "fronted.size", "%i", m_frontedBufs);
+        freeBuffer(wnb);
+        break;
+    default:
+        // attached again while still fronted, it is released only once
+        TRACE("release of wnb:%p in state %i", wnb, wnb->state);
+        break;
     }
-    assert(it != fronted.end());
-
 
+    HYBRIS_TRACE_END("wayland-platform", "releaseBuffer", "-%p", wnb);
+}
 
-    WaylandNativeWindowBuffer* wnb = *it;
-    fronted.erase(it);
-    HYBRIS_TRACE_COUNTER("wayland-platform", "fronted.size", "%i", fronted.size());
-
-    for (it = m_bufList.begin(); it != m_bufList.end(); it++)
-    {
-        if ((*it) == wnb)
-            break;
+/*
+ * Puts a buffer the window owns back on the free list, or on the stale
+ * list if it belongs to a previous buffer set. Must be called locked.
+ */
+void WaylandNativeWindow::freeBuffer(WaylandNativeWindowBuffer *wnb)
+{
+    if (isCurrent(wnb)) {
+        wnb->state = WAYLAND_BUFFER_FREE;
+        m_freeList.push_back(wnb);
+    } else {
+        wnb->state = WAYLAND_BUFFER_STALE;
+        m_staleList.push_back(wnb);
     }
-    assert(it != m_bufList.end());
-    HYBRIS_TRACE_BEGIN("wayland-platform", "releaseBuffer", "-%p", wnb);
-    wnb->busy = 0;
+    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeList.size());
+}
 
-    ++m_freeBufs;
-    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeBufs);
-    for (it = m_bufList.begin(); it != m_bufList.end(); it++)
-    {
-        (*it)->youngest = 0;
+/* Takes a buffer off whichever list its state says it is on */
+void WaylandNativeWindow::unlinkBuffer(WaylandNativeWindowBuffer *wnb)
+{
+    switch (wnb->state) {
+    case WAYLAND_BUFFER_FREE:
+        m_freeList.remove(wnb);
+        break;
+    case WAYLAND_BUFFER_STALE:
+        m_staleList.remove(wnb);
+        break;
+    case WAYLAND_BUFFER_DEQUEUED:
+    case WAYLAND_BUFFER_QUEUED:
+        m_queued.remove(wnb);
+        break;
+    case WAYLAND_BUFFER_FRONTED:
+        --m_frontedBufs;
+        break;
+    default:
+        break;
     }
-    wnb->youngest = 1;
-
-
-    HYBRIS_TRACE_END("wayland-platform", "releaseBuffer", "-%p", wnb);
 }
 
 
@@ -327,67 +492,51 @@ int WaylandNativeWindow::dequeueBuffer(BaseNativeWindowBuffer **buffer, int *fen
     TRACE("%p", buffer);
 
     lock();
-    readQueue(false);
 
     HYBRIS_TRACE_BEGIN("wayland-platform", "dequeueBuffer_wait_for_buffer", "");
 
-    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeBufs);
+    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeList.size());
 
-    while (m_freeBufs==0) {
-        HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeBufs);
-        readQueue(true);
+    /* If the window changed, request a new buffer set; the old buffers
+     * stay in use until their replacements arrive */
+    if (m_window->width != m_allocWidth || m_window->height != m_allocHeight
+        || m_format != m_allocFormat || m_usage != m_allocUsage)
+    {
+        TRACE("win:%p %ix%i -> %ix%i x%x -> x%x x%x -> x%x", m_window,
+            m_allocWidth, m_allocHeight, m_window->width, m_window->height,
+            m_allocFormat, m_format, m_allocUsage, m_usage);
+        reallocateBuffers();
     }
-
-    std::list<WaylandNativeWindowBuffer *>::iterator it = m_bufList.begin();
-    for (; it != m_bufList.end(); it++)
+    /* Every buffer of the set failed to allocate last time, try again */
+    else if (m_bufList.empty() && m_pendingAllocs == 0)
     {
-         if ((*it)->busy)
-             continue;
-         if ((*it)->youngest == 1)
-             continue;
-         break;
+        reallocateBuffers();
     }
 
-    if (it==m_bufList.end()) {
-        HYBRIS_TRACE_BEGIN("wayland-platform", "dequeueBuffer_worst_case_scenario", "");
-        HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_worst_case_scenario", "");
-
-        it = m_bufList.begin();
-        for (; it != m_bufList.end() && (*it)->busy; it++)
-        {}
-
-    }
-    if (it==m_bufList.end()) {
-        unlock();
-        HYBRIS_TRACE_BEGIN("wayland-platform", "dequeueBuffer_no_free_buffers", "");
-        HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_no_free_buffers", "");
-        TRACE("%p: no free buffers", buffer);
-        return NO_ERROR;
+    while ((wnb = pickBuffer()) == NULL) {
+        HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeList.size());
+        if (m_failedAllocs > 0 && m_pendingAllocs == 0) {
+            dropFailedBuffers();
+            if (m_bufList.empty()) {
+                unlock();
+                HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_wait_for_buffer", "");
+                return -ENOMEM;
+            }
+        }
+        if (waitForEvents() < 0) {
+            unlock();
+            HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_wait_for_buffer", "");
+            return -EIO;
+        }
     }
 
-    wnb = *it;
-    assert(wnb!=NULL);
     HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_wait_for_buffer", "");
 
-    /* If the buffer doesn't match the window anymore, re-allocate */
-    if (wnb->width != m_window->width || wnb->height != m_window->height
-        || wnb->format != m_format || wnb->usage != m_usage)
-    {
-        TRACE("wnb:%p,win:%p %i,%i %i,%i x%x,x%x x%x,x%x",
-            wnb,m_window,
-            wnb->width,m_window->width, wnb->height,m_window->height,
-            wnb->format,m_format, wnb->usage,m_usage);
-        destroyBuffer(wnb);
-        m_bufList.erase(it);
-        wnb = addBuffer();
-    }
-
-    wnb->busy = 1;
+    wnb->state = WAYLAND_BUFFER_DEQUEUED;
+    m_queued.push_back(wnb);
     *buffer = wnb;
-    queue.push_back(wnb);
-    --m_freeBufs;
 
-    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeBufs);
+    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeList.size());
     HYBRIS_TRACE_BEGIN("wayland-platform", "dequeueBuffer_gotBuffer", "-%p", wnb);
     HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_gotBuffer", "-%p", wnb);
     HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_wait_for_buffer", "");
@@ -409,19 +558,14 @@ int WaylandNativeWindow::postBuffer(ANativeWindowBuffer* buffer)
     WaylandNativeWindowBuffer *wnb = NULL;
 
     lock();
-    std::list<WaylandNativeWindowBuffer *>::iterator it = post_registered.begin();
-    for (; it != post_registered.end(); it++)
-    {
-        if ((*it)->other == buffer)
-        {
-            wnb = (*it);
-            break;
-        }
-    }
+    std::map<ANativeWindowBuffer *, WaylandNativeWindowBuffer *>::iterator it = post_registered.find(buffer);
+    if (it != post_registered.end())
+        wnb = it->second;
     unlock();
     if (!wnb)
     {
         wnb = new WaylandNativeWindowBuffer(buffer);
+        wnb->window = this;
 
         wnb->common.incRef(&wnb->common);
         buffer->common.incRef(&buffer->common);
@@ -430,76 +574,132 @@ int WaylandNativeWindow::postBuffer(ANativeWindowBuffer* buffer)
     int ret = 0;
 
     lock();
-    wnb->busy = 1;
-    ret = readQueue(false);
+    wnb->state = WAYLAND_BUFFER_POSTED;
 
-    if (ret < 0) {
+    if (m_dispatchFailed) {
         unlock();
-        return ret;
+        return -1;
     }
 
     if (wnb->wlbuffer == NULL)
     {
         wnb->wlbuffer_from_native_handle(m_android_wlegl, m_display, wl_queue);
         TRACE("%p add listener with %p inside", wnb, wnb->wlbuffer);
-        wl_buffer_add_listener(wnb->wlbuffer, &wl_buffer_listener, this);
+        wl_buffer_add_listener(wnb->wlbuffer, &wl_buffer_listener, wnb);
         wl_proxy_set_queue((struct wl_proxy *) wnb->wlbuffer, this->wl_queue);
-        post_registered.push_back(wnb);
+        post_registered[buffer] = wnb;
     }
-    TRACE("%p DAMAGE AREA: %dx%d", wnb, wnb->width, wnb->height);
+    TRACE("%p DAMAGE AREA: %dx%d, %d rects", wnb, wnb->width, wnb->height, m_damage_n_rects);
     wl_surface_attach(m_window->surface, wnb->wlbuffer, 0, 0);
-    wl_surface_damage(m_window->surface, 0, 0, wnb->width, wnb->height);
+    wayland_surface_damage(m_window->surface, wnb->width, wnb->height,
+                           m_damage_rects, m_damage_n_rects, m_maxDamageRects);
     wl_surface_commit(m_window->surface);
     wl_display_flush(m_display);
 
-    posted.push_back(wnb);
     unlock();
 
     return NO_ERROR;
 }
 
-int WaylandNativeWindow::readQueue(bool block)
+void WaylandNativeWindow::prepareSwap(EGLint *damage_rects, EGLint damage_n_rects)
 {
-    int ret = 0;
+    lock();
+    m_damage_rects = damage_rects;
+    m_damage_n_rects = damage_n_rects;
+    unlock();
+}
 
-    if (++m_queueReads == 1) {
-        if (block) {
-            ret = wl_display_dispatch_queue(m_display, wl_queue);
-        } else {
-            ret = wl_display_dispatch_queue_pending(m_display, wl_queue);
-        }
+/*
+ * Whether the frame finishSwap() is about to commit will be guarded by
+ * a fence on the compositor side, so it doesn't need to be waited for.
+ */
+bool WaylandNativeWindow::frameHasAcquireFence()
+{
+    bool ret;
 
-        // all threads waiting on the false branch will wake and return now, so we
-        // can safely set m_queueReads to 0 here instead of relying on every thread
-        // to decrement it. This prevents a race condition when a thread enters readQueue()
-        // before the one in this thread returns.
-        // The new thread would go in the false branch, and there would be no thread in the
-        // true branch, blocking the new thread and any other that will call readQueue in
-        // the future.
-        m_queueReads = 0;
+    lock();
+    ret = !m_queued.empty() && m_queued.front()->acquireFence >= 0;
+    unlock();
 
-        pthread_cond_broadcast(&cond);
+    return ret;
+}
 
-        if (ret < 0) {
-            TRACE("wl_display_dispatch_queue returned an error");
-            check_fatal_error(m_display);
-            return ret;
-        }
-    } else if (block) {
-        while (m_queueReads > 0) {
-            pthread_cond_wait(&cond, &mutex);
-        }
+/*
+ * Tells the compositor how the client wants the buffer to be shown, a
+ * NATIVE_WINDOW_TRANSFORM_* flips first and then rotates clockwise, the
+ * compositor undoes a wl_output_transform. Must be called locked.
+ */
+void WaylandNativeWindow::applyBufferTransform(WaylandNativeWindowBuffer *wnb)
+{
+    uint32_t transform;
+
+    switch (wnb->getTransform()) {
+    case NATIVE_WINDOW_TRANSFORM_FLIP_H:
+        transform = WL_OUTPUT_TRANSFORM_FLIPPED;
+        break;
+    case NATIVE_WINDOW_TRANSFORM_FLIP_V:
+        transform = WL_OUTPUT_TRANSFORM_FLIPPED_180;
+        break;
+    case NATIVE_WINDOW_TRANSFORM_ROT_90:
+        transform = WL_OUTPUT_TRANSFORM_90;
+        break;
+    case NATIVE_WINDOW_TRANSFORM_ROT_180:
+        transform = WL_OUTPUT_TRANSFORM_180;
+        break;
+    case NATIVE_WINDOW_TRANSFORM_ROT_270:
+        transform = WL_OUTPUT_TRANSFORM_270;
+        break;
+    case NATIVE_WINDOW_TRANSFORM_FLIP_H | NATIVE_WINDOW_TRANSFORM_ROT_90:
+        transform = WL_OUTPUT_TRANSFORM_FLIPPED_270;
+        break;
+    case NATIVE_WINDOW_TRANSFORM_FLIP_V | NATIVE_WINDOW_TRANSFORM_ROT_90:
+        transform = WL_OUTPUT_TRANSFORM_FLIPPED_90;
+        break;
+    default:
+        transform = WL_OUTPUT_TRANSFORM_NORMAL;
+        break;
     }
 
-    return ret;
+    if (transform == m_bufferTransform)
+        return;
+
+    if (wl_proxy_get_version((struct wl_proxy *) m_window->surface) <
+        WL_SURFACE_SET_BUFFER_TRANSFORM_SINCE_VERSION) {
+        TRACE("wl_surface too old for buffer transform %u", transform);
+        return;
+    }
+
+    wl_surface_set_buffer_transform(m_window->surface, transform);
+    m_bufferTransform = transform;
 }
 
-void WaylandNativeWindow::prepareSwap(EGLint *damage_rects, EGLint damage_n_rects)
+/*
+ * Holds a frame with a presentation time back until a repaint before it
+ * is due, so that the compositor shows it in time but not earlier. A
+ * time more than a second ahead is taken as bogus and the frame shown
+ * right away, like BufferQueue does. Must be called locked, the lock is
+ * dropped while waiting.
+ */
+void WaylandNativeWindow::waitForPresentTime(WaylandNativeWindowBuffer *wnb)
 {
-    lock();
-    m_damage_rects = damage_rects;
-    m_damage_n_rects = damage_n_rects;
+    int64_t due = wnb->getDesiredPresent();
+    if (due == 0)
+        return;
+
+    int64_t now = monotonic_now();
+    int64_t commit = due - m_frameInterval;
+    if (commit <= now || due > now + 1000000000LL)
+        return;
+
+    HYBRIS_TRACE_BEGIN("wayland-platform", "finishSwap_wait_for_present_time", "-%p", wnb);
+    struct timespec ts;
+    ts.tv_sec = commit / 1000000000LL;
+    ts.tv_nsec = commit % 1000000000LL;
     unlock();
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+    lock();
+    HYBRIS_TRACE_END("wayland-platform", "finishSwap_wait_for_present_time", "-%p", wnb);
 }
 
 void WaylandNativeWindow::finishSwap()
@@ -507,32 +707,38 @@ void WaylandNativeWindow::finishSwap()
     int ret = 0;
     lock();
 
-    WaylandNativeWindowBuffer *wnb = queue.front();
+    WaylandNativeWindowBuffer *wnb = m_queued.pop_front();
+    bool repeated = !wnb;
     if (!wnb) {
+        // nothing new was rendered, attach the last buffer again
         wnb = m_lastBuffer;
-    } else {
-        queue.pop_front();
+        assert(wnb);
+        if (wnb->state != WAYLAND_BUFFER_FRONTED)
+            unlinkBuffer(wnb);
     }
     assert(wnb);
     m_lastBuffer = wnb;
-    wnb->busy = 1;
-
-    ret = readQueue(false);
-    if (this->frame_callback) {
-        do {
-            ret = readQueue(true);
-        } while (this->frame_callback && ret != -1);
+    if (wnb->state != WAYLAND_BUFFER_FRONTED) {
+        wnb->state = WAYLAND_BUFFER_FRONTED;
+        ++m_frontedBufs;
     }
+
+    HYBRIS_TRACE_BEGIN("wayland-platform", "finishSwap_wait_for_frame_callback", "-%p", wnb);
+    while (this->frame_callback && ret != -1)
+        ret = waitForEvents();
+    HYBRIS_TRACE_END("wayland-platform", "finishSwap_wait_for_frame_callback", "-%p", wnb);
     if (ret < 0) {
-        HYBRIS_TRACE_END("wayland-platform", "queueBuffer_wait_for_frame_callback", "-%p", wnb);
+        unlock();
         return;
     }
 
+    waitForPresentTime(wnb);
+
     if (wnb->wlbuffer == NULL)
     {
         wnb->init(m_android_wlegl, m_display, wl_queue);
         TRACE("%p add listener with %p inside", wnb, wnb->wlbuffer);
-        wl_buffer_add_listener(wnb->wlbuffer, &wl_buffer_listener, this);
+        wl_buffer_add_listener(wnb->wlbuffer, &wl_buffer_listener, wnb);
         wl_proxy_set_queue((struct wl_proxy *) wnb->wlbuffer, this->wl_queue);
     }
 
@@ -542,8 +748,30 @@ void WaylandNativeWindow::finishSwap()
         wl_proxy_set_queue((struct wl_proxy *) this->frame_callback, this->wl_queue);
     }
 
+    if (wnb->acquireFence >= 0)
+    {
+        // the request carries a duplicate of the fd
+        android_wlegl_set_acquire_fence(m_android_wlegl, wnb->wlbuffer, wnb->acquireFence);
+        close(wnb->acquireFence);
+        wnb->acquireFence = -1;
+    }
+
+    applyBufferTransform(wnb);
     wl_surface_attach(m_window->surface, wnb->wlbuffer, 0, 0);
-    wl_surface_damage(m_window->surface, 0, 0, wnb->width, wnb->height);
+
+    bool bufferDamage = false;
+#ifdef WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION
+    bufferDamage = wl_proxy_get_version((struct wl_proxy *) m_window->surface) >=
+        WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION;
+#endif
+    if (m_bufferTransform != WL_OUTPUT_TRANSFORM_NORMAL && !bufferDamage) {
+        // the rectangles are in buffer coordinates, which surface damage
+        // doesn't transform, so damage all of the surface instead
+        wl_surface_damage(m_window->surface, 0, 0, INT32_MAX, INT32_MAX);
+    } else {
+        wayland_surface_damage(m_window->surface, wnb->width, wnb->height,
+                               m_damage_rects, m_damage_n_rects, m_maxDamageRects);
+    }
     wl_surface_commit(m_window->surface);
     // Some compositors, namely Weston, queue buffer release events instead
     // of sending them immediately.  If a frame event is used, this should
@@ -551,7 +779,10 @@ void WaylandNativeWindow::finishSwap()
     // request to ensure that they get flushed.
     wl_callback_destroy(wl_display_sync(m_display));
     wl_display_flush(m_display);
-    fronted.push_back(wnb);
+
+    // the repaint rate stands in for the vsync period of the outputs
+    if (!repeated)
+        bufferWasPresented(wnb, m_frameInterval);
 
     m_window->attached_width = wnb->width;
     m_window->attached_height = wnb->height;
@@ -578,12 +809,14 @@ int WaylandNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd
         else
             debugenvchecked = 1;
     }
-    if (debugenvchecked == 2)
-    {
-        HYBRIS_TRACE_BEGIN("wayland-platform", "queueBuffer_dumping_buffer", "-%p", wnb);
-        hybris_dump_buffer_to_file(wnb->getNativeBuffer());
-        HYBRIS_TRACE_END("wayland-platform", "queueBuffer_dumping_buffer", "-%p", wnb);
 
+    if (m_explicitFences)
+    {
+        // handed to the compositor by finishSwap
+        if (wnb->acquireFence >= 0)
+            close(wnb->acquireFence);
+        wnb->acquireFence = fenceFd;
+        fenceFd = -1;
     }
 
 #if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
@@ -596,7 +829,17 @@ int WaylandNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd
     HYBRIS_TRACE_END("wayland-platform", "queueBuffer_waiting_for_fence", "-%p", wnb);
 #endif
 
-    HYBRIS_TRACE_COUNTER("wayland-platform", "fronted.size", "%i", fronted.size());
+    if (debugenvchecked == 2)
+    {
+        // copied before the buffer can be dequeued again, written out later
+        HYBRIS_TRACE_BEGIN("wayland-platform", "queueBuffer_dumping_buffer", "-%p", wnb);
+        hybris_capture_frame(wnb->getNativeBuffer(), wnb->acquireFence);
+        HYBRIS_TRACE_END("wayland-platform", "queueBuffer_dumping_buffer", "-%p", wnb);
+    }
+
+    wnb->state = WAYLAND_BUFFER_QUEUED;
+
+    HYBRIS_TRACE_COUNTER("wayland-platform", "fronted.size", "%i", m_frontedBufs);
     HYBRIS_TRACE_END("wayland-platform", "queueBuffer", "-%p", wnb);
     unlock();
 
@@ -604,37 +847,18 @@ int WaylandNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd
 }
 
 int WaylandNativeWindow::cancelBuffer(BaseNativeWindowBuffer* buffer, int fenceFd){
-    std::list<WaylandNativeWindowBuffer *>::iterator it;
     WaylandNativeWindowBuffer *wnb = (WaylandNativeWindowBuffer*) buffer;
 
     lock();
     HYBRIS_TRACE_BEGIN("wayland-platform", "cancelBuffer", "-%p", wnb);
 
-    /* Check first that it really is our buffer */
-    for (it = m_bufList.begin(); it != m_bufList.end(); it++)
-    {
-        if ((*it) == wnb)
-            break;
-    }
-    assert(it != m_bufList.end());
-
-    wnb->busy = 0;
-    ++m_freeBufs;
-    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeBufs);
+    assert(wnb->window == this && wnb->state == WAYLAND_BUFFER_DEQUEUED);
 
-    for (it = m_bufList.begin(); it != m_bufList.end(); it++)
-    {
-        (*it)->youngest = 0;
-    }
-    wnb->youngest = 1;
+    m_queued.remove(wnb);
+    freeBuffer(wnb);
 
-    if (m_queueReads != 0) {
-        // Some thread is waiting on wl_display_dispatch_queue(), possibly waiting for a wl_buffer.release
-        // event. Since we have now cancelled a buffer push an artificial event so that the dispatch returns
-        // and the thread can notice the cancelled buffer. This means there is a delay of one roundtrip,
-        // but I don't see other solution except having one dedicated thread for calling wl_display_dispatch_queue().
-        wl_callback_destroy(wl_display_sync(m_display));
-    }
+    // wake up a dequeueBuffer() waiting for a free buffer
+    pthread_cond_broadcast(&cond);
 
     HYBRIS_TRACE_END("wayland-platform", "cancelBuffer", "-%p", wnb);
     unlock();
@@ -706,8 +930,8 @@ void WaylandNativeWindow::destroyBuffer(WaylandNativeWindowBuffer* wnb)
     assert(wnb != NULL);
 
     int ret = 0;
-    while (ret != -1 && wnb->creation_callback)
-        ret = wl_display_dispatch_queue(m_display, wl_queue);
+    while (ret != -1 && (wnb->creation_callback || wnb->state == WAYLAND_BUFFER_ALLOCATING))
+        ret = waitForEvents();
 
     if (wnb->creation_callback) {
         wl_callback_destroy(wnb->creation_callback);
@@ -717,36 +941,47 @@ void WaylandNativeWindow::destroyBuffer(WaylandNativeWindowBuffer* wnb)
     if (wnb->wlbuffer)
         wl_buffer_destroy(wnb->wlbuffer);
     wnb->wlbuffer = NULL;
+    if (wnb->acquireFence >= 0)
+        close(wnb->acquireFence);
+    wnb->acquireFence = -1;
+    unlinkBuffer(wnb);
+    if (wnb->state == WAYLAND_BUFFER_FAILED)
+        --m_failedAllocs;
+    if (wnb == m_lastBuffer)
+        m_lastBuffer = NULL;
     wnb->common.decRef(&wnb->common);
-    m_freeBufs--;
 }
 
 void WaylandNativeWindow::destroyBuffers()
 {
     TRACE("");
 
-    std::list<WaylandNativeWindowBuffer*>::iterator it = m_bufList.begin();
-    for (; it!=m_bufList.end(); ++it)
+    while (!m_bufList.empty())
     {
-        destroyBuffer(*it);
-        it = m_bufList.erase(it);
+        destroyBuffer(m_bufList.front());
+        m_bufList.pop_front();
     }
-    m_bufList.clear();
-    m_freeBufs = 0;
 }
 
+/*
+ * Creates a buffer with the current allocation parameters. Server side
+ * buffers are only requested here, they become usable once the
+ * compositor's answer has been dispatched to bufferAllocated().
+ */
 WaylandNativeWindowBuffer *WaylandNativeWindow::addBuffer() {
 
     WaylandNativeWindowBuffer *wnb;
 
 #ifndef HYBRIS_NO_SERVER_SIDE_BUFFERS
-    wnb = new ServerWaylandBuffer(m_width, m_height, m_format, m_usage, m_gralloc, m_android_wlegl, wl_queue);
-    wayland_roundtrip(this);
+    wnb = new ServerWaylandBuffer(m_allocWidth, m_allocHeight, m_allocFormat, m_allocUsage, m_gralloc, m_android_wlegl, wl_queue, this);
+    wnb->state = WAYLAND_BUFFER_ALLOCATING;
+    ++m_pendingAllocs;
 #else
-    wnb = new ClientWaylandBuffer(m_alloc, m_width, m_height, m_format, m_usage);
+    wnb = new ClientWaylandBuffer(m_alloc, m_allocWidth, m_allocHeight, m_allocFormat, m_allocUsage);
+    wnb->window = this;
+    freeBuffer(wnb);
 #endif
     m_bufList.push_back(wnb);
-    ++m_freeBufs;
 
     TRACE("wnb:%p width:%i height:%i format:x%x usage:x%x",
          wnb, wnb->width, wnb->height, wnb->format, wnb->usage);
@@ -754,34 +989,143 @@ WaylandNativeWindowBuffer *WaylandNativeWindow::addBuffer() {
     return wnb;
 }
 
+void WaylandNativeWindow::bufferAllocated(WaylandNativeWindowBuffer *wnb, bool success)
+{
+    --m_pendingAllocs;
 
-int WaylandNativeWindow::setBufferCount(int cnt) {
-    int start = 0;
+    if (!success) {
+        // never handed out, dequeueBuffer() drops it
+        fprintf(stderr, "failed to allocate a server side buffer\n");
+        wnb->state = WAYLAND_BUFFER_FAILED;
+        ++m_failedAllocs;
+        return;
+    }
 
-    TRACE("cnt:%d", cnt);
+    freeBuffer(wnb);
+}
 
-    if (m_bufList.size() == cnt)
-        return NO_ERROR;
+/*
+ * Requests a full buffer set for the current window parameters in one
+ * go. The requests are pipelined, nobody waits for them here.
+ */
+void WaylandNativeWindow::reallocateBuffers()
+{
+    HYBRIS_TRACE_BEGIN("wayland-platform", "reallocateBuffers", "");
+
+    while (!m_freeList.empty()) {
+        WaylandNativeWindowBuffer *wnb = m_freeList.pop_front();
+        wnb->state = WAYLAND_BUFFER_STALE;
+        m_staleList.push_back(wnb);
+    }
+
+    m_allocWidth = m_window->width;
+    m_allocHeight = m_window->height;
+    m_allocFormat = m_format;
+    m_allocUsage = m_usage;
+
+    for (int i = 0; i < m_bufferCount; i++)
+        addBuffer();
+    wl_display_flush(m_display);
+
+    HYBRIS_TRACE_END("wayland-platform", "reallocateBuffers", "");
+}
+
+bool WaylandNativeWindow::isCurrent(const WaylandNativeWindowBuffer *wnb) const
+{
+    return wnb->width == m_allocWidth && wnb->height == m_allocHeight &&
+        wnb->format == m_allocFormat && wnb->usage == m_allocUsage;
+}
+
+/* Destroys the buffers of previous sets that are no longer in use */
+void WaylandNativeWindow::dropStaleBuffers()
+{
+    WaylandNativeWindowBuffer *wnb = m_staleList.front();
+
+    while (wnb)
+    {
+        WaylandNativeWindowBuffer *next = m_staleList.next(wnb);
+
+        // finishSwap() may still attach it again
+        if (wnb != m_lastBuffer) {
+            TRACE("dropping stale buffer wnb:%p %ix%i", wnb, wnb->width, wnb->height);
+            destroyBuffer(wnb);
+            m_bufList.remove(wnb);
+        }
+        wnb = next;
+    }
+}
+
+void WaylandNativeWindow::dropFailedBuffers()
+{
+    std::list<WaylandNativeWindowBuffer *>::iterator it = m_bufList.begin();
+
+    while (it != m_bufList.end())
+    {
+        if ((*it)->state == WAYLAND_BUFFER_FAILED) {
+            destroyBuffer(*it);
+            it = m_bufList.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+/*
+ * Returns a free buffer to render into, the one released longest ago.
+ * Buffers of an older set are only used while none of the new ones is
+ * free and if they differ in size only; they are destroyed once a buffer
+ * of the new set is free. Must be called locked.
+ */
+WaylandNativeWindowBuffer *WaylandNativeWindow::pickBuffer()
+{
+    WaylandNativeWindowBuffer *wnb;
+
+    if (!m_freeList.empty()) {
+        if (!m_staleList.empty())
+            dropStaleBuffers();
+        return m_freeList.pop_front();
+    }
+
+    for (wnb = m_staleList.front(); wnb; wnb = m_staleList.next(wnb))
+    {
+        if (wnb->format == m_allocFormat && wnb->usage == m_allocUsage) {
+            m_staleList.remove(wnb);
+            return wnb;
+        }
+    }
+
+    return NULL;
+}
+
+int WaylandNativeWindow::setBufferCount(int cnt) {
+    TRACE("cnt:%d", cnt);
 
     lock();
 
-    if (m_bufList.size() > cnt) {
+    if (m_bufferCount == cnt) {
+        unlock();
+        return NO_ERROR;
+    }
+
+    if (m_bufferCount > cnt) {
         /* Decreasing buffer count, remove from beginning */
-        std::list<WaylandNativeWindowBuffer*>::iterator it = m_bufList.begin();
-        for (int i = 0; i <= m_bufList.size() - cnt; i++ )
+        while (m_bufList.size() > (unsigned int) cnt)
         {
-            destroyBuffer(*it);
-            ++it;
+            destroyBuffer(m_bufList.front());
             m_bufList.pop_front();
         }
 
     } else {
-        /* Increasing buffer count, start from current size */
-        for (int i = m_bufList.size(); i < cnt; i++)
-            WaylandNativeWindowBuffer *unused = addBuffer();
+        /* Increasing buffer count, request all new buffers at once */
+        for (int i = m_bufferCount; i < cnt; i++)
+            addBuffer();
 
+#ifndef HYBRIS_NO_SERVER_SIDE_BUFFERS
+        roundtrip();
+#endif
     }
 
+    m_bufferCount = cnt;
     unlock();
 
     return NO_ERROR;
@@ -839,10 +1183,14 @@ static void ssb_fd(void *data, android_wlegl_server_buffer_handle *, int fd)
     *ptr = fd;
 }
 
-static void ssb_buffer(void *data, android_wlegl_server_buffer_handle *, wl_buffer *buffer, int32_t format, int32_t stride)
+static void ssb_buffer(void *data, android_wlegl_server_buffer_handle *ssb, wl_buffer *buffer, int32_t format, int32_t stride)
 {
     ServerWaylandBuffer *wsb = static_cast<ServerWaylandBuffer *>(data);
 
+    android_wlegl_server_buffer_handle_destroy(ssb);
+    wsb->m_ssb = NULL;
+    wsb->m_buf = buffer;
+
     native_handle_t *native;
     int numFds = wsb->fds.size / sizeof(int);
     int numInts = wsb->ints.size / sizeof(int32_t);
@@ -854,18 +1202,29 @@ static void ssb_buffer(void *data, android_wlegl_server_buffer_handle *, wl_buff
     /* ownership of fds passed to native_handle_t */
     wsb->fds.size = 0;
 
-    wsb->handle = (buffer_handle_t) native;
-    wsb->format = format;
     wsb->stride = stride;
 
+    /* The window only uses buffers of the format it asked for, and EGL
+     * renders in the format of its config, so anything else is useless */
+    if (format != wsb->format) {
+        fprintf(stderr, "ERROR: compositor allocated format x%x instead of x%x\n", format, wsb->format);
+        native_handle_close(native);
+        native_handle_delete(native);
+        wsb->window->bufferAllocated(wsb, false);
+        return;
+    }
+
+    wsb->handle = (buffer_handle_t) native;
+
     int ret = wsb->m_gralloc->registerBuffer(wsb->m_gralloc, wsb->handle);
     if (ret) {
         fprintf(stderr,"failed to register buffer\n");
-        return;
+        native_handle_close(native);
+        native_handle_delete(native);
+        wsb->handle = NULL;
     }
 
-    wsb->common.incRef(&wsb->common);
-    wsb->m_buf = buffer;
+    wsb->window->bufferAllocated(wsb, ret == 0);
 }
 
 static const struct android_wlegl_server_buffer_handle_listener server_handle_listener = {
@@ -874,31 +1233,40 @@ static const struct android_wlegl_server_buffer_handle_listener server_handle_li
     ssb_buffer,
 };
 
-ServerWaylandBuffer::ServerWaylandBuffer(unsigned int w, unsigned int h, int f, int u, gralloc_module_t *gralloc, android_wlegl *android_wlegl, struct wl_event_queue *queue)
+ServerWaylandBuffer::ServerWaylandBuffer(unsigned int w, unsigned int h, int f, int u, gralloc_module_t *gralloc, android_wlegl *android_wlegl, struct wl_event_queue *queue, WaylandNativeWindow *owner)
                    : WaylandNativeWindowBuffer()
                    , m_buf(0)
 {
     ANativeWindowBuffer::width = w;
     ANativeWindowBuffer::height = h;
+    ANativeWindowBuffer::format = f;
     m_gralloc = gralloc;
     usage = u;
+    window = owner;
 
     wl_array_init(&ints);
     wl_array_init(&fds);
 
-    android_wlegl_server_buffer_handle *ssb = android_wlegl_get_server_buffer_handle(android_wlegl, width, height, f, u);
-    wl_proxy_set_queue((struct wl_proxy *) ssb, queue);
-    android_wlegl_server_buffer_handle_add_listener(ssb, &server_handle_listener, this);
+    // the window's reference, the buffer becomes usable in ssb_buffer()
+    common.incRef(&common);
+
+    m_ssb = android_wlegl_get_server_buffer_handle(android_wlegl, width, height, f, u);
+    wl_proxy_set_queue((struct wl_proxy *) m_ssb, queue);
+    android_wlegl_server_buffer_handle_add_listener(m_ssb, &server_handle_listener, this);
 }
 
 ServerWaylandBuffer::~ServerWaylandBuffer()
 {
+    if (m_ssb)
+        android_wlegl_server_buffer_handle_destroy(m_ssb);
     if (m_buf)
         wl_buffer_destroy(m_buf);
 
-    m_gralloc->unregisterBuffer(m_gralloc, handle);
-    native_handle_close(handle);
-    native_handle_delete(const_cast<native_handle_t *>(handle));
+    if (handle) {
+        m_gralloc->unregisterBuffer(m_gralloc, handle);
+        native_handle_close(handle);
+        native_handle_delete(const_cast<native_handle_t *>(handle));
+    }
     wl_array_release(&ints);
     wl_array_release(&fds);
 }
@@ -37,12 +37,15 @@ extern "C" {
 #include <pthread.h>
 }
 #include <list>
-#include <deque>
+#include <map>
+#include "wayland_buffer_list.h"
+
+class WaylandNativeWindow;
 
 class WaylandNativeWindowBuffer : public BaseNativeWindowBuffer
 {
 public:
-    WaylandNativeWindowBuffer() : wlbuffer(0), busy(0), youngest(0), other(0), creation_callback(0) {}
+    WaylandNativeWindowBuffer() : wlbuffer(0), state(WAYLAND_BUFFER_FREE), listPrev(0), listNext(0), window(0), other(0), creation_callback(0), acquireFence(-1) {}
     WaylandNativeWindowBuffer(ANativeWindowBuffer *other)
     {
         ANativeWindowBuffer::width = other->width;
@@ -53,16 +56,24 @@ public:
         ANativeWindowBuffer::stride = other->stride;
         this->wlbuffer = NULL;
         this->creation_callback = NULL;
-        this->busy = 0;
+        this->state = WAYLAND_BUFFER_FREE;
+        this->listPrev = NULL;
+        this->listNext = NULL;
+        this->window = NULL;
         this->other = other;
-        this->youngest = 0;
+        this->acquireFence = -1;
     }
 
     struct wl_buffer *wlbuffer;
-    int busy;
-    int youngest;
+    enum wayland_buffer_state state;
+    // links of the window list the buffer is on, see state
+    WaylandNativeWindowBuffer *listPrev;
+    WaylandNativeWindowBuffer *listNext;
+    WaylandNativeWindow *window;
     ANativeWindowBuffer *other;
     struct wl_callback *creation_callback;
+    // fence of the rendering into this buffer, sent with the next attach
+    int acquireFence;
 
     void wlbuffer_from_native_handle(struct android_wlegl *android_wlegl,
                                      struct wl_display *display,
@@ -96,7 +107,10 @@ protected:
         ANativeWindowBuffer::usage = usage;
         this->wlbuffer = NULL;
         this->creation_callback = NULL;
-        this->busy = 0;
+        this->state = WAYLAND_BUFFER_FREE;
+        this->listPrev = NULL;
+        this->listNext = NULL;
+        this->window = NULL;
         this->other = NULL;
         this->m_alloc = alloc_device;
         int alloc_ok = this->m_alloc->alloc(this->m_alloc,
@@ -104,7 +118,6 @@ protected:
                 this->format, this->usage,
                 &this->handle, &this->stride);
         assert(alloc_ok == 0);
-        this->youngest = 0;
         this->common.incRef(&this->common);
     }
 
@@ -131,7 +144,7 @@ public:
 class ServerWaylandBuffer : public WaylandNativeWindowBuffer
 {
 public:
-    ServerWaylandBuffer(unsigned int w, unsigned int h, int format, int usage, gralloc_module_t *gralloc, android_wlegl *android_wlegl, struct wl_event_queue *queue);
+    ServerWaylandBuffer(unsigned int w, unsigned int h, int format, int usage, gralloc_module_t *gralloc, android_wlegl *android_wlegl, struct wl_event_queue *queue, WaylandNativeWindow *owner);
     ~ServerWaylandBuffer();
     void init(struct android_wlegl *android_wlegl,
                                      struct wl_display *display,
@@ -141,6 +154,7 @@ public:
     struct wl_array fds;
     gralloc_module_t *m_gralloc;
     wl_buffer *m_buf;
+    android_wlegl_server_buffer_handle *m_ssb;
 };
 
 #endif // HYBRIS_NO_SERVER_SIDE_BUFFERS
@@ -154,12 +168,14 @@ public:
     void unlock();
     void frame();
     void resize(unsigned int width, unsigned int height);
-    void releaseBuffer(struct wl_buffer *buffer);
+    void releaseBuffer(WaylandNativeWindowBuffer *buffer);
+    void bufferAllocated(WaylandNativeWindowBuffer *buffer, bool success);
     int postBuffer(ANativeWindowBuffer *buffer);
 
     virtual int setSwapInterval(int interval);
     void prepareSwap(EGLint *damage_rects, EGLint damage_n_rects);
     void finishSwap();
+    bool frameHasAcquireFence();
 
     static void sync_callback(void *data, struct wl_callback *callback, uint32_t serial);
     static void registry_handle_global(void *data, struct wl_registry *registry, uint32_t name,
@@ -192,13 +208,29 @@ private:
     WaylandNativeWindowBuffer *addBuffer();
     void destroyBuffer(WaylandNativeWindowBuffer *);
     void destroyBuffers();
-    int readQueue(bool block);
+    void reallocateBuffers();
+    void freeBuffer(WaylandNativeWindowBuffer *);
+    void unlinkBuffer(WaylandNativeWindowBuffer *);
+    void dropStaleBuffers();
+    void dropFailedBuffers();
+    WaylandNativeWindowBuffer *pickBuffer();
+    bool isCurrent(const WaylandNativeWindowBuffer *wnb) const;
+    void applyBufferTransform(WaylandNativeWindowBuffer *wnb);
+    void waitForPresentTime(WaylandNativeWindowBuffer *wnb);
+    int waitForEvents();
+    int roundtrip();
+
+    static void *dispatcherThread(void *data);
+    void dispatchLoop();
+    void stopDispatcher();
 
     std::list<WaylandNativeWindowBuffer *> m_bufList;
-    std::list<WaylandNativeWindowBuffer *> fronted;
-    std::list<WaylandNativeWindowBuffer *> posted;
-    std::list<WaylandNativeWindowBuffer *> post_registered;
-    std::deque<WaylandNativeWindowBuffer *> queue;
+    // free buffers, least recently released first
+    WaylandBufferList<WaylandNativeWindowBuffer> m_freeList;
+    WaylandBufferList<WaylandNativeWindowBuffer> m_staleList;
+    // dequeued and queued buffers, in the order they will be attached
+    WaylandBufferList<WaylandNativeWindowBuffer> m_queued;
+    std::map<ANativeWindowBuffer *, WaylandNativeWindowBuffer *> post_registered;
     struct wl_egl_window *m_window;
     struct wl_display *m_display;
     WaylandNativeWindowBuffer *m_lastBuffer;
@@ -211,13 +243,33 @@ private:
     struct android_wlegl *m_android_wlegl;
     alloc_device_t* m_alloc;
     pthread_mutex_t mutex;
+    // signalled by the dispatcher thread after each batch of events
     pthread_cond_t cond;
-    int m_queueReads;
-    int m_freeBufs;
+    pthread_t m_dispatcher;
+    bool m_dispatcherRunning;
+    bool m_dispatchFailed;
+    int m_wakeupFd;
+    int m_frontedBufs;
+    int m_bufferCount;
+    // allocation requests the compositor hasn't answered yet
+    int m_pendingAllocs;
+    int m_failedAllocs;
+    // parameters of the most recently requested buffer set
+    unsigned int m_allocWidth;
+    unsigned int m_allocHeight;
+    unsigned int m_allocFormat;
+    unsigned int m_allocUsage;
     EGLint *m_damage_rects, m_damage_n_rects;
+    int m_maxDamageRects;
     struct wl_callback *frame_callback;
     int m_swap_interval;
-    static int wayland_roundtrip(WaylandNativeWindow *display);
+    // CLOCK_MONOTONIC ns of the last frame event and the time between the
+    // last two, to commit a frame with a presentation time ahead of it
+    int64_t m_lastFrameTime;
+    int64_t m_frameInterval;
+    // wl_output_transform of the attached buffer
+    uint32_t m_bufferTransform;
+    bool m_explicitFences;
     gralloc_module_t *m_gralloc;
 };
 
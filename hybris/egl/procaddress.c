@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "procaddress.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logging.h"
+
+/* FNV-1a, the seed picks one of a family of hash functions */
+static uint32_t proc_hash(const char *name, uint32_t seed)
+{
+	uint32_t h = 2166136261u ^ seed;
+
+	while (*name) {
+		h ^= (unsigned char) *name++;
+		h *= 16777619u;
+	}
+	return h ^ (h >> 15);
+}
+
+static int proc_table_place(struct egl_proc_table *table, const struct egl_proc *procs, int count)
+{
+	int i;
+
+	memset(table->slots, 0, (table->mask + 1) * sizeof(*table->slots));
+	for (i = 0; i < count; i++) {
+		uint32_t slot = proc_hash(procs[i].name, table->seed) & table->mask;
+		if (table->slots[slot])
+			return 0;
+		table->slots[slot] = &procs[i];
+	}
+	return 1;
+}
+
+void egl_proc_table_init(struct egl_proc_table *table, const struct egl_proc *procs, int count)
+{
+	uint32_t size = 4;
+
+	while (size < 2 * (uint32_t) count)
+		size <<= 1;
+
+	/* try a few seeds for every size, a sparser table always works out */
+	for (;;) {
+		table->slots = calloc(size, sizeof(*table->slots));
+		assert(table->slots != NULL);
+		table->mask = size - 1;
+		for (table->seed = 0; table->seed < 64; table->seed++) {
+			if (proc_table_place(table, procs, count)) {
+				TRACE("%d procs in %u slots, seed %u", count, size, table->seed);
+				return;
+			}
+		}
+		free(table->slots);
+		size <<= 1;
+	}
+}
+
+__eglMustCastToProperFunctionPointerType egl_proc_table_lookup(const struct egl_proc_table *table, const char *name)
+{
+	const struct egl_proc *proc = table->slots[proc_hash(name, table->seed) & table->mask];
+
+	if (proc && strcmp(proc->name, name) == 0)
+		return proc->address;
+	return NULL;
+}
+
+struct proc_cache_entry {
+	const char *name;
+	int version;
+	uint32_t hash;
+	__eglMustCastToProperFunctionPointerType address;
+};
+
+struct proc_cache {
+	uint32_t mask;
+	uint32_t count;
+	struct proc_cache_entry entries[];
+};
+
+/*
+ * Open addressing with linear probing, never more than half full. Readers
+ * take no lock: an entry is complete before its name is published, and a
+ * table is complete before it replaces the previous one. Replaced tables
+ * are never freed, since a reader may still be probing them; together
+ * they are smaller than the current one.
+ */
+static struct proc_cache *_proc_cache = NULL;
+static pthread_mutex_t _proc_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct proc_cache_entry *proc_cache_find(struct proc_cache *cache, const char *name, int version, uint32_t hash)
+{
+	const char *entry_name;
+	uint32_t slot;
+
+	if (!cache)
+		return NULL;
+
+	for (slot = hash & cache->mask;
+			(entry_name = __atomic_load_n(&cache->entries[slot].name, __ATOMIC_ACQUIRE)) != NULL;
+			slot = (slot + 1) & cache->mask) {
+		struct proc_cache_entry *entry = &cache->entries[slot];
+		if (entry->hash == hash && entry->version == version && strcmp(entry_name, name) == 0)
+			return entry;
+	}
+	return NULL;
+}
+
+static void proc_cache_add(struct proc_cache *cache, const struct proc_cache_entry *entry)
+{
+	uint32_t slot;
+
+	for (slot = entry->hash & cache->mask; cache->entries[slot].name; slot = (slot + 1) & cache->mask)
+		;
+	cache->entries[slot].version = entry->version;
+	cache->entries[slot].hash = entry->hash;
+	cache->entries[slot].address = entry->address;
+	__atomic_store_n(&cache->entries[slot].name, entry->name, __ATOMIC_RELEASE);
+	cache->count++;
+}
+
+static struct proc_cache *proc_cache_grow(struct proc_cache *old)
+{
+	uint32_t size = old ? 2 * (old->mask + 1) : 256;
+	struct proc_cache *cache = calloc(1, sizeof(*cache) + size * sizeof(cache->entries[0]));
+	uint32_t i;
+
+	assert(cache != NULL);
+	cache->mask = size - 1;
+	if (old) {
+		for (i = 0; i <= old->mask; i++) {
+			if (old->entries[i].name)
+				proc_cache_add(cache, &old->entries[i]);
+		}
+	}
+	return cache;
+}
+
+int egl_proc_cache_lookup(const char *name, int version, __eglMustCastToProperFunctionPointerType *address)
+{
+	struct proc_cache *cache = __atomic_load_n(&_proc_cache, __ATOMIC_ACQUIRE);
+	struct proc_cache_entry *entry = proc_cache_find(cache, name, version, proc_hash(name, 0));
+
+	if (!entry)
+		return 0;
+
+	*address = entry->address;
+	return 1;
+}
+
+void egl_proc_cache_insert(const char *name, int version, __eglMustCastToProperFunctionPointerType address)
+{
+	struct proc_cache_entry entry = { NULL, version, proc_hash(name, 0), address };
+	struct proc_cache *cache;
+
+	pthread_mutex_lock(&_proc_cache_lock);
+	cache = _proc_cache;
+	/* another thread may have resolved the same name meanwhile */
+	if (!proc_cache_find(cache, name, version, entry.hash)) {
+		if (!cache || 2 * (cache->count + 1) > cache->mask + 1) {
+			cache = proc_cache_grow(cache);
+			__atomic_store_n(&_proc_cache, cache, __ATOMIC_RELEASE);
+		}
+		entry.name = strdup(name);
+		assert(entry.name != NULL);
+		proc_cache_add(cache, &entry);
+	}
+	pthread_mutex_unlock(&_proc_cache_lock);
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef LIBHYBRIS_EGL_PROCADDRESS_H
+#define LIBHYBRIS_EGL_PROCADDRESS_H
+
+#include <EGL/egl.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct egl_proc {
+	const char *name;
+	__eglMustCastToProperFunctionPointerType address;
+};
+
+/*
+ * A fixed set of names, laid out so that no two of them share a slot.
+ * A lookup is one hash and at most one strcmp.
+ */
+struct egl_proc_table {
+	const struct egl_proc **slots;
+	uint32_t mask;
+	uint32_t seed;
+};
+
+/* Lays out count procs, which must stay valid for the lifetime of the table */
+void egl_proc_table_init(struct egl_proc_table *table, const struct egl_proc *procs, int count);
+
+/* Returns NULL if name is not in the table */
+__eglMustCastToProperFunctionPointerType egl_proc_table_lookup(const struct egl_proc_table *table, const char *name);
+
+/*
+ * Addresses resolved earlier, per client API version. Lookups take no
+ * lock and can run on any thread while another one inserts.
+ */
+int egl_proc_cache_lookup(const char *name, int version, __eglMustCastToProperFunctionPointerType *address);
+
+void egl_proc_cache_insert(const char *name, int version, __eglMustCastToProperFunctionPointerType address);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif /* LIBHYBRIS_EGL_PROCADDRESS_H */
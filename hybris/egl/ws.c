@@ -118,4 +118,33 @@ void ws_setSwapInterval(EGLDisplay dpy, EGLNativeWindowType win, EGLint interval
 		ws->setSwapInterval(dpy, win, interval);
 }
 
+EGLint ws_getBufferAge(EGLDisplay dpy, EGLNativeWindowType win)
+{
+	_init_ws();
+	if (ws->getBufferAge)
+		return ws->getBufferAge(dpy, win);
+	/* the contents of the back buffer are unknown */
+	return 0;
+}
+
+/*
+ * Returns the image created earlier for the same client buffer and the
+ * same arguments with a reference added for the caller, or NULL.
+ */
+struct egl_image *ws_lookupImageKHR(EGLDisplay dpy, EGLContext ctx, EGLenum target, EGLClientBuffer buffer, const EGLint *attrib_list)
+{
+	_init_ws();
+	if (ws->lookupImageKHR)
+		return ws->lookupImageKHR(dpy, ctx, target, buffer, attrib_list);
+	return NULL;
+}
+
+/* Offers a new image to the platform, which may keep a reference */
+void ws_cacheImageKHR(EGLDisplay dpy, EGLenum target, EGLClientBuffer buffer, struct egl_image *image)
+{
+	_init_ws();
+	if (ws->cacheImageKHR)
+		ws->cacheImageKHR(dpy, target, buffer, image);
+}
+
 // vim:ts=4:sw=4:noexpandtab
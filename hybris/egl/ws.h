@@ -15,8 +15,45 @@ struct egl_image
     EGLImageKHR egl_image;
     EGLClientBuffer egl_buffer;
     EGLenum target;
+    /* the rest of the arguments the image was created with */
+    EGLContext ctx;
+    EGLint *attrib_list;
+    /* held by the application and possibly by a platform cache */
+    int refcount;
+    EGLDisplay dpy;
+    EGLBoolean (*destroy)(struct egl_image *image);
 };
 
+static inline void egl_image_ref(struct egl_image *image)
+{
+    __sync_fetch_and_add(&image->refcount, 1);
+}
+
+/* Whether image was created on dpy for ctx with the same attributes */
+static inline int egl_image_matches(const struct egl_image *image, EGLDisplay dpy,
+        EGLContext ctx, const EGLint *attrib_list)
+{
+    const EGLint *a = image->attrib_list, *b = attrib_list;
+
+    if (image->dpy != dpy || image->ctx != ctx)
+        return 0;
+    while (a && *a != EGL_NONE && b && *b != EGL_NONE) {
+        if (a[0] != b[0] || a[1] != b[1])
+            return 0;
+        a += 2;
+        b += 2;
+    }
+    return (!a || *a == EGL_NONE) && (!b || *b == EGL_NONE);
+}
+
+/* Drops a reference, destroying the image with the last one */
+static inline EGLBoolean egl_image_unref(struct egl_image *image)
+{
+    if (__sync_fetch_and_sub(&image->refcount, 1) > 1)
+        return EGL_TRUE;
+    return image->destroy(image);
+}
+
 /* Defined in egl.c */
 extern struct ws_egl_interface hybris_egl_interface;
 
@@ -37,6 +74,9 @@ struct ws_module {
 	void (*prepareSwap)(EGLDisplay dpy, EGLNativeWindowType win, EGLint *damage_rects, EGLint damage_n_rects);
 	void (*finishSwap)(EGLDisplay dpy, EGLNativeWindowType win);
 	void (*setSwapInterval)(EGLDisplay dpy, EGLNativeWindowType win, EGLint interval);
+	EGLint (*getBufferAge)(EGLDisplay dpy, EGLNativeWindowType win);
+	struct egl_image *(*lookupImageKHR)(EGLDisplay dpy, EGLContext ctx, EGLenum target, EGLClientBuffer buffer, const EGLint *attrib_list);
+	void (*cacheImageKHR)(EGLDisplay dpy, EGLenum target, EGLClientBuffer buffer, struct egl_image *image);
 };
 
 struct _EGLDisplay *ws_GetDisplay(EGLNativeDisplayType native);
@@ -49,5 +89,8 @@ const char *ws_eglQueryString(EGLDisplay dpy, EGLint name, const char *(*real_eg
 void ws_prepareSwap(EGLDisplay dpy, EGLNativeWindowType win, EGLint *damage_rects, EGLint damage_n_rects);
 void ws_finishSwap(EGLDisplay dpy, EGLNativeWindowType win);
 void ws_setSwapInterval(EGLDisplay dpy, EGLNativeWindowType win, EGLint interval);
+EGLint ws_getBufferAge(EGLDisplay dpy, EGLNativeWindowType win);
+struct egl_image *ws_lookupImageKHR(EGLDisplay dpy, EGLContext ctx, EGLenum target, EGLClientBuffer buffer, const EGLint *attrib_list);
+void ws_cacheImageKHR(EGLDisplay dpy, EGLenum target, EGLClientBuffer buffer, struct egl_image *image);
 
 #endif
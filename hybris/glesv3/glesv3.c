@@ -0,0 +1,990 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * The entry points OpenGL ES 3.0 adds. Those it shares with 2.0 stay in
+ * libGLESv2, so applications link against both.
+ */
+
+#include <GLES3/gl3.h>
+#include <dlfcn.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <hybris/common/binding.h>
+#include <hybris/common/floating_point_abi.h>
+
+static void *_libglesv3 = NULL;
+
+/* Only functions with floating point argument need a wrapper to change the call convention correctly */
+
+static void         (*_glClearBufferfi)(GLenum buffer, GLint drawbuffer, GLfloat depth, GLint stencil) FP_ATTRIB = NULL;
+static void         (*_glSamplerParameterf)(GLuint sampler, GLenum pname, GLfloat param) FP_ATTRIB = NULL;
+
+static void         (*_glReadBuffer)(GLenum src) = NULL;
+static void         (*_glDrawRangeElements)(GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const void *indices) = NULL;
+static void         (*_glTexImage3D)(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void *pixels) = NULL;
+static void         (*_glTexSubImage3D)(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void *pixels) = NULL;
+static void         (*_glCopyTexSubImage3D)(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLint x, GLint y, GLsizei width, GLsizei height) = NULL;
+static void         (*_glCompressedTexImage3D)(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLsizei imageSize, const void *data) = NULL;
+static void         (*_glCompressedTexSubImage3D)(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLsizei imageSize, const void *data) = NULL;
+static void         (*_glGenQueries)(GLsizei n, GLuint *ids) = NULL;
+static void         (*_glDeleteQueries)(GLsizei n, const GLuint *ids) = NULL;
+static GLboolean    (*_glIsQuery)(GLuint id) = NULL;
+static void         (*_glBeginQuery)(GLenum target, GLuint id) = NULL;
+static void         (*_glEndQuery)(GLenum target) = NULL;
+static void         (*_glGetQueryiv)(GLenum target, GLenum pname, GLint *params) = NULL;
+static void         (*_glGetQueryObjectuiv)(GLuint id, GLenum pname, GLuint *params) = NULL;
+static GLboolean    (*_glUnmapBuffer)(GLenum target) = NULL;
+static void         (*_glGetBufferPointerv)(GLenum target, GLenum pname, void **params) = NULL;
+static void         (*_glDrawBuffers)(GLsizei n, const GLenum *bufs) = NULL;
+static void         (*_glUniformMatrix2x3fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) = NULL;
+static void         (*_glUniformMatrix3x2fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) = NULL;
+static void         (*_glUniformMatrix2x4fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) = NULL;
+static void         (*_glUniformMatrix4x2fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) = NULL;
+static void         (*_glUniformMatrix3x4fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) = NULL;
+static void         (*_glUniformMatrix4x3fv)(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value) = NULL;
+static void         (*_glBlitFramebuffer)(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter) = NULL;
+static void         (*_glRenderbufferStorageMultisample)(GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height) = NULL;
+static void         (*_glFramebufferTextureLayer)(GLenum target, GLenum attachment, GLuint texture, GLint level, GLint layer) = NULL;
+static void*        (*_glMapBufferRange)(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) = NULL;
+static void         (*_glFlushMappedBufferRange)(GLenum target, GLintptr offset, GLsizeiptr length) = NULL;
+static void         (*_glBindVertexArray)(GLuint array) = NULL;
+static void         (*_glDeleteVertexArrays)(GLsizei n, const GLuint *arrays) = NULL;
+static void         (*_glGenVertexArrays)(GLsizei n, GLuint *arrays) = NULL;
+static GLboolean    (*_glIsVertexArray)(GLuint array) = NULL;
+static void         (*_glGetIntegeri_v)(GLenum target, GLuint index, GLint *data) = NULL;
+static void         (*_glBeginTransformFeedback)(GLenum primitiveMode) = NULL;
+static void         (*_glEndTransformFeedback)(void) = NULL;
+static void         (*_glBindBufferRange)(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) = NULL;
+static void         (*_glBindBufferBase)(GLenum target, GLuint index, GLuint buffer) = NULL;
+static void         (*_glTransformFeedbackVaryings)(GLuint program, GLsizei count, const GLchar *const*varyings, GLenum bufferMode) = NULL;
+static void         (*_glGetTransformFeedbackVarying)(GLuint program, GLuint index, GLsizei bufSize, GLsizei *length, GLsizei *size, GLenum *type, GLchar *name) = NULL;
+static void         (*_glVertexAttribIPointer)(GLuint index, GLint size, GLenum type, GLsizei stride, const void *pointer) = NULL;
+static void         (*_glGetVertexAttribIiv)(GLuint index, GLenum pname, GLint *params) = NULL;
+static void         (*_glGetVertexAttribIuiv)(GLuint index, GLenum pname, GLuint *params) = NULL;
+static void         (*_glVertexAttribI4i)(GLuint index, GLint x, GLint y, GLint z, GLint w) = NULL;
+static void         (*_glVertexAttribI4ui)(GLuint index, GLuint x, GLuint y, GLuint z, GLuint w) = NULL;
+static void         (*_glVertexAttribI4iv)(GLuint index, const GLint *v) = NULL;
+static void         (*_glVertexAttribI4uiv)(GLuint index, const GLuint *v) = NULL;
+static void         (*_glGetUniformuiv)(GLuint program, GLint location, GLuint *params) = NULL;
+static GLint        (*_glGetFragDataLocation)(GLuint program, const GLchar *name) = NULL;
+static void         (*_glUniform1ui)(GLint location, GLuint v0) = NULL;
+static void         (*_glUniform2ui)(GLint location, GLuint v0, GLuint v1) = NULL;
+static void         (*_glUniform3ui)(GLint location, GLuint v0, GLuint v1, GLuint v2) = NULL;
+static void         (*_glUniform4ui)(GLint location, GLuint v0, GLuint v1, GLuint v2, GLuint v3) = NULL;
+static void         (*_glUniform1uiv)(GLint location, GLsizei count, const GLuint *value) = NULL;
+static void         (*_glUniform2uiv)(GLint location, GLsizei count, const GLuint *value) = NULL;
+static void         (*_glUniform3uiv)(GLint location, GLsizei count, const GLuint *value) = NULL;
+static void         (*_glUniform4uiv)(GLint location, GLsizei count, const GLuint *value) = NULL;
+static void         (*_glClearBufferiv)(GLenum buffer, GLint drawbuffer, const GLint *value) = NULL;
+static void         (*_glClearBufferuiv)(GLenum buffer, GLint drawbuffer, const GLuint *value) = NULL;
+static void         (*_glClearBufferfv)(GLenum buffer, GLint drawbuffer, const GLfloat *value) = NULL;
+static const GLubyte* (*_glGetStringi)(GLenum name, GLuint index) = NULL;
+static void         (*_glCopyBufferSubData)(GLenum readTarget, GLenum writeTarget, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size) = NULL;
+static void         (*_glGetUniformIndices)(GLuint program, GLsizei uniformCount, const GLchar *const*uniformNames, GLuint *uniformIndices) = NULL;
+static void         (*_glGetActiveUniformsiv)(GLuint program, GLsizei uniformCount, const GLuint *uniformIndices, GLenum pname, GLint *params) = NULL;
+static GLuint       (*_glGetUniformBlockIndex)(GLuint program, const GLchar *uniformBlockName) = NULL;
+static void         (*_glGetActiveUniformBlockiv)(GLuint program, GLuint uniformBlockIndex, GLenum pname, GLint *params) = NULL;
+static void         (*_glGetActiveUniformBlockName)(GLuint program, GLuint uniformBlockIndex, GLsizei bufSize, GLsizei *length, GLchar *uniformBlockName) = NULL;
+static void         (*_glUniformBlockBinding)(GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding) = NULL;
+static void         (*_glDrawArraysInstanced)(GLenum mode, GLint first, GLsizei count, GLsizei instancecount) = NULL;
+static void         (*_glDrawElementsInstanced)(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount) = NULL;
+static GLsync       (*_glFenceSync)(GLenum condition, GLbitfield flags) = NULL;
+static GLboolean    (*_glIsSync)(GLsync sync) = NULL;
+static void         (*_glDeleteSync)(GLsync sync) = NULL;
+static GLenum       (*_glClientWaitSync)(GLsync sync, GLbitfield flags, GLuint64 timeout) = NULL;
+static void         (*_glWaitSync)(GLsync sync, GLbitfield flags, GLuint64 timeout) = NULL;
+static void         (*_glGetInteger64v)(GLenum pname, GLint64 *data) = NULL;
+static void         (*_glGetSynciv)(GLsync sync, GLenum pname, GLsizei count, GLsizei *length, GLint *values) = NULL;
+static void         (*_glGetInteger64i_v)(GLenum target, GLuint index, GLint64 *data) = NULL;
+static void         (*_glGetBufferParameteri64v)(GLenum target, GLenum pname, GLint64 *params) = NULL;
+static void         (*_glGenSamplers)(GLsizei count, GLuint *samplers) = NULL;
+static void         (*_glDeleteSamplers)(GLsizei count, const GLuint *samplers) = NULL;
+static GLboolean    (*_glIsSampler)(GLuint sampler) = NULL;
+static void         (*_glBindSampler)(GLuint unit, GLuint sampler) = NULL;
+static void         (*_glSamplerParameteri)(GLuint sampler, GLenum pname, GLint param) = NULL;
+static void         (*_glSamplerParameteriv)(GLuint sampler, GLenum pname, const GLint *param) = NULL;
+static void         (*_glSamplerParameterfv)(GLuint sampler, GLenum pname, const GLfloat *param) = NULL;
+static void         (*_glGetSamplerParameteriv)(GLuint sampler, GLenum pname, GLint *params) = NULL;
+static void         (*_glGetSamplerParameterfv)(GLuint sampler, GLenum pname, GLfloat *params) = NULL;
+static void         (*_glVertexAttribDivisor)(GLuint index, GLuint divisor) = NULL;
+static void         (*_glBindTransformFeedback)(GLenum target, GLuint id) = NULL;
+static void         (*_glDeleteTransformFeedbacks)(GLsizei n, const GLuint *ids) = NULL;
+static void         (*_glGenTransformFeedbacks)(GLsizei n, GLuint *ids) = NULL;
+static GLboolean    (*_glIsTransformFeedback)(GLuint id) = NULL;
+static void         (*_glPauseTransformFeedback)(void) = NULL;
+static void         (*_glResumeTransformFeedback)(void) = NULL;
+static void         (*_glGetProgramBinary)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary) = NULL;
+static void         (*_glProgramBinary)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length) = NULL;
+static void         (*_glProgramParameteri)(GLuint program, GLenum pname, GLint value) = NULL;
+static void         (*_glInvalidateFramebuffer)(GLenum target, GLsizei numAttachments, const GLenum *attachments) = NULL;
+static void         (*_glInvalidateSubFramebuffer)(GLenum target, GLsizei numAttachments, const GLenum *attachments, GLint x, GLint y, GLsizei width, GLsizei height) = NULL;
+static void         (*_glTexStorage2D)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height) = NULL;
+static void         (*_glTexStorage3D)(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth) = NULL;
+static void         (*_glGetInternalformativ)(GLenum target, GLenum internalformat, GLenum pname, GLsizei count, GLint *params) = NULL;
+
+
+#define GLES3_LOAD(sym)  { *(&_ ## sym) = (void *) android_dlsym(_libglesv3, #sym);  }
+
+/*
+This generates a function that when first called overwrites it's plt entry with new address. Subsequent calls jump directly at the target function in the android library. This means effectively 0 call overhead after the first call.
+*/
+
+#define GLES3_IDLOAD(sym) \
+ __asm__ (".type " #sym ", %gnu_indirect_function"); \
+typeof(sym) * sym ## _dispatch (void) __asm__ (#sym);\
+typeof(sym) * sym ## _dispatch (void) \
+{ \
+	if (_libglesv3) \
+		return (void *) android_dlsym(_libglesv3, #sym); \
+	else \
+		return &sym ## _wrapper; \
+}
+
+static void  __attribute__((constructor)) _init_androidglesv3()  {
+	_libglesv3 = (void *) android_dlopen(getenv("LIBGLESV3") ? getenv("LIBGLESV3") : "libGLESv3.so", RTLD_NOW);
+	GLES3_LOAD(glClearBufferfi);
+	GLES3_LOAD(glSamplerParameterf);
+
+	GLES3_LOAD(glReadBuffer);
+	GLES3_LOAD(glDrawRangeElements);
+	GLES3_LOAD(glTexImage3D);
+	GLES3_LOAD(glTexSubImage3D);
+	GLES3_LOAD(glCopyTexSubImage3D);
+	GLES3_LOAD(glCompressedTexImage3D);
+	GLES3_LOAD(glCompressedTexSubImage3D);
+	GLES3_LOAD(glGenQueries);
+	GLES3_LOAD(glDeleteQueries);
+	GLES3_LOAD(glIsQuery);
+	GLES3_LOAD(glBeginQuery);
+	GLES3_LOAD(glEndQuery);
+	GLES3_LOAD(glGetQueryiv);
+	GLES3_LOAD(glGetQueryObjectuiv);
+	GLES3_LOAD(glUnmapBuffer);
+	GLES3_LOAD(glGetBufferPointerv);
+	GLES3_LOAD(glDrawBuffers);
+	GLES3_LOAD(glUniformMatrix2x3fv);
+	GLES3_LOAD(glUniformMatrix3x2fv);
+	GLES3_LOAD(glUniformMatrix2x4fv);
+	GLES3_LOAD(glUniformMatrix4x2fv);
+	GLES3_LOAD(glUniformMatrix3x4fv);
+	GLES3_LOAD(glUniformMatrix4x3fv);
+	GLES3_LOAD(glBlitFramebuffer);
+	GLES3_LOAD(glRenderbufferStorageMultisample);
+	GLES3_LOAD(glFramebufferTextureLayer);
+	GLES3_LOAD(glMapBufferRange);
+	GLES3_LOAD(glFlushMappedBufferRange);
+	GLES3_LOAD(glBindVertexArray);
+	GLES3_LOAD(glDeleteVertexArrays);
+	GLES3_LOAD(glGenVertexArrays);
+	GLES3_LOAD(glIsVertexArray);
+	GLES3_LOAD(glGetIntegeri_v);
+	GLES3_LOAD(glBeginTransformFeedback);
+	GLES3_LOAD(glEndTransformFeedback);
+	GLES3_LOAD(glBindBufferRange);
+	GLES3_LOAD(glBindBufferBase);
+	GLES3_LOAD(glTransformFeedbackVaryings);
+	GLES3_LOAD(glGetTransformFeedbackVarying);
+	GLES3_LOAD(glVertexAttribIPointer);
+	GLES3_LOAD(glGetVertexAttribIiv);
+	GLES3_LOAD(glGetVertexAttribIuiv);
+	GLES3_LOAD(glVertexAttribI4i);
+	GLES3_LOAD(glVertexAttribI4ui);
+	GLES3_LOAD(glVertexAttribI4iv);
+	GLES3_LOAD(glVertexAttribI4uiv);
+	GLES3_LOAD(glGetUniformuiv);
+	GLES3_LOAD(glGetFragDataLocation);
+	GLES3_LOAD(glUniform1ui);
+	GLES3_LOAD(glUniform2ui);
+	GLES3_LOAD(glUniform3ui);
+	GLES3_LOAD(glUniform4ui);
+	GLES3_LOAD(glUniform1uiv);
+	GLES3_LOAD(glUniform2uiv);
+	GLES3_LOAD(glUniform3uiv);
+	GLES3_LOAD(glUniform4uiv);
+	GLES3_LOAD(glClearBufferiv);
+	GLES3_LOAD(glClearBufferuiv);
+	GLES3_LOAD(glClearBufferfv);
+	GLES3_LOAD(glGetStringi);
+	GLES3_LOAD(glCopyBufferSubData);
+	GLES3_LOAD(glGetUniformIndices);
+	GLES3_LOAD(glGetActiveUniformsiv);
+	GLES3_LOAD(glGetUniformBlockIndex);
+	GLES3_LOAD(glGetActiveUniformBlockiv);
+	GLES3_LOAD(glGetActiveUniformBlockName);
+	GLES3_LOAD(glUniformBlockBinding);
+	GLES3_LOAD(glDrawArraysInstanced);
+	GLES3_LOAD(glDrawElementsInstanced);
+	GLES3_LOAD(glFenceSync);
+	GLES3_LOAD(glIsSync);
+	GLES3_LOAD(glDeleteSync);
+	GLES3_LOAD(glClientWaitSync);
+	GLES3_LOAD(glWaitSync);
+	GLES3_LOAD(glGetInteger64v);
+	GLES3_LOAD(glGetSynciv);
+	GLES3_LOAD(glGetInteger64i_v);
+	GLES3_LOAD(glGetBufferParameteri64v);
+	GLES3_LOAD(glGenSamplers);
+	GLES3_LOAD(glDeleteSamplers);
+	GLES3_LOAD(glIsSampler);
+	GLES3_LOAD(glBindSampler);
+	GLES3_LOAD(glSamplerParameteri);
+	GLES3_LOAD(glSamplerParameteriv);
+	GLES3_LOAD(glSamplerParameterfv);
+	GLES3_LOAD(glGetSamplerParameteriv);
+	GLES3_LOAD(glGetSamplerParameterfv);
+	GLES3_LOAD(glVertexAttribDivisor);
+	GLES3_LOAD(glBindTransformFeedback);
+	GLES3_LOAD(glDeleteTransformFeedbacks);
+	GLES3_LOAD(glGenTransformFeedbacks);
+	GLES3_LOAD(glIsTransformFeedback);
+	GLES3_LOAD(glPauseTransformFeedback);
+	GLES3_LOAD(glResumeTransformFeedback);
+	GLES3_LOAD(glGetProgramBinary);
+	GLES3_LOAD(glProgramBinary);
+	GLES3_LOAD(glProgramParameteri);
+	GLES3_LOAD(glInvalidateFramebuffer);
+	GLES3_LOAD(glInvalidateSubFramebuffer);
+	GLES3_LOAD(glTexStorage2D);
+	GLES3_LOAD(glTexStorage3D);
+	GLES3_LOAD(glGetInternalformativ);
+}
+
+static void glReadBuffer_wrapper(GLenum src)
+{
+	return (*_glReadBuffer)(src);
+}
+
+static void glDrawRangeElements_wrapper(GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const void *indices)
+{
+	return (*_glDrawRangeElements)(mode, start, end, count, type, indices);
+}
+
+static void glTexImage3D_wrapper(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const void *pixels)
+{
+	return (*_glTexImage3D)(target, level, internalformat, width, height, depth, border, format, type, pixels);
+}
+
+static void glTexSubImage3D_wrapper(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const void *pixels)
+{
+	return (*_glTexSubImage3D)(target, level, xoffset, yoffset, zoffset, width, height, depth, format, type, pixels);
+}
+
+static void glCopyTexSubImage3D_wrapper(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	return (*_glCopyTexSubImage3D)(target, level, xoffset, yoffset, zoffset, x, y, width, height);
+}
+
+static void glCompressedTexImage3D_wrapper(GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLsizei imageSize, const void *data)
+{
+	return (*_glCompressedTexImage3D)(target, level, internalformat, width, height, depth, border, imageSize, data);
+}
+
+static void glCompressedTexSubImage3D_wrapper(GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLsizei imageSize, const void *data)
+{
+	return (*_glCompressedTexSubImage3D)(target, level, xoffset, yoffset, zoffset, width, height, depth, format, imageSize, data);
+}
+
+static void glGenQueries_wrapper(GLsizei n, GLuint *ids)
+{
+	return (*_glGenQueries)(n, ids);
+}
+
+static void glDeleteQueries_wrapper(GLsizei n, const GLuint *ids)
+{
+	return (*_glDeleteQueries)(n, ids);
+}
+
+static GLboolean glIsQuery_wrapper(GLuint id)
+{
+	return (*_glIsQuery)(id);
+}
+
+static void glBeginQuery_wrapper(GLenum target, GLuint id)
+{
+	return (*_glBeginQuery)(target, id);
+}
+
+static void glEndQuery_wrapper(GLenum target)
+{
+	return (*_glEndQuery)(target);
+}
+
+static void glGetQueryiv_wrapper(GLenum target, GLenum pname, GLint *params)
+{
+	return (*_glGetQueryiv)(target, pname, params);
+}
+
+static void glGetQueryObjectuiv_wrapper(GLuint id, GLenum pname, GLuint *params)
+{
+	return (*_glGetQueryObjectuiv)(id, pname, params);
+}
+
+static GLboolean glUnmapBuffer_wrapper(GLenum target)
+{
+	return (*_glUnmapBuffer)(target);
+}
+
+static void glGetBufferPointerv_wrapper(GLenum target, GLenum pname, void **params)
+{
+	return (*_glGetBufferPointerv)(target, pname, params);
+}
+
+static void glDrawBuffers_wrapper(GLsizei n, const GLenum *bufs)
+{
+	return (*_glDrawBuffers)(n, bufs);
+}
+
+static void glUniformMatrix2x3fv_wrapper(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+	return (*_glUniformMatrix2x3fv)(location, count, transpose, value);
+}
+
+static void glUniformMatrix3x2fv_wrapper(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+	return (*_glUniformMatrix3x2fv)(location, count, transpose, value);
+}
+
+static void glUniformMatrix2x4fv_wrapper(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+	return (*_glUniformMatrix2x4fv)(location, count, transpose, value);
+}
+
+static void glUniformMatrix4x2fv_wrapper(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+	return (*_glUniformMatrix4x2fv)(location, count, transpose, value);
+}
+
+static void glUniformMatrix3x4fv_wrapper(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+	return (*_glUniformMatrix3x4fv)(location, count, transpose, value);
+}
+
+static void glUniformMatrix4x3fv_wrapper(GLint location, GLsizei count, GLboolean transpose, const GLfloat *value)
+{
+	return (*_glUniformMatrix4x3fv)(location, count, transpose, value);
+}
+
+static void glBlitFramebuffer_wrapper(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter)
+{
+	return (*_glBlitFramebuffer)(srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter);
+}
+
+static void glRenderbufferStorageMultisample_wrapper(GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height)
+{
+	return (*_glRenderbufferStorageMultisample)(target, samples, internalformat, width, height);
+}
+
+static void glFramebufferTextureLayer_wrapper(GLenum target, GLenum attachment, GLuint texture, GLint level, GLint layer)
+{
+	return (*_glFramebufferTextureLayer)(target, attachment, texture, level, layer);
+}
+
+static void* glMapBufferRange_wrapper(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+	return (*_glMapBufferRange)(target, offset, length, access);
+}
+
+static void glFlushMappedBufferRange_wrapper(GLenum target, GLintptr offset, GLsizeiptr length)
+{
+	return (*_glFlushMappedBufferRange)(target, offset, length);
+}
+
+static void glBindVertexArray_wrapper(GLuint array)
+{
+	return (*_glBindVertexArray)(array);
+}
+
+static void glDeleteVertexArrays_wrapper(GLsizei n, const GLuint *arrays)
+{
+	return (*_glDeleteVertexArrays)(n, arrays);
+}
+
+static void glGenVertexArrays_wrapper(GLsizei n, GLuint *arrays)
+{
+	return (*_glGenVertexArrays)(n, arrays);
+}
+
+static GLboolean glIsVertexArray_wrapper(GLuint array)
+{
+	return (*_glIsVertexArray)(array);
+}
+
+static void glGetIntegeri_v_wrapper(GLenum target, GLuint index, GLint *data)
+{
+	return (*_glGetIntegeri_v)(target, index, data);
+}
+
+static void glBeginTransformFeedback_wrapper(GLenum primitiveMode)
+{
+	return (*_glBeginTransformFeedback)(primitiveMode);
+}
+
+static void glEndTransformFeedback_wrapper(void)
+{
+	return (*_glEndTransformFeedback)();
+}
+
+static void glBindBufferRange_wrapper(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	return (*_glBindBufferRange)(target, index, buffer, offset, size);
+}
+
+static void glBindBufferBase_wrapper(GLenum target, GLuint index, GLuint buffer)
+{
+	return (*_glBindBufferBase)(target, index, buffer);
+}
+
+static void glTransformFeedbackVaryings_wrapper(GLuint program, GLsizei count, const GLchar *const*varyings, GLenum bufferMode)
+{
+	return (*_glTransformFeedbackVaryings)(program, count, varyings, bufferMode);
+}
+
+static void glGetTransformFeedbackVarying_wrapper(GLuint program, GLuint index, GLsizei bufSize, GLsizei *length, GLsizei *size, GLenum *type, GLchar *name)
+{
+	return (*_glGetTransformFeedbackVarying)(program, index, bufSize, length, size, type, name);
+}
+
+static void glVertexAttribIPointer_wrapper(GLuint index, GLint size, GLenum type, GLsizei stride, const void *pointer)
+{
+	return (*_glVertexAttribIPointer)(index, size, type, stride, pointer);
+}
+
+static void glGetVertexAttribIiv_wrapper(GLuint index, GLenum pname, GLint *params)
+{
+	return (*_glGetVertexAttribIiv)(index, pname, params);
+}
+
+static void glGetVertexAttribIuiv_wrapper(GLuint index, GLenum pname, GLuint *params)
+{
+	return (*_glGetVertexAttribIuiv)(index, pname, params);
+}
+
+static void glVertexAttribI4i_wrapper(GLuint index, GLint x, GLint y, GLint z, GLint w)
+{
+	return (*_glVertexAttribI4i)(index, x, y, z, w);
+}
+
+static void glVertexAttribI4ui_wrapper(GLuint index, GLuint x, GLuint y, GLuint z, GLuint w)
+{
+	return (*_glVertexAttribI4ui)(index, x, y, z, w);
+}
+
+static void glVertexAttribI4iv_wrapper(GLuint index, const GLint *v)
+{
+	return (*_glVertexAttribI4iv)(index, v);
+}
+
+static void glVertexAttribI4uiv_wrapper(GLuint index, const GLuint *v)
+{
+	return (*_glVertexAttribI4uiv)(index, v);
+}
+
+static void glGetUniformuiv_wrapper(GLuint program, GLint location, GLuint *params)
+{
+	return (*_glGetUniformuiv)(program, location, params);
+}
+
+static GLint glGetFragDataLocation_wrapper(GLuint program, const GLchar *name)
+{
+	return (*_glGetFragDataLocation)(program, name);
+}
+
+static void glUniform1ui_wrapper(GLint location, GLuint v0)
+{
+	return (*_glUniform1ui)(location, v0);
+}
+
+static void glUniform2ui_wrapper(GLint location, GLuint v0, GLuint v1)
+{
+	return (*_glUniform2ui)(location, v0, v1);
+}
+
+static void glUniform3ui_wrapper(GLint location, GLuint v0, GLuint v1, GLuint v2)
+{
+	return (*_glUniform3ui)(location, v0, v1, v2);
+}
+
+static void glUniform4ui_wrapper(GLint location, GLuint v0, GLuint v1, GLuint v2, GLuint v3)
+{
+	return (*_glUniform4ui)(location, v0, v1, v2, v3);
+}
+
+static void glUniform1uiv_wrapper(GLint location, GLsizei count, const GLuint *value)
+{
+	return (*_glUniform1uiv)(location, count, value);
+}
+
+static void glUniform2uiv_wrapper(GLint location, GLsizei count, const GLuint *value)
+{
+	return (*_glUniform2uiv)(location, count, value);
+}
+
+static void glUniform3uiv_wrapper(GLint location, GLsizei count, const GLuint *value)
+{
+	return (*_glUniform3uiv)(location, count, value);
+}
+
+static void glUniform4uiv_wrapper(GLint location, GLsizei count, const GLuint *value)
+{
+	return (*_glUniform4uiv)(location, count, value);
+}
+
+static void glClearBufferiv_wrapper(GLenum buffer, GLint drawbuffer, const GLint *value)
+{
+	return (*_glClearBufferiv)(buffer, drawbuffer, value);
+}
+
+static void glClearBufferuiv_wrapper(GLenum buffer, GLint drawbuffer, const GLuint *value)
+{
+	return (*_glClearBufferuiv)(buffer, drawbuffer, value);
+}
+
+static void glClearBufferfv_wrapper(GLenum buffer, GLint drawbuffer, const GLfloat *value)
+{
+	return (*_glClearBufferfv)(buffer, drawbuffer, value);
+}
+
+static const GLubyte* glGetStringi_wrapper(GLenum name, GLuint index)
+{
+	return (*_glGetStringi)(name, index);
+}
+
+static void glCopyBufferSubData_wrapper(GLenum readTarget, GLenum writeTarget, GLintptr readOffset, GLintptr writeOffset, GLsizeiptr size)
+{
+	return (*_glCopyBufferSubData)(readTarget, writeTarget, readOffset, writeOffset, size);
+}
+
+static void glGetUniformIndices_wrapper(GLuint program, GLsizei uniformCount, const GLchar *const*uniformNames, GLuint *uniformIndices)
+{
+	return (*_glGetUniformIndices)(program, uniformCount, uniformNames, uniformIndices);
+}
+
+static void glGetActiveUniformsiv_wrapper(GLuint program, GLsizei uniformCount, const GLuint *uniformIndices, GLenum pname, GLint *params)
+{
+	return (*_glGetActiveUniformsiv)(program, uniformCount, uniformIndices, pname, params);
+}
+
+static GLuint glGetUniformBlockIndex_wrapper(GLuint program, const GLchar *uniformBlockName)
+{
+	return (*_glGetUniformBlockIndex)(program, uniformBlockName);
+}
+
+static void glGetActiveUniformBlockiv_wrapper(GLuint program, GLuint uniformBlockIndex, GLenum pname, GLint *params)
+{
+	return (*_glGetActiveUniformBlockiv)(program, uniformBlockIndex, pname, params);
+}
+
+static void glGetActiveUniformBlockName_wrapper(GLuint program, GLuint uniformBlockIndex, GLsizei bufSize, GLsizei *length, GLchar *uniformBlockName)
+{
+	return (*_glGetActiveUniformBlockName)(program, uniformBlockIndex, bufSize, length, uniformBlockName);
+}
+
+static void glUniformBlockBinding_wrapper(GLuint program, GLuint uniformBlockIndex, GLuint uniformBlockBinding)
+{
+	return (*_glUniformBlockBinding)(program, uniformBlockIndex, uniformBlockBinding);
+}
+
+static void glDrawArraysInstanced_wrapper(GLenum mode, GLint first, GLsizei count, GLsizei instancecount)
+{
+	return (*_glDrawArraysInstanced)(mode, first, count, instancecount);
+}
+
+static void glDrawElementsInstanced_wrapper(GLenum mode, GLsizei count, GLenum type, const void *indices, GLsizei instancecount)
+{
+	return (*_glDrawElementsInstanced)(mode, count, type, indices, instancecount);
+}
+
+static GLsync glFenceSync_wrapper(GLenum condition, GLbitfield flags)
+{
+	return (*_glFenceSync)(condition, flags);
+}
+
+static GLboolean glIsSync_wrapper(GLsync sync)
+{
+	return (*_glIsSync)(sync);
+}
+
+static void glDeleteSync_wrapper(GLsync sync)
+{
+	return (*_glDeleteSync)(sync);
+}
+
+static GLenum glClientWaitSync_wrapper(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	return (*_glClientWaitSync)(sync, flags, timeout);
+}
+
+static void glWaitSync_wrapper(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	return (*_glWaitSync)(sync, flags, timeout);
+}
+
+static void glGetInteger64v_wrapper(GLenum pname, GLint64 *data)
+{
+	return (*_glGetInteger64v)(pname, data);
+}
+
+static void glGetSynciv_wrapper(GLsync sync, GLenum pname, GLsizei count, GLsizei *length, GLint *values)
+{
+	return (*_glGetSynciv)(sync, pname, count, length, values);
+}
+
+static void glGetInteger64i_v_wrapper(GLenum target, GLuint index, GLint64 *data)
+{
+	return (*_glGetInteger64i_v)(target, index, data);
+}
+
+static void glGetBufferParameteri64v_wrapper(GLenum target, GLenum pname, GLint64 *params)
+{
+	return (*_glGetBufferParameteri64v)(target, pname, params);
+}
+
+static void glGenSamplers_wrapper(GLsizei count, GLuint *samplers)
+{
+	return (*_glGenSamplers)(count, samplers);
+}
+
+static void glDeleteSamplers_wrapper(GLsizei count, const GLuint *samplers)
+{
+	return (*_glDeleteSamplers)(count, samplers);
+}
+
+static GLboolean glIsSampler_wrapper(GLuint sampler)
+{
+	return (*_glIsSampler)(sampler);
+}
+
+static void glBindSampler_wrapper(GLuint unit, GLuint sampler)
+{
+	return (*_glBindSampler)(unit, sampler);
+}
+
+static void glSamplerParameteri_wrapper(GLuint sampler, GLenum pname, GLint param)
+{
+	return (*_glSamplerParameteri)(sampler, pname, param);
+}
+
+static void glSamplerParameteriv_wrapper(GLuint sampler, GLenum pname, const GLint *param)
+{
+	return (*_glSamplerParameteriv)(sampler, pname, param);
+}
+
+static void glSamplerParameterfv_wrapper(GLuint sampler, GLenum pname, const GLfloat *param)
+{
+	return (*_glSamplerParameterfv)(sampler, pname, param);
+}
+
+static void glGetSamplerParameteriv_wrapper(GLuint sampler, GLenum pname, GLint *params)
+{
+	return (*_glGetSamplerParameteriv)(sampler, pname, params);
+}
+
+static void glGetSamplerParameterfv_wrapper(GLuint sampler, GLenum pname, GLfloat *params)
+{
+	return (*_glGetSamplerParameterfv)(sampler, pname, params);
+}
+
+static void glVertexAttribDivisor_wrapper(GLuint index, GLuint divisor)
+{
+	return (*_glVertexAttribDivisor)(index, divisor);
+}
+
+static void glBindTransformFeedback_wrapper(GLenum target, GLuint id)
+{
+	return (*_glBindTransformFeedback)(target, id);
+}
+
+static void glDeleteTransformFeedbacks_wrapper(GLsizei n, const GLuint *ids)
+{
+	return (*_glDeleteTransformFeedbacks)(n, ids);
+}
+
+static void glGenTransformFeedbacks_wrapper(GLsizei n, GLuint *ids)
+{
+	return (*_glGenTransformFeedbacks)(n, ids);
+}
+
+static GLboolean glIsTransformFeedback_wrapper(GLuint id)
+{
+	return (*_glIsTransformFeedback)(id);
+}
+
+static void glPauseTransformFeedback_wrapper(void)
+{
+	return (*_glPauseTransformFeedback)();
+}
+
+static void glResumeTransformFeedback_wrapper(void)
+{
+	return (*_glResumeTransformFeedback)();
+}
+
+static void glGetProgramBinary_wrapper(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary)
+{
+	return (*_glGetProgramBinary)(program, bufSize, length, binaryFormat, binary);
+}
+
+static void glProgramBinary_wrapper(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length)
+{
+	return (*_glProgramBinary)(program, binaryFormat, binary, length);
+}
+
+static void glProgramParameteri_wrapper(GLuint program, GLenum pname, GLint value)
+{
+	return (*_glProgramParameteri)(program, pname, value);
+}
+
+static void glInvalidateFramebuffer_wrapper(GLenum target, GLsizei numAttachments, const GLenum *attachments)
+{
+	return (*_glInvalidateFramebuffer)(target, numAttachments, attachments);
+}
+
+static void glInvalidateSubFramebuffer_wrapper(GLenum target, GLsizei numAttachments, const GLenum *attachments, GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	return (*_glInvalidateSubFramebuffer)(target, numAttachments, attachments, x, y, width, height);
+}
+
+static void glTexStorage2D_wrapper(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height)
+{
+	return (*_glTexStorage2D)(target, levels, internalformat, width, height);
+}
+
+static void glTexStorage3D_wrapper(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth)
+{
+	return (*_glTexStorage3D)(target, levels, internalformat, width, height, depth);
+}
+
+static void glGetInternalformativ_wrapper(GLenum target, GLenum internalformat, GLenum pname, GLsizei count, GLint *params)
+{
+	return (*_glGetInternalformativ)(target, internalformat, pname, count, params);
+}
+
+GLES3_IDLOAD(glReadBuffer);
+
+GLES3_IDLOAD(glDrawRangeElements);
+
+GLES3_IDLOAD(glTexImage3D);
+
+GLES3_IDLOAD(glTexSubImage3D);
+
+GLES3_IDLOAD(glCopyTexSubImage3D);
+
+GLES3_IDLOAD(glCompressedTexImage3D);
+
+GLES3_IDLOAD(glCompressedTexSubImage3D);
+
+GLES3_IDLOAD(glGenQueries);
+
+GLES3_IDLOAD(glDeleteQueries);
+
+GLES3_IDLOAD(glIsQuery);
+
+GLES3_IDLOAD(glBeginQuery);
+
+GLES3_IDLOAD(glEndQuery);
+
+GLES3_IDLOAD(glGetQueryiv);
+
+GLES3_IDLOAD(glGetQueryObjectuiv);
+
+GLES3_IDLOAD(glUnmapBuffer);
+
+GLES3_IDLOAD(glGetBufferPointerv);
+
+GLES3_IDLOAD(glDrawBuffers);
+
+GLES3_IDLOAD(glUniformMatrix2x3fv);
+
+GLES3_IDLOAD(glUniformMatrix3x2fv);
+
+GLES3_IDLOAD(glUniformMatrix2x4fv);
+
+GLES3_IDLOAD(glUniformMatrix4x2fv);
+
+GLES3_IDLOAD(glUniformMatrix3x4fv);
+
+GLES3_IDLOAD(glUniformMatrix4x3fv);
+
+GLES3_IDLOAD(glBlitFramebuffer);
+
+GLES3_IDLOAD(glRenderbufferStorageMultisample);
+
+GLES3_IDLOAD(glFramebufferTextureLayer);
+
+GLES3_IDLOAD(glMapBufferRange);
+
+GLES3_IDLOAD(glFlushMappedBufferRange);
+
+GLES3_IDLOAD(glBindVertexArray);
+
+GLES3_IDLOAD(glDeleteVertexArrays);
+
+GLES3_IDLOAD(glGenVertexArrays);
+
+GLES3_IDLOAD(glIsVertexArray);
+
+GLES3_IDLOAD(glGetIntegeri_v);
+
+GLES3_IDLOAD(glBeginTransformFeedback);
+
+GLES3_IDLOAD(glEndTransformFeedback);
+
+GLES3_IDLOAD(glBindBufferRange);
+
+GLES3_IDLOAD(glBindBufferBase);
+
+GLES3_IDLOAD(glTransformFeedbackVaryings);
+
+GLES3_IDLOAD(glGetTransformFeedbackVarying);
+
+GLES3_IDLOAD(glVertexAttribIPointer);
+
+GLES3_IDLOAD(glGetVertexAttribIiv);
+
+GLES3_IDLOAD(glGetVertexAttribIuiv);
+
+GLES3_IDLOAD(glVertexAttribI4i);
+
+GLES3_IDLOAD(glVertexAttribI4ui);
+
+GLES3_IDLOAD(glVertexAttribI4iv);
+
+GLES3_IDLOAD(glVertexAttribI4uiv);
+
+GLES3_IDLOAD(glGetUniformuiv);
+
+GLES3_IDLOAD(glGetFragDataLocation);
+
+GLES3_IDLOAD(glUniform1ui);
+
+GLES3_IDLOAD(glUniform2ui);
+
+GLES3_IDLOAD(glUniform3ui);
+
+GLES3_IDLOAD(glUniform4ui);
+
+GLES3_IDLOAD(glUniform1uiv);
+
+GLES3_IDLOAD(glUniform2uiv);
+
+GLES3_IDLOAD(glUniform3uiv);
+
+GLES3_IDLOAD(glUniform4uiv);
+
+GLES3_IDLOAD(glClearBufferiv);
+
+GLES3_IDLOAD(glClearBufferuiv);
+
+GLES3_IDLOAD(glClearBufferfv);
+
+GLES3_IDLOAD(glGetStringi);
+
+GLES3_IDLOAD(glCopyBufferSubData);
+
+GLES3_IDLOAD(glGetUniformIndices);
+
+GLES3_IDLOAD(glGetActiveUniformsiv);
+
+GLES3_IDLOAD(glGetUniformBlockIndex);
+
+GLES3_IDLOAD(glGetActiveUniformBlockiv);
+
+GLES3_IDLOAD(glGetActiveUniformBlockName);
+
+GLES3_IDLOAD(glUniformBlockBinding);
+
+GLES3_IDLOAD(glDrawArraysInstanced);
+
+GLES3_IDLOAD(glDrawElementsInstanced);
+
+GLES3_IDLOAD(glFenceSync);
+
+GLES3_IDLOAD(glIsSync);
+
+GLES3_IDLOAD(glDeleteSync);
+
+GLES3_IDLOAD(glClientWaitSync);
+
+GLES3_IDLOAD(glWaitSync);
+
+GLES3_IDLOAD(glGetInteger64v);
+
+GLES3_IDLOAD(glGetSynciv);
+
+GLES3_IDLOAD(glGetInteger64i_v);
+
+GLES3_IDLOAD(glGetBufferParameteri64v);
+
+GLES3_IDLOAD(glGenSamplers);
+
+GLES3_IDLOAD(glDeleteSamplers);
+
+GLES3_IDLOAD(glIsSampler);
+
+GLES3_IDLOAD(glBindSampler);
+
+GLES3_IDLOAD(glSamplerParameteri);
+
+GLES3_IDLOAD(glSamplerParameteriv);
+
+GLES3_IDLOAD(glSamplerParameterfv);
+
+GLES3_IDLOAD(glGetSamplerParameteriv);
+
+GLES3_IDLOAD(glGetSamplerParameterfv);
+
+GLES3_IDLOAD(glVertexAttribDivisor);
+
+GLES3_IDLOAD(glBindTransformFeedback);
+
+GLES3_IDLOAD(glDeleteTransformFeedbacks);
+
+GLES3_IDLOAD(glGenTransformFeedbacks);
+
+GLES3_IDLOAD(glIsTransformFeedback);
+
+GLES3_IDLOAD(glPauseTransformFeedback);
+
+GLES3_IDLOAD(glResumeTransformFeedback);
+
+GLES3_IDLOAD(glGetProgramBinary);
+
+GLES3_IDLOAD(glProgramBinary);
+
+GLES3_IDLOAD(glProgramParameteri);
+
+GLES3_IDLOAD(glInvalidateFramebuffer);
+
+GLES3_IDLOAD(glInvalidateSubFramebuffer);
+
+GLES3_IDLOAD(glTexStorage2D);
+
+GLES3_IDLOAD(glTexStorage3D);
+
+GLES3_IDLOAD(glGetInternalformativ);
+
+void glClearBufferfi (GLenum buffer, GLint drawbuffer, GLfloat depth, GLint stencil)
+{
+	return (*_glClearBufferfi)(buffer, drawbuffer, depth, stencil);
+}
+
+void glSamplerParameterf (GLuint sampler, GLenum pname, GLfloat param)
+{
+	return (*_glSamplerParameterf)(sampler, pname, param);
+}
@@ -51,6 +51,17 @@ extern "C" {
 	int property_get(const char *key, char *value, const char *default_value);
 	int property_list(void (*propfn)(const char *key, const char *value, void *cookie), void *cookie);
 
+	/* Fetch all properties with a single request to the property service
+	 * and store them in the runtime property cache. Returns the number of
+	 * properties received or a negative error code. */
+	int property_snapshot_load(void);
+
+	/* Look up count properties at once, using at most one request to the
+	 * property service. Each values[i] must hold PROP_VALUE_MAX bytes;
+	 * default_values may be NULL. */
+	int property_get_many(const char *const *keys, char **values,
+			const char *const *default_values, int count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,116 +22,207 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 #include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <hybris/properties/properties.h>
 #include "properties_p.h"
 
+#define PROP_FILE "/system/build.prop"
+
+/* How often (in seconds) build.prop is checked for changes at most. Override
+ * with HYBRIS_PROPERTY_FILE_CHECK_SECS environment variable, 0 checks on
+ * every lookup.
+ */
+#define HYBRIS_PROPERTY_FILE_DEFAULT_CHECK_SECS 1
+
 struct hybris_prop_value
 {
-	char *key;
-	char *value;
+	uint32_t hash;
+	/* offsets of the NUL-terminated key and value in the string arena */
+	uint32_t key;
+	uint32_t value;
 };
 
-/* surely enough for anyone */
-#define MAX_PROPS 1000
+/* all properties, in file order */
+static struct hybris_prop_value *prop_array;
+static int max_prop;
+static int num_alloc;
 
-/* the sorted prop array */
-static struct hybris_prop_value prop_array[MAX_PROPS];
+/* open addressing hash index into prop_array, entries are index + 1 */
+static uint32_t *prop_index;
+static uint32_t index_size;
 
-/* the current highest index in prop_array */
-static int max_prop;
+/* key/value strings of all properties, back to back */
+static char *arena;
+static size_t arena_used;
+static size_t arena_alloc;
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* helpers */
 static void cache_update();
-static int prop_qcmp(const void *a, const void *b);
 static struct hybris_prop_value *cache_find_internal(const char *key);
-static void cache_add_internal(const char *key, const char *value);
-static void cache_repopulate_internal(FILE *f);
+static void cache_add_internal(const char *key, size_t key_len, const char *value, size_t value_len);
+static void cache_repopulate_internal(const char *data, size_t size);
 static void cache_empty_internal();
 static void cache_repopulate_cmdline_internal();
 
 /* the inode/mtime of the prop cache, used for invalidation */
 static ino_t static_prop_inode;
 static time_t static_prop_mtime;
+static int static_prop_loaded;
+
+static time_t check_interval_secs = -1;
+static time_t last_check;
 
 
 /* public:
  * find a prop value from the file cache.
  *
- * the return value is the value of the given property key, or NULL if the
- * property key is not found. the returned value is owned by the caller,
- * and must be freed.
+ * copies the value of the given property key into value, which must hold
+ * PROP_VALUE_MAX bytes, and returns 0. returns -1 if the property key is
+ * not found. the copy is made under the cache lock, as another thread may
+ * reload build.prop and move the strings at any time.
  */
-char *hybris_propcache_find(const char *key)
+int hybris_propcache_find(const char *key, char *value)
 {
-	char *ret = NULL;
+	int ret = -1;
 
+	pthread_mutex_lock(&cache_mutex);
 	cache_update();
 
-	/* then look up the key and do a copy if we get a result */
 	struct hybris_prop_value *prop = cache_find_internal(key);
-	if (prop)
-		return prop->value;
+	if (prop) {
+		strncpy(value, arena + prop->value, PROP_VALUE_MAX - 1);
+		value[PROP_VALUE_MAX - 1] = '\0';
+		ret = 0;
+	}
+	pthread_mutex_unlock(&cache_mutex);
 
-out:
 	return ret;
 }
 
+/* public:
+ * calls cb for every property in the file cache.
+ *
+ * the properties are copied out under the cache lock and cb runs without
+ * it, so that it may look up properties itself.
+ */
 void hybris_propcache_list(hybris_propcache_list_cb cb, void *cookie)
 {
 	int n;
-	struct hybris_prop_value *current;
+	int count;
+	char *strings;
+	struct hybris_prop_value *props;
 
 	if (!cb)
 		return;
 
+	pthread_mutex_lock(&cache_mutex);
 	cache_update();
 
-	for (n = 0; n < max_prop; n++) {
-		current = &prop_array[n];
-		cb(current->key, current->value, cookie);
+	count = max_prop;
+	props = malloc(count * sizeof(*props) + 1);
+	strings = malloc(arena_used + 1);
+	if (!props || !strings) {
+		pthread_mutex_unlock(&cache_mutex);
+		free(props);
+		free(strings);
+		return;
 	}
+	if (count > 0) {
+		memcpy(props, prop_array, count * sizeof(*props));
+		memcpy(strings, arena, arena_used);
+	}
+	pthread_mutex_unlock(&cache_mutex);
+
+	for (n = 0; n < count; n++)
+		cb(strings + props[n].key, strings + props[n].value, cookie);
+
+	free(props);
+	free(strings);
+}
+
+/* private:
+ * returns nonzero if it's time to look at build.prop again
+ */
+static int cache_check_due()
+{
+	struct timespec now;
+
+	if (check_interval_secs < 0) {
+		const char *interval_str = getenv("HYBRIS_PROPERTY_FILE_CHECK_SECS");
+		check_interval_secs = interval_str ? atoi(interval_str)
+			: HYBRIS_PROPERTY_FILE_DEFAULT_CHECK_SECS;
+		if (check_interval_secs < 0)
+			check_interval_secs = 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	if (static_prop_loaded && now.tv_sec - last_check < check_interval_secs)
+		return 0;
+
+	last_check = now.tv_sec;
+	return 1;
 }
 
 static void cache_update()
 {
 	struct stat st;
-	FILE *f = fopen("/system/build.prop", "r");
-	char *ret = NULL;
+	void *data;
+	int fd;
 
-	if (!f)
-		return NULL;
+	if (!cache_check_due())
+		return;
 
 	/* before searching, we must first determine whether our cache is valid. if
 	 * it isn't, we must discard our results and re-create the cache.
-	 *
-	 * we use fstat here to avoid a race between stat and something else
+	 */
+	if (stat(PROP_FILE, &st) != 0)
+		return;
+
+	if (static_prop_loaded &&
+		static_prop_inode == st.st_ino &&
+		static_prop_mtime == st.st_mtime)
+		return;
+
+	fd = open(PROP_FILE, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	/* we use fstat here to avoid a race between stat and something else
 	 * touching the file.
 	 */
-	if (fstat(fileno(f), &st) != 0) {
-		perror("cache_find can't stat build.prop");
-		goto out;
+	if (fstat(fd, &st) != 0) {
+		perror("cache_update can't stat build.prop");
+		close(fd);
+		return;
 	}
 
-	/* TODO: is there any better way to detect changes? */
-	if (static_prop_inode != st.st_ino ||
-		static_prop_mtime != st.st_mtime) {
-		static_prop_inode = st.st_ino;
-		static_prop_mtime = st.st_mtime;
+	data = (st.st_size > 0) ?
+		mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	close(fd);
 
-		/* cache is stale. fill it back up with fresh data first. */
-		cache_empty_internal();
-		cache_repopulate_internal(f);
-		cache_repopulate_cmdline_internal();
+	if (data == MAP_FAILED)
+		return;
 
-		/* sort by keys */
-		qsort(prop_array, max_prop, sizeof(struct hybris_prop_value), prop_qcmp);
-	}
+	static_prop_inode = st.st_ino;
+	static_prop_mtime = st.st_mtime;
+	static_prop_loaded = 1;
 
-out:
-	fclose(f);
+	/* cache is stale. fill it back up with fresh data first. */
+	cache_empty_internal();
+	if (data) {
+		cache_repopulate_internal(data, st.st_size);
+		munmap(data, st.st_size);
+	}
+	cache_repopulate_cmdline_internal();
 }
 
 /* private:
@@ -139,25 +230,76 @@ out:
  */
 static void cache_empty_internal()
 {
-	int i;
-	for (i = 0; i < max_prop; ++i) {
-		free(prop_array[i].key);
-		free(prop_array[i].value);
+	max_prop = 0;
+	arena_used = 0;
+
+	if (prop_index)
+		memset(prop_index, 0, index_size * sizeof(uint32_t));
+}
+
+/* private:
+ * FNV-1a hash of the first `len' bytes of `key'
+ */
+static uint32_t prop_hash(const char *key, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char) key[i];
+		hash *= 16777619u;
 	}
 
-	max_prop = 0;
+	return hash;
 }
 
 /* private:
- * compares two hybris_prop_value by key, so as to maintain a qsorted array of
- * props, and search the array.
+ * returns the slot of `key' in prop_index, which is either empty or
+ * holds the matching property
  */
-static int prop_qcmp(const void *a, const void *b)
+static uint32_t cache_lookup_slot(const char *key, size_t len, uint32_t hash)
 {
-	struct hybris_prop_value *aa = (struct hybris_prop_value *)a;
-	struct hybris_prop_value *bb = (struct hybris_prop_value *)b;
+	uint32_t mask = index_size - 1;
+	uint32_t slot = hash & mask;
+
+	while (prop_index[slot] != 0) {
+		struct hybris_prop_value *prop = &prop_array[prop_index[slot] - 1];
+		const char *prop_key = arena + prop->key;
+
+		if (prop->hash == hash && strncmp(prop_key, key, len) == 0 &&
+				prop_key[len] == '\0')
+			return slot;
+
+		slot = (slot + 1) & mask;
+	}
 
-	return strcmp(aa->key, bb->key);
+	return slot;
+}
+
+/* private:
+ * doubles the hash index and reinserts all properties
+ */
+static int cache_grow_index()
+{
+	uint32_t new_size = index_size ? index_size * 2 : 256;
+	uint32_t *new_index = calloc(new_size, sizeof(uint32_t));
+	int i;
+
+	if (!new_index)
+		return -1;
+
+	free(prop_index);
+	prop_index = new_index;
+	index_size = new_size;
+
+	for (i = 0; i < max_prop; i++) {
+		uint32_t slot = prop_array[i].hash & (index_size - 1);
+		while (prop_index[slot] != 0)
+			slot = (slot + 1) & (index_size - 1);
+		prop_index[slot] = i + 1;
+	}
+
+	return 0;
 }
 
 /* private:
@@ -169,10 +311,44 @@ static int prop_qcmp(const void *a, const void *b)
  */
 static struct hybris_prop_value *cache_find_internal(const char *key)
 {
-	struct hybris_prop_value prop_key;
-	prop_key.key = (char*)key;
+	size_t len;
+	uint32_t slot;
 
-	return bsearch(&prop_key, prop_array, max_prop, sizeof(struct hybris_prop_value), prop_qcmp);
+	if (!key || !prop_index)
+		return NULL;
+
+	len = strlen(key);
+	slot = cache_lookup_slot(key, len, prop_hash(key, len));
+
+	return prop_index[slot] ? &prop_array[prop_index[slot] - 1] : NULL;
+}
+
+/* private:
+ * copies `len' bytes of `str' into the string arena, returning the offset
+ */
+static int arena_add(const char *str, size_t len, uint32_t *offset)
+{
+	if (arena_used + len + 1 > arena_alloc) {
+		size_t new_alloc = arena_alloc ? arena_alloc : 16384;
+		char *new_arena;
+
+		while (arena_used + len + 1 > new_alloc)
+			new_alloc *= 2;
+
+		new_arena = realloc(arena, new_alloc);
+		if (!new_arena)
+			return -1;
+
+		arena = new_arena;
+		arena_alloc = new_alloc;
+	}
+
+	memcpy(arena + arena_used, str, len);
+	arena[arena_used + len] = '\0';
+	*offset = arena_used;
+	arena_used += len + 1;
+
+	return 0;
 }
 
 /* private:
@@ -180,49 +356,80 @@ static struct hybris_prop_value *cache_find_internal(const char *key)
  *
  * both `key' and `value' are copied from the caller.
  */
-static void cache_add_internal(const char *key, const char *value)
+static void cache_add_internal(const char *key, size_t key_len, const char *value, size_t value_len)
 {
+	struct hybris_prop_value *prop;
+	uint32_t hash, slot;
+
 	/* Skip values that can be bigger than value max */
-	if (strlen(value) >= PROP_VALUE_MAX -1)
+	if (value_len >= PROP_VALUE_MAX -1)
+		return;
+
+	/* keep the index at most half full */
+	if ((uint32_t) (max_prop + 1) * 2 > index_size && cache_grow_index() < 0)
 		return;
 
+	hash = prop_hash(key, key_len);
+	slot = cache_lookup_slot(key, key_len, hash);
+
 	/* preserve current behavior of first prop key => match */
-	if (cache_find_internal(key))
+	if (prop_index[slot] != 0)
 		return;
 
-	prop_array[max_prop].key = strdup(key);
-	prop_array[max_prop++].value = strdup(value);
+	if (max_prop == num_alloc) {
+		int new_alloc = num_alloc ? num_alloc * 2 : 256;
+		struct hybris_prop_value *new_array =
+			realloc(prop_array, new_alloc * sizeof(struct hybris_prop_value));
+
+		if (!new_array)
+			return;
 
-	if (max_prop >= MAX_PROPS) {
-		fprintf(stderr, "libhybris: ran out of props, increase MAX_PROPS");
-		exit(1);
+		prop_array = new_array;
+		num_alloc = new_alloc;
 	}
+
+	prop = &prop_array[max_prop];
+	prop->hash = hash;
+	if (arena_add(key, key_len, &prop->key) < 0 ||
+			arena_add(value, value_len, &prop->value) < 0)
+		return;
+
+	prop_index[slot] = ++max_prop;
 }
 
 /* private:
- * repopulates the prop cache from a given file `f'.
+ * repopulates the prop cache from the mapped contents of build.prop,
+ * `key=value' per line.
  */
-static void cache_repopulate_internal(FILE *f)
+static void cache_repopulate_internal(const char *data, size_t size)
 {
-	char buf[1024];
-	char *mkey, *value;
-
-	while (fgets(buf, 1024, f) != NULL) {
-		if (strchr(buf, '\r'))
-			*(strchr(buf, '\r')) = '\0';
-		if (strchr(buf, '\n'))
-			*(strchr(buf, '\n')) = '\0';
-
-		mkey = strtok(buf, "=");
-
-		if (!mkey)
-			continue;
-
-		value = strtok(NULL, "=");
-		if (!value)
-			continue;
+	const char *end = data + size;
+	const char *line = data;
+
+	while (line < end) {
+		const char *eol = memchr(line, '\n', end - line);
+		const char *key, *eq, *value, *value_end;
+
+		if (!eol)
+			eol = end;
+
+		value_end = eol;
+		if (value_end > line && value_end[-1] == '\r')
+			value_end--;
+
+		/* skip leading separators, like strtok did before */
+		key = line;
+		while (key < value_end && *key == '=')
+			key++;
+
+		eq = memchr(key, '=', value_end - key);
+		if (eq && *key != '#') {
+			value = eq + 1;
+			if (value < value_end)
+				cache_add_internal(key, eq - key, value, value_end - value);
+		}
 
-		cache_add_internal(mkey, value);
+		line = eol + 1;
 	}
 }
 
@@ -272,7 +479,7 @@ static void cache_repopulate_cmdline_internal()
 			char prop[PROP_NAME_MAX];
 			snprintf(prop, sizeof(prop) -1, "ro.%s", boot_prop_name);
 
-			cache_add_internal(prop, value);
+			cache_add_internal(prop, strlen(prop), value, strlen(value));
 		}
 	}
 }
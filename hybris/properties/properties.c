@@ -134,7 +134,7 @@ int property_list(void (*propfn)(const char *key, const char *value, void *cooki
 	return 0;
 }
 
-static int property_get_socket(const char *key, char *value, const char *default_value)
+static int property_get_socket(const char *key, char *value)
 {
 	int err;
 	prop_msg_t msg;
@@ -149,24 +149,56 @@ static int property_get_socket(const char *key, char *value, const char *default
 			return err;
 	}
 
-	/* In case it's null, just use the default */
-	if ((strlen(msg.value) == 0) && (default_value)) {
-		if (strlen(default_value) >= PROP_VALUE_MAX -1)	return -1;
-		strcpy(msg.value, default_value);
-	}
-
 	strcpy(value, msg.value);
 
 	return 0;
 }
 
-int property_get(const char *key, char *value, const char *default_value)
+static void snapshot_insert(const char *key, const char *value, void *cookie)
 {
-	char *ret = NULL;
+	int *count = (int *) cookie;
 
-	if ((key) && (strlen(key) >= PROP_NAME_MAX -1)) return -1;
-	if (value == NULL) return -1;
+	runtime_cache_insert(key, value);
+	(*count)++;
+}
+
+/* Must be called with the runtime cache locked */
+static int property_snapshot_load_locked(void)
+{
+	int err;
+	int count = 0;
+	prop_msg_t msg;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.cmd = PROP_MSG_LISTPROP;
+
+	runtime_cache_snapshot_begin();
+	err = send_prop_msg(&msg, snapshot_insert, &count);
+	runtime_cache_snapshot_end(err == 0);
+
+	return (err < 0) ? err : count;
+}
+
+int property_snapshot_load(void)
+{
+#ifdef NO_RUNTIME_PROPERTY_CACHE
+	/* Nowhere to keep the snapshot */
+	return -ENOSYS;
+#else
+	int ret;
 
+	runtime_cache_lock();
+	ret = property_snapshot_load_locked();
+	runtime_cache_unlock();
+
+	return ret;
+#endif
+}
+
+/* Raw lookup without applying a default, returns 0 if the value is known */
+static int property_get_cached(const char *key, char *value)
+{
+	int ret = -1;
 
 	// Runtime cache will serialize property lookups within the process.
 	// This will increase latency if multiple threads are doing many
@@ -174,22 +206,43 @@ int property_get(const char *key, char *value, const char *default_value)
 	// be offset with the caching eventually.
 	runtime_cache_lock();
 	if (runtime_cache_get(key, value) == 0) {
-		ret = value;
-	} else if (property_get_socket(key, value, default_value) == 0) {
+		ret = 0;
+	} else if (runtime_cache_snapshot_needed() &&
+			property_snapshot_load_locked() >= 0) {
+		// the whole property list was just fetched in one go
+		if (runtime_cache_get(key, value) != 0)
+			value[0] = '\0';
+		ret = 0;
+	} else if (runtime_cache_snapshot_valid()) {
+		// not part of a recent snapshot, so it isn't set
+		value[0] = '\0';
+		ret = 0;
+	} else if (property_get_socket(key, value) == 0) {
 		runtime_cache_insert(key, value);
-		ret = value;
+		ret = 0;
 	}
 	runtime_cache_unlock();
 
-	if (ret)
-		return strlen(ret);
+	return ret;
+}
 
+int property_get(const char *key, char *value, const char *default_value)
+{
+	if ((key) && (strlen(key) >= PROP_NAME_MAX -1)) return -1;
+	if (value == NULL) return -1;
+
+	if (property_get_cached(key, value) == 0) {
+		/* In case it's null, just use the default */
+		if ((strlen(value) == 0) && (default_value)) {
+			if (strlen(default_value) >= PROP_VALUE_MAX -1)	return -1;
+			strcpy(value, default_value);
+		}
+		return strlen(value);
+	}
 
-	/* In case the socket is not available, search the property file cache by hand */
-	ret = hybris_propcache_find(key);
 
-	if (ret) {
-		strcpy(value, ret);
+	/* In case the socket is not available, search the property file cache by hand */
+	if (hybris_propcache_find(key, value) == 0) {
 		return strlen(value);
 	} else if (default_value != NULL) {
 		strcpy(value, default_value);
@@ -201,6 +254,93 @@ int property_get(const char *key, char *value, const char *default_value)
 	return 0;
 }
 
+struct get_many_state {
+	const char *const *keys;
+	char **values;
+	char *found;
+	int count;
+};
+
+static void get_many_record(const char *key, const char *value, void *cookie)
+{
+	struct get_many_state *state = (struct get_many_state *) cookie;
+	int i;
+
+	runtime_cache_insert(key, value);
+
+	for (i = 0; i < state->count; i++) {
+		if (!state->found[i] && strcmp(state->keys[i], key) == 0) {
+			strncpy(state->values[i], value, PROP_VALUE_MAX - 1);
+			state->values[i][PROP_VALUE_MAX - 1] = '\0';
+			state->found[i] = 1;
+			break;
+		}
+	}
+}
+
+int property_get_many(const char *const *keys, char **values,
+		const char *const *default_values, int count)
+{
+	struct get_many_state state;
+	prop_msg_t msg;
+	int i;
+	int err;
+
+	if (keys == NULL || values == NULL || count < 0) return -1;
+
+	state.keys = keys;
+	state.values = values;
+	state.count = count;
+	state.found = calloc(count ? count : 1, 1);
+	if (state.found == NULL) return -ENOMEM;
+
+	/* Whatever is cached already doesn't need to go over the socket */
+	runtime_cache_lock();
+	int missing = 0;
+	for (i = 0; i < count; i++) {
+		if (runtime_cache_get(keys[i], values[i]) == 0)
+			state.found[i] = 1;
+		else
+			missing++;
+	}
+
+	if (missing > 0) {
+		memset(&msg, 0, sizeof(msg));
+		msg.cmd = PROP_MSG_LISTPROP;
+
+		runtime_cache_snapshot_begin();
+		err = send_prop_msg(&msg, get_many_record, &state);
+		runtime_cache_snapshot_end(err == 0);
+
+		if (err == 0) {
+			/* Everything not in the list isn't set */
+			for (i = 0; i < count; i++) {
+				if (!state.found[i]) {
+					values[i][0] = '\0';
+					state.found[i] = 1;
+				}
+			}
+		}
+	}
+	runtime_cache_unlock();
+
+	for (i = 0; i < count; i++) {
+		const char *default_value = default_values ? default_values[i] : NULL;
+
+		if (!state.found[i]) {
+			/* Socket not available, fall back to the slow path */
+			property_get(keys[i], values[i], default_value);
+		} else if ((strlen(values[i]) == 0) && (default_value) &&
+				(strlen(default_value) < PROP_VALUE_MAX - 1)) {
+			strcpy(values[i], default_value);
+		}
+	}
+
+	free(state.found);
+
+	return 0;
+}
+
 int property_set(const char *key, const char *value)
 {
 	int err;
@@ -225,6 +365,12 @@ int property_set(const char *key, const char *value)
 		return err;
 	}
 
+	/* The value is known now, and other processes' cached ones may be stale */
+	runtime_cache_lock();
+	runtime_cache_insert(key, value);
+	runtime_cache_notify_change();
+	runtime_cache_unlock();
+
 	return 0;
 }
 
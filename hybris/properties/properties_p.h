@@ -21,20 +21,30 @@
 typedef void (*hybris_propcache_list_cb)(const char *key, const char *value, void *cookie);
 
 void hybris_propcache_list(hybris_propcache_list_cb cb, void *cookie);
-char *hybris_propcache_find(const char *key);
+int hybris_propcache_find(const char *key, char *value);
 
 #ifndef NO_RUNTIME_PROPERTY_CACHE
 void runtime_cache_lock();
 void runtime_cache_unlock();
 int  runtime_cache_get(const char *key, char *value);
-void runtime_cache_insert(const char *key, char *value);
+void runtime_cache_insert(const char *key, const char *value);
 void runtime_cache_remove(const char *key);
+int  runtime_cache_snapshot_needed();
+int  runtime_cache_snapshot_valid();
+void runtime_cache_snapshot_begin();
+void runtime_cache_snapshot_end(int success);
+void runtime_cache_notify_change();
 #else
 #define runtime_cache_lock()
 #define runtime_cache_unlock()
 #define runtime_cache_get(K,V) (-1)
 #define runtime_cache_insert(K,V)
 #define runtime_cache_remove(K)
+#define runtime_cache_snapshot_needed() (0)
+#define runtime_cache_snapshot_valid() (0)
+#define runtime_cache_snapshot_begin()
+#define runtime_cache_snapshot_end(S)
+#define runtime_cache_notify_change()
 #endif
 
 #endif
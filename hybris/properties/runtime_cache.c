@@ -26,6 +26,10 @@
 #include <string.h>
 #include <time.h>
 #include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
 #define HYBRIS_PROPERTY_CACHE_DEFAULT_TIMEOUT_SECS 10
@@ -35,6 +39,29 @@
 */
 static time_t runtime_cache_timeout_secs = HYBRIS_PROPERTY_CACHE_DEFAULT_TIMEOUT_SECS;
 
+/** Name of the shared memory object holding the property change serial.
+	Every successful property_set() bumps it, so other processes know
+	their cache is out of date without having to wait for the timeout.
+	Only the user that created it can bump it, everyone else just reads
+	it and relies on the timeout for their own changes.
+*/
+#define HYBRIS_PROPERTY_SERIAL_SHM "/hybris_property_serial"
+
+static volatile unsigned int *shared_serial = NULL;
+static int shared_serial_writable = 0;
+static unsigned int seen_serial = 0;
+
+/** Whether a miss should (re)load the whole property list. Override with
+	HYBRIS_PROPERTY_CACHE_WARMUP=0 environment variable.
+*/
+static int runtime_cache_warmup = 1;
+
+/** Time the last full snapshot was loaded, 0 if there is none */
+static time_t snapshot_time = 0;
+
+/** Number of sorted entries while a snapshot is being merged in */
+static int num_sorted = -1;
+
 
 /** Key, value pair and the time of previous update (in seconds) */
 struct hybris_prop_value
@@ -68,7 +95,42 @@ static struct hybris_prop_value *cache_find_internal(const char *key)
 	struct hybris_prop_value prop_key;
 	prop_key.key = (char*)key;
 
-	return bsearch(&prop_key, prop_array, num_prop, sizeof(struct hybris_prop_value), prop_qcmp);
+	/* While a snapshot is merged in, only the front part is sorted */
+	int n = (num_sorted >= 0) ? num_sorted : num_prop;
+
+	return bsearch(&prop_key, prop_array, n, sizeof(struct hybris_prop_value), prop_qcmp);
+}
+
+static void runtime_cache_serial_init()
+{
+	struct stat st;
+	void *addr;
+	int prot = PROT_READ | PROT_WRITE;
+
+	int fd = shm_open(HYBRIS_PROPERTY_SERIAL_SHM, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0 && errno == EACCES) {
+		fd = shm_open(HYBRIS_PROPERTY_SERIAL_SHM, O_RDONLY | O_CLOEXEC, 0);
+		prot = PROT_READ;
+	}
+	if (fd < 0)
+		return;
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(unsigned int)) {
+		/* nobody else can map it before it has its size */
+		if (prot == PROT_READ || ftruncate(fd, sizeof(unsigned int)) < 0) {
+			close(fd);
+			return;
+		}
+	}
+
+	addr = mmap(NULL, sizeof(unsigned int), prot, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (addr != MAP_FAILED) {
+		shared_serial = addr;
+		shared_serial_writable = (prot & PROT_WRITE) != 0;
+		seen_serial = *shared_serial;
+	}
 }
 
 static void runtime_cache_init()
@@ -80,6 +142,13 @@ static void runtime_cache_init()
 	if (timeout_str) {
 		runtime_cache_timeout_secs = atoi(timeout_str);
 	}
+
+	const char *warmup_str = getenv("HYBRIS_PROPERTY_CACHE_WARMUP");
+	if (warmup_str) {
+		runtime_cache_warmup = atoi(warmup_str);
+	}
+
+	runtime_cache_serial_init();
 }
 
 static void runtime_cache_ensure_initialized()
@@ -100,10 +169,31 @@ static void runtime_cache_invalidate_entry(struct hybris_prop_value *entry)
 	entry->value = NULL;
 }
 
+/** Drop every cached value, e.g. after another process changed a property */
+static void runtime_cache_invalidate_all()
+{
+	int i;
+
+	for (i = 0; i < num_prop; i++)
+		runtime_cache_invalidate_entry(&prop_array[i]);
+
+	snapshot_time = 0;
+}
+
+static void runtime_cache_check_serial()
+{
+	if (shared_serial && *shared_serial != seen_serial) {
+		seen_serial = *shared_serial;
+		runtime_cache_invalidate_all();
+	}
+}
+
 static int runtime_cache_get_impl(const char *key, char *value)
 {
 	int ret = -ENOENT;
 
+	runtime_cache_check_serial();
+
 	struct hybris_prop_value *entry = cache_find_internal(key);
 	if (entry != NULL && entry->value != NULL) {
 		struct timespec now;
@@ -122,16 +212,16 @@ static int runtime_cache_get_impl(const char *key, char *value)
 	return ret;
 }
 
-static void runtime_cache_insert_impl(const char *key, char *value)
+static void runtime_cache_insert_impl(const char *key, const char *value)
 {
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
 
 	struct hybris_prop_value *entry = cache_find_internal(key);
 	if (entry) {
-		assert(entry->value == NULL);
-		// key,value pair was invalidated earlier,
-		// reuse entry in the property array
+		// key,value pair was invalidated earlier (or is being
+		// refreshed by a snapshot), reuse entry in the property array
+		free(entry->value);
 		entry->value = strdup(value);
 		entry->last_update = now.tv_sec;
 	} else {
@@ -143,7 +233,9 @@ static void runtime_cache_insert_impl(const char *key, char *value)
 		struct hybris_prop_value new_entry = { strdup(key), strdup(value), now.tv_sec };
 		prop_array[num_prop++] = new_entry;
 
-		qsort(prop_array, num_prop, sizeof(struct hybris_prop_value), prop_qcmp);
+		// a snapshot sorts once when it is done
+		if (num_sorted < 0)
+			qsort(prop_array, num_prop, sizeof(struct hybris_prop_value), prop_qcmp);
 	}
 }
 
@@ -173,8 +265,63 @@ int runtime_cache_get(const char *key, char *value)
 	return runtime_cache_get_impl(key, value);
 }
 
-void runtime_cache_insert(const char *key, char *value)
+void runtime_cache_insert(const char *key, const char *value)
 {
 	runtime_cache_ensure_initialized();
 	runtime_cache_insert_impl(key, value);
 }
+
+int runtime_cache_snapshot_valid()
+{
+	struct timespec now;
+
+	runtime_cache_ensure_initialized();
+	runtime_cache_check_serial();
+
+	if (snapshot_time == 0)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	return (now.tv_sec - snapshot_time) <= runtime_cache_timeout_secs;
+}
+
+int runtime_cache_snapshot_needed()
+{
+	runtime_cache_ensure_initialized();
+	return runtime_cache_warmup && !runtime_cache_snapshot_valid();
+}
+
+void runtime_cache_snapshot_begin()
+{
+	runtime_cache_ensure_initialized();
+	runtime_cache_check_serial();
+	num_sorted = num_prop;
+}
+
+void runtime_cache_snapshot_end(int success)
+{
+	struct timespec now;
+
+	qsort(prop_array, num_prop, sizeof(struct hybris_prop_value), prop_qcmp);
+	num_sorted = -1;
+
+	if (success) {
+		clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+		snapshot_time = now.tv_sec;
+	} else {
+		// don't keep hammering a property service without LISTPROP
+		runtime_cache_warmup = 0;
+	}
+}
+
+void runtime_cache_notify_change()
+{
+	runtime_cache_ensure_initialized();
+
+	if (shared_serial && shared_serial_writable) {
+		unsigned int serial = __sync_add_and_fetch(shared_serial, 1);
+		// our own cache was already updated, don't drop all of it
+		if (seen_serial == serial - 1)
+			seen_serial = serial;
+	}
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Checks that eglGetProcAddress hands out the entry points of the OpenGL
+ * ES version of the context current on the calling thread, with OpenGL
+ * ES 1.x and 2.0 contexts current on several threads at once.
+ *
+ * Usage: test_client_version [threads] [iterations]
+ *
+ * Unless LIBEGL names the vendor EGL to use, the test runs against the
+ * stand-in the build produces, .libs/test_egl_stub.so, on the headless
+ * platform, so it needs no device.
+ */
+
+#include <android-config.h>
+#include <EGL/egl.h>
+#include <assert.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* entry points both OpenGL ES 1.x and 2.0 have */
+static const char *names[] = {
+	"glActiveTexture", "glBindBuffer", "glBindTexture", "glBlendFunc",
+	"glClear", "glClearColor", "glDrawArrays", "glDrawElements",
+	"glEnable", "glFinish", "glGetError", "glGetString",
+	"glReadPixels", "glTexImage2D", "glTexParameteri", "glViewport",
+};
+
+#define NUM_NAMES (sizeof(names) / sizeof(names[0]))
+
+static EGLDisplay display;
+static EGLConfig config;
+static void *gles[3];
+static int iterations;
+
+static EGLContext create_context(int version)
+{
+	EGLint attr[] = {
+		EGL_CONTEXT_CLIENT_VERSION, version,
+		EGL_NONE
+	};
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, attr);
+
+	assert(context != EGL_NO_CONTEXT);
+	return context;
+}
+
+static void check_names(int version)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_NAMES; i++)
+		assert((void *) eglGetProcAddress(names[i]) == dlsym(gles[version], names[i]));
+}
+
+static void *version_thread(void *data)
+{
+	int version = (int) (long) data;
+	EGLint pbuffer_attr[] = {
+		EGL_WIDTH, 1,
+		EGL_HEIGHT, 1,
+		EGL_NONE
+	};
+	EGLSurface surface = eglCreatePbufferSurface(display, config, pbuffer_attr);
+	EGLContext context = create_context(version);
+	int i;
+
+	assert(surface != EGL_NO_SURFACE);
+	for (i = 0; i < iterations; i++) {
+		assert(eglMakeCurrent(display, surface, surface, context) == EGL_TRUE);
+		check_names(version);
+		assert(eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT) == EGL_TRUE);
+	}
+
+	eglDestroyContext(display, context);
+	eglDestroySurface(display, surface);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int num_threads = argc > 1 ? atoi(argv[1]) : 8;
+	pthread_t threads[num_threads];
+	EGLint attr[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES_BIT | EGL_OPENGL_ES2_BIT,
+		EGL_NONE
+	};
+	EGLint num_config;
+	unsigned int i;
+	int t;
+
+	iterations = argc > 2 ? atoi(argv[2]) : 100;
+
+	/* libEGL opens the vendor library on its first call */
+	if (getenv("LIBEGL") == NULL) {
+		setenv("LIBEGL", ".libs/test_egl_stub.so", 1);
+		setenv("HYBRIS_EGLPLATFORM", "headless", 1);
+	}
+
+	gles[1] = dlopen(getenv("HYBRIS_LIBGLESV1") ?: "libGLESv1_CM.so.1", RTLD_LAZY);
+	gles[2] = dlopen(getenv("HYBRIS_LIBGLESV2") ?: "libGLESv2.so.2", RTLD_LAZY);
+	assert(gles[1] != NULL && gles[2] != NULL);
+
+	/* the two versions must be told apart for the checks to mean anything */
+	for (i = 0; i < NUM_NAMES; i++) {
+		void *v1 = dlsym(gles[1], names[i]);
+		void *v2 = dlsym(gles[2], names[i]);
+
+		assert(v1 != NULL && v2 != NULL && v1 != v2);
+	}
+
+	display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	assert(display != EGL_NO_DISPLAY);
+	assert(eglInitialize(display, NULL, NULL) == EGL_TRUE);
+	assert(eglChooseConfig(display, attr, &config, 1, &num_config) == EGL_TRUE);
+	assert(num_config == 1);
+
+	/* without a current context, the last one created decides */
+	EGLContext context1 = create_context(1);
+	EGLContext context2 = create_context(2);
+	check_names(2);
+	eglDestroyContext(display, context1);
+	eglDestroyContext(display, context2);
+
+	for (t = 0; t < num_threads; t++)
+		assert(pthread_create(&threads[t], NULL, version_thread, (void *) (long) (t % 2 + 1)) == 0);
+	for (t = 0; t < num_threads; t++)
+		pthread_join(threads[t], NULL);
+	printf("%d threads with OpenGL ES 1.x and 2.0 contexts: ok\n", num_threads);
+
+	eglTerminate(display);
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Measures looking up the platform display of an EGLDisplay, which
+ * creating window surfaces and Wayland buffers do, from one thread and
+ * from several at once. Then terminates and initializes the display
+ * again many times. The display keeps its mapping, and window surfaces
+ * can be created on it after every cycle.
+ *
+ * Usage: test_display_mapping [lookups] [threads] [cycles]
+ *
+ * Unless LIBEGL names the vendor EGL to use, the test runs against the
+ * stand-in the build produces, .libs/test_egl_stub.so, on the headless
+ * platform, so it needs no device.
+ */
+
+#include <android-config.h>
+#include <EGL/egl.h>
+#include <eglhybris.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static EGLDisplay display;
+static int lookups;
+
+static double now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double lookup(void)
+{
+	struct _EGLDisplay *expected = hybris_egl_display_get_mapping(display);
+	double start = now_ns();
+	int i;
+
+	for (i = 0; i < lookups; i++)
+		assert(hybris_egl_display_get_mapping(display) == expected);
+	return (now_ns() - start) / lookups;
+}
+
+static void *lookup_thread(void *data)
+{
+	*(double *) data = lookup();
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int num_threads = argc > 2 ? atoi(argv[2]) : 4;
+	int cycles = argc > 3 ? atoi(argv[3]) : 1000;
+	pthread_t threads[num_threads];
+	double thread_ns[num_threads];
+	EGLint attr[] = {
+		EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint num_config;
+	EGLSurface surface;
+	double start;
+	int i, t;
+
+	lookups = argc > 1 ? atoi(argv[1]) : 1000000;
+
+	/* libEGL opens the vendor library on its first call */
+	if (getenv("LIBEGL") == NULL) {
+		setenv("LIBEGL", ".libs/test_egl_stub.so", 1);
+		setenv("HYBRIS_EGLPLATFORM", "headless", 1);
+	}
+
+	display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	assert(display != EGL_NO_DISPLAY);
+	assert(eglInitialize(display, NULL, NULL) == EGL_TRUE);
+	assert(hybris_egl_display_get_mapping(display) != NULL);
+	assert(eglChooseConfig(display, attr, &config, 1, &num_config) == EGL_TRUE);
+
+	printf("lookup: %.1f ns\n", lookup());
+	for (t = 0; t < num_threads; t++)
+		assert(pthread_create(&threads[t], NULL, lookup_thread, &thread_ns[t]) == 0);
+	for (t = 0; t < num_threads; t++) {
+		pthread_join(threads[t], NULL);
+		printf("lookup on thread %d of %d: %.1f ns\n", t, num_threads, thread_ns[t]);
+	}
+
+	/* the EGLDisplay stays valid across eglTerminate, so does its mapping */
+	start = now_ns();
+	for (i = 0; i < cycles; i++) {
+		assert(eglTerminate(display) == EGL_TRUE);
+		assert(eglInitialize(display, NULL, NULL) == EGL_TRUE);
+		assert(hybris_egl_display_get_mapping(display) != NULL);
+
+		surface = eglCreateWindowSurface(display, config, (EGLNativeWindowType) 0, NULL);
+		assert(surface != EGL_NO_SURFACE);
+		assert(eglDestroySurface(display, surface) == EGL_TRUE);
+
+		assert(eglGetDisplay(EGL_DEFAULT_DISPLAY) == display);
+	}
+	printf("%d terminate and initialize cycles: %.1f us each\n", cycles, (now_ns() - start) / 1000 / cycles);
+
+	eglTerminate(display);
+	return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Checks the EGLImage cache of Wayland buffers through libEGL's
+ * eglCreateImageKHR. A compositor imports the buffer a client committed
+ * on every frame; with clients cycling through a few buffers, only the
+ * first import of each should reach the vendor EGL. Imports with another
+ * display, context or attribute list must get an image of their own.
+ *
+ * Usage: test_egl_image_cache [vendor library] [frames]
+ *
+ * The vendor library is the stand-in the build produces,
+ * .libs/test_egl_stub.so, which counts the images it creates.
+ */
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <hybris/common/binding.h>
+
+#include <ws.h>
+#include "server_wlegl_buffer.h"
+#include "server_wlegl_private.h"
+
+#define N_BUFFERS 3
+#define WIDTH 64
+#define HEIGHT 64
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void (*image_counts)(int *created, int *destroyed);
+
+static int images_created()
+{
+	int created, destroyed;
+
+	image_counts(&created, &destroyed);
+	return created;
+}
+
+static int images_destroyed()
+{
+	int created, destroyed;
+
+	image_counts(&created, &destroyed);
+	return destroyed;
+}
+
+/* stand-in gralloc, only freeing is used */
+
+static int buffers_freed;
+
+static int alloc_free(struct alloc_device_t *dev, buffer_handle_t handle)
+{
+	native_handle_delete(const_cast<native_handle_t *>(handle));
+	buffers_freed++;
+	return 0;
+}
+
+static PFNEGLCREATEIMAGEKHRPROC create_image;
+static PFNEGLDESTROYIMAGEKHRPROC destroy_image;
+
+static EGLImageKHR import(EGLDisplay dpy, EGLContext ctx, server_wlegl_buffer *buffer, const EGLint *attrib_list)
+{
+	EGLImageKHR image = create_image(dpy, ctx, EGL_WAYLAND_BUFFER_WL,
+					 (EGLClientBuffer) buffer->resource, attrib_list);
+
+	assert(image != EGL_NO_IMAGE_KHR);
+	return image;
+}
+
+int main(int argc, char **argv)
+{
+	const char *vendor_path = argc > 1 ? argv[1] : ".libs/test_egl_stub.so";
+	int frames = argc > 2 ? atoi(argv[2]) : 10000;
+	EGLDisplay dpy = (EGLDisplay) 1;
+	EGLContext ctx = (EGLContext) 1;
+	const EGLint empty[] = { EGL_NONE };
+	const EGLint preserved[] = { EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE };
+	const EGLint preserved_copy[] = { EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE };
+	const EGLint not_preserved[] = { EGL_IMAGE_PRESERVED_KHR, EGL_FALSE, EGL_NONE };
+	server_wlegl_buffer *buffers[N_BUFFERS];
+	struct wl_display *display;
+	struct wl_client *client;
+	gralloc_module_t gralloc;
+	alloc_device_t alloc;
+	server_wlegl wlegl;
+	EGLImageKHR image, other;
+	double start;
+	int fds[2];
+	int rv;
+
+	assert(frames >= N_BUFFERS);
+
+	/* libEGL opens the vendor library on its first call */
+	setenv("LIBEGL", vendor_path, 1);
+	setenv("EGL_PLATFORM", "headless", 1);
+	void *vendor = android_dlopen(vendor_path, RTLD_NOW);
+	assert(vendor != NULL);
+	image_counts = (void (*)(int *, int *)) android_dlsym(vendor, "test_egl_stub_image_counts");
+	assert(image_counts != NULL);
+
+	create_image = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
+	assert(create_image != NULL);
+	destroy_image = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
+	assert(destroy_image != NULL);
+
+	memset(&gralloc, 0, sizeof(gralloc));
+	memset(&alloc, 0, sizeof(alloc));
+	alloc.free = alloc_free;
+
+	display = wl_display_create();
+	assert(display != NULL);
+	rv = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+	assert(rv == 0);
+	client = wl_client_create(display, fds[0]);
+	assert(client != NULL);
+
+	memset(&wlegl, 0, sizeof(wlegl));
+	wlegl.display = display;
+	wlegl.gralloc = &gralloc;
+	wlegl.alloc = &alloc;
+
+	for (int i = 0; i < N_BUFFERS; i++) {
+		buffers[i] = server_wlegl_buffer_create_server(client, WIDTH, HEIGHT, WIDTH,
+							       HAL_PIXEL_FORMAT_RGBA_8888,
+							       GRALLOC_USAGE_HW_TEXTURE,
+							       native_handle_create(0, 0), &wlegl);
+		assert(buffers[i] != NULL);
+	}
+
+	/* one vendor image per buffer, kept until the buffer is gone */
+	start = now();
+	for (int i = 0; i < frames; i++) {
+		image = import(dpy, EGL_NO_CONTEXT, buffers[i % N_BUFFERS], NULL);
+		destroy_image(dpy, image);
+	}
+	printf("%d frames, %d images created, %.1f ns per import\n",
+	       frames, images_created(), (now() - start) * 1e9 / frames);
+	assert(images_created() == N_BUFFERS);
+	assert(images_destroyed() == 0);
+
+	/* an empty attribute list is no attribute list */
+	image = import(dpy, EGL_NO_CONTEXT, buffers[0], empty);
+	assert(images_created() == N_BUFFERS);
+	destroy_image(dpy, image);
+
+	/*
+	 * Other attributes get their own image, which replaces the cached
+	 * one. Only the values count, not where the list is.
+	 */
+	image = import(dpy, EGL_NO_CONTEXT, buffers[0], preserved);
+	assert(images_created() == N_BUFFERS + 1);
+	assert(images_destroyed() == 1);
+	other = import(dpy, EGL_NO_CONTEXT, buffers[0], preserved_copy);
+	assert(other == image);
+	destroy_image(dpy, other);
+	other = import(dpy, EGL_NO_CONTEXT, buffers[0], not_preserved);
+	assert(other != image);
+	assert(images_created() == N_BUFFERS + 2);
+	destroy_image(dpy, other);
+	destroy_image(dpy, image);
+	assert(images_destroyed() == 2);
+
+	/* so do other contexts */
+	image = import(dpy, ctx, buffers[1], NULL);
+	assert(images_created() == N_BUFFERS + 3);
+	assert(images_destroyed() == 3);
+	other = import(dpy, ctx, buffers[1], NULL);
+	assert(other == image);
+	destroy_image(dpy, other);
+	destroy_image(dpy, image);
+
+	/* and other displays */
+	image = import((EGLDisplay) 2, EGL_NO_CONTEXT, buffers[2], NULL);
+	assert(images_created() == N_BUFFERS + 4);
+	assert(images_destroyed() == 4);
+	destroy_image((EGLDisplay) 2, image);
+
+	/* destroying the wl_buffers releases the images they keep */
+	wl_client_destroy(client);
+	assert(images_destroyed() == images_created());
+	assert(buffers_freed == N_BUFFERS);
+
+	wl_display_destroy(display);
+
+	printf("images were cached and released correctly\n");
+
+	return 0;
+}
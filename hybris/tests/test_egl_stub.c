@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Stands in for the vendor libEGL.so in the tests that check what
+ * libhybris' libEGL does around the driver. It is built without libc, so
+ * the Android linker can load it on any system. There is one display and
+ * one config, contexts and surfaces are handles that are never reused,
+ * and images are counted for test_egl_stub_image_counts().
+ */
+
+#define EGL_SUCCESS 0x3000
+
+static int handles;
+static int images_created;
+static int images_destroyed;
+
+static void *new_handle(void)
+{
+	return (void *) (long) __sync_add_and_fetch(&handles, 1);
+}
+
+void *eglGetDisplay(void *display_id)
+{
+	return (void *) 1;
+}
+
+unsigned int eglInitialize(void *dpy, int *major, int *minor)
+{
+	if (major)
+		*major = 1;
+	if (minor)
+		*minor = 4;
+	return 1;
+}
+
+unsigned int eglTerminate(void *dpy)
+{
+	return 1;
+}
+
+const char *eglQueryString(void *dpy, int name)
+{
+	return "";
+}
+
+unsigned int eglChooseConfig(void *dpy, const int *attrib_list, void **configs,
+			     int config_size, int *num_config)
+{
+	if (configs && config_size > 0)
+		configs[0] = (void *) 1;
+	*num_config = 1;
+	return 1;
+}
+
+void *eglCreateContext(void *dpy, void *config, void *share_context, const int *attrib_list)
+{
+	return new_handle();
+}
+
+unsigned int eglDestroyContext(void *dpy, void *ctx)
+{
+	return 1;
+}
+
+void *eglCreateWindowSurface(void *dpy, void *config, void *win, const int *attrib_list)
+{
+	return new_handle();
+}
+
+void *eglCreatePbufferSurface(void *dpy, void *config, const int *attrib_list)
+{
+	return new_handle();
+}
+
+unsigned int eglDestroySurface(void *dpy, void *surface)
+{
+	return 1;
+}
+
+unsigned int eglMakeCurrent(void *dpy, void *draw, void *read, void *ctx)
+{
+	return 1;
+}
+
+void test_egl_stub_image_counts(int *created, int *destroyed)
+{
+	*created = images_created;
+	*destroyed = images_destroyed;
+}
+
+/* every image gets a handle of its own, counting up from 1 */
+void *eglCreateImageKHR(void *dpy, void *ctx, unsigned int target, void *buffer, const int *attrib_list)
+{
+	return (void *) (long) ++images_created;
+}
+
+unsigned int eglDestroyImageKHR(void *dpy, void *image)
+{
+	images_destroyed++;
+	return 1;
+}
+
+void *eglGetProcAddress(const char *procname)
+{
+	return 0;
+}
+
+int eglGetError(void)
+{
+	return EGL_SUCCESS;
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Captures frames from mock gralloc buffers, checks the container file
+ * the capture service writes and compares what capturing costs the
+ * rendering thread with writing every frame to its own file in place.
+ * Like WaylandNativeWindow, which hands a queued buffer out again as soon
+ * as the compositor releases it, the test draws into a buffer again right
+ * after capturing it.
+ *
+ * Usage: test_frame_capture [frames]
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "framecapture.h"
+
+#define WIDTH 320
+#define HEIGHT 240
+#define STRIDE 384
+#define INTERVAL 2
+#define MAX_FRAMES 10
+#define N_BUFFERS 2
+
+struct mock_buffer {
+	ANativeWindowBuffer base;
+	native_handle_t handle;
+	uint32_t pixels[STRIDE * HEIGHT];
+};
+
+static mock_buffer buffers[N_BUFFERS];
+
+static int mock_lock(struct gralloc_module_t const *module, buffer_handle_t handle,
+		     int usage, int l, int t, int w, int h, void **vaddr)
+{
+	for (int i = 0; i < N_BUFFERS; i++) {
+		if (handle == &buffers[i].handle)
+			*vaddr = buffers[i].pixels;
+	}
+	return 0;
+}
+
+static int mock_unlock(struct gralloc_module_t const *module, buffer_handle_t handle)
+{
+	return 0;
+}
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void draw(mock_buffer *buffer, uint32_t frame)
+{
+	for (int i = 0; i < STRIDE * HEIGHT; i++)
+		buffer->pixels[i] = frame;
+}
+
+/* what hybris_dump_buffer_to_file used to do on every frame */
+static void dump_in_place(const char *dir, const uint32_t *pixels, int frame)
+{
+	char path[256];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/frame.%i", dir, frame);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	assert(fd >= 0);
+	assert(write(fd, pixels, STRIDE * HEIGHT * sizeof(*pixels)) == STRIDE * HEIGHT * sizeof(*pixels));
+	close(fd);
+	unlink(path);
+}
+
+static void check_file(const char *path, unsigned int expected_frames)
+{
+	hybris_capture_file_header header;
+	hybris_capture_trailer trailer;
+	FILE *f = fopen(path, "r");
+	uint64_t last_timestamp = 0;
+
+	assert(f != NULL);
+	assert(fread(&header, sizeof(header), 1, f) == 1);
+	assert(memcmp(header.magic, HYBRIS_CAPTURE_MAGIC, sizeof(header.magic)) == 0);
+	assert(header.version == HYBRIS_CAPTURE_VERSION);
+	assert(header.frame_header_size == sizeof(hybris_capture_frame_header));
+
+	assert(fseek(f, -(long) sizeof(trailer), SEEK_END) == 0);
+	assert(fread(&trailer, sizeof(trailer), 1, f) == 1);
+	assert(memcmp(trailer.magic, HYBRIS_CAPTURE_INDEX_MAGIC, sizeof(trailer.magic)) == 0);
+	assert(trailer.frames == expected_frames);
+
+	hybris_capture_index_entry *index = new hybris_capture_index_entry[trailer.frames];
+	assert(fseek(f, trailer.index_offset, SEEK_SET) == 0);
+	assert(fread(index, sizeof(*index), trailer.frames, f) == trailer.frames);
+
+	uint32_t *row = new uint32_t[WIDTH];
+	for (unsigned int i = 0; i < trailer.frames; i++) {
+		hybris_capture_frame_header frame;
+
+		assert(fseek(f, index[i].offset, SEEK_SET) == 0);
+		assert(fread(&frame, sizeof(frame), 1, f) == 1);
+		assert(frame.timestamp_ns == index[i].timestamp_ns);
+		assert(frame.timestamp_ns > last_timestamp);
+		last_timestamp = frame.timestamp_ns;
+		assert(frame.sequence % INTERVAL == 0);
+		assert(frame.width == WIDTH && frame.height == HEIGHT);
+		assert(frame.format == HAL_PIXEL_FORMAT_RGBA_8888);
+		assert(frame.bytes_per_pixel == 4);
+		assert(frame.size == WIDTH * HEIGHT * 4);
+
+		/* rows come without the stride padding */
+		for (int y = 0; y < HEIGHT; y++) {
+			assert(fread(row, sizeof(uint32_t), WIDTH, f) == WIDTH);
+			for (int x = 0; x < WIDTH; x++)
+				assert(row[x] == frame.sequence);
+		}
+	}
+
+	delete[] row;
+	delete[] index;
+	fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 100;
+	char dir[] = "/tmp/test_frame_capture.XXXXXX";
+	char path[256];
+	char value[16];
+	struct hybris_capture_stats stats;
+	gralloc_module_t gralloc;
+	double start, captured = 0, in_place = 0;
+
+	assert(frames >= INTERVAL * MAX_FRAMES);
+	assert(mkdtemp(dir) != NULL);
+	snprintf(path, sizeof(path), "%s/capture.hcap", dir);
+	setenv("HYBRIS_CAPTURE_FILE", path, 1);
+	snprintf(value, sizeof(value), "%i", INTERVAL);
+	setenv("HYBRIS_CAPTURE_INTERVAL", value, 1);
+	snprintf(value, sizeof(value), "%i", MAX_FRAMES);
+	setenv("HYBRIS_CAPTURE_FRAMES", value, 1);
+
+	memset(&gralloc, 0, sizeof(gralloc));
+	gralloc.lock = mock_lock;
+	gralloc.unlock = mock_unlock;
+	hybris_capture_init(&gralloc);
+
+	for (int i = 0; i < N_BUFFERS; i++) {
+		ANativeWindowBuffer *base = &buffers[i].base;
+
+		base->width = WIDTH;
+		base->height = HEIGHT;
+		base->stride = STRIDE;
+		base->format = HAL_PIXEL_FORMAT_RGBA_8888;
+		base->handle = &buffers[i].handle;
+	}
+
+	for (int i = 0; i < frames; i++) {
+		mock_buffer *buffer = &buffers[i % N_BUFFERS];
+
+		draw(buffer, i);
+
+		start = now();
+		hybris_capture_frame(&buffer->base, -1);
+		captured += now() - start;
+
+		start = now();
+		dump_in_place(dir, buffer->pixels, i);
+		in_place += now() - start;
+
+		/* the buffer is free again, whatever goes in now must not be captured */
+		draw(buffer, ~0u);
+
+		/* a frame's worth of rendering, for the writer to keep up */
+		usleep(2000);
+	}
+
+	hybris_capture_stop();
+	hybris_capture_get_stats(&stats);
+	assert(stats.captured == MAX_FRAMES);
+	assert(stats.dropped == 0);
+	assert(stats.written == MAX_FRAMES);
+
+	check_file(path, MAX_FRAMES);
+	unlink(path);
+	rmdir(dir);
+
+	printf("%d frames of %dx%d: %.1f us per frame capturing, %.1f us writing in place\n",
+	       frames, WIDTH, HEIGHT, captured * 1e6 / frames, in_place * 1e6 / frames);
+	printf("%u frames captured, %u dropped, %u written\n",
+	       stats.captured, stats.dropped, stats.written);
+
+	return 0;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Renders frames with a known pace into a window that presents them right
+ * away on a 20 ms vsync and checks the frame statistics it collected.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test_window_fixture.h"
+
+#define WIDTH 64
+#define HEIGHT 64
+#define PERIOD_MS 20
+
+/* presents every frame right away, or drops it if asked to */
+class StatsWindow : public TestWindow
+{
+public:
+	// how long the next dequeueBuffer() blocks
+	int blockMs;
+	// whether the next queued frame is replaced rather than presented
+	bool dropNext;
+
+	StatsWindow() : TestWindow(WIDTH, HEIGHT), blockMs(0), dropNext(false) {}
+
+protected:
+	int dequeueBuffer(BaseNativeWindowBuffer **b, int *fenceFd)
+	{
+		usleep(blockMs * 1000);
+		blockMs = 0;
+		return TestWindow::dequeueBuffer(b, fenceFd);
+	}
+	int queueBuffer(BaseNativeWindowBuffer *b, int fenceFd)
+	{
+		if (dropNext)
+			bufferWasDropped(b);
+		else
+			bufferWasPresented(b, PERIOD_MS * 1000000LL);
+		dropNext = false;
+		return 0;
+	}
+};
+
+/* a frame that takes renderMs to draw */
+static void render(ANativeWindow *window, int renderMs)
+{
+	ANativeWindowBuffer *buffer = dequeue(window);
+	usleep(renderMs * 1000);
+	queue(window, buffer);
+}
+
+static void print_histogram(const char *name, const HybrisFrameStatsHistogram &h)
+{
+	printf("%-15s", name);
+	for (int i = 0; i < HYBRIS_FRAME_STATS_BUCKETS; i++)
+		printf(" %3u", h.buckets[i]);
+	printf("  avg %.1f ms, max %.1f ms\n",
+	       h.count ? h.total_ns / 1e6 / h.count : 0.0, h.max_ns / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+	StatsWindow *test = new StatsWindow;
+	ANativeWindow *window = test;
+	HybrisFrameStats stats;
+	int ret;
+
+	/* steady frames make every vsync */
+	for (int i = 0; i < 10; i++)
+		render(window, PERIOD_MS);
+	test->getFrameStats(&stats, false);
+	assert(stats.queued == 10 && stats.presented == 10);
+	assert(stats.missed_vsyncs == 0);
+	assert(stats.frame_interval.count == 9);
+	assert(stats.dequeue_wait.count == 10);
+	assert(stats.swap_latency.count == 10);
+	assert(stats.buffers_in_flight == 0 && stats.max_buffers_in_flight == 1);
+
+	/* a frame three vsyncs long misses two */
+	render(window, 3 * PERIOD_MS);
+	test->getFrameStats(&stats, false);
+	assert(stats.missed_vsyncs == 2);
+	/* 60 ms fall into the 32 to 64 ms bucket */
+	assert(stats.frame_interval.buckets[6] == 1);
+
+	/* a client that was idle for a while did not miss anything */
+	usleep(10 * PERIOD_MS * 1000);
+	render(window, PERIOD_MS);
+	test->getFrameStats(&stats, false);
+	assert(stats.missed_vsyncs == 2);
+
+	/* every second vsync is all a swap interval of 2 asks for */
+	ret = window->setSwapInterval(window, 2);
+	assert(ret == 0);
+	for (int i = 0; i < 3; i++)
+		render(window, 2 * PERIOD_MS);
+	test->getFrameStats(&stats, false);
+	assert(stats.missed_vsyncs == 2);
+	ret = window->setSwapInterval(window, 1);
+	assert(ret == 0);
+
+	/* blocking for a buffer, 5 ms fall into the 4 to 8 ms bucket */
+	test->blockMs = 5;
+	render(window, PERIOD_MS);
+	test->getFrameStats(&stats, false);
+	assert(stats.dequeue_wait.buckets[3] == 1);
+	assert(stats.dequeue_wait.max_ns >= 5000000);
+
+	/* cancelled and dropped buffers */
+	cancel(window, dequeue(window));
+	test->dropNext = true;
+	render(window, PERIOD_MS);
+	test->getFrameStats(&stats, false);
+	assert(stats.cancelled == 1);
+	assert(stats.dropped == 1);
+	assert(stats.queued == stats.presented + stats.dropped);
+
+	print_histogram("dequeue wait", stats.dequeue_wait);
+	print_histogram("frame interval", stats.frame_interval);
+	print_histogram("swap latency", stats.swap_latency);
+	printf("%u queued, %u presented, %u cancelled, %u dropped, %u missed vsyncs in %.1f ms\n",
+	       stats.queued, stats.presented, stats.cancelled, stats.dropped,
+	       stats.missed_vsyncs, stats.elapsed_ns / 1e6);
+
+	/* a reset starts over, but keeps the buffers still in flight */
+	ANativeWindowBuffer *buffer = dequeue(window);
+	test->getFrameStats(&stats, true);
+	assert(stats.buffers_in_flight == 1);
+	test->getFrameStats(&stats, false);
+	assert(stats.queued == 0 && stats.cancelled == 0 && stats.dropped == 0);
+	assert(stats.dequeue_wait.count == 0 && stats.missed_vsyncs == 0);
+	assert(stats.buffers_in_flight == 1);
+	queue(window, buffer);
+	test->getFrameStats(&stats, false);
+	assert(stats.presented == 1 && stats.buffers_in_flight == 0);
+
+	delete test;
+
+	printf("frame statistics match the frames rendered\n");
+
+	return 0;
+}
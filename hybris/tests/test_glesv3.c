@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Checks that libGLESv3 hands out the entry points of the vendor library
+ * itself, so calling through it costs nothing over calling the driver
+ * directly. Only the functions with floating point arguments may go
+ * through a wrapper, since those change the calling convention.
+ *
+ * Usage: test_glesv3 [vendor library]
+ *
+ * The vendor library defaults to the driver's libGLESv3.so. The build
+ * also produces a stand-in, .libs/test_glesv3_stub.so, to run this on
+ * systems without an OpenGL ES 3.0 driver.
+ */
+
+#include <GLES3/gl3.h>
+#include <assert.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hybris/common/binding.h>
+
+static const char *direct[] = {
+	/* pixel buffer objects and asynchronous readback */
+	"glReadBuffer", "glMapBufferRange", "glFlushMappedBufferRange",
+	"glUnmapBuffer", "glGetBufferPointerv", "glCopyBufferSubData",
+	/* instancing */
+	"glDrawArraysInstanced", "glDrawElementsInstanced", "glVertexAttribDivisor",
+	"glDrawRangeElements", "glBindVertexArray",
+	/* sync objects */
+	"glFenceSync", "glClientWaitSync", "glWaitSync", "glDeleteSync",
+	/* uniform buffers */
+	"glBindBufferBase", "glBindBufferRange", "glGetUniformBlockIndex",
+	"glUniformBlockBinding", "glGetStringi",
+};
+
+static const char *wrapped[] = {
+	"glClearBufferfi", "glSamplerParameterf",
+};
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
+
+int main(int argc, char **argv)
+{
+	const char *vendor_path = argc > 1 ? argv[1] : "libGLESv3.so";
+	unsigned int i;
+
+	/* libGLESv3 opens the vendor library as it is loaded */
+	setenv("LIBGLESV3", vendor_path, 1);
+	void *vendor = android_dlopen(vendor_path, RTLD_NOW);
+	assert(vendor != NULL);
+	void *gles3 = dlopen("libGLESv3.so.3", RTLD_LAZY);
+	if (!gles3) {
+		printf("%s\n", dlerror());
+		return 1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(direct); i++) {
+		void *target = android_dlsym(vendor, direct[i]);
+		assert(target != NULL);
+		if (dlsym(gles3, direct[i]) != target) {
+			printf("%s: %p is not the vendor's %p\n", direct[i], dlsym(gles3, direct[i]), target);
+			return 1;
+		}
+	}
+	printf("%u entry points dispatch straight to %s\n", (unsigned int) ARRAY_SIZE(direct), vendor_path);
+
+	for (i = 0; i < ARRAY_SIZE(wrapped); i++)
+		assert(dlsym(gles3, wrapped[i]) != NULL);
+
+	/* the calls reach the vendor */
+	PFNGLMAPBUFFERRANGEPROC map_buffer_range = (PFNGLMAPBUFFERRANGEPROC) dlsym(gles3, "glMapBufferRange");
+	assert(map_buffer_range(GL_PIXEL_PACK_BUFFER, 0, 16, GL_MAP_READ_BIT) ==
+	       ((PFNGLMAPBUFFERRANGEPROC) android_dlsym(vendor, "glMapBufferRange"))(GL_PIXEL_PACK_BUFFER, 0, 16, GL_MAP_READ_BIT));
+
+	return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Stands in for the vendor libGLESv3.so in test_glesv3. It is built
+ * without libc, so the Android linker can load it on any system. Only
+ * the addresses of the entry points matter, and a few return something
+ * the test can recognize.
+ */
+
+#define STUB(sym) void sym(void) {}
+
+static char mapped[64];
+
+const unsigned char *glGetStringi(unsigned int name, unsigned int index)
+{
+	return (const unsigned char *) "test_glesv3_stub";
+}
+
+void *glMapBufferRange(unsigned int target, long offset, long length, unsigned int access)
+{
+	return mapped;
+}
+
+unsigned char glUnmapBuffer(unsigned int target)
+{
+	return 1;
+}
+
+/* pixel buffer objects and asynchronous readback */
+STUB(glReadBuffer)
+STUB(glFlushMappedBufferRange)
+STUB(glGetBufferPointerv)
+STUB(glCopyBufferSubData)
+/* instancing */
+STUB(glDrawArraysInstanced)
+STUB(glDrawElementsInstanced)
+STUB(glVertexAttribDivisor)
+STUB(glDrawRangeElements)
+STUB(glBindVertexArray)
+/* sync objects */
+STUB(glFenceSync)
+STUB(glClientWaitSync)
+STUB(glWaitSync)
+STUB(glDeleteSync)
+/* uniform buffers */
+STUB(glBindBufferBase)
+STUB(glBindBufferRange)
+STUB(glGetUniformBlockIndex)
+STUB(glUniformBlockBinding)
+/* wrapped for the floating point calling convention */
+STUB(glClearBufferfi)
+STUB(glSamplerParameterf)
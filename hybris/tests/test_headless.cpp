@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Benchmarks the window buffer paths on the headless platform, which
+ * needs no Android graphics HALs:
+ *  - what dequeueing and queueing a buffer costs with a consumer that
+ *    takes frames as soon as they come,
+ *  - the same with software rendering through the gralloc stand-in,
+ *  - pacing against a simulated 60 Hz display, with and without the
+ *    consumer spending time on each frame,
+ *  - dropping frames with a swap interval of 0,
+ *  - the same frames through eglplatform_headless.so and its ws_module
+ *    hooks, if the module is installed.
+ *
+ * Usage: test_headless [frames] [consumer latency in us]
+ */
+
+#include <assert.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <ws.h>
+#include "headless_gralloc.h"
+#include "headless_window.h"
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define PERIOD_NS 16666667LL
+
+static double now_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static ANativeWindowBuffer *dequeue(ANativeWindow *window)
+{
+	ANativeWindowBuffer *buffer;
+	int fence;
+
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
+	assert(window->dequeueBuffer(window, &buffer, &fence) == 0);
+	assert(fence == -1);
+#else
+	assert(window->dequeueBuffer(window, &buffer) == 0);
+#endif
+	return buffer;
+}
+
+static void queue(ANativeWindow *window, ANativeWindowBuffer *buffer)
+{
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
+	assert(window->queueBuffer(window, buffer, -1) == 0);
+#else
+	assert(window->queueBuffer(window, buffer) == 0);
+#endif
+}
+
+/* fills the buffer the way a software renderer would */
+static void render(gralloc_module_t *gralloc, ANativeWindowBuffer *buffer, int frame)
+{
+	void *vaddr;
+
+	assert(gralloc->lock(gralloc, buffer->handle, GRALLOC_USAGE_SW_WRITE_OFTEN,
+			     0, 0, buffer->width, buffer->height, &vaddr) == 0);
+	for (int y = 0; y < buffer->height; y++)
+		memset((uint32_t *) vaddr + y * buffer->stride, frame, buffer->width * 4);
+	assert(gralloc->unlock(gralloc, buffer->handle) == 0);
+}
+
+struct timings {
+	double dequeue;
+	double queue;
+	double render;
+	double total;
+};
+
+static timings run(ANativeWindow *window, gralloc_module_t *gralloc, int frames,
+		   EGLint (*buffer_age)(ANativeWindow *window))
+{
+	timings t;
+	double start = now_us(), mark;
+
+	memset(&t, 0, sizeof(t));
+	for (int i = 0; i < frames; i++) {
+		mark = now_us();
+		ANativeWindowBuffer *buffer = dequeue(window);
+		if (buffer_age)
+			buffer_age(window);
+		t.dequeue += now_us() - mark;
+
+		if (gralloc) {
+			mark = now_us();
+			render(gralloc, buffer, i);
+			t.render += now_us() - mark;
+		}
+
+		mark = now_us();
+		queue(window, buffer);
+		t.queue += now_us() - mark;
+	}
+	t.total = now_us() - start;
+
+	t.dequeue /= frames;
+	t.queue /= frames;
+	t.render /= frames;
+	t.total /= frames;
+	return t;
+}
+
+static void print_stats(const HybrisFrameStats &stats)
+{
+	const HybrisFrameStatsHistogram &interval = stats.frame_interval;
+	const HybrisFrameStatsHistogram &wait = stats.dequeue_wait;
+	const HybrisFrameStatsHistogram &latency = stats.swap_latency;
+
+	printf("    frame interval %.2f ms, dequeue wait %.2f ms (max %.2f), swap latency %.2f ms (max %.2f)\n",
+	       interval.count ? interval.total_ns / 1e6 / interval.count : 0.0,
+	       wait.count ? wait.total_ns / 1e6 / wait.count : 0.0, wait.max_ns / 1e6,
+	       latency.count ? latency.total_ns / 1e6 / latency.count : 0.0, latency.max_ns / 1e6);
+	printf("    %u queued, %u presented, %u dropped, %u missed vsyncs, max %u buffers in flight\n",
+	       stats.queued, stats.presented, stats.dropped, stats.missed_vsyncs,
+	       stats.max_buffers_in_flight);
+}
+
+/* lets the consumer catch up, so that the statistics are complete */
+static void settle(HeadlessNativeWindow *window, HybrisFrameStats *stats)
+{
+	for (int i = 0; i < 100; i++) {
+		window->getFrameStats(stats, false);
+		if (stats->presented + stats->dropped == stats->queued)
+			break;
+		usleep(PERIOD_NS / 1000);
+	}
+	window->getFrameStats(stats, true);
+}
+
+static HybrisFrameStats fake_stats;
+static ANativeWindow *ws_window;
+
+static int fake_has_mapping(EGLSurface surface)
+{
+	return surface == (EGLSurface) &fake_stats;
+}
+
+static EGLNativeWindowType fake_get_mapping(EGLSurface surface)
+{
+	return (EGLNativeWindowType) ws_window;
+}
+
+static struct ws_module *ws;
+
+static EGLint ws_buffer_age(ANativeWindow *window)
+{
+	return ws->getBufferAge(EGL_NO_DISPLAY, (EGLNativeWindowType) window);
+}
+
+static void run_module(int frames)
+{
+	struct ws_egl_interface iface = { NULL, fake_has_mapping, fake_get_mapping };
+	void *module = dlopen(PKGLIBDIR "eglplatform_headless.so", RTLD_LAZY);
+
+	if (!module) {
+		printf("ws module: skipped, %s\n", dlerror());
+		return;
+	}
+	ws = (struct ws_module *) dlsym(module, "ws_module_info");
+	assert(ws != NULL);
+
+	setenv("HYBRIS_HEADLESS_VSYNC_US", "0", 1);
+	ws->init_module(&iface);
+	struct _EGLDisplay *display = ws->GetDisplay(EGL_DEFAULT_DISPLAY);
+	ws_window = (ANativeWindow *) ws->CreateWindow(0, display);
+	ws->setSwapInterval(EGL_NO_DISPLAY, (EGLNativeWindowType) ws_window, 1);
+
+	PFNEGLHYBRISGETFRAMESTATSPROC get_stats =
+		(PFNEGLHYBRISGETFRAMESTATSPROC) ws->eglGetProcAddress("eglHybrisGetFrameStats");
+	assert(get_stats != NULL);
+
+	timings t = run(ws_window, NULL, frames, ws_buffer_age);
+	printf("ws module: %.2f us per frame, %.2f us dequeue with buffer age, %.2f us queue\n",
+	       t.total, t.dequeue, t.queue);
+
+	HybrisFrameStats stats;
+	assert(get_stats(EGL_NO_DISPLAY, (EGLSurface) &fake_stats, &stats, EGL_FALSE) == EGL_TRUE);
+	assert(stats.queued == (unsigned int) frames);
+	assert(ws_buffer_age(ws_window) == 0);
+
+	ws->DestroyWindow((EGLNativeWindowType) ws_window);
+	ws->Terminate(display);
+}
+
+int main(int argc, char **argv)
+{
+	int frames = argc > 1 ? atoi(argv[1]) : 2000;
+	int latency_us = argc > 2 ? atoi(argv[2]) : 4000;
+	int paced = 60;
+	gralloc_module_t *gralloc;
+	alloc_device_t *alloc;
+	HybrisFrameStats stats;
+	timings t;
+
+	assert(headless_gralloc_open(&gralloc, &alloc) == 0);
+
+	HeadlessNativeWindow *window = new HeadlessNativeWindow(alloc, WIDTH, HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888);
+	ANativeWindow *anw = window;
+	anw->common.incRef(&anw->common);
+
+	/* the window itself, nothing to wait for */
+	window->setConsumer(0, 0);
+	t = run(anw, NULL, frames, NULL);
+	settle(window, &stats);
+	printf("unthrottled: %.2f us per frame, %.2f us dequeue, %.2f us queue\n",
+	       t.total, t.dequeue, t.queue);
+	print_stats(stats);
+	assert(stats.queued == (unsigned int) frames);
+
+	t = run(anw, gralloc, frames / 10, NULL);
+	settle(window, &stats);
+	printf("software rendering %dx%d: %.2f us per frame, %.2f us rendering\n",
+	       WIDTH, HEIGHT, t.total, t.render);
+
+	/* paced by the display, rendering blocks in dequeue */
+	window->setConsumer(PERIOD_NS, 0);
+	run(anw, NULL, paced, NULL);
+	settle(window, &stats);
+	printf("60 Hz:\n");
+	print_stats(stats);
+	assert(stats.queued == (unsigned int) paced);
+	assert(stats.presented + stats.dropped == stats.queued);
+	/* timing depends on the machine's load, only report what is off */
+	double interval = stats.frame_interval.total_ns / 1e6 / stats.frame_interval.count;
+	if (interval < PERIOD_NS / 1e6 * 0.8 || interval > PERIOD_NS / 1e6 * 1.2)
+		printf("    note: frame interval is off the %.2f ms vsync period\n", PERIOD_NS / 1e6);
+
+	window->setConsumer(PERIOD_NS, latency_us * 1000LL);
+	run(anw, NULL, paced, NULL);
+	settle(window, &stats);
+	printf("60 Hz, %d us consumer latency:\n", latency_us);
+	print_stats(stats);
+	assert(stats.queued == (unsigned int) paced);
+	assert(stats.presented + stats.dropped == stats.queued);
+	if (stats.swap_latency.total_ns / stats.swap_latency.count < latency_us * 1000ULL)
+		printf("    note: swap latency is below the consumer latency\n");
+
+	/* rendering twice as fast as the display, the extra frames are dropped */
+	anw->setSwapInterval(anw, 0);
+	window->setConsumer(PERIOD_NS, PERIOD_NS / 2);
+	for (int i = 0; i < paced; i++) {
+		queue(anw, dequeue(anw));
+		usleep(PERIOD_NS / 2000);
+	}
+	settle(window, &stats);
+	printf("swap interval 0 at 120 fps:\n");
+	print_stats(stats);
+	assert(stats.dropped > 0);
+	assert(stats.presented + stats.dropped == stats.queued);
+
+	anw->common.decRef(&anw->common);
+
+	run_module(frames);
+
+	return 0;
+}
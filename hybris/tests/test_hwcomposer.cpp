@@ -98,6 +98,7 @@ class HWComposer : public HWComposerNativeWindow
 	public:
 
 		HWComposer(unsigned int width, unsigned int height, unsigned int format, hwc_composer_device_1_t *device, hwc_display_contents_1_t **mList, hwc_layer_1_t *layer);
+		~HWComposer() { stopPresenter(); }
 		void set();	
 };
 
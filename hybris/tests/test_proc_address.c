@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Measures what resolving the entry points a toolkit looks up at startup
+ * costs: every OpenGL ES 2.0 and 3.0 function and the extensions of
+ * gl2ext.h. The first pass goes down to the libraries, later ones are
+ * answered from the cache of eglGetProcAddress, also from several threads
+ * at once.
+ *
+ * Usage: test_proc_address [passes] [threads]
+ */
+
+#include <android-config.h>
+#include <EGL/egl.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const char *names[] = {
+	/* EGL extensions, the wrapped ones first */
+	"eglCreateImageKHR", "eglDestroyImageKHR", "eglSwapBuffersWithDamageEXT",
+	"eglCreateSyncKHR", "eglDestroySyncKHR", "eglClientWaitSyncKHR",
+	"eglGetSyncAttribKHR", "eglDupNativeFenceFDANDROID", "eglPresentationTimeANDROID",
+	"eglSetDamageRegionKHR", "eglBindWaylandDisplayWL", "eglUnbindWaylandDisplayWL",
+	"eglQueryWaylandBufferWL", "eglHybrisCreateNativeBuffer", "eglHybrisLockNativeBuffer",
+	"eglHybrisUnlockNativeBuffer", "eglHybrisReleaseNativeBuffer", "eglHybrisGetFrameStats",
+	/* OpenGL ES 2.0 */
+	"glActiveTexture", "glAttachShader", "glBindAttribLocation",
+	"glBindBuffer", "glBindFramebuffer", "glBindRenderbuffer",
+	"glBindTexture", "glBlendColor", "glBlendEquation",
+	"glBlendEquationSeparate", "glBlendFunc", "glBlendFuncSeparate",
+	"glBufferData", "glBufferSubData", "glCheckFramebufferStatus",
+	"glClear", "glClearColor", "glClearDepthf",
+	"glClearStencil", "glColorMask", "glCompileShader",
+	"glCompressedTexImage2D", "glCompressedTexSubImage2D", "glCopyTexImage2D",
+	"glCopyTexSubImage2D", "glCreateProgram", "glCreateShader",
+	"glCullFace", "glDeleteBuffers", "glDeleteFramebuffers",
+	"glDeleteProgram", "glDeleteRenderbuffers", "glDeleteShader",
+	"glDeleteTextures", "glDepthFunc", "glDepthMask",
+	"glDepthRangef", "glDetachShader", "glDisable",
+	"glDisableVertexAttribArray", "glDrawArrays", "glDrawElements",
+	"glEnable", "glEnableVertexAttribArray", "glFinish",
+	"glFlush", "glFramebufferRenderbuffer", "glFramebufferTexture2D",
+	"glFrontFace", "glGenBuffers", "glGenerateMipmap",
+	"glGenFramebuffers", "glGenRenderbuffers", "glGenTextures",
+	"glGetActiveAttrib", "glGetActiveUniform", "glGetAttachedShaders",
+	"glGetAttribLocation", "glGetBooleanv", "glGetBufferParameteriv",
+	"glGetError", "glGetFloatv", "glGetFramebufferAttachmentParameteriv",
+	"glGetIntegerv", "glGetProgramiv", "glGetProgramInfoLog",
+	"glGetRenderbufferParameteriv", "glGetShaderiv", "glGetShaderInfoLog",
+	"glGetShaderPrecisionFormat", "glGetShaderSource", "glGetString",
+	"glGetTexParameterfv", "glGetTexParameteriv", "glGetUniformfv",
+	"glGetUniformiv", "glGetUniformLocation", "glGetVertexAttribfv",
+	"glGetVertexAttribiv", "glGetVertexAttribPointerv", "glHint",
+	"glIsBuffer", "glIsEnabled", "glIsFramebuffer",
+	"glIsProgram", "glIsRenderbuffer", "glIsShader",
+	"glIsTexture", "glLineWidth", "glLinkProgram",
+	"glPixelStorei", "glPolygonOffset", "glReadPixels",
+	"glReleaseShaderCompiler", "glRenderbufferStorage", "glSampleCoverage",
+	"glScissor", "glShaderBinary", "glShaderSource",
+	"glStencilFunc", "glStencilFuncSeparate", "glStencilMask",
+	"glStencilMaskSeparate", "glStencilOp", "glStencilOpSeparate",
+	"glTexImage2D", "glTexParameterf", "glTexParameterfv",
+	"glTexParameteri", "glTexParameteriv", "glTexSubImage2D",
+	"glUniform1f", "glUniform1fv", "glUniform1i",
+	"glUniform1iv", "glUniform2f", "glUniform2fv",
+	"glUniform2i", "glUniform2iv", "glUniform3f",
+	"glUniform3fv", "glUniform3i", "glUniform3iv",
+	"glUniform4f", "glUniform4fv", "glUniform4i",
+	"glUniform4iv", "glUniformMatrix2fv", "glUniformMatrix3fv",
+	"glUniformMatrix4fv", "glUseProgram", "glValidateProgram",
+	"glVertexAttrib1f", "glVertexAttrib1fv", "glVertexAttrib2f",
+	"glVertexAttrib2fv", "glVertexAttrib3f", "glVertexAttrib3fv",
+	"glVertexAttrib4f", "glVertexAttrib4fv", "glVertexAttribPointer",
+	"glViewport",
+	/* OpenGL ES 3.0 */
+	"glReadBuffer", "glDrawRangeElements", "glTexImage3D",
+	"glTexSubImage3D", "glCopyTexSubImage3D", "glCompressedTexImage3D",
+	"glCompressedTexSubImage3D", "glGenQueries", "glDeleteQueries",
+	"glIsQuery", "glBeginQuery", "glEndQuery",
+	"glGetQueryiv", "glGetQueryObjectuiv", "glUnmapBuffer",
+	"glGetBufferPointerv", "glDrawBuffers", "glUniformMatrix2x3fv",
+	"glUniformMatrix3x2fv", "glUniformMatrix2x4fv", "glUniformMatrix4x2fv",
+	"glUniformMatrix3x4fv", "glUniformMatrix4x3fv", "glBlitFramebuffer",
+	"glRenderbufferStorageMultisample", "glFramebufferTextureLayer", "glMapBufferRange",
+	"glFlushMappedBufferRange", "glBindVertexArray", "glDeleteVertexArrays",
+	"glGenVertexArrays", "glIsVertexArray", "glGetIntegeri_v",
+	"glBeginTransformFeedback", "glEndTransformFeedback", "glBindBufferRange",
+	"glBindBufferBase", "glTransformFeedbackVaryings", "glGetTransformFeedbackVarying",
+	"glVertexAttribIPointer", "glGetVertexAttribIiv", "glGetVertexAttribIuiv",
+	"glVertexAttribI4i", "glVertexAttribI4ui", "glVertexAttribI4iv",
+	"glVertexAttribI4uiv", "glGetUniformuiv", "glGetFragDataLocation",
+	"glUniform1ui", "glUniform2ui", "glUniform3ui",
+	"glUniform4ui", "glUniform1uiv", "glUniform2uiv",
+	"glUniform3uiv", "glUniform4uiv", "glClearBufferiv",
+	"glClearBufferuiv", "glClearBufferfv", "glClearBufferfi",
+	"glGetStringi", "glCopyBufferSubData", "glGetUniformIndices",
+	"glGetActiveUniformsiv", "glGetUniformBlockIndex", "glGetActiveUniformBlockiv",
+	"glGetActiveUniformBlockName", "glUniformBlockBinding", "glDrawArraysInstanced",
+	"glDrawElementsInstanced", "glFenceSync", "glIsSync",
+	"glDeleteSync", "glClientWaitSync", "glWaitSync",
+	"glGetInteger64v", "glGetSynciv", "glGetInteger64i_v",
+	"glGetBufferParameteri64v", "glGenSamplers", "glDeleteSamplers",
+	"glIsSampler", "glBindSampler", "glSamplerParameteri",
+	"glSamplerParameteriv", "glSamplerParameterf", "glSamplerParameterfv",
+	"glGetSamplerParameteriv", "glGetSamplerParameterfv", "glVertexAttribDivisor",
+	"glBindTransformFeedback", "glDeleteTransformFeedbacks", "glGenTransformFeedbacks",
+	"glIsTransformFeedback", "glPauseTransformFeedback", "glResumeTransformFeedback",
+	"glGetProgramBinary", "glProgramBinary", "glProgramParameteri",
+	"glInvalidateFramebuffer", "glInvalidateSubFramebuffer", "glTexStorage2D",
+	"glTexStorage3D", "glGetInternalformativ",
+	/* OpenGL ES 2.0 extensions */
+	"glEGLImageTargetTexture2DOES", "glEGLImageTargetRenderbufferStorageOES", "glGetProgramBinaryOES",
+	"glProgramBinaryOES", "glMapBufferOES", "glUnmapBufferOES",
+	"glGetBufferPointervOES", "glTexImage3DOES", "glTexSubImage3DOES",
+	"glCopyTexSubImage3DOES", "glCompressedTexImage3DOES", "glCompressedTexSubImage3DOES",
+	"glFramebufferTexture3DOES", "glBindVertexArrayOES", "glDeleteVertexArraysOES",
+	"glGenVertexArraysOES", "glIsVertexArrayOES", "glGetPerfMonitorGroupsAMD",
+	"glGetPerfMonitorCountersAMD", "glGetPerfMonitorGroupStringAMD", "glGetPerfMonitorCounterStringAMD",
+	"glGetPerfMonitorCounterInfoAMD", "glGenPerfMonitorsAMD", "glDeletePerfMonitorsAMD",
+	"glSelectPerfMonitorCountersAMD", "glBeginPerfMonitorAMD", "glEndPerfMonitorAMD",
+	"glGetPerfMonitorCounterDataAMD", "glBlitFramebufferANGLE", "glRenderbufferStorageMultisampleANGLE",
+	"glDrawArraysInstancedANGLE", "glDrawElementsInstancedANGLE", "glVertexAttribDivisorANGLE",
+	"glGetTranslatedShaderSourceANGLE", "glRenderbufferStorageMultisampleAPPLE", "glResolveMultisampleFramebufferAPPLE",
+	"glLabelObjectEXT", "glGetObjectLabelEXT", "glInsertEventMarkerEXT",
+	"glPushGroupMarkerEXT", "glPopGroupMarkerEXT", "glDiscardFramebufferEXT",
+	"glRenderbufferStorageMultisampleEXT", "glFramebufferTexture2DMultisampleEXT", "glMultiDrawArraysEXT",
+	"glMultiDrawElementsEXT", "glGenQueriesEXT", "glDeleteQueriesEXT",
+	"glIsQueryEXT", "glBeginQueryEXT", "glEndQueryEXT",
+	"glGetQueryivEXT", "glGetQueryObjectuivEXT", "glGetGraphicsResetStatusEXT",
+	"glReadnPixelsEXT", "glGetnUniformfvEXT", "glGetnUniformivEXT",
+	"glUseProgramStagesEXT", "glActiveShaderProgramEXT", "glCreateShaderProgramvEXT",
+	"glBindProgramPipelineEXT", "glDeleteProgramPipelinesEXT", "glGenProgramPipelinesEXT",
+	"glIsProgramPipelineEXT", "glProgramParameteriEXT", "glGetProgramPipelineivEXT",
+	"glProgramUniform1iEXT", "glProgramUniform2iEXT", "glProgramUniform3iEXT",
+	"glProgramUniform4iEXT", "glProgramUniform1fEXT", "glProgramUniform2fEXT",
+	"glProgramUniform3fEXT", "glProgramUniform4fEXT", "glProgramUniform1ivEXT",
+	"glProgramUniform2ivEXT", "glProgramUniform3ivEXT", "glProgramUniform4ivEXT",
+	"glProgramUniform1fvEXT", "glProgramUniform2fvEXT", "glProgramUniform3fvEXT",
+	"glProgramUniform4fvEXT", "glProgramUniformMatrix2fvEXT", "glProgramUniformMatrix3fvEXT",
+	"glProgramUniformMatrix4fvEXT", "glValidateProgramPipelineEXT", "glGetProgramPipelineInfoLogEXT",
+	"glTexStorage1DEXT", "glTexStorage2DEXT", "glTexStorage3DEXT",
+	"glTextureStorage1DEXT", "glTextureStorage2DEXT", "glTextureStorage3DEXT",
+	"glRenderbufferStorageMultisampleIMG", "glFramebufferTexture2DMultisampleIMG", "glCoverageMaskNV",
+	"glCoverageOperationNV", "glDrawBuffersNV", "glDeleteFencesNV",
+	"glGenFencesNV", "glIsFenceNV", "glTestFenceNV",
+	"glGetFenceivNV", "glFinishFenceNV", "glSetFenceNV",
+	"glReadBufferNV", "glAlphaFuncQCOM", "glGetDriverControlsQCOM",
+	"glGetDriverControlStringQCOM", "glEnableDriverControlQCOM", "glDisableDriverControlQCOM",
+	"glExtGetTexturesQCOM", "glExtGetBuffersQCOM", "glExtGetRenderbuffersQCOM",
+	"glExtGetFramebuffersQCOM", "glExtGetTexLevelParameterivQCOM", "glExtTexObjectStateOverrideiQCOM",
+	"glExtGetTexSubImageQCOM", "glExtGetBufferPointervQCOM", "glExtGetShadersQCOM",
+	"glExtGetProgramsQCOM", "glExtIsProgramBinaryQCOM", "glExtGetProgramBinarySourceQCOM",
+	"glStartTilingQCOM", "glEndTilingQCOM",
+};
+
+#define NUM_NAMES (sizeof(names) / sizeof(names[0]))
+
+static __eglMustCastToProperFunctionPointerType resolved[NUM_NAMES];
+static int passes;
+
+static double now_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* resolves every name again and checks it still gets the first answer */
+static double resolve_again()
+{
+	double start = now_us();
+	unsigned int i;
+	int pass;
+
+	for (pass = 0; pass < passes; pass++) {
+		for (i = 0; i < NUM_NAMES; i++)
+			assert(eglGetProcAddress(names[i]) == resolved[i]);
+	}
+	return (now_us() - start) / passes;
+}
+
+static void *resolve_thread(void *data)
+{
+	*(double *) data = resolve_again();
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int num_threads = argc > 2 ? atoi(argv[2]) : 4;
+	pthread_t threads[num_threads];
+	double thread_us[num_threads];
+	unsigned int i, found = 0;
+	double first_us, cached_us;
+	int t;
+
+	passes = argc > 1 ? atoi(argv[1]) : 100;
+
+	EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	assert(display != EGL_NO_DISPLAY);
+	assert(eglInitialize(display, NULL, NULL) == EGL_TRUE);
+
+	first_us = now_us();
+	for (i = 0; i < NUM_NAMES; i++) {
+		resolved[i] = eglGetProcAddress(names[i]);
+		if (resolved[i])
+			found++;
+	}
+	first_us = now_us() - first_us;
+	printf("%u names, %u resolved\n", (unsigned int) NUM_NAMES, found);
+	printf("first lookup: %.1f us, %.3f us per name\n", first_us, first_us / NUM_NAMES);
+
+	cached_us = resolve_again();
+	printf("later lookups: %.1f us, %.3f us per name, %.1fx faster\n",
+	       cached_us, cached_us / NUM_NAMES, first_us / cached_us);
+
+	for (t = 0; t < num_threads; t++)
+		assert(pthread_create(&threads[t], NULL, resolve_thread, &thread_us[t]) == 0);
+	for (t = 0; t < num_threads; t++) {
+		pthread_join(threads[t], NULL);
+		printf("thread %d: %.3f us per name\n", t, thread_us[t] / NUM_NAMES);
+	}
+
+	eglTerminate(display);
+	return 0;
+}
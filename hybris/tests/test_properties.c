@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Compares looking up every property one by one on a cold cache against
+ * a single snapshot request, and checks that both return the same values
+ * and that a property_set() is visible to the next lookup. Every run
+ * happens in a fresh child process so none benefits from another's cache.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <hybris/properties/properties.h>
+
+typedef struct {
+	int count;
+	char **keys;
+} key_list_t;
+
+static void record_key(const char *key, const char *value, void *cookie)
+{
+	key_list_t *list = (key_list_t *) cookie;
+
+	list->keys = realloc(list->keys, (list->count + 1) * sizeof(char *));
+	list->keys[list->count++] = strdup(key);
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void bench_cold_gets(key_list_t *list)
+{
+	char value[PROP_VALUE_MAX];
+	double start;
+	int i;
+
+	/* one request per property, as before */
+	setenv("HYBRIS_PROPERTY_CACHE_WARMUP", "0", 1);
+
+	start = now_ms();
+	for (i = 0; i < list->count; i++)
+		property_get(list->keys[i], value, NULL);
+
+	printf("%d cold property_get calls: %.3f ms\n", list->count, now_ms() - start);
+}
+
+static void bench_snapshot(key_list_t *list)
+{
+	char **values = malloc(list->count * sizeof(char *));
+	char value[PROP_VALUE_MAX];
+	double start;
+	int rv;
+	int i;
+
+	for (i = 0; i < list->count; i++)
+		values[i] = malloc(PROP_VALUE_MAX);
+
+	start = now_ms();
+	rv = property_get_many((const char *const *) list->keys, values, NULL, list->count);
+	assert(rv == 0);
+
+	printf("property_get_many of %d properties: %.3f ms\n", list->count, now_ms() - start);
+
+	start = now_ms();
+	for (i = 0; i < list->count; i++)
+		property_get(list->keys[i], value, NULL);
+
+	printf("%d property_get calls after snapshot: %.3f ms\n", list->count, now_ms() - start);
+
+	for (i = 0; i < list->count; i++) {
+		property_get(list->keys[i], value, NULL);
+		assert(strcmp(value, values[i]) == 0);
+	}
+}
+
+static void expect_value(const char *key, const char *expected)
+{
+	const char *keys[1] = { key };
+	char value[PROP_VALUE_MAX];
+	char many[PROP_VALUE_MAX];
+	char *values[1] = { many };
+	int rv;
+
+	rv = property_get(key, value, "default");
+	assert(rv == (int) strlen(expected));
+	assert(strcmp(value, expected) == 0);
+
+	rv = property_get_many(keys, values, NULL, 1);
+	assert(rv == 0);
+	assert(strcmp(many, expected) == 0);
+}
+
+static void check_set_get(key_list_t *list)
+{
+	const char *key = "debug.hybris.test_properties";
+	char value[PROP_VALUE_MAX];
+	int rv;
+	int i;
+
+	/* a fresh snapshot must not hide the values set below */
+	rv = property_snapshot_load();
+	assert(rv >= 0);
+
+	for (i = 0; i < 3; i++) {
+		snprintf(value, sizeof(value), "%d-%d", getpid(), i);
+		rv = property_set(key, value);
+		assert(rv == 0);
+		expect_value(key, value);
+	}
+
+	printf("property_set is visible to property_get and property_get_many\n");
+}
+
+static void run_child(void (*test)(key_list_t *), key_list_t *list)
+{
+	int status;
+	pid_t pid = fork();
+	pid_t rv;
+
+	if (pid == 0) {
+		test(list);
+		exit(0);
+	}
+
+	rv = waitpid(pid, &status, 0);
+	assert(rv == pid);
+	assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+int main(int argc, char *argv[])
+{
+	key_list_t list;
+
+	memset(&list, 0, sizeof(list));
+	property_list(record_key, &list);
+
+	if (list.count == 0) {
+		printf("No properties available, is the property service running?\n");
+		return 1;
+	}
+
+	run_child(bench_cold_gets, &list);
+	run_child(bench_snapshot, &list);
+	run_child(check_set_get, &list);
+
+	return 0;
+}
@@ -0,0 +1,355 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Benchmarks the buffer handling of WaylandNativeWindow. A stand-in
+ * compositor offering wl_compositor and android_wlegl, allocating from a
+ * mock gralloc, runs in a thread on one end of a socket pair. It releases
+ * the previously attached buffer and answers the frame callbacks on every
+ * commit. The client cycles the window through dequeue, queue and swap
+ * thousands of times, with and without waiting for frame callbacks, and
+ * resizes it in between to make it reallocate its buffers.
+ *
+ * Usage: test_wayland_buffers [cycles] [resize every n cycles]
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <vector>
+
+#include <wayland-server.h>
+
+#include "wayland_window.h"
+#include "server_wlegl.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+
+static int allocated;
+static int freed;
+static int commits;
+static int releases;
+/* frames rendered into a buffer of the size before a resize, while the
+ * window waits for the new buffer set */
+static int stale_frames;
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* mock gralloc, shared by the compositor and the client */
+
+static int mock_alloc(alloc_device_t *dev, int w, int h, int format, int usage,
+		      buffer_handle_t *handle, int *stride)
+{
+	native_handle_t *native = native_handle_create(0, 1);
+
+	native->data[0] = __sync_add_and_fetch(&allocated, 1);
+	*handle = native;
+	*stride = w;
+	return 0;
+}
+
+static int mock_free(alloc_device_t *dev, buffer_handle_t handle)
+{
+	native_handle_delete(const_cast<native_handle_t *>(handle));
+	__sync_add_and_fetch(&freed, 1);
+	return 0;
+}
+
+static int mock_register(struct gralloc_module_t const *module, buffer_handle_t handle)
+{
+	return 0;
+}
+
+/* stand-in compositor */
+
+struct surface_state {
+	struct wl_resource *pending;
+	struct wl_resource *current;
+	std::vector<struct wl_resource *> frames;
+};
+
+static void surface_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void surface_attach(struct wl_client *client, struct wl_resource *resource,
+			   struct wl_resource *buffer, int32_t x, int32_t y)
+{
+	surface_state *state = (surface_state *) wl_resource_get_user_data(resource);
+
+	state->pending = buffer;
+}
+
+static void surface_damage(struct wl_client *client, struct wl_resource *resource,
+			   int32_t x, int32_t y, int32_t width, int32_t height)
+{
+}
+
+static void surface_frame(struct wl_client *client, struct wl_resource *resource, uint32_t callback)
+{
+	surface_state *state = (surface_state *) wl_resource_get_user_data(resource);
+
+	state->frames.push_back(wl_resource_create(client, &wl_callback_interface, 1, callback));
+}
+
+static void surface_set_region(struct wl_client *client, struct wl_resource *resource,
+			       struct wl_resource *region)
+{
+}
+
+/* the new buffer replaces the old one on screen, which is released */
+static void surface_commit(struct wl_client *client, struct wl_resource *resource)
+{
+	surface_state *state = (surface_state *) wl_resource_get_user_data(resource);
+
+	if (state->current && state->current != state->pending) {
+		wl_buffer_send_release(state->current);
+		releases++;
+	}
+	state->current = state->pending;
+	commits++;
+
+	for (size_t i = 0; i < state->frames.size(); i++) {
+		wl_callback_send_done(state->frames[i], 0);
+		wl_resource_destroy(state->frames[i]);
+	}
+	state->frames.clear();
+}
+
+static void surface_set_int(struct wl_client *client, struct wl_resource *resource, int32_t value)
+{
+}
+
+static const struct wl_surface_interface surface_implementation = {
+	surface_destroy,
+	surface_attach,
+	surface_damage,
+	surface_frame,
+	surface_set_region,
+	surface_set_region,
+	surface_commit,
+	surface_set_int,
+	surface_set_int,
+#ifdef WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION
+	surface_damage,
+#endif
+};
+
+static void surface_free(struct wl_resource *resource)
+{
+	delete (surface_state *) wl_resource_get_user_data(resource);
+}
+
+static void compositor_create_surface(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+	struct wl_resource *surface = wl_resource_create(client, &wl_surface_interface,
+							 wl_resource_get_version(resource), id);
+	surface_state *state = new surface_state();
+
+	wl_resource_set_implementation(surface, &surface_implementation, state, surface_free);
+}
+
+static void compositor_create_region(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+}
+
+static const struct wl_compositor_interface compositor_implementation = {
+	compositor_create_surface,
+	compositor_create_region
+};
+
+static void bind_compositor(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+	struct wl_resource *resource = wl_resource_create(client, &wl_compositor_interface, version, id);
+	wl_resource_set_implementation(resource, &compositor_implementation, NULL, NULL);
+}
+
+static void *compositor_thread(void *data)
+{
+	wl_display_run((struct wl_display *) data);
+	return NULL;
+}
+
+/* client */
+
+static struct wl_compositor *client_compositor;
+static struct android_wlegl *client_wlegl;
+
+static void registry_global(void *data, struct wl_registry *registry, uint32_t name,
+			    const char *interface, uint32_t version)
+{
+	if (strcmp(interface, "wl_compositor") == 0)
+		client_compositor = (struct wl_compositor *)
+			wl_registry_bind(registry, name, &wl_compositor_interface, version);
+	else if (strcmp(interface, "android_wlegl") == 0)
+		client_wlegl = (struct android_wlegl *)
+			wl_registry_bind(registry, name, &android_wlegl_interface, version);
+}
+
+static void registry_global_remove(void *data, struct wl_registry *registry, uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+	registry_global,
+	registry_global_remove
+};
+
+/* what eglSwapBuffers does with the window, the resizes in between */
+static double swap_cycles(WaylandNativeWindow *window, struct wl_egl_window *egl_window,
+			  int cycles, int resize_every, int *resizes)
+{
+	ANativeWindow *win = static_cast<ANativeWindow *>(window);
+	int width = *resizes % 2 ? HEIGHT : WIDTH;
+	int height = *resizes % 2 ? WIDTH : HEIGHT;
+	double start = now();
+
+	for (int i = 0; i < cycles; i++) {
+		ANativeWindowBuffer *buffer = NULL;
+		int fence;
+		int ret;
+
+		if (resize_every > 0 && i % resize_every == resize_every - 1) {
+			int tmp = width;
+
+			width = height;
+			height = tmp;
+			wl_egl_window_resize(egl_window, width, height, 0, 0);
+			++*resizes;
+		}
+
+		ret = win->dequeueBuffer(win, &buffer, &fence);
+		assert(ret == 0);
+		if (buffer->width != width || buffer->height != height) {
+			assert(buffer->width == height && buffer->height == width);
+			stale_frames++;
+		}
+		ret = win->queueBuffer(win, buffer, -1);
+		assert(ret == 0);
+		window->finishSwap();
+	}
+
+	return now() - start;
+}
+
+int main(int argc, char **argv)
+{
+	int cycles = argc > 1 ? atoi(argv[1]) : 10000;
+	int resize_every = argc > 2 ? atoi(argv[2]) : 100;
+	struct wl_display *server;
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct wl_surface *surface;
+	struct wl_egl_window *egl_window;
+	struct wl_client *client;
+	struct server_wlegl *wlegl;
+	gralloc_module_t gralloc;
+	alloc_device_t alloc;
+	pthread_t thread;
+	int resizes = 0;
+	int fds[2];
+	int ret;
+
+	assert(cycles > 0);
+
+	memset(&gralloc, 0, sizeof(gralloc));
+	gralloc.registerBuffer = mock_register;
+	gralloc.unregisterBuffer = mock_register;
+	memset(&alloc, 0, sizeof(alloc));
+	alloc.alloc = mock_alloc;
+	alloc.free = mock_free;
+
+	ret = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+	assert(ret == 0);
+
+	server = wl_display_create();
+	assert(server != NULL);
+#ifdef WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION
+	wl_global_create(server, &wl_compositor_interface, 4, NULL, bind_compositor);
+#else
+	wl_global_create(server, &wl_compositor_interface, 3, NULL, bind_compositor);
+#endif
+	wlegl = server_wlegl_create(server, &gralloc, &alloc);
+	client = wl_client_create(server, fds[0]);
+	assert(client != NULL);
+	ret = pthread_create(&thread, NULL, compositor_thread, server);
+	assert(ret == 0);
+
+	display = wl_display_connect_to_fd(fds[1]);
+	assert(display != NULL);
+	registry = wl_display_get_registry(display);
+	wl_registry_add_listener(registry, &registry_listener, NULL);
+	wl_display_roundtrip(display);
+	assert(client_compositor != NULL && client_wlegl != NULL);
+
+	surface = wl_compositor_create_surface(client_compositor);
+	egl_window = wl_egl_window_create(surface, WIDTH, HEIGHT);
+	assert(egl_window != NULL);
+
+	WaylandNativeWindow *window = new WaylandNativeWindow(egl_window, display, client_wlegl,
+							      &alloc, &gralloc);
+	window->common.incRef(&window->common);
+	ANativeWindow *win = static_cast<ANativeWindow *>(window);
+
+	win->setSwapInterval(win, 0);
+	double unthrottled = swap_cycles(window, egl_window, cycles, resize_every, &resizes);
+	win->setSwapInterval(win, 1);
+	double throttled = swap_cycles(window, egl_window, cycles, resize_every, &resizes);
+
+	window->common.decRef(&window->common);
+	wl_egl_window_destroy(egl_window);
+	wl_surface_destroy(surface);
+	wl_display_roundtrip(display);
+
+	printf("%d cycles, %d resizes: %.2f us per frame with swap interval 0, %.2f us with 1\n",
+	       cycles, resizes, unthrottled * 1e6 / cycles, throttled * 1e6 / cycles);
+	printf("%d buffers allocated, %d commits, %d releases, %d frames in stale buffers\n",
+	       allocated, commits, releases, stale_frames);
+
+	/* every frame replaced the one before it, and only resizes allocated */
+	assert(commits == 2 * cycles);
+	assert(releases == commits - 1);
+	assert(allocated <= 3 * (resizes + 1));
+
+	/* disconnecting wakes up the compositor loop if terminating doesn't */
+	wl_display_terminate(server);
+	wl_registry_destroy(registry);
+	wl_compositor_destroy(client_compositor);
+	android_wlegl_destroy(client_wlegl);
+	wl_display_flush(display);
+	pthread_join(thread, NULL);
+
+	wl_client_destroy(client);
+	server_wlegl_destroy(wlegl);
+	assert(freed == allocated);
+	wl_display_destroy(server);
+	wl_display_disconnect(display);
+
+	return 0;
+}
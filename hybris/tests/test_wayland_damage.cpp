@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Checks that swap damage reaches the compositor. A minimal compositor
+ * offering only wl_compositor runs in a thread on one end of a socket
+ * pair and records the damage of each commit, while the client side
+ * posts EGL style damage rectangles through the Wayland platform helper.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <vector>
+
+#include <wayland-server.h>
+#include <wayland-client.h>
+
+#include "wayland_damage.h"
+
+#define WIDTH 320
+#define HEIGHT 240
+
+struct recorded_damage {
+	int x, y, width, height;
+	bool buffer_coords;
+};
+
+static pthread_mutex_t damage_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<recorded_damage> pending_damage;
+static std::vector<recorded_damage> committed_damage;
+
+static void record_damage(int32_t x, int32_t y, int32_t width, int32_t height, bool buffer_coords)
+{
+	recorded_damage d = { x, y, width, height, buffer_coords };
+
+	pthread_mutex_lock(&damage_mutex);
+	pending_damage.push_back(d);
+	pthread_mutex_unlock(&damage_mutex);
+}
+
+static void surface_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void surface_attach(struct wl_client *client, struct wl_resource *resource,
+			   struct wl_resource *buffer, int32_t x, int32_t y)
+{
+}
+
+static void surface_damage(struct wl_client *client, struct wl_resource *resource,
+			   int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	record_damage(x, y, width, height, false);
+}
+
+static void surface_frame(struct wl_client *client, struct wl_resource *resource, uint32_t callback)
+{
+}
+
+static void surface_set_region(struct wl_client *client, struct wl_resource *resource,
+			       struct wl_resource *region)
+{
+}
+
+static void surface_commit(struct wl_client *client, struct wl_resource *resource)
+{
+	pthread_mutex_lock(&damage_mutex);
+	committed_damage = pending_damage;
+	pending_damage.clear();
+	pthread_mutex_unlock(&damage_mutex);
+}
+
+static void surface_set_int(struct wl_client *client, struct wl_resource *resource, int32_t value)
+{
+}
+
+#ifdef WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION
+static void surface_damage_buffer(struct wl_client *client, struct wl_resource *resource,
+				  int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	record_damage(x, y, width, height, true);
+}
+#endif
+
+static const struct wl_surface_interface surface_implementation = {
+	surface_destroy,
+	surface_attach,
+	surface_damage,
+	surface_frame,
+	surface_set_region,
+	surface_set_region,
+	surface_commit,
+	surface_set_int,
+	surface_set_int,
+#ifdef WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION
+	surface_damage_buffer,
+#endif
+};
+
+static void compositor_create_surface(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+	struct wl_resource *surface = wl_resource_create(client, &wl_surface_interface,
+							 wl_resource_get_version(resource), id);
+	wl_resource_set_implementation(surface, &surface_implementation, NULL, NULL);
+}
+
+static void compositor_create_region(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+}
+
+static const struct wl_compositor_interface compositor_implementation = {
+	compositor_create_surface,
+	compositor_create_region
+};
+
+static void bind_compositor(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+	struct wl_resource *resource = wl_resource_create(client, &wl_compositor_interface, version, id);
+	wl_resource_set_implementation(resource, &compositor_implementation, NULL, NULL);
+}
+
+static void *compositor_thread(void *data)
+{
+	wl_display_run((struct wl_display *) data);
+	return NULL;
+}
+
+static struct wl_compositor *client_compositor;
+static uint32_t client_compositor_version;
+
+static void registry_global(void *data, struct wl_registry *registry, uint32_t name,
+			    const char *interface, uint32_t version)
+{
+	if (strcmp(interface, "wl_compositor") == 0) {
+		client_compositor = (struct wl_compositor *)
+			wl_registry_bind(registry, name, &wl_compositor_interface, version);
+		client_compositor_version = version;
+	}
+}
+
+static void registry_global_remove(void *data, struct wl_registry *registry, uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+	registry_global,
+	registry_global_remove
+};
+
+/* swaps with the given EGL rectangles and returns what the compositor saw */
+static std::vector<recorded_damage> swap(struct wl_display *display, struct wl_surface *surface,
+					 const EGLint *rects, EGLint n_rects, int max_rects)
+{
+	std::vector<recorded_damage> result;
+
+	wayland_surface_damage(surface, WIDTH, HEIGHT, rects, n_rects, max_rects);
+	wl_surface_commit(surface);
+	wl_display_roundtrip(display);
+
+	pthread_mutex_lock(&damage_mutex);
+	result = committed_damage;
+	pthread_mutex_unlock(&damage_mutex);
+
+	for (size_t i = 0; i < result.size(); i++)
+		assert(result[i].buffer_coords == (client_compositor_version >= 4));
+
+	return result;
+}
+
+static bool contains(const recorded_damage &d, int x, int y, int width, int height)
+{
+	return d.x <= x && d.y <= y &&
+		d.x + d.width >= x + width && d.y + d.height >= y + height;
+}
+
+int main(int argc, char **argv)
+{
+	struct wl_display *server;
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct wl_surface *surface;
+	std::vector<recorded_damage> damage;
+	struct wl_client *client;
+	pthread_t thread;
+	int fds[2];
+	int rv;
+
+	rv = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+	assert(rv == 0);
+
+	server = wl_display_create();
+	assert(server != NULL);
+#ifdef WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION
+	wl_global_create(server, &wl_compositor_interface, 4, NULL, bind_compositor);
+#else
+	wl_global_create(server, &wl_compositor_interface, 3, NULL, bind_compositor);
+#endif
+	client = wl_client_create(server, fds[0]);
+	assert(client != NULL);
+	rv = pthread_create(&thread, NULL, compositor_thread, server);
+	assert(rv == 0);
+
+	display = wl_display_connect_to_fd(fds[1]);
+	assert(display != NULL);
+	registry = wl_display_get_registry(display);
+	wl_registry_add_listener(registry, &registry_listener, NULL);
+	wl_display_roundtrip(display);
+	assert(client_compositor != NULL);
+
+	surface = wl_compositor_create_surface(client_compositor);
+
+	/* plain eglSwapBuffers damages everything */
+	damage = swap(display, surface, NULL, 0, WAYLAND_DEFAULT_MAX_DAMAGE_RECTS);
+	assert(damage.size() == 1);
+	assert(damage[0].x == 0 && damage[0].y == 0);
+	assert(damage[0].width == WIDTH && damage[0].height == HEIGHT);
+
+	/* a rectangle at the bottom of the GL surface is at the bottom of the buffer */
+	EGLint bottom[] = { 10, 0, 100, 20 };
+	damage = swap(display, surface, bottom, 1, WAYLAND_DEFAULT_MAX_DAMAGE_RECTS);
+	assert(damage.size() == 1);
+	assert(damage[0].x == 10 && damage[0].y == HEIGHT - 20);
+	assert(damage[0].width == 100 && damage[0].height == 20);
+
+	/* rectangles are clipped to the buffer and empty ones dropped */
+	EGLint clipped[] = { -10, HEIGHT - 5, 20, 50,   50, 50, 0, 10 };
+	damage = swap(display, surface, clipped, 2, WAYLAND_DEFAULT_MAX_DAMAGE_RECTS);
+	assert(damage.size() == 1);
+	assert(damage[0].x == 0 && damage[0].y == 0);
+	assert(damage[0].width == 10 && damage[0].height == 5);
+
+	/* too many rectangles are merged, but still cover every one of them */
+	EGLint many[4 * 32];
+	for (int i = 0; i < 32; i++) {
+		many[i * 4 + 0] = (i % 8) * 40;
+		many[i * 4 + 1] = (i / 8) * 60;
+		many[i * 4 + 2] = 8;
+		many[i * 4 + 3] = 8;
+	}
+	damage = swap(display, surface, many, 32, 4);
+	assert(damage.size() <= 4 && damage.size() > 0);
+	for (int i = 0; i < 32; i++) {
+		int x = many[i * 4 + 0];
+		int y = HEIGHT - many[i * 4 + 1] - many[i * 4 + 3];
+		bool covered = false;
+
+		for (size_t j = 0; j < damage.size(); j++)
+			covered = covered || contains(damage[j], x, y, 8, 8);
+		assert(covered);
+	}
+	for (size_t j = 0; j < damage.size(); j++)
+		assert(damage[j].width < WIDTH || damage[j].height < HEIGHT);
+
+	wl_surface_destroy(surface);
+	wl_registry_destroy(registry);
+	wl_display_roundtrip(display);
+
+	/* disconnecting wakes up the compositor loop if terminating doesn't */
+	wl_display_terminate(server);
+	wl_display_disconnect(display);
+	pthread_join(thread, NULL);
+	wl_display_destroy(server);
+
+	printf("damage regions were transmitted correctly\n");
+
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * A window with a single buffer for the tests of BaseNativeWindow, and
+ * the calls a client makes on it. Tests override the backend methods
+ * they look at.
+ */
+
+#ifndef TEST_WINDOW_FIXTURE_H
+#define TEST_WINDOW_FIXTURE_H
+
+#include <assert.h>
+
+#include "nativewindowbase.h"
+
+class TestBuffer : public BaseNativeWindowBuffer
+{
+public:
+	TestBuffer(int w, int h)
+	{
+		width = w;
+		height = h;
+		stride = w;
+		format = HAL_PIXEL_FORMAT_RGBA_8888;
+	}
+};
+
+class TestWindow : public BaseNativeWindow
+{
+public:
+	TestBuffer buffer;
+
+	TestWindow(int w, int h) : buffer(w, h) {}
+
+protected:
+	int setSwapInterval(int interval) { return 0; }
+	int dequeueBuffer(BaseNativeWindowBuffer **b, int *fenceFd)
+	{
+		*b = &buffer;
+		*fenceFd = -1;
+		return 0;
+	}
+	int queueBuffer(BaseNativeWindowBuffer *b, int fenceFd) { return 0; }
+	int cancelBuffer(BaseNativeWindowBuffer *b, int fenceFd) { return 0; }
+	int lockBuffer(BaseNativeWindowBuffer *b) { return 0; }
+	unsigned int type() const { return NATIVE_WINDOW_FRAMEBUFFER; }
+	unsigned int width() const { return buffer.width; }
+	unsigned int height() const { return buffer.height; }
+	unsigned int format() const { return HAL_PIXEL_FORMAT_RGBA_8888; }
+	unsigned int defaultWidth() const { return buffer.width; }
+	unsigned int defaultHeight() const { return buffer.height; }
+	unsigned int queueLength() const { return 0; }
+	unsigned int transformHint() const { return 0; }
+	int setBuffersFormat(int format) { return 0; }
+	int setBuffersDimensions(int width, int height) { return 0; }
+	int setUsage(int usage) { return 0; }
+	int setBufferCount(int cnt) { return 0; }
+};
+
+static inline ANativeWindowBuffer *dequeue(ANativeWindow *window)
+{
+	ANativeWindowBuffer *buffer;
+	int fence;
+	int ret;
+
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
+	ret = window->dequeueBuffer(window, &buffer, &fence);
+#else
+	ret = window->dequeueBuffer(window, &buffer);
+#endif
+	assert(ret == 0);
+	return buffer;
+}
+
+static inline void queue(ANativeWindow *window, ANativeWindowBuffer *buffer)
+{
+	int ret;
+
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
+	ret = window->queueBuffer(window, buffer, -1);
+#else
+	ret = window->queueBuffer(window, buffer);
+#endif
+	assert(ret == 0);
+}
+
+static inline void cancel(ANativeWindow *window, ANativeWindowBuffer *buffer)
+{
+	int ret;
+
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
+	ret = window->cancelBuffer(window, buffer, -1);
+#else
+	ret = window->cancelBuffer(window, buffer);
+#endif
+	assert(ret == 0);
+}
+
+#endif
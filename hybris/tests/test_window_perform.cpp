@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Checks that the crop, transform and timestamp set on a window through
+ * perform() reach the backend with each queued buffer.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "test_window_fixture.h"
+
+#define WIDTH 640
+#define HEIGHT 480
+
+/* remembers what was queued last */
+class PerformWindow : public TestWindow
+{
+public:
+	android_native_rect_t crop;
+	uint32_t transform;
+	int64_t present;
+
+	PerformWindow() : TestWindow(WIDTH, HEIGHT) {}
+
+protected:
+	int queueBuffer(BaseNativeWindowBuffer *b, int fenceFd)
+	{
+		crop = b->getCrop();
+		transform = b->getTransform();
+		present = b->getDesiredPresent();
+		return 0;
+	}
+};
+
+static void swap(ANativeWindow *window)
+{
+	queue(window, dequeue(window));
+}
+
+static void check_crop(const android_native_rect_t &crop, int left, int top, int right, int bottom)
+{
+	assert(crop.left == left && crop.top == top);
+	assert(crop.right == right && crop.bottom == bottom);
+}
+
+int main(int argc, char **argv)
+{
+	PerformWindow *test = new PerformWindow;
+	ANativeWindow *window = test;
+	android_native_rect_t rect = { 10, 20, 110, 70 };
+	int ret;
+
+	/* nothing set, the whole buffer as soon as possible */
+	swap(window);
+	check_crop(test->crop, 0, 0, 0, 0);
+	assert(test->transform == 0);
+	assert(test->present == 0);
+
+	/* values stick to the buffers queued after they are set */
+	ret = window->perform(window, NATIVE_WINDOW_SET_CROP, &rect);
+	assert(ret == 0);
+	ret = window->perform(window, NATIVE_WINDOW_SET_BUFFERS_TRANSFORM,
+			      NATIVE_WINDOW_TRANSFORM_ROT_90);
+	assert(ret == 0);
+	ret = window->perform(window, NATIVE_WINDOW_SET_BUFFERS_TIMESTAMP, (int64_t) 123456789);
+	assert(ret == 0);
+	swap(window);
+	check_crop(test->crop, 10, 20, 110, 70);
+	assert(test->transform == NATIVE_WINDOW_TRANSFORM_ROT_90);
+	assert(test->present == 123456789);
+
+	ret = window->perform(window, NATIVE_WINDOW_SET_BUFFERS_TIMESTAMP,
+			      (int64_t) NATIVE_WINDOW_TIMESTAMP_AUTO);
+	assert(ret == 0);
+	swap(window);
+	assert(test->present == 0);
+
+	/* an inverted crop is refused, NULL resets it */
+	android_native_rect_t bad = { 100, 0, 0, 10 };
+	ret = window->perform(window, NATIVE_WINDOW_SET_CROP, &bad);
+	assert(ret != 0);
+	ret = window->perform(window, NATIVE_WINDOW_SET_CROP, (android_native_rect_t *) NULL);
+	assert(ret == 0);
+	swap(window);
+	check_crop(test->crop, 0, 0, 0, 0);
+
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=1 || ANDROID_VERSION_MAJOR>=5
+	/*
+	 * Rotated by 90 degrees the 640x480 buffer shows as 480x640, where
+	 * the top left 100x50 come from the bottom left of the buffer.
+	 */
+	android_native_rect_t shown = { 0, 0, 100, 50 };
+	ret = window->perform(window, NATIVE_WINDOW_SET_POST_TRANSFORM_CROP, &shown);
+	assert(ret == 0);
+	swap(window);
+	check_crop(test->crop, 0, HEIGHT - 100, 50, HEIGHT);
+
+	/* rotated by 180 degrees, they come from the bottom right */
+	ret = window->perform(window, NATIVE_WINDOW_SET_BUFFERS_TRANSFORM,
+			      NATIVE_WINDOW_TRANSFORM_ROT_180);
+	assert(ret == 0);
+	swap(window);
+	check_crop(test->crop, WIDTH - 100, HEIGHT - 50, WIDTH, HEIGHT);
+
+	/* and by 270 degrees from the top right */
+	ret = window->perform(window, NATIVE_WINDOW_SET_BUFFERS_TRANSFORM,
+			      NATIVE_WINDOW_TRANSFORM_ROT_270);
+	assert(ret == 0);
+	swap(window);
+	check_crop(test->crop, WIDTH - 50, 0, WIDTH, 100);
+#endif
+
+	delete test;
+
+	printf("crop, transform and timestamps reached the queued buffers\n");
+
+	return 0;
+}
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2015 libhybris
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Checks the pool recycling server side buffers of android_wlegl against
+ * a mock gralloc allocation device that takes a while to allocate, and
+ * that one client never gets the buffers another one freed. Then it
+ * compares the time clients spend reallocating their buffer sets with
+ * and without the pool.
+ *
+ * Usage: test_wlegl_pool [alloc latency in us] [resizes]
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "server_wlegl_pool.h"
+
+#define FORMAT HAL_PIXEL_FORMAT_RGBA_8888
+#define USAGE (GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_COMPOSER)
+#define BUFFER_BYTES(w, h) ((w) * (h) * 4)
+
+static int alloc_latency = 1000;
+static int allocated;
+static int freed;
+
+static int mock_alloc(alloc_device_t *dev, int w, int h, int format, int usage,
+		      buffer_handle_t *handle, int *stride)
+{
+	native_handle_t *native = native_handle_create(0, 1);
+
+	usleep(alloc_latency);
+	native->data[0] = ++allocated;
+	*handle = native;
+	*stride = w;
+	return 0;
+}
+
+static int mock_free(alloc_device_t *dev, buffer_handle_t handle)
+{
+	native_handle_delete(const_cast<native_handle_t *>(handle));
+	freed++;
+	return 0;
+}
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static buffer_handle_t alloc_buffer(alloc_device_t *dev, int w, int h, int usage)
+{
+	buffer_handle_t handle;
+	int stride;
+	int ret;
+
+	ret = dev->alloc(dev, w, h, FORMAT, usage, &handle, &stride);
+	assert(ret == 0);
+	assert(stride == w);
+	return handle;
+}
+
+static buffer_handle_t alloc_client_buffer(server_wlegl_pool *pool, struct wl_client *client)
+{
+	buffer_handle_t handle;
+	int stride;
+	int ret;
+
+	ret = server_wlegl_pool_alloc(pool, client, 64, 64, FORMAT, USAGE, &handle, &stride);
+	assert(ret == 0);
+	return handle;
+}
+
+/* a client going back and forth between two sizes with three buffers */
+static double resize_clients(alloc_device_t *dev, int resizes)
+{
+	buffer_handle_t buffers[3];
+	double start = now();
+
+	for (int i = 0; i < resizes; i++) {
+		int w = i % 2 ? 480 : 640;
+		int h = i % 2 ? 640 : 480;
+
+		for (int j = 0; j < 3; j++)
+			buffers[j] = alloc_buffer(dev, w, h, USAGE);
+		for (int j = 0; j < 3; j++)
+			dev->free(dev, buffers[j]);
+	}
+
+	return now() - start;
+}
+
+int main(int argc, char **argv)
+{
+	int resizes = 100;
+	server_wlegl_pool_stats stats;
+	struct wl_event_loop *loop;
+	server_wlegl_pool *pool;
+	alloc_device_t mock;
+	alloc_device_t *dev;
+	buffer_handle_t a, b, c;
+
+	if (argc > 1)
+		alloc_latency = atoi(argv[1]);
+	if (argc > 2)
+		resizes = atoi(argv[2]);
+
+	memset(&mock, 0, sizeof(mock));
+	mock.alloc = mock_alloc;
+	mock.free = mock_free;
+
+	loop = wl_event_loop_create();
+	assert(loop != NULL);
+
+	/* room for three 64x64 buffers, kept for 100ms */
+	pool = server_wlegl_pool_create(&mock, 3 * BUFFER_BYTES(64, 64), 100, loop);
+	dev = server_wlegl_pool_device(pool);
+
+	/* a freed buffer comes back for the same parameters only */
+	a = alloc_buffer(dev, 64, 64, USAGE);
+	dev->free(dev, a);
+	b = alloc_buffer(dev, 64, 64, USAGE | GRALLOC_USAGE_SW_READ_OFTEN);
+	assert(b != a);
+	c = alloc_buffer(dev, 64, 64, USAGE);
+	assert(c == a);
+	server_wlegl_pool_get_stats(pool, &stats);
+	assert(stats.hits == 1 && stats.misses == 2);
+	assert(stats.buffers == 0 && stats.bytes == 0);
+	dev->free(dev, b);
+	dev->free(dev, c);
+
+	/* the size limit evicts the buffers freed longest ago */
+	buffer_handle_t set[5];
+	for (int i = 0; i < 5; i++)
+		set[i] = alloc_buffer(dev, 64, 64, USAGE);
+	for (int i = 0; i < 5; i++)
+		dev->free(dev, set[i]);
+	server_wlegl_pool_get_stats(pool, &stats);
+	assert(stats.buffers == 3);
+	assert(stats.bytes == 3 * BUFFER_BYTES(64, 64));
+	assert(stats.evictions == 3);
+	assert(freed == 3);
+
+	/* buffers too large for the pool are freed right away */
+	a = alloc_buffer(dev, 256, 256, USAGE);
+	dev->free(dev, a);
+	assert(freed == 4);
+
+	/* the remaining ones expire */
+	double start = now();
+	while (stats.buffers > 0 && now() - start < 1.0) {
+		wl_event_loop_dispatch(loop, 200);
+		server_wlegl_pool_get_stats(pool, &stats);
+	}
+	assert(stats.buffers == 0 && stats.bytes == 0);
+	assert(stats.expirations == 3);
+	assert(freed == allocated);
+
+	server_wlegl_pool_destroy(pool);
+
+	/* buffers only go back to the client that freed them */
+	struct wl_display *display = wl_display_create();
+	struct wl_client *clients[2];
+	int fds[2][2];
+	assert(display != NULL);
+	for (int i = 0; i < 2; i++) {
+		int rv = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds[i]);
+		assert(rv == 0);
+		clients[i] = wl_client_create(display, fds[i][0]);
+		assert(clients[i] != NULL);
+	}
+
+	allocated = freed = 0;
+	pool = server_wlegl_pool_create(&mock, 4 * BUFFER_BYTES(64, 64), 1000, loop);
+	dev = server_wlegl_pool_device(pool);
+	a = alloc_client_buffer(pool, clients[0]);
+	dev->free(dev, a);
+	b = alloc_client_buffer(pool, clients[1]);
+	assert(b != a);
+	c = alloc_client_buffer(pool, clients[0]);
+	assert(c == a);
+	dev->free(dev, b);
+
+	/* a destroyed client's pooled buffers are freed, and the rest once it frees them */
+	a = alloc_client_buffer(pool, clients[0]);
+	dev->free(dev, a);
+	server_wlegl_pool_get_stats(pool, &stats);
+	assert(stats.buffers == 2);
+	wl_client_destroy(clients[0]);
+	server_wlegl_pool_get_stats(pool, &stats);
+	assert(stats.buffers == 1);
+	assert(freed == 1);
+	dev->free(dev, c);
+	server_wlegl_pool_get_stats(pool, &stats);
+	assert(stats.buffers == 1);
+	assert(freed == 2);
+
+	/* the device outlives the pool for the buffers still allocated */
+	b = alloc_client_buffer(pool, clients[1]);
+	server_wlegl_pool_destroy(pool);
+	assert(freed == 2);
+	dev->free(dev, b);
+	assert(freed == allocated);
+
+	wl_client_destroy(clients[1]);
+	wl_display_destroy(display);
+
+	/* reallocating buffer sets, straight from the device and pooled */
+	allocated = freed = 0;
+	double direct = resize_clients(&mock, resizes);
+	assert(allocated == resizes * 3);
+
+	allocated = freed = 0;
+	pool = server_wlegl_pool_create(&mock, SERVER_WLEGL_POOL_DEFAULT_SIZE,
+					SERVER_WLEGL_POOL_DEFAULT_MAX_AGE, loop);
+	dev = server_wlegl_pool_device(pool);
+	double pooled = resize_clients(dev, resizes);
+	server_wlegl_pool_get_stats(pool, &stats);
+	assert(allocated == 6);
+	assert(stats.misses == 6 && stats.hits == (unsigned int) resizes * 3 - 6);
+
+	printf("%d resizes with %d us allocations: %.1f ms direct, %.1f ms pooled\n",
+	       resizes, alloc_latency, direct * 1e3, pooled * 1e3);
+	printf("pool: %u hits, %u misses, %u buffers (%zu bytes) pooled\n",
+	       stats.hits, stats.misses, stats.buffers, stats.bytes);
+
+	server_wlegl_pool_destroy(pool);
+	assert(freed == allocated);
+	wl_event_loop_destroy(loop);
+
+	return 0;
+}